@@ -35,6 +35,7 @@
 #include <common/fs.hh>
 #include <common/settings.hh>
 #include <common/ostream.hh>
+#include <common/prtfile.hh>
 
 #include <map>
 #include <set>
@@ -176,6 +177,19 @@ bsputil_settings::bsputil_settings()
               return this->load_setting<settings::setting_string>(name, parser, src, "");
           },
           nullptr, "Remove a BSPX lump"},
+      convert_portals{this, "convert-portals",
+          [&](const std::string &name, parser_base_t &parser, settings::source src) {
+              auto input = std::make_shared<settings::setting_string>(nullptr, name, "");
+              if (bool parsed = input->parse(name, parser, src); !parsed)
+                  return false;
+              auto output = std::make_shared<settings::setting_string>(nullptr, name, "");
+              if (bool parsed = output->parse(name, parser, src); !parsed)
+                  return false;
+              operations.push_back(std::make_unique<setting_combined>(
+                  nullptr, name, std::initializer_list<std::shared_ptr<settings::setting_base>>{input, output}));
+              return true;
+          },
+          nullptr, "Convert a portal file between the text and binary formats"},
       svg{this, "svg",
           [&](const std::string &name, parser_base_t &parser, settings::source src) {
               return this->load_setting<settings::setting_int32>(name, parser, src, 0);
@@ -311,7 +325,7 @@ static void CheckBSPFacesPlanar(const mbsp_t *bsp)
             const float dist = plane.distance_to(point);
 
             if (dist < -PLANE_ON_EPSILON || dist > PLANE_ON_EPSILON)
-                logging::print("WARNING: face {}, point {} off plane by {}\n", i, j, dist);
+                logging::print(logging::flag::WARNING, "WARNING: face {}, point {} off plane by {}\n", i, j, dist);
         }
     }
 }
@@ -397,15 +411,15 @@ static void CheckBSPFile(const mbsp_t *bsp)
 
         /* texinfo bounds check */
         if (face->texinfo < 0)
-            logging::print("warning: face {} has negative texinfo ({})\n", i, face->texinfo);
+            logging::print(logging::flag::WARNING, "warning: face {} has negative texinfo ({})\n", i, face->texinfo);
         if (face->texinfo >= bsp->texinfo.size())
-            logging::print(
+            logging::print(logging::flag::WARNING,
                 "warning: face {} has texinfo out of range ({} >= {})\n", i, face->texinfo, bsp->texinfo.size());
         referenced_texinfos.insert(face->texinfo);
 
         /* planenum bounds check */
         if (face->planenum < 0)
-            logging::print("warning: face {} has negative planenum ({})\n", i, face->planenum);
+            logging::print(logging::flag::WARNING, "warning: face {} has negative planenum ({})\n", i, face->planenum);
         if (face->planenum >= bsp->dplanes.size())
             fmt::print(
                 "warning: face {} has planenum out of range ({} >= {})\n", i, face->planenum, bsp->dplanes.size());
@@ -413,20 +427,22 @@ static void CheckBSPFile(const mbsp_t *bsp)
 
         /* lightofs check */
         if (face->lightofs < -1)
-            logging::print("warning: face {} has negative light offset ({})\n", i, face->lightofs);
+            logging::print(logging::flag::WARNING, "warning: face {} has negative light offset ({})\n", i,
+                face->lightofs);
         if (face->lightofs >= bsp->dlightdata.size())
-            logging::print("warning: face {} has light offset out of range "
-                           "({} >= {})\n",
+            logging::print(logging::flag::WARNING, "warning: face {} has light offset out of range "
+                                                   "({} >= {})\n",
                 i, face->lightofs, bsp->dlightdata.size());
 
         /* edge check */
         if (face->firstedge < 0)
-            logging::print("warning: face {} has negative firstedge ({})\n", i, face->firstedge);
+            logging::print(logging::flag::WARNING, "warning: face {} has negative firstedge ({})\n", i,
+                face->firstedge);
         if (face->numedges < 3)
-            logging::print("warning: face {} has < 3 edges ({})\n", i, face->numedges);
+            logging::print(logging::flag::WARNING, "warning: face {} has < 3 edges ({})\n", i, face->numedges);
         if (face->firstedge + face->numedges > bsp->dsurfedges.size())
-            logging::print("warning: face {} has edges out of range ({}..{} >= {})\n", i, face->firstedge,
-                face->firstedge + face->numedges - 1, bsp->dsurfedges.size());
+            logging::print(logging::flag::WARNING, "warning: face {} has edges out of range ({}..{} >= {})\n", i,
+                face->firstedge, face->firstedge + face->numedges - 1, bsp->dsurfedges.size());
 
         for (int j = 0; j < 4; j++) {
             used_lightstyles.insert(face->styles[j]);
@@ -441,8 +457,8 @@ static void CheckBSPFile(const mbsp_t *bsp)
         for (j = 0; j < 2; j++) {
             const uint32_t vertex = (*edge)[j];
             if (vertex > bsp->dvertexes.size())
-                logging::print("warning: edge {} has vertex {} out range "
-                               "({} >= {})\n",
+                logging::print(logging::flag::WARNING, "warning: edge {} has vertex {} out range "
+                                                       "({} >= {})\n",
                     i, j, vertex, bsp->dvertexes.size());
             referenced_vertexes.insert(vertex);
         }
@@ -452,16 +468,18 @@ static void CheckBSPFile(const mbsp_t *bsp)
     for (i = 0; i < bsp->dsurfedges.size(); i++) {
         const int edgenum = bsp->dsurfedges[i];
         if (!edgenum)
-            logging::print("warning: surfedge {} has zero value!\n", i);
+            logging::print(logging::flag::WARNING, "warning: surfedge {} has zero value!\n", i);
         if (std::abs(edgenum) >= bsp->dedges.size())
-            logging::print("warning: surfedge {} is out of range (abs({}) >= {})\n", i, edgenum, bsp->dedges.size());
+            logging::print(logging::flag::WARNING, "warning: surfedge {} is out of range (abs({}) >= {})\n", i, edgenum,
+                bsp->dedges.size());
     }
 
     /* marksurfaces */
     for (i = 0; i < bsp->dleaffaces.size(); i++) {
         const uint32_t surfnum = bsp->dleaffaces[i];
         if (surfnum >= bsp->dfaces.size())
-            logging::print("warning: marksurface {} is out of range ({} >= {})\n", i, surfnum, bsp->dfaces.size());
+            logging::print(logging::flag::WARNING, "warning: marksurface {} is out of range ({} >= {})\n", i, surfnum,
+                bsp->dfaces.size());
     }
 
     /* leafs */
@@ -469,14 +487,15 @@ static void CheckBSPFile(const mbsp_t *bsp)
         const mleaf_t *leaf = &bsp->dleafs[i];
         const uint32_t endmarksurface = leaf->firstmarksurface + leaf->nummarksurfaces;
         if (endmarksurface > bsp->dleaffaces.size())
-            logging::print("warning: leaf {} has marksurfaces out of range "
-                           "({}..{} >= {})\n",
+            logging::print(logging::flag::WARNING, "warning: leaf {} has marksurfaces out of range "
+                                                   "({}..{} >= {})\n",
                 i, leaf->firstmarksurface, endmarksurface - 1, bsp->dleaffaces.size());
         if (leaf->visofs < -1)
-            logging::print("warning: leaf {} has negative visdata offset ({})\n", i, leaf->visofs);
+            logging::print(logging::flag::WARNING, "warning: leaf {} has negative visdata offset ({})\n", i,
+                leaf->visofs);
         if (leaf->visofs >= bsp->dvis.bits.size())
-            logging::print("warning: leaf {} has visdata offset out of range "
-                           "({} >= {})\n",
+            logging::print(logging::flag::WARNING, "warning: leaf {} has visdata offset out of range "
+                                                   "({} >= {})\n",
                 i, leaf->visofs, bsp->dvis.bits.size());
     }
 
@@ -488,17 +507,17 @@ static void CheckBSPFile(const mbsp_t *bsp)
         for (j = 0; j < 2; j++) {
             const int32_t child = node->children[j];
             if (child >= 0 && child >= bsp->dnodes.size())
-                logging::print("warning: node {} has child {} (node) out of range "
-                               "({} >= {})\n",
+                logging::print(logging::flag::WARNING, "warning: node {} has child {} (node) out of range "
+                                                       "({} >= {})\n",
                     i, j, child, bsp->dnodes.size());
             if (child < 0 && -child - 1 >= bsp->dleafs.size())
-                logging::print("warning: node {} has child {} (leaf) out of range "
-                               "({} >= {})\n",
+                logging::print(logging::flag::WARNING, "warning: node {} has child {} (leaf) out of range "
+                                                       "({} >= {})\n",
                     i, j, -child - 1, bsp->dleafs.size());
         }
 
         if (node->children[0] == node->children[1]) {
-            logging::print("warning: node {} has both children {}\n", i, node->children[0]);
+            logging::print(logging::flag::WARNING, "warning: node {} has both children {}\n", i, node->children[0]);
         }
 
         referenced_planenums.insert(node->planenum);
@@ -511,15 +530,17 @@ static void CheckBSPFile(const mbsp_t *bsp)
         for (int j = 0; j < 2; j++) {
             const int32_t child = clipnode->children[j];
             if (child >= 0 && child >= bsp->dclipnodes.size())
-                logging::print("warning: clipnode {} has child {} (clipnode) out of range "
-                               "({} >= {})\n",
+                logging::print(logging::flag::WARNING, "warning: clipnode {} has child {} (clipnode) out of range "
+                                                       "({} >= {})\n",
                     i, j, child, bsp->dclipnodes.size());
             if (child < 0 && child < CONTENTS_MIN)
-                logging::print("warning: clipnode {} has invalid contents ({}) for child {}\n", i, child, j);
+                logging::print(logging::flag::WARNING, "warning: clipnode {} has invalid contents ({}) for child {}\n",
+                    i, child, j);
         }
 
         if (clipnode->children[0] == clipnode->children[1]) {
-            logging::print("warning: clipnode {} has both children {}\n", i, clipnode->children[0]);
+            logging::print(logging::flag::WARNING, "warning: clipnode {} has both children {}\n", i,
+                clipnode->children[0]);
         }
 
         referenced_planenums.insert(clipnode->planenum);
@@ -536,7 +557,7 @@ static void CheckBSPFile(const mbsp_t *bsp)
             }
         }
         if (num_unreferenced_texinfo)
-            logging::print("warning: {} texinfos are unreferenced\n", num_unreferenced_texinfo);
+            logging::print(logging::flag::WARNING, "warning: {} texinfos are unreferenced\n", num_unreferenced_texinfo);
     }
 
     /* unreferenced planes */
@@ -548,7 +569,7 @@ static void CheckBSPFile(const mbsp_t *bsp)
             }
         }
         if (num_unreferenced_planes)
-            logging::print("warning: {} planes are unreferenced\n", num_unreferenced_planes);
+            logging::print(logging::flag::WARNING, "warning: {} planes are unreferenced\n", num_unreferenced_planes);
     }
 
     /* unreferenced vertices */
@@ -560,7 +581,8 @@ static void CheckBSPFile(const mbsp_t *bsp)
             }
         }
         if (num_unreferenced_vertexes)
-            logging::print("warning: {} vertexes are unreferenced\n", num_unreferenced_vertexes);
+            logging::print(logging::flag::WARNING, "warning: {} vertexes are unreferenced\n",
+                num_unreferenced_vertexes);
     }
 
     /* tree balance */
@@ -1556,6 +1578,30 @@ int bsputil_main(int _argc, const char **_argv)
             ConvertBSPFormat(&bspdata, bspdata.loadversion);
             WriteBSPFile(source, &bspdata);
 
+            logging::print("done.\n");
+        } else if (operation->primary_name() == "convert-portals") {
+            auto setting = dynamic_cast<setting_combined *>(operation.get());
+            fs::path input_file_name = setting->get<settings::setting_string>(0)->value();
+            fs::path output_file_name = setting->get<settings::setting_string>(1)->value();
+
+            if (!bspdata.loadversion) {
+                FError("--convert-portals needs a .bsp to know the game\n");
+            }
+
+            prtfile_t prtfile = LoadPrtFile(input_file_name, bspdata.loadversion);
+
+            logging::print("-> converting {} portals from {} to {}... ", prtfile.portals.size(), input_file_name,
+                output_file_name);
+
+            // the output format follows the extension
+            if (string_iequals(output_file_name.extension().string(), ".prtb")) {
+                WritePortalfileBinary(output_file_name, prtfile);
+            } else {
+                const bool uses_detail = bspdata.loadversion->game->id != GAME_QUAKE_II &&
+                                         prtfile.portalleafs != prtfile.portalleafs_real;
+                WritePortalfile(output_file_name, prtfile, bspdata.loadversion, uses_detail, false);
+            }
+
             logging::print("done.\n");
         } else {
             Error("option not implemented: {}", operation->primary_name());
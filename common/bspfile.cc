@@ -1503,7 +1503,7 @@ public:
                         }
 
                         if (!found_maps_folder) {
-                            logging::print(
+                            logging::print(logging::flag::WARNING,
                                 "WARNING: '{}' is not a child of '{}'; gamedir can't be automatically determined.\n",
                                 source, MAPS_FOLDER);
 
@@ -1517,7 +1517,7 @@ public:
             }
 
             if (!exists(gamedir)) {
-                logging::print("WARNING: failed to find gamedir '{}'\n", gamedir);
+                logging::print(logging::flag::WARNING, "WARNING: failed to find gamedir '{}'\n", gamedir);
             } else {
                 logging::print("using gamedir: '{}'\n", gamedir);
             }
@@ -1537,7 +1537,7 @@ public:
             }
 
             if (!exists(basedir)) {
-                logging::print("WARNING: failed to find basedir '{}'\n", basedir);
+                logging::print(logging::flag::WARNING, "WARNING: failed to find basedir '{}'\n", basedir);
             } else if (!equivalent(gamedir, basedir)) {
                 addArchive(basedir);
                 logging::print("using basedir: '{}'\n", basedir);
@@ -1880,28 +1880,43 @@ inline void CopyArray(std::vector<std::array<F, N>> &from, std::vector<std::arra
     }
 }
 
+// like CopyArray, but the source is discarded afterwards, so
+// lumps that are already in the generic layout can be moved
+// over instead of copied
+template<typename T>
+inline void MoveArray(T &in, T &out)
+{
+    out = std::move(in);
+}
+
+template<typename T, typename F>
+inline void MoveArray(F &in, T &out)
+{
+    CopyArray(in, out);
+}
+
 // Convert from a Q1-esque format to Generic
 template<typename T>
 inline void ConvertQ1BSPToGeneric(T &bsp, mbsp_t &mbsp)
 {
-    CopyArray(bsp.dentdata, mbsp.dentdata);
-    CopyArray(bsp.dplanes, mbsp.dplanes);
-    CopyArray(bsp.dtex, mbsp.dtex);
-    CopyArray(bsp.dvertexes, mbsp.dvertexes);
-    CopyArray(bsp.dvisdata, mbsp.dvis.bits);
-    CopyArray(bsp.dnodes, mbsp.dnodes);
-    CopyArray(bsp.texinfo, mbsp.texinfo);
-    CopyArray(bsp.dfaces, mbsp.dfaces);
-    CopyArray(bsp.dlightdata, mbsp.dlightdata);
-    CopyArray(bsp.dclipnodes, mbsp.dclipnodes);
-    CopyArray(bsp.dleafs, mbsp.dleafs);
-    CopyArray(bsp.dmarksurfaces, mbsp.dleaffaces);
-    CopyArray(bsp.dedges, mbsp.dedges);
-    CopyArray(bsp.dsurfedges, mbsp.dsurfedges);
+    MoveArray(bsp.dentdata, mbsp.dentdata);
+    MoveArray(bsp.dplanes, mbsp.dplanes);
+    MoveArray(bsp.dtex, mbsp.dtex);
+    MoveArray(bsp.dvertexes, mbsp.dvertexes);
+    MoveArray(bsp.dvisdata, mbsp.dvis.bits);
+    MoveArray(bsp.dnodes, mbsp.dnodes);
+    MoveArray(bsp.texinfo, mbsp.texinfo);
+    MoveArray(bsp.dfaces, mbsp.dfaces);
+    MoveArray(bsp.dlightdata, mbsp.dlightdata);
+    MoveArray(bsp.dclipnodes, mbsp.dclipnodes);
+    MoveArray(bsp.dleafs, mbsp.dleafs);
+    MoveArray(bsp.dmarksurfaces, mbsp.dleaffaces);
+    MoveArray(bsp.dedges, mbsp.dedges);
+    MoveArray(bsp.dsurfedges, mbsp.dsurfedges);
     if (std::holds_alternative<dmodelh2_vector>(bsp.dmodels)) {
-        CopyArray(std::get<dmodelh2_vector>(bsp.dmodels), mbsp.dmodels);
+        MoveArray(std::get<dmodelh2_vector>(bsp.dmodels), mbsp.dmodels);
     } else {
-        CopyArray(std::get<dmodelq1_vector>(bsp.dmodels), mbsp.dmodels);
+        MoveArray(std::get<dmodelq1_vector>(bsp.dmodels), mbsp.dmodels);
     }
 }
 
@@ -1909,24 +1924,24 @@ inline void ConvertQ1BSPToGeneric(T &bsp, mbsp_t &mbsp)
 template<typename T>
 inline void ConvertQ2BSPToGeneric(T &bsp, mbsp_t &mbsp)
 {
-    CopyArray(bsp.dentdata, mbsp.dentdata);
-    CopyArray(bsp.dplanes, mbsp.dplanes);
-    CopyArray(bsp.dvertexes, mbsp.dvertexes);
-    CopyArray(bsp.dvis, mbsp.dvis);
-    CopyArray(bsp.dnodes, mbsp.dnodes);
-    CopyArray(bsp.texinfo, mbsp.texinfo);
-    CopyArray(bsp.dfaces, mbsp.dfaces);
-    CopyArray(bsp.dlightdata, mbsp.dlightdata);
-    CopyArray(bsp.dleafs, mbsp.dleafs);
-    CopyArray(bsp.dleaffaces, mbsp.dleaffaces);
-    CopyArray(bsp.dleafbrushes, mbsp.dleafbrushes);
-    CopyArray(bsp.dedges, mbsp.dedges);
-    CopyArray(bsp.dsurfedges, mbsp.dsurfedges);
-    CopyArray(bsp.dmodels, mbsp.dmodels);
-    CopyArray(bsp.dbrushes, mbsp.dbrushes);
-    CopyArray(bsp.dbrushsides, mbsp.dbrushsides);
-    CopyArray(bsp.dareas, mbsp.dareas);
-    CopyArray(bsp.dareaportals, mbsp.dareaportals);
+    MoveArray(bsp.dentdata, mbsp.dentdata);
+    MoveArray(bsp.dplanes, mbsp.dplanes);
+    MoveArray(bsp.dvertexes, mbsp.dvertexes);
+    MoveArray(bsp.dvis, mbsp.dvis);
+    MoveArray(bsp.dnodes, mbsp.dnodes);
+    MoveArray(bsp.texinfo, mbsp.texinfo);
+    MoveArray(bsp.dfaces, mbsp.dfaces);
+    MoveArray(bsp.dlightdata, mbsp.dlightdata);
+    MoveArray(bsp.dleafs, mbsp.dleafs);
+    MoveArray(bsp.dleaffaces, mbsp.dleaffaces);
+    MoveArray(bsp.dleafbrushes, mbsp.dleafbrushes);
+    MoveArray(bsp.dedges, mbsp.dedges);
+    MoveArray(bsp.dsurfedges, mbsp.dsurfedges);
+    MoveArray(bsp.dmodels, mbsp.dmodels);
+    MoveArray(bsp.dbrushes, mbsp.dbrushes);
+    MoveArray(bsp.dbrushsides, mbsp.dbrushsides);
+    MoveArray(bsp.dareas, mbsp.dareas);
+    MoveArray(bsp.dareaportals, mbsp.dareaportals);
 }
 
 // Convert from a Q1-esque format to Generic
@@ -2280,8 +2295,9 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
 
     bspdata->file = filename;
 
-    /* load the file header */
-    fs::data file_data = fs::load(filename);
+    /* map the file; lumps are read straight out of the mapping
+       instead of first being copied into a buffer */
+    fs::mapped_data file_data = fs::map(filename);
 
     if (!file_data) {
         FError("Unable to load \"{}\"\n", filename);
@@ -2289,7 +2305,7 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
 
     filename = fs::resolveArchivePath(filename);
 
-    imemstream stream(file_data->data(), file_data->size());
+    imemstream stream(file_data.data(), file_data.size());
 
     stream >> endianness<std::endian::little>;
 
@@ -2321,7 +2337,7 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
         Error("Sorry, this bsp version is not supported.");
     } else {
         // special case handling for Hexen II
-        if (bspdata->version->game->id == GAME_QUAKE && isHexen2((dheader_t *)file_data->data(), bspdata->version)) {
+        if (bspdata->version->game->id == GAME_QUAKE && isHexen2((const dheader_t *)file_data.data(), bspdata->version)) {
             if (bspdata->version == &bspver_q1) {
                 bspdata->version = &bspver_h2;
             } else if (bspdata->version == &bspver_bsp2) {
@@ -2362,14 +2378,14 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
     bspxofs = (bspxofs + 3) & ~3;
 
     /*okay, so that's where it *should* be if it exists */
-    if (bspxofs + sizeof(bspx_header_t) <= file_data->size()) {
+    if (bspxofs + sizeof(bspx_header_t) <= file_data.size()) {
         stream.seekg(bspxofs);
 
         bspx_header_t bspx;
         stream >= bspx;
 
         if (!stream || memcmp(bspx.id.data(), "BSPX", 4)) {
-            logging::print("WARNING: invalid BSPX header\n");
+            logging::print(logging::flag::WARNING, "WARNING: invalid BSPX header\n");
             return;
         }
 
@@ -2377,17 +2393,17 @@ void LoadBSPFile(fs::path &filename, bspdata_t *bspdata)
             bspx_lump_t xlump;
 
             if (!(stream >= xlump)) {
-                logging::print("WARNING: invalid BSPX lump at index {}\n", i);
+                logging::print(logging::flag::WARNING, "WARNING: invalid BSPX lump at index {}\n", i);
                 return;
             }
 
-            if (xlump.fileofs > file_data->size() || (xlump.fileofs + xlump.filelen) > file_data->size()) {
-                logging::print("WARNING: invalid BSPX lump at index {}\n", i);
+            if (xlump.fileofs > file_data.size() || (xlump.fileofs + xlump.filelen) > file_data.size()) {
+                logging::print(logging::flag::WARNING, "WARNING: invalid BSPX lump at index {}\n", i);
                 return;
             }
 
-            bspdata->bspx.transfer(xlump.lumpname.data(), std::vector<uint8_t>(file_data->begin() + xlump.fileofs,
-                                                              file_data->begin() + xlump.fileofs + xlump.filelen));
+            bspdata->bspx.transfer(xlump.lumpname.data(), std::vector<uint8_t>(file_data.begin() + xlump.fileofs,
+                                                              file_data.begin() + xlump.fileofs + xlump.filelen));
         }
     }
 }
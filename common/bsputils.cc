@@ -649,7 +649,7 @@ bool Pvs_LeafVisible(const mbsp_t *bsp, const std::vector<uint8_t> &pvs, const m
             return false;
         }
         if (visleaf < -1 || visleaf >= bsp->dmodels[0].visleafs) {
-            logging::print("WARNING: bad/empty vis data on leaf?");
+            logging::print(logging::flag::WARNING, "WARNING: bad/empty vis data on leaf?");
             return false;
         }
 
@@ -901,10 +901,11 @@ faceextents_t::faceextents_t(const mface_t &face, const mbsp_t &bsp, float light
             const qvec3f &point = Face_PointAtIndex(&bsp, &face, 0); // grab first vert
             const char *texname = Face_TextureName(&bsp, &face);
 
-            logging::print("WARNING: Bad surface extents (may not load in vanilla Q1 engines):\n"
-                           "   surface {}, {} extents = {}, shift = {}\n"
-                           "   texture {} at ({})\n"
-                           "   surface normal ({})\n",
+            logging::print(logging::flag::WARNING,
+                "WARNING: Bad surface extents (may not load in vanilla Q1 engines):\n"
+                "   surface {}, {} extents = {}, shift = {}\n"
+                "   texture {} at ({})\n"
+                "   surface normal ({})\n",
                 Face_GetNum(&bsp, &face), i ? "t" : "s", lm_extents[i], lightmapshift, texname, point, plane.normal);
         }
     }
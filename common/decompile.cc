@@ -31,6 +31,8 @@
 #include <common/ostream.hh>
 
 #include <fstream>
+#include <mutex>
+#include <sstream>
 #include <vector>
 #include <cstdio>
 #include <string>
@@ -40,6 +42,7 @@
 #include <fmt/core.h>
 
 #include "tbb/parallel_for.h"
+#include "tbb/parallel_pipeline.h"
 
 // texturing
 
@@ -136,7 +139,32 @@ struct wal_metadata_t
     auto stream_data() { return std::tie(flags, contents, value); }
 };
 
-static std::unordered_map<std::string, wal_metadata_t> wals;
+// .wal metadata, loaded on demand; entities are decompiled concurrently,
+// so access is guarded by wals_lock
+static std::unordered_map<std::string, std::optional<wal_metadata_t>> wals;
+static std::mutex wals_lock;
+
+static std::optional<wal_metadata_t> LoadWalMetadata(const std::string &texture_name)
+{
+    std::unique_lock lock(wals_lock);
+
+    if (auto it = wals.find(texture_name); it != wals.end()) {
+        return it->second;
+    }
+
+    std::optional<wal_metadata_t> &meta = wals[texture_name];
+    auto wal = fs::load((fs::path("textures") / texture_name) += ".wal");
+
+    if (wal) {
+        imemstream stream(wal->data(), wal->size(), std::ios_base::in | std::ios_base::binary);
+        stream >> endianness<std::endian::little>;
+        stream.seekg(88);
+
+        stream >= meta.emplace();
+    }
+
+    return meta;
+}
 
 struct compiled_brush_t
 {
@@ -145,7 +173,7 @@ struct compiled_brush_t
     std::optional<qvec3d> brush_offset;
     contentflags_t contents;
 
-    inline void write(const mbsp_t *bsp, std::ofstream &stream)
+    inline void write(const mbsp_t *bsp, std::ostream &stream)
     {
         if (!sides.size()) {
             return;
@@ -189,24 +217,7 @@ struct compiled_brush_t
             int native = bsp->loadversion->game->contents_to_native(contents);
 
             if (bsp->loadversion->game->id == GAME_QUAKE_II && (native || side.flags.native || side.value)) {
-                wal_metadata_t *meta = nullptr;
-
-                auto it = wals.find(side.texture_name);
-
-                if (it != wals.end()) {
-                    meta = &it->second;
-                } else {
-                    auto wal = fs::load((fs::path("textures") / side.texture_name) += ".wal");
-
-                    if (wal) {
-                        imemstream stream(wal->data(), wal->size(), std::ios_base::in | std::ios_base::binary);
-                        stream >> endianness<std::endian::little>;
-                        stream.seekg(88);
-
-                        meta = &wals.emplace(side.texture_name, wal_metadata_t{}).first->second;
-                        stream >= *meta;
-                    }
-                }
+                const std::optional<wal_metadata_t> meta = LoadWalMetadata(side.texture_name);
 
                 if (!meta || !((meta->contents & ~(Q2_CONTENTS_SOLID | Q2_CONTENTS_WINDOW)) ==
                                      (native & ~(Q2_CONTENTS_SOLID | Q2_CONTENTS_WINDOW)) &&
@@ -350,8 +361,7 @@ struct leaf_decompile_task
 /**
  * Builds the initial list of faces on the node
  */
-static std::vector<decomp_brush_face_t> BuildDecompFacesOnPlane(
-    const mbsp_t *bsp, const leaf_decompile_task &task, const decomp_plane_t &plane)
+static std::vector<decomp_brush_face_t> BuildDecompFacesOnPlane(const mbsp_t *bsp, const decomp_plane_t &plane)
 {
     if (plane.node == nullptr) {
         return {};
@@ -363,8 +373,8 @@ static std::vector<decomp_brush_face_t> BuildDecompFacesOnPlane(
 
     result.reserve(static_cast<size_t>(node->numfaces));
 
-    for (int i = 0; i < node->numfaces; i++) {
-        const mface_t *face = BSP_GetFace(bsp, static_cast<int>(node->firstface) + i);
+    for (uint32_t i = 0; i < node->numfaces; i++) {
+        const mface_t *face = BSP_GetFace(bsp, static_cast<int>(node->firstface + i));
 
         decomp_brush_face_t decompFace(bsp, face);
 
@@ -391,8 +401,8 @@ struct decomp_brush_side_t
     // for Q2 path
     polylib::winding_t winding;
 
-    decomp_brush_side_t(const mbsp_t *bsp, const leaf_decompile_task &model, const decomp_plane_t &planeIn)
-        : faces(BuildDecompFacesOnPlane(bsp, model, planeIn)),
+    decomp_brush_side_t(const mbsp_t *bsp, const decomp_plane_t &planeIn)
+        : faces(BuildDecompFacesOnPlane(bsp, planeIn)),
           plane(planeIn)
     {
     }
@@ -618,13 +628,12 @@ static void OverrideTextureForContents(
  * @returns a brush object which has the faces from the .bsp clipped to
  * the parts that lie on the brush.
  */
-static decomp_brush_t BuildInitialBrush(
-    const mbsp_t *bsp, const leaf_decompile_task &task, const std::vector<decomp_plane_t> &planes)
+static decomp_brush_t BuildInitialBrush(const mbsp_t *bsp, const std::vector<decomp_plane_t> &planes)
 {
     std::vector<decomp_brush_side_t> sides;
 
     for (const decomp_plane_t &plane : planes) {
-        decomp_brush_side_t side(bsp, task, plane);
+        decomp_brush_side_t side(bsp, plane);
 
         // clip `side` by all of the other planes, and keep the back portion
         for (const decomp_plane_t &plane2 : planes) {
@@ -645,8 +654,7 @@ static decomp_brush_t BuildInitialBrush(
     return decomp_brush_t(sides);
 }
 
-static decomp_brush_t BuildInitialBrush_Q2(
-    const mbsp_t *bsp, const leaf_decompile_task &task, const std::vector<decomp_plane_t> &planes)
+static decomp_brush_t BuildInitialBrush_Q2(const mbsp_t *bsp, const std::vector<decomp_plane_t> &planes)
 {
     std::vector<decomp_brush_side_t> sides;
 
@@ -654,7 +662,7 @@ static decomp_brush_t BuildInitialBrush_Q2(
     std::vector<bool> clipped_away;
     clipped_away.resize(planes.size(), false);
 
-    for (int i = planes.size() - 1; i >= 0; --i) {
+    for (int i = static_cast<int>(planes.size()) - 1; i >= 0; --i) {
         const decomp_plane_t &plane = planes[i];
 
         // FIXME: use a better max
@@ -664,7 +672,7 @@ static decomp_brush_t BuildInitialBrush_Q2(
         for (size_t j = 0; j < planes.size(); ++j) {
             const decomp_plane_t &plane2 = planes[j];
 
-            if (i == j)
+            if (static_cast<size_t>(i) == j)
                 continue;
 
             if (clipped_away[j]) {
@@ -692,7 +700,7 @@ static decomp_brush_t BuildInitialBrush_Q2(
         if (winding->size() < 3)
             continue;
 
-        auto side = decomp_brush_side_t(bsp, task, plane);
+        auto side = decomp_brush_side_t(bsp, plane);
         side.winding = std::move(*winding);
         sides.push_back(std::move(side));
     }
@@ -844,7 +852,7 @@ static std::vector<compiled_brush_t> DecompileLeafTask(const mbsp_t *bsp, const
     if (bsp->loadversion->game->id == GAME_QUAKE_II && !options.ignoreBrushes) {
         // Q2 doesn't need this - we assume each brush in the brush lump corresponds to exactly one .map file brush
         // and so each side of the brush can only have 1 texture at this point.
-        finalBrushes = {BuildInitialBrush_Q2(bsp, task, task.allPlanes)};
+        finalBrushes = {BuildInitialBrush_Q2(bsp, task.allPlanes)};
     } else {
         // Q1 (or Q2, with options.ignoreBrushes)
         RemoveRedundantPlanes(task.allPlanes);
@@ -860,7 +868,7 @@ static std::vector<compiled_brush_t> DecompileLeafTask(const mbsp_t *bsp, const
         // parts that are outside of our brush. (keeping track of which of the nodes they belonged to)
         // It's possible that the faces are half-overlapping the leaf, so we may have to cut the
         // faces in half.
-        auto initialBrush = BuildInitialBrush(bsp, task, task.allPlanes);
+        auto initialBrush = BuildInitialBrush(bsp, task.allPlanes);
         // assert(initialBrush.checkPoints());
 
         // Next, for each plane in reducedPlanes, if there are 2+ faces on the plane with non-equal
@@ -963,7 +971,7 @@ static std::vector<compiled_brush_t> DecompileLeafTaskLeafVisualization(
 
     // fmt::print("before: {} after {}\n", task.allPlanes.size(), reducedPlanes.size());
 
-    auto initialBrush = BuildInitialBrush_Q2(bsp, task, task.allPlanes);
+    auto initialBrush = BuildInitialBrush_Q2(bsp, task.allPlanes);
     // assert(initialBrush.checkPoints());
 
     finalBrushes = {initialBrush};
@@ -1097,7 +1105,7 @@ static void AddMapBoundsToStack(std::vector<decomp_plane_t> &planestack, const m
 static std::vector<compiled_brush_t> DecompileBrushTask(const mbsp_t *bsp, const decomp_options &options,
     leaf_decompile_task &task, const std::optional<qvec3d> &brush_offset)
 {
-    for (size_t i = 0; i < task.brush->numsides; i++) {
+    for (int32_t i = 0; i < task.brush->numsides; i++) {
         const q2_dbrushside_qbism_t *side = &bsp->dbrushsides[task.brush->firstside + i];
         decomp_plane_t &plane = task.allPlanes.emplace_back(decomp_plane_t{qplane3d{bsp->dplanes[side->planenum]}});
         plane.source = side;
@@ -1112,8 +1120,68 @@ static std::vector<compiled_brush_t> DecompileBrushTask(const mbsp_t *bsp, const
 
 #include "common/parser.hh"
 
-static void DecompileEntity(
-    const mbsp_t *bsp, const decomp_options &options, std::ofstream &file, const entdict_t &dict, bool isWorld)
+// cleans up and formats one task's worth of brushes
+static std::string FormatCompiledBrushes(const mbsp_t *bsp, std::vector<compiled_brush_t> brushes, bool isTrigger)
+{
+    // If we run into a trigger brush, replace all of its faces with trigger texture.
+    if (isTrigger) {
+        for (auto &brush : brushes) {
+            for (auto &side : brush.sides) {
+                DefaultTriggerSide(side, bsp);
+            }
+        }
+    }
+
+    // cleanup step: we're left with visible faces having textures, but
+    // things that aren't output in BSP faces will use a skip texture.
+    // we'll find the best matching texture that we think would work well.
+    for (auto &brush : brushes) {
+        for (auto &side : brush.sides) {
+            if (side.texture_name != DefaultSkipTexture(bsp)) {
+                continue;
+            }
+
+            // check all of the other sides, find the one with the nearest opposite plane
+            qvec3d normal_to_check = -side.plane.normal;
+            double closest_dot = -DBL_MAX;
+            compiled_brush_side_t *closest = nullptr;
+
+            for (auto &side2 : brush.sides) {
+                if (&side2 == &side) {
+                    continue;
+                }
+
+                if (side2.texture_name == DefaultSkipTexture(bsp)) {
+                    continue;
+                }
+
+                double d = qv::dot(normal_to_check, side2.plane.normal);
+
+                if (!closest || d > closest_dot) {
+                    closest_dot = d;
+                    closest = &side2;
+                }
+            }
+
+            if (closest) {
+                side.texture_name = closest->texture_name;
+            } else {
+                side.texture_name = DefaultTextureForContents(bsp, brush.contents);
+            }
+        }
+    }
+
+    std::ostringstream stream;
+
+    for (auto &brush : brushes) {
+        brush.write(bsp, stream);
+    }
+
+    return std::move(stream).str();
+}
+
+// returns the entity as .map text
+static std::string DecompileEntity(const mbsp_t *bsp, const decomp_options &options, const entdict_t &dict, bool isWorld)
 {
     // we use -1 to indicate it's not a brush model
     int modelNum = -1;
@@ -1147,9 +1215,11 @@ static void DecompileEntity(
         }
     } else if (dict.find("classname")->second == "func_group") {
         // Some older Q2 maps included func_group in the entity list.
-        return;
+        return {};
     }
 
+    std::ostringstream file;
+
     // First, print the key/values for this entity
     ewt::print(file, "{{\n");
     for (const auto &keyValue : dict) {
@@ -1182,7 +1252,11 @@ static void DecompileEntity(
         ewt::print(file, "\"{}\" \"{}\"\n", keyValue.first, keyValue.second);
     }
 
-    std::vector<std::vector<compiled_brush_t>> compiledBrushes;
+    const bool isTrigger = modelNum > 0 && dict.find("classname")->second.compare(0, 8, "trigger_") == 0;
+
+    // each task's brushes are formatted as soon as they're decompiled,
+    // so only their text is held on to
+    std::vector<std::string> compiledBrushes;
 
     // Print brushes if any
     if (modelNum >= 0) {
@@ -1201,8 +1275,10 @@ static void DecompileEntity(
 
             // decompile the leafs in parallel
             compiledBrushes.resize(tasks.size());
-            tbb::parallel_for(static_cast<size_t>(0), tasks.size(),
-                [&](size_t i) { compiledBrushes[i] = DecompileLeafTaskGeometryOnly(bsp, tasks[i], brush_offset); });
+            tbb::parallel_for(static_cast<size_t>(0), tasks.size(), [&](size_t i) {
+                compiledBrushes[i] =
+                    FormatCompiledBrushes(bsp, DecompileLeafTaskGeometryOnly(bsp, tasks[i], brush_offset), isTrigger);
+            });
         } else if (bsp->loadversion->game->id == GAME_QUAKE_II && !options.ignoreBrushes) {
             std::unordered_map<const dbrush_t *, leaf_decompile_task> brushes;
 
@@ -1249,11 +1325,10 @@ static void DecompileEntity(
                 brushes.begin(), brushes.end(), std::back_inserter(brushesVector), [](auto &v) { return v.second; });
 
             compiledBrushes.resize(brushes.size());
-            size_t t = brushes.size();
 
             tbb::parallel_for(static_cast<size_t>(0), brushes.size(), [&](size_t i) {
-                compiledBrushes[i] = DecompileBrushTask(bsp, options, brushesVector[i], brush_offset);
-                t--;
+                compiledBrushes[i] = FormatCompiledBrushes(
+                    bsp, DecompileBrushTask(bsp, options, brushesVector[i], brush_offset), isTrigger);
             });
         } else {
             // recursively visit the nodes to gather up a list of leafs to decompile
@@ -1269,74 +1344,24 @@ static void DecompileEntity(
             compiledBrushes.resize(tasks.size());
             tbb::parallel_for(static_cast<size_t>(0), tasks.size(), [&](size_t i) {
                 if (options.geometryOnly) {
-                    compiledBrushes[i] = DecompileLeafTaskGeometryOnly(bsp, tasks[i], brush_offset);
+                    compiledBrushes[i] = FormatCompiledBrushes(
+                        bsp, DecompileLeafTaskGeometryOnly(bsp, tasks[i], brush_offset), isTrigger);
                 } else {
-                    compiledBrushes[i] = DecompileLeafTask(bsp, options, tasks[i], brush_offset);
+                    compiledBrushes[i] =
+                        FormatCompiledBrushes(bsp, DecompileLeafTask(bsp, options, tasks[i], brush_offset), isTrigger);
                 }
             });
         }
     } else if (areaportal_brush) {
         leaf_decompile_task task;
         task.brush = areaportal_brush;
-        compiledBrushes.push_back(DecompileBrushTask(bsp, options, task, brush_offset));
-    }
-
-    // If we run into a trigger brush, replace all of its faces with trigger texture.
-    if (modelNum > 0 && dict.find("classname")->second.compare(0, 8, "trigger_") == 0) {
-        for (auto &brushlist : compiledBrushes) {
-            for (auto &brush : brushlist) {
-                for (auto &side : brush.sides) {
-                    DefaultTriggerSide(side, bsp);
-                }
-            }
-        }
-    }
-
-    // cleanup step: we're left with visible faces having textures, but
-    // things that aren't output in BSP faces will use a skip texture.
-    // we'll find the best matching texture that we think would work well.
-    for (auto &brushlist : compiledBrushes) {
-        for (auto &brush : brushlist) {
-            for (auto &side : brush.sides) {
-                if (side.texture_name != DefaultSkipTexture(bsp)) {
-                    continue;
-                }
-
-                // check all of the other sides, find the one with the nearest opposite plane
-                qvec3d normal_to_check = -side.plane.normal;
-                double closest_dot = -DBL_MAX;
-                compiled_brush_side_t *closest = nullptr;
-
-                for (auto &side2 : brush.sides) {
-                    if (&side2 == &side) {
-                        continue;
-                    }
-
-                    if (side2.texture_name == DefaultSkipTexture(bsp)) {
-                        continue;
-                    }
-
-                    double d = qv::dot(normal_to_check, side2.plane.normal);
-
-                    if (!closest || d > closest_dot) {
-                        closest_dot = d;
-                        closest = &side2;
-                    }
-                }
-
-                if (closest) {
-                    side.texture_name = closest->texture_name;
-                } else {
-                    side.texture_name = DefaultTextureForContents(bsp, brush.contents);
-                }
-            }
-        }
+        compiledBrushes.push_back(
+            FormatCompiledBrushes(bsp, DecompileBrushTask(bsp, options, task, brush_offset), isTrigger));
     }
 
     // add the origin brush, if we have one
     if (brush_offset.has_value()) {
-        std::vector<compiled_brush_t> &brushlist = compiledBrushes.emplace_back();
-        compiled_brush_t &brush = brushlist.emplace_back();
+        compiled_brush_t brush;
         brush.brush_offset = brush_offset;
         brush.contents = contentflags_t::make(EWT_INVISCONTENTS_ORIGIN);
 
@@ -1355,25 +1380,48 @@ static void DecompileEntity(
             side.texture_name = DefaultOriginTexture(bsp);
             side.valve = plane.normal;
         }
+
+        std::ostringstream stream;
+        brush.write(bsp, stream);
+        compiledBrushes.push_back(std::move(stream).str());
     }
 
-    for (auto &brushlist : compiledBrushes) {
-        for (auto &brush : brushlist) {
-            brush.write(bsp, file);
-        }
+    for (auto &text : compiledBrushes) {
+        file << text;
     }
 
     ewt::print(file, "}}\n");
+
+    return std::move(file).str();
 }
 
-void DecompileBSP(const mbsp_t *bsp, const decomp_options &options, std::ofstream &file)
+void DecompileBSP(const mbsp_t *bsp, const decomp_options &options, std::ostream &file)
 {
     auto entdicts = EntData_Parse(*bsp);
 
-    for (size_t i = 0; i < entdicts.size(); ++i) {
-        // entity 0 is implicitly worldspawn (model 0)
-        DecompileEntity(bsp, options, file, entdicts[i], i == 0);
-    }
+    // entities are decompiled concurrently but written out in order; the
+    // number in flight is bounded, so only a few entities' text is held
+    // in memory at once. each entity is still built as one string, so
+    // worldspawn's brushes are held in full before being written.
+    const size_t max_live_entities = std::max(1, tbb::this_task_arena::max_concurrency()) * 2;
+    size_t next_entity = 0;
+
+    tbb::parallel_pipeline(max_live_entities,
+        tbb::make_filter<void, size_t>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control &fc) -> size_t {
+                if (next_entity == entdicts.size()) {
+                    fc.stop();
+                    return 0;
+                }
+                return next_entity++;
+            }) &
+            tbb::make_filter<size_t, std::string>(tbb::filter_mode::parallel,
+                [&](size_t i) {
+                    // entity 0 is implicitly worldspawn (model 0)
+                    return DecompileEntity(bsp, options, entdicts[i], i == 0);
+                }) &
+            tbb::make_filter<std::string, void>(
+                tbb::filter_mode::serial_in_order, [&](const std::string &text) { file << text; }));
 }
 
 // MARK: - leaf visualization
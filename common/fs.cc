@@ -28,6 +28,24 @@
 #include <list>
 #include <stdexcept>
 #include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+
+// don't break std::min
+#ifdef min
+#undef min
+#endif
+#ifdef max
+#undef max
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace fs
 {
@@ -55,10 +73,15 @@ struct directory_archive : archive_like
             stream.read(reinterpret_cast<char *>(data.data()), size);
             return data;
         } catch (const filesystem_error &e) {
-            logging::funcprint("WARNING: {}\n", e.what());
+            logging::funcwarning("WARNING: {}\n", e.what());
             return std::nullopt;
         }
     }
+
+    std::optional<path> loose_path(const path &filename) override
+    {
+        return !pathname.empty() ? (pathname / filename) : filename;
+    }
 };
 
 struct pak_archive : archive_like
@@ -208,7 +231,8 @@ struct wad_archive : archive_like
 
             std::string tex_name = file.name_as_string();
             if (tex_name.size() == 16) {
-                logging::print("WARNING: texture name {} ({}) is not null-terminated\n", tex_name, pathname);
+                logging::print(logging::flag::WARNING, "WARNING: texture name {} ({}) is not null-terminated\n",
+                    tex_name, pathname);
             }
             files[tex_name] = std::make_tuple(file.filepos, file.disksize);
         }
@@ -275,10 +299,10 @@ inline std::shared_ptr<archive_like> addArchiveInternal(const path &p, bool exte
                 logging::print(logging::flag::VERBOSE, "Added wad '{}' with {} lumps\n", p, wad->files.size());
                 return arch;
             } else {
-                logging::funcprint("WARNING: no idea what to do with archive '{}'\n", p);
+                logging::funcwarning("WARNING: no idea what to do with archive '{}'\n", p);
             }
         } catch (std::exception e) {
-            logging::funcprint("WARNING: unable to load archive '{}': {}\n", p, e.what());
+            logging::funcwarning("WARNING: unable to load archive '{}': {}\n", p, e.what());
         }
     }
 
@@ -288,7 +312,7 @@ inline std::shared_ptr<archive_like> addArchiveInternal(const path &p, bool exte
 std::shared_ptr<archive_like> addArchive(const path &p, bool external)
 {
     if (p.empty()) {
-        logging::funcprint("WARNING: can't add empty archive path\n");
+        logging::funcwarning("WARNING: can't add empty archive path\n");
         return nullptr;
     }
 
@@ -297,7 +321,7 @@ std::shared_ptr<archive_like> addArchive(const path &p, bool external)
         path filename = p.filename();
 
         if (!exists(filename)) {
-            logging::funcprint("WARNING: archive '{}' not found\n", p);
+            logging::funcwarning("WARNING: archive '{}' not found\n", p);
             return nullptr;
         }
 
@@ -359,6 +383,174 @@ data load(const path &p, bool prefer_loose)
     return load(where(p, prefer_loose));
 }
 
+mapped_data::mapped_data(std::vector<uint8_t> &&data)
+    : fallback(std::move(data)),
+      valid(true)
+{
+    base = fallback.data();
+    length = fallback.size();
+}
+
+mapped_data::mapped_data(mapped_data &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+mapped_data &mapped_data::operator=(mapped_data &&other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+
+    unmap();
+
+    // note: moving a vector keeps its buffer, so `base` stays valid
+    fallback = std::move(other.fallback);
+    base = std::exchange(other.base, nullptr);
+    length = std::exchange(other.length, 0);
+    valid = std::exchange(other.valid, false);
+    mapped = std::exchange(other.mapped, false);
+#ifdef _WIN32
+    file_handle = std::exchange(other.file_handle, nullptr);
+    mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+
+    return *this;
+}
+
+mapped_data::~mapped_data()
+{
+    unmap();
+}
+
+void mapped_data::unmap()
+{
+    if (mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        file_handle = mapping_handle = nullptr;
+#else
+        munmap(const_cast<uint8_t *>(base), length);
+#endif
+    }
+
+    fallback.clear();
+    base = nullptr;
+    length = 0;
+    valid = mapped = false;
+}
+
+mapped_data mapped_data::map_file(const path &p)
+{
+    mapped_data result;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return result;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return result;
+    }
+
+    // can't map zero-length files
+    if (!size.QuadPart) {
+        CloseHandle(file);
+        return mapped_data(std::vector<uint8_t>{});
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!mapping) {
+        CloseHandle(file);
+        return result;
+    }
+
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return result;
+    }
+
+    result.file_handle = file;
+    result.mapping_handle = mapping;
+    result.length = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(p.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        return result;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return result;
+    }
+
+    // can't map zero-length files
+    if (!st.st_size) {
+        close(fd);
+        return mapped_data(std::vector<uint8_t>{});
+    }
+
+    void *view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping holds its own reference to the file
+    close(fd);
+
+    if (view == MAP_FAILED) {
+        return result;
+    }
+
+    // lumps are generally read front-to-back
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    result.length = static_cast<size_t>(st.st_size);
+#endif
+
+    result.base = reinterpret_cast<const uint8_t *>(view);
+    result.valid = result.mapped = true;
+    return result;
+}
+
+mapped_data map(const resolve_result &pos)
+{
+    if (!pos) {
+        return {};
+    }
+
+    if (auto loose = pos.archive->loose_path(pos.filename)) {
+        if (auto mapped = mapped_data::map_file(*loose)) {
+            logging::print(logging::flag::VERBOSE, "Mapped '{}'\n", *loose);
+            return mapped;
+        }
+    }
+
+    // not mappable; load a copy instead
+    if (auto data = load(pos)) {
+        return mapped_data(std::move(*data));
+    }
+
+    return {};
+}
+
+mapped_data map(const path &p, bool prefer_loose)
+{
+    return map(where(p, prefer_loose));
+}
+
 archive_components splitArchivePath(const path &source)
 {
     // check direct archive loading
@@ -488,14 +488,14 @@ if (texture) {
     tex = std::move(texture.value());
 } else {
     if (miptex.data.size() <= sizeof(dmiptex_t)) {
-        logging::funcprint("WARNING: can't find texture {}\n", miptex.name);
+        logging::funcwarning("WARNING: can't find texture {}\n", miptex.name);
         continue;
     }
 
     auto loaded_tex = img::load_mip(miptex.name, miptex.data, false, bsp->loadversion->game);
 
     if (!loaded_tex) {
-        logging::funcprint("WARNING: Texture {} is invalid\n", miptex.name);
+        logging::funcwarning("WARNING: Texture {} is invalid\n", miptex.name);
         continue;
     }
 
@@ -542,7 +542,7 @@ static void AddTextureName(std::string_view textureName, const mbsp_t *bsp, cons
     auto [texture, _0, _1] = img::load_texture(textureName, false, bsp->loadversion->game, options);
 
     if (!texture) {
-        logging::funcprint("WARNING: can't find pixel data for {}\n", textureName);
+        logging::funcwarning("WARNING: can't find pixel data for {}\n", textureName);
     } else {
         tex = std::move(texture.value());
     }
@@ -550,7 +550,7 @@ static void AddTextureName(std::string_view textureName, const mbsp_t *bsp, cons
     auto [texture_meta, __0, __1] = img::load_texture_meta(textureName, bsp->loadversion->game, options);
 
     if (!texture_meta) {
-        logging::funcprint("WARNING: can't find meta data for {}\n", textureName);
+        logging::funcwarning("WARNING: can't find meta data for {}\n", textureName);
     } else {
         tex.meta = std::move(texture_meta.value());
     }
@@ -604,7 +604,7 @@ static void ConvertTextures(const mbsp_t *bsp, const settings::common_settings &
 
     for (auto &miptex : bsp->dtex.textures) {
         if (img::find(miptex.name)) {
-            logging::funcprint("WARNING: Texture {} duplicated\n", miptex.name);
+            logging::funcwarning("WARNING: Texture {} duplicated\n", miptex.name);
             continue;
         }
 
@@ -626,7 +626,7 @@ static void ConvertTextures(const mbsp_t *bsp, const settings::common_settings &
         }
 
         if (!tex.pixels.size() || !tex.width || !tex.meta.width) {
-            logging::funcprint("WARNING: invalid size data for {}\n", miptex.name);
+            logging::funcwarning("WARNING: invalid size data for {}\n", miptex.name);
             continue;
         }
 
@@ -657,7 +657,7 @@ void load_textures(const mbsp_t *bsp, const settings::common_settings &options)
     } else if (bsp->dtex.textures.size() > 0) {
         ConvertTextures(bsp, options);
     } else {
-        logging::print("WARNING: failed to load or convert textures.\n");
+        logging::print(logging::flag::WARNING, "WARNING: failed to load or convert textures.\n");
     }
 }
 } // namespace img
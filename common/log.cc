@@ -21,17 +21,20 @@
  * common/log.c
  */
 
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <thread>
 #include <fmt/ostream.h>
 #include <fmt/chrono.h>
 #include <fmt/color.h>
 #include <string>
 
 #include <common/log.hh>
+#include <common/parallel.hh>
 #include <common/settings.hh>
 #include <common/cmdlib.hh>
 
@@ -48,10 +51,13 @@
 #endif
 
 static std::ofstream logfile;
+// guards logfile and stdout between the writer thread and init/close
+static std::mutex logfile_mutex;
 
 namespace logging
 {
 bitflags<flag> mask = bitflags<flag>(flag::ALL) & ~bitflags<flag>(flag::VERBOSE);
+thread_local bitflags<flag> thread_mask = flag::ALL;
 bool enable_color_codes = true;
 
 void preinitialize()
@@ -79,15 +85,25 @@ void init(std::optional<fs::path> filename, const settings::common_settings &set
 
     fs::path p = fs::absolute(filename.value());
 
-    if (logfile) {
-        logfile.close();
-    }
+    // anything still queued belongs to the previous log file
+    flush();
 
-    logfile.open(p, settings.logappend.value() ? std::ios_base::app : std::ios_base::trunc);
+    {
+        std::unique_lock lock(logfile_mutex);
+
+        if (logfile) {
+            logfile.close();
+        }
+
+        logfile.open(p, settings.logappend.value() ? std::ios_base::app : std::ios_base::trunc);
+
+        if (logfile) {
+            fmt::print(logfile, "---- {} / ericw-tools {} ----\n", settings.program_name, ERICWTOOLS_VERSION);
+        }
+    }
 
     if (logfile) {
         print(flag::PROGRESS, "logging to {} ({})\n", p.string(), settings.logappend.value() ? "append" : "truncate");
-        fmt::print(logfile, "---- {} / ericw-tools {} ----\n", settings.program_name, ERICWTOOLS_VERSION);
     } else {
         print(flag::PROGRESS, "WARNING: can't log to {}\n", p.string());
     }
@@ -95,13 +111,16 @@ void init(std::optional<fs::path> filename, const settings::common_settings &set
 
 void close()
 {
+    flush();
+
+    std::unique_lock lock(logfile_mutex);
+
     if (logfile) {
         fmt::print(logfile, "\n\n");
         logfile.close();
     }
 }
 
-static std::mutex print_mutex;
 static print_callback_t active_print_callback;
 
 void set_print_callback(print_callback_t cb)
@@ -109,57 +128,274 @@ void set_print_callback(print_callback_t cb)
     active_print_callback = cb;
 }
 
-void print(flag logflag, const char *str)
+struct log_message_t
 {
-    if (!(mask & logflag)) {
-        return;
-    }
-
-    if (active_print_callback) {
-        active_print_callback(logflag, str);
-    }
+    flag logflag;
+    std::string text;
+};
 
-    fmt::text_style style;
-
-    if (enable_color_codes) {
-        if (string_icontains(str, "error")) {
-            style = fmt::fg(fmt::color::red);
-        } else if (string_icontains(str, "warning")) {
-            style = fmt::fg(fmt::terminal_color::yellow);
-        } else if (bitflags<flag>(logflag) & flag::PERCENT) {
-            style = fmt::fg(fmt::terminal_color::bright_black);
-        } else if (bitflags<flag>(logflag) & flag::STAT) {
-            style = fmt::fg(fmt::terminal_color::cyan);
-        }
-    }
-
-    print_mutex.lock();
+// write one message to stdout and the log file; the caller holds
+// logfile_mutex and flushes
+static void write_message(const log_message_t &message)
+{
+    const flag logflag = message.logflag;
 
     if (logflag != flag::PERCENT) {
         // log file, if open
         if (logfile && logflag != flag::PROGRESS) {
-            logfile << str;
-            logfile.flush();
+            logfile << message.text;
         }
 
 #ifdef _WIN32
         // print to windows console.
         // if VS's Output window gets support for ANSI colors, we can change this to ansi_str.c_str()
-        OutputDebugStringA(str);
+        OutputDebugStringA(message.text.c_str());
 #endif
     }
 
     if (enable_color_codes) {
+        fmt::text_style style;
+
+        switch (logflag) {
+            case flag::FAILURE: style = fmt::fg(fmt::color::red); break;
+            case flag::WARNING: style = fmt::fg(fmt::terminal_color::yellow); break;
+            case flag::PERCENT: style = fmt::fg(fmt::terminal_color::bright_black); break;
+            case flag::STAT: style = fmt::fg(fmt::terminal_color::cyan); break;
+            default: break;
+        }
+
         // stdout (assume the terminal can render ANSI colors)
-        fmt::print(style, "{}", str);
+        fmt::print(style, "{}", message.text);
     } else {
-        std::cout << str;
+        std::cout << message.text;
+    }
+}
+
+static void flush_targets()
+{
+    if (logfile) {
+        logfile.flush();
     }
 
     // for TB, etc...
     fflush(stdout);
+}
+
+/*
+ * Bounded multi-producer, single-consumer ring of messages. Producers
+ * claim a slot by bumping `head`, fill it and publish it through the
+ * slot's sequence number; only the writer thread reads `tail`.
+ */
+class log_queue_t
+{
+    struct slot_t
+    {
+        std::atomic<size_t> sequence;
+        log_message_t message;
+    };
+
+    static constexpr size_t capacity = 4096;
+
+    std::unique_ptr<slot_t[]> slots;
+    alignas(64) std::atomic<size_t> head = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+
+public:
+    log_queue_t()
+        : slots(std::make_unique<slot_t[]>(capacity))
+    {
+        for (size_t i = 0; i < capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // false if the ring is full
+    bool try_push(log_message_t &message)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+
+        while (true) {
+            slot_t &slot = slots[pos & (capacity - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.message = std::move(message);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // writer thread only; false if the next message isn't published yet
+    bool try_pop(log_message_t &message)
+    {
+        const size_t pos = tail.load(std::memory_order_relaxed);
+        slot_t &slot = slots[pos & (capacity - 1)];
+
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+
+        message = std::move(slot.message);
+        slot.sequence.store(pos + capacity, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // number of messages claimed / written so far
+    size_t claimed() const { return head.load(std::memory_order_acquire); }
+    size_t consumed() const { return tail.load(std::memory_order_acquire); }
+};
+
+/*
+ * Background writer: drains the queue on a timer, or as soon as someone
+ * is waiting in flush(), and flushes stdout and the log file once per batch.
+ * Created on the first print; stopped at exit, after which printing falls
+ * back to writing synchronously.
+ */
+class log_writer_t
+{
+    log_queue_t queue;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    size_t flush_requests = 0;
+    bool stopping = false;
+
+    std::thread thread;
+
+    void drain()
+    {
+        std::unique_lock lock(logfile_mutex);
+        log_message_t message;
+        bool wrote = false;
+
+        while (queue.try_pop(message)) {
+            write_message(message);
+            wrote = true;
+        }
+
+        if (wrote) {
+            flush_targets();
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock lock(mutex);
+
+        while (true) {
+            wake.wait_for(lock, flush_interval, [this] { return stopping || flush_requests; });
+
+            const bool stop = stopping;
+            lock.unlock();
+            drain();
+            lock.lock();
+
+            drained.notify_all();
+
+            if (stop && queue.consumed() == queue.claimed()) {
+                break;
+            }
+        }
+    }
+
+public:
+    static constexpr auto flush_interval = std::chrono::milliseconds(50);
+
+    log_writer_t()
+        : thread(&log_writer_t::run, this)
+    {
+    }
+
+    void push(log_message_t &message)
+    {
+        // full; let the writer catch up
+        while (!queue.try_push(message)) {
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+    }
+
+    void flush()
+    {
+        std::unique_lock lock(mutex);
+        const size_t target = queue.claimed();
+
+        flush_requests++;
+        wake.notify_one();
+        drained.wait(lock, [&] { return queue.consumed() >= target; });
+        flush_requests--;
+    }
+
+    void stop()
+    {
+        {
+            std::unique_lock lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_one();
+        thread.join();
+    }
+};
+
+static std::atomic<log_writer_t *> active_writer = nullptr;
+static std::once_flag writer_once;
+
+static log_writer_t *writer()
+{
+    std::call_once(writer_once, [] {
+        // never destroyed, so printing from other static destructors is safe;
+        // the thread is stopped at exit and later prints are synchronous
+        active_writer = new log_writer_t();
+
+        std::atexit([] {
+            if (log_writer_t *w = active_writer.exchange(nullptr)) {
+                w->stop();
+            }
+        });
+    });
 
-    print_mutex.unlock();
+    return active_writer.load();
+}
+
+void flush()
+{
+    if (log_writer_t *w = active_writer.load()) {
+        w->flush();
+    }
+}
+
+void print(flag logflag, const char *str)
+{
+    if (!(mask & thread_mask & logflag)) {
+        return;
+    }
+
+    if (active_print_callback) {
+        active_print_callback(logflag, str);
+    }
+
+    log_message_t message{logflag, str};
+
+    if (log_writer_t *w = writer()) {
+        w->push(message);
+        return;
+    }
+
+    // exiting; write directly
+    std::unique_lock lock(logfile_mutex);
+    write_message(message);
+    flush_targets();
 }
 
 void vprint(flag logflag, fmt::string_view format, fmt::format_args args)
@@ -239,7 +475,7 @@ void percent(uint64_t count, uint64_t max, bool displayElapsed)
 {
     bool expected = false;
 
-    if (!(logging::mask & flag::CLOCK_ELAPSED)) {
+    if (!(logging::mask & thread_mask & flag::CLOCK_ELAPSED)) {
         displayElapsed = false;
     }
 
@@ -330,9 +566,10 @@ void percent(uint64_t count, uint64_t max, bool displayElapsed)
 // percent_clock
 
 percent_clock::percent_clock(uint64_t i_max)
-    : max(i_max)
+    : max(i_max),
+      quiet(!(thread_mask & flag::PERCENT))
 {
-    if (max != 0) {
+    if (max != 0 && !quiet) {
         percent(0, max, displayElapsed);
     }
 }
@@ -341,10 +578,16 @@ void percent_clock::increase()
 {
 #ifdef _DEBUG
     if (count == max) {
-        logging::print("ERROR TO FIX LATER: clock counter increased to end, but not finished yet\n");
+        logging::print(logging::flag::FAILURE,
+            "ERROR TO FIX LATER: clock counter increased to end, but not finished yet\n");
     }
 #endif
 
+    if (quiet) {
+        count++;
+        return;
+    }
+
     percent(count++, max, displayElapsed);
 }
 
@@ -369,12 +612,14 @@ void percent_clock::print()
 #ifdef _DEBUG
     if (max != indeterminate) {
         if (count != max) {
-            logging::print("ERROR TO FIX LATER: clock counter ended too early\n");
+            logging::print(logging::flag::FAILURE, "ERROR TO FIX LATER: clock counter ended too early\n");
         }
     }
 #endif
 
-    percent(max, max, displayElapsed);
+    if (!quiet) {
+        percent(max, max, displayElapsed);
+    }
 }
 
 percent_clock::~percent_clock()
@@ -382,6 +627,58 @@ percent_clock::~percent_clock()
     print();
 }
 
+// parallel_progress
+
+// how often a worker reports the summed counters
+static constexpr auto parallel_progress_interval = std::chrono::milliseconds(100);
+
+parallel_progress::parallel_progress(uint64_t i_max)
+    : num_counters(std::max(1, tbb::this_task_arena::max_concurrency())),
+      max(i_max),
+      next_report((qclock::now() + parallel_progress_interval).time_since_epoch().count())
+{
+    counters = std::make_unique<counter_t[]>(num_counters);
+
+    if (max != 0) {
+        // start the clock before any work is done
+        percent(0, max);
+    }
+}
+
+parallel_progress::~parallel_progress()
+{
+    percent(max, max);
+}
+
+uint64_t parallel_progress::sample() const
+{
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < num_counters; i++) {
+        total += counters[i].value.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void parallel_progress::report(qclock::rep now)
+{
+    qclock::rep due = next_report.load(std::memory_order_relaxed);
+    const qclock::rep next = now + std::chrono::duration_cast<qclock::duration>(parallel_progress_interval).count();
+
+    // only the worker that moves the deadline forward reports
+    if (now < due || !next_report.compare_exchange_strong(due, next, std::memory_order_relaxed)) {
+        return;
+    }
+
+    const uint64_t count = sample();
+
+    // reaching `max` finishes the clock, which is left to the destructor
+    if (count < max) {
+        percent(count, max);
+    }
+}
+
 // stat_tracker_t
 
 stat_tracker_t::stat &stat_tracker_t::register_stat(const std::string &name, bool show_even_if_zero, bool is_warning)
@@ -425,7 +722,11 @@ void stat_tracker_t::print_stats()
 
     for (auto &stat : stats) {
         if (stat.show_even_if_zero || stat.count) {
-            print(flag::STAT, "{}{:{}} {}\n", stat.is_warning ? "WARNING: " : "", fmt::group_digits(stat.count.load()),
+            // warnings are still only shown along with the other stats
+            const flag logflag =
+                (stat.is_warning && (mask & thread_mask & flag::STAT)) ? flag::WARNING : flag::STAT;
+
+            print(logflag, "{}{:{}} {}\n", stat.is_warning ? "WARNING: " : "", fmt::group_digits(stat.count.load()),
                 stat.is_warning ? 0 : number_padding, stat.name);
         }
     }
@@ -444,7 +745,7 @@ ericwtools_error::ericwtools_error(const char *what)
 
 [[noreturn]] void exit_on_exception(const std::exception &e)
 {
-    logging::print("************ ERROR ************\n{}\n", e.what());
+    logging::print(logging::flag::FAILURE, "************ ERROR ************\n{}\n", e.what());
     logging::close();
     exit(1);
 }
@@ -36,8 +36,9 @@ void brush_side_t::validate_texture_projection()
     if (!is_valid_texture_projection()) {
         /*
         if (qbsp_options.verbose.value()) {
-        logging::print("WARNING: {}: repairing invalid texture projection (\"{}\" near {} {} {})\n", mapface.line,
-        mapface.texname, (int)mapface.planepts[0][0], (int)mapface.planepts[0][1], (int)mapface.planepts[0][2]);
+        logging::print(logging::flag::WARNING,
+            "WARNING: {}: repairing invalid texture projection (\"{}\" near {} {} {})\n", mapface.line, mapface.texname,
+            (int)mapface.planepts[0][0], (int)mapface.planepts[0][1], (int)mapface.planepts[0][2]);
         } else {
         issue_stats.num_repaired++;
         }
@@ -327,7 +328,8 @@ void brush_side_t::set_texinfo(const texdef_etp_t &texdef)
      */
     double determinant = a * d - b * c;
     if (fabs(determinant) < ZERO_EPSILON) {
-        logging::print("WARNING: {}: Face with degenerate QuArK-style texture axes\n", location);
+        logging::print(logging::flag::WARNING, "WARNING: {}: Face with degenerate QuArK-style texture axes\n",
+            location);
         for (size_t i = 0; i < 3; i++) {
             vecs.at(0, i) = vecs.at(1, i) = 0;
         }
@@ -981,7 +983,7 @@ void brush_t::parse_brush_face(parser_t &parser, texcoord_style_t base_format)
     side.parse_texture_def(parser, base_format);
 
     if (length < NORMAL_EPSILON) {
-        logging::print("WARNING: {}: Brush plane with no normal\n", parser.location);
+        logging::print(logging::flag::WARNING, "WARNING: {}: Brush plane with no normal\n", parser.location);
         return;
     }
 
@@ -178,13 +178,15 @@ skipspace:
                         break;
                     case '\"':
                         if (pos[2] == '\r' || pos[2] == '\n') {
-                            logging::print("WARNING: {}: escaped double-quote at end of string\n", location);
+                            logging::print(logging::flag::WARNING,
+                                "WARNING: {}: escaped double-quote at end of string\n", location);
                         } else {
                             *token_p++ = *pos++;
                         }
                         break;
                     default:
-                        logging::print("WARNING: {}: Unrecognised string escape - \\{}\n", location, pos[1]);
+                        logging::print(logging::flag::WARNING, "WARNING: {}: Unrecognised string escape - \\{}\n",
+                            location, pos[1]);
                         break;
                 }
             }
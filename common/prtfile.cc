@@ -33,8 +33,143 @@ constexpr const char *PORTALFILEAM = "PRT1-AM";
 
 constexpr size_t PRT_MAX_WINDING = 64;
 
+constexpr std::array<char, 4> PORTALFILEBIN_IDENT = {'P', 'R', 'T', 'B'};
+constexpr uint32_t PORTALFILEBIN_VERSION = 1;
+
+/*
+ * Binary portal file layout (all values little-endian):
+ *
+ *   char[4]  ident ("PRTB")
+ *   uint32   version
+ *   int32    portalleafs
+ *   int32    portalleafs_real
+ *   uint32   numportals
+ *   uint32   numleafinfos
+ *   numportals * {
+ *       uint32   numpoints
+ *       int32    leafnums[2]
+ *       numpoints * double[3]
+ *   }
+ *   numleafinfos * int32 cluster
+ *
+ * Unlike the text formats, this stores the prtfile_t exactly as vis
+ * consumes it: points aren't rounded and the cluster mapping is stored
+ * per leaf, so loading it needs no reconstruction.
+ */
+struct prtbin_header_t
+{
+    std::array<char, 4> ident;
+    uint32_t version;
+    int32_t portalleafs;
+    int32_t portalleafs_real;
+    uint32_t numportals;
+    uint32_t numleafinfos;
+
+    auto stream_data() { return std::tie(ident, version, portalleafs, portalleafs_real, numportals, numleafinfos); }
+};
+
+bool IsBinaryPortalFile(const fs::path &name)
+{
+    std::ifstream f(name, std::ios_base::in | std::ios_base::binary);
+    std::array<char, 4> ident{};
+
+    if (!f.read(ident.data(), ident.size())) {
+        return false;
+    }
+
+    return ident == PORTALFILEBIN_IDENT;
+}
+
+static prtfile_t LoadPrtFileBinary(const fs::path &name, const bspversion_t *loadversion)
+{
+    fs::mapped_data file_data = fs::map(name);
+
+    if (!file_data) {
+        FError("unable to load portal file {}\n", name);
+    }
+
+    imemstream stream(file_data.data(), file_data.size());
+    stream >> endianness<std::endian::little>;
+
+    prtbin_header_t header;
+    stream >= header;
+
+    if (!stream || header.ident != PORTALFILEBIN_IDENT)
+        FError("{} is not a binary portal file\n", name);
+    if (header.version != PORTALFILEBIN_VERSION)
+        FError("{} has unsupported binary portal file version {} (expected {})\n", name, header.version,
+            PORTALFILEBIN_VERSION);
+    if (header.portalleafs < 0 || header.portalleafs_real < 0)
+        FError("{} has a corrupt header\n", name);
+
+    // each portal takes at least 12 bytes and each leaf 4, so a corrupt
+    // count can't make us reserve more than the file could hold
+    if (header.numportals > file_data.size() / 12 || header.numleafinfos > file_data.size() / 4)
+        FError("{} has a corrupt header\n", name);
+
+    if (loadversion->game->id == GAME_QUAKE_II) {
+        // q2bsp has native cluster support; there's no leaf -> cluster mapping
+        if (header.portalleafs_real != 0 || header.numleafinfos != 0)
+            FError("{} was not written for Q2\n", name);
+    } else if (header.numleafinfos != static_cast<uint32_t>(header.portalleafs_real) + 1) {
+        FError("{} has {} leaf infos, expected {}\n", name, header.numleafinfos, header.portalleafs_real + 1);
+    }
+
+    prtfile_t result{};
+    result.portalleafs = header.portalleafs;
+    result.portalleafs_real = header.portalleafs_real;
+    result.portals.resize(header.numportals);
+
+    for (uint32_t i = 0; i < header.numportals; i++) {
+        prtfile_portal_t &p = result.portals[i];
+        uint32_t numpoints;
+
+        stream >= numpoints >= p.leafnums[0] >= p.leafnums[1];
+        if (!stream)
+            FError("reading portal {}", i);
+        if (numpoints > PRT_MAX_WINDING)
+            FError("portal {} has too many points", i);
+        if ((unsigned)p.leafnums[0] > (unsigned)result.portalleafs ||
+            (unsigned)p.leafnums[1] > (unsigned)result.portalleafs)
+            FError("out of bounds leaf in portal {}", i);
+
+        auto &w = p.winding;
+        w.resize(numpoints);
+
+        for (uint32_t j = 0; j < numpoints; j++) {
+            stream >= w[j][0] >= w[j][1] >= w[j][2];
+        }
+
+        if (!stream)
+            FError("reading portal {}", i);
+    }
+
+    result.dleafinfos.resize(header.numleafinfos);
+
+    for (uint32_t i = 0; i < header.numleafinfos; i++) {
+        int32_t cluster;
+        stream >= cluster;
+
+        if (!stream)
+            Error("Unexpected end of cluster map\n");
+        // leaf 0 is the solid leaf and isn't part of the mapping
+        if (i != 0 && (cluster < 0 || cluster >= result.portalleafs)) {
+            FError("Invalid cluster number {} in cluster map, number of clusters: {}\n", cluster,
+                result.portalleafs);
+        }
+
+        result.dleafinfos[i].cluster = cluster;
+    }
+
+    return result;
+}
+
 prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
 {
+    if (IsBinaryPortalFile(name)) {
+        return LoadPrtFileBinary(name, loadversion);
+    }
+
     std::ifstream f(name);
 
     /*
@@ -88,7 +223,7 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
         f >> numpoints >> p.leafnums[0] >> p.leafnums[1];
         if (f.bad())
             FError("reading portal {}", i);
-        if (numpoints > PRT_MAX_WINDING)
+        if (numpoints < 0 || static_cast<size_t>(numpoints) > PRT_MAX_WINDING)
             FError("portal {} has too many points", i);
         if ((unsigned)p.leafnums[0] > (unsigned)result.portalleafs ||
             (unsigned)p.leafnums[1] > (unsigned)result.portalleafs)
@@ -177,7 +312,7 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion)
 static void WriteDebugPortal(const polylib::winding_t &w, std::ofstream &portalFile)
 {
     ewt::print(portalFile, "{} {} {} ", w.size(), 0, 0);
-    for (int i = 0; i < w.size(); i++) {
+    for (size_t i = 0; i < w.size(); i++) {
         ewt::print(portalFile, "({} {} {}) ", w.at(i)[0], w.at(i)[1], w.at(i)[2]);
     }
     ewt::print(portalFile, "\n");
@@ -296,3 +431,37 @@ void WritePortalfile(
         WritePTR2ClusterMapping(portalFile, prtfile);
     }
 }
+
+/*
+================
+WritePortalfileBinary
+================
+*/
+void WritePortalfileBinary(const fs::path &name, const prtfile_t &prtfile)
+{
+    std::ofstream portalFile(name, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!portalFile)
+        FError("Failed to open {}: {}", name, strerror(errno));
+
+    portalFile << endianness<std::endian::little>;
+
+    prtbin_header_t header{PORTALFILEBIN_IDENT, PORTALFILEBIN_VERSION, prtfile.portalleafs, prtfile.portalleafs_real,
+        static_cast<uint32_t>(prtfile.portals.size()), static_cast<uint32_t>(prtfile.dleafinfos.size())};
+    portalFile <= header;
+
+    for (auto &portal : prtfile.portals) {
+        portalFile <= static_cast<uint32_t>(portal.winding.size()) <= static_cast<int32_t>(portal.leafnums[0]) <=
+            static_cast<int32_t>(portal.leafnums[1]);
+
+        for (auto &point : portal.winding) {
+            portalFile <= point[0] <= point[1] <= point[2];
+        }
+    }
+
+    for (auto &leafinfo : prtfile.dleafinfos) {
+        portalFile <= static_cast<int32_t>(leafinfo.cluster);
+    }
+
+    if (!portalFile)
+        FError("Failed to write {}: {}", name, strerror(errno));
+}
@@ -233,6 +233,7 @@ std::string setting_redirect::format() const
 setting_group performance_group{"Performance", 10, expected_source::commandline};
 setting_group logging_group{"Logging", 5, expected_source::commandline};
 setting_group game_group{"Game", 15, expected_source::commandline};
+setting_group testing_group{"Testing", 1000, expected_source::testing};
 
 // setting_container
 
@@ -535,9 +536,16 @@ void setting_container::set_settings(const entdict_t &epairs, source source)
 
 void setting_container::print_help(bool fatal)
 {
+    // written straight to stdout, after anything already logged
+    logging::flush();
+
     fmt::print("{}usage: {} [-help/-h/-?] [-options] {}\n\n", program_description, program_name, remainder_name);
 
     for (auto grouped : grouped()) {
+        if (grouped.first && grouped.first->type == expected_source::testing) {
+            continue;
+        }
+
         if (grouped.first) {
             fmt::print("{}:\n", grouped.first->name);
         }
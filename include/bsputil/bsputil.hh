@@ -88,6 +88,7 @@ public:
     settings::setting_func extract_bspx_lump;
     settings::setting_func insert_bspx_lump;
     settings::setting_func remove_bspx_lump;
+    settings::setting_func convert_portals;
     settings::setting_func svg;
 
     std::vector<std::unique_ptr<settings::setting_base>> operations;
@@ -28,7 +28,7 @@ struct decomp_options
     int hullnum = 0;
 };
 
-void DecompileBSP(const mbsp_t *bsp, const decomp_options &options, std::ofstream &file);
+void DecompileBSP(const mbsp_t *bsp, const decomp_options &options, std::ostream &file);
 
 struct leaf_visualization_t
 {
@@ -47,6 +47,10 @@ struct archive_like
     virtual bool contains(const path &filename) = 0;
 
     virtual data load(const path &filename) = 0;
+
+    // if the file is stored loose on disk, the path to it;
+    // nullopt for files packed inside of an archive
+    virtual std::optional<path> loose_path(const path &filename) { return std::nullopt; }
 };
 
 // clear all initialized/loaded data from fs
@@ -87,6 +91,48 @@ data load(const resolve_result &pos);
 // shortcut to load(where(p))
 data load(const path &p, bool prefer_loose = false);
 
+// read-only view over the contents of a file. Loose files are
+// memory-mapped so large files (ie, .bsp) can be parsed without first
+// copying them to the heap; files inside of archives are loaded normally.
+class mapped_data
+{
+    const uint8_t *base = nullptr;
+    size_t length = 0;
+    std::vector<uint8_t> fallback;
+    bool valid = false, mapped = false;
+#ifdef _WIN32
+    void *file_handle = nullptr, *mapping_handle = nullptr;
+#endif
+
+    void unmap();
+
+public:
+    mapped_data() = default;
+    explicit mapped_data(std::vector<uint8_t> &&data);
+    mapped_data(mapped_data &&other) noexcept;
+    mapped_data &operator=(mapped_data &&other) noexcept;
+    mapped_data(const mapped_data &) = delete;
+    mapped_data &operator=(const mapped_data &) = delete;
+    ~mapped_data();
+
+    // map the specified loose file; empty result on failure
+    static mapped_data map_file(const path &p);
+
+    inline const uint8_t *data() const { return base; }
+    inline size_t size() const { return length; }
+    inline const uint8_t *begin() const { return base; }
+    inline const uint8_t *end() const { return base + length; }
+    inline bool is_mapped() const { return mapped; }
+    inline explicit operator bool() const { return valid; }
+};
+
+// attempt to map the specified resolve result; falls back to
+// load() for files that aren't loose.
+mapped_data map(const resolve_result &pos);
+
+// shortcut to map(where(p))
+mapped_data map(const path &p, bool prefer_loose = false);
+
 struct archive_components
 {
     path archive, filename;
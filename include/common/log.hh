@@ -55,12 +55,31 @@ enum class flag : uint8_t
     PERCENT = nth_bit(3), // prints everywhere, if enabled
     STAT = nth_bit(4), // prints everywhere, if enabled
     CLOCK_ELAPSED = nth_bit(5), // overrides displayElapsed if disabled
+    WARNING = nth_bit(6), // prints everywhere, highlighted
+    FAILURE = nth_bit(7), // prints everywhere, highlighted (ERROR is a windows.h macro)
     ALL = 0xFF
 };
 
 extern bitflags<flag> mask;
+// flags masked out on the calling thread only, on top of `mask`; see thread_mask_scope
+extern thread_local bitflags<flag> thread_mask;
 extern bool enable_color_codes;
 
+// masks `flags` out of this thread's output while in scope, without
+// silencing whatever other threads print at the same time
+struct thread_mask_scope
+{
+    bitflags<flag> prev_mask;
+
+    inline thread_mask_scope(bitflags<flag> flags)
+        : prev_mask(thread_mask)
+    {
+        thread_mask &= ~flags;
+    }
+
+    inline ~thread_mask_scope() { thread_mask = prev_mask; }
+};
+
 // Windows: calls SetConsoleMode for ANSI escape sequence processing (so colors work)
 void preinitialize();
 
@@ -70,6 +89,10 @@ void init(std::optional<fs::path> filename, const settings::common_settings &set
 // shutdown logging subsystem
 void close();
 
+// Output is written to stdout and the log file by a background thread;
+// this blocks until everything printed so far has been written out.
+void flush();
+
 // print to respective targets based on log flag
 void print(flag logflag, const char *str);
 
@@ -87,7 +110,7 @@ void vprint(fmt::string_view format, fmt::format_args args);
 template<typename... T>
 inline void print(flag type, fmt::format_string<T...> format, T &&...args)
 {
-    if (mask & type) {
+    if (mask & thread_mask & type) {
         vprint(type, format, fmt::make_format_args(args...));
     }
 }
@@ -109,9 +132,11 @@ void header(const char *name);
 // TODO: C++20 source_location
 #ifdef _MSC_VER
 #define funcprint(fmt, ...) print("{}: " fmt, __FUNCTION__, ##__VA_ARGS__)
+#define funcwarning(fmt, ...) print(logging::flag::WARNING, "{}: " fmt, __FUNCTION__, ##__VA_ARGS__)
 #define funcheader() header(__FUNCTION__)
 #else
 #define funcprint(fmt, ...) print("{}: " fmt, __func__, ##__VA_ARGS__)
+#define funcwarning(fmt, ...) print(logging::flag::WARNING, "{}: " fmt, __func__, ##__VA_ARGS__)
 #define funcheader() header(__func__)
 #endif
 
@@ -142,6 +167,9 @@ struct percent_clock
     bool displayElapsed = true;
     std::atomic<uint64_t> count = 0;
     bool ready = true;
+    // created on a thread with PERCENT masked out; only counts, since percent()
+    // is shared with whatever clock is running on the other threads
+    bool quiet;
 
     // runs a tick immediately to show up on stdout
     // unless max is zero
@@ -21,53 +21,129 @@
 #pragma once
 
 #include "common/log.hh"
+#include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
+#include <tbb/task_arena.h>
 
 #include <atomic>
+#include <iterator>
+#include <memory>
+#include <type_traits>
 
 // parallel extensions to logging
 namespace logging
 {
+// Progress for a single parallel loop. Each worker adds the items it has
+// finished to its own cache-line-sized counter, so the workers never write
+// anything shared per item. percent() is driven by whichever worker first
+// notices the report interval has passed; the others skip it after one
+// relaxed load.
+class parallel_progress
+{
+    struct alignas(64) counter_t
+    {
+        std::atomic<uint64_t> value = 0;
+    };
+
+    std::unique_ptr<counter_t[]> counters;
+    size_t num_counters;
+    uint64_t max;
+
+    // qclock ticks at which the next report is due
+    std::atomic<qclock::rep> next_report;
+
+    uint64_t sample() const;
+    void report(qclock::rep now);
+
+public:
+    parallel_progress(uint64_t max);
+
+    // finishes the percent() clock
+    ~parallel_progress();
+
+    // called by a worker after finishing `count` items
+    inline void add(uint64_t count)
+    {
+        size_t index = static_cast<size_t>(tbb::this_task_arena::current_thread_index());
+
+        // not a worker of the arena we were created in; still correct,
+        // just shares a counter
+        if (index >= num_counters) {
+            index = 0;
+        }
+
+        counters[index].value.fetch_add(count, std::memory_order_relaxed);
+
+        const qclock::rep now = qclock::now().time_since_epoch().count();
+
+        if (now >= next_report.load(std::memory_order_relaxed)) {
+            report(now);
+        }
+    }
+};
+
 template<typename TS, typename TE, typename Body>
 void parallel_for(const TS &start, const TE &end, const Body &func)
 {
-    auto length = end - start;
-    std::atomic<uint64_t> progress = 0;
+    using index_t = std::common_type_t<TS, TE>;
 
-    tbb::parallel_for(start, end, [&](const auto &it) {
-        percent(progress++, length);
-        func(it);
-    });
+    parallel_progress progress(end - start);
+
+    tbb::parallel_for(tbb::blocked_range<index_t>(start, end), [&](const tbb::blocked_range<index_t> &range) {
+        for (index_t it = range.begin(); it != range.end(); ++it) {
+            func(it);
+        }
 
-    percent(progress, length);
+        progress.add(range.size());
+    });
 }
 
 template<typename Container, typename Body>
 void parallel_for_each(Container &container, const Body &func)
 {
-    auto length = std::size(container);
-    std::atomic<uint64_t> progress = 0;
-
-    tbb::parallel_for_each(container, [&](auto &f) {
-        percent(progress++, length);
-        func(f);
-    });
-
-    percent(progress, length);
+    parallel_progress progress(std::size(container));
+
+    if constexpr (std::random_access_iterator<decltype(std::begin(container))>) {
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, std::size(container)), [&](const tbb::blocked_range<size_t> &range) {
+                auto it = std::begin(container) + range.begin();
+
+                for (size_t i = range.begin(); i != range.end(); ++i, ++it) {
+                    func(*it);
+                }
+
+                progress.add(range.size());
+            });
+    } else {
+        tbb::parallel_for_each(container, [&](auto &f) {
+            func(f);
+            progress.add(1);
+        });
+    }
 }
 
 template<typename Container, typename Body>
 void parallel_for_each(const Container &container, const Body &func)
 {
-    auto length = std::size(container);
-    std::atomic<uint64_t> progress = 0;
-
-    tbb::parallel_for_each(container, [&](const auto &f) {
-        percent(progress++, length);
-        func(f);
-    });
-
-    percent(progress, length);
+    parallel_progress progress(std::size(container));
+
+    if constexpr (std::random_access_iterator<decltype(std::begin(container))>) {
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, std::size(container)), [&](const tbb::blocked_range<size_t> &range) {
+                auto it = std::begin(container) + range.begin();
+
+                for (size_t i = range.begin(); i != range.end(); ++i, ++it) {
+                    func(*it);
+                }
+
+                progress.add(range.size());
+            });
+    } else {
+        tbb::parallel_for_each(container, [&](const auto &f) {
+            func(f);
+            progress.add(1);
+        });
+    }
 }
-} // namespace logging
\ No newline at end of file
+} // namespace logging
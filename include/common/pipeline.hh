@@ -0,0 +1,44 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#pragma once
+
+#include <common/bspfile.hh>
+#include <common/json.hh>
+#include <common/prtfile.hh>
+
+#include <optional>
+
+// Compile results handed from one tool to the next when qbsp, vis and
+// light are run in the same process, in place of the .bsp, .prt and
+// .texinfo.json files they would otherwise write and parse back.
+struct pipeline_data_t
+{
+    // the compiled bsp. qbsp leaves it in the output format; vis leaves
+    // it in the generic format, since light converts to that anyway.
+    bspdata_t bspdata{};
+
+    // vis portals, as they would have been written to the .prt file.
+    // unset if qbsp didn't generate them (e.g. the map leaked)
+    std::optional<prtfile_t> portals;
+
+    // extended texinfo flags, as they would have been written to the
+    // .texinfo.json file; null if there are none
+    json extended_texinfo_flags;
+};
@@ -54,4 +54,9 @@ prtfile_t LoadPrtFile(const fs::path &name, const bspversion_t *loadversion);
 void WritePortalfile(
     const fs::path &name, const prtfile_t &prtfile, const bspversion_t *loadversion, bool uses_detail, bool forceprt1);
 
+// binary (.prtb) portal file: little-endian, exact doubles, and the leaf -> cluster
+// mapping stored as-is. LoadPrtFile detects and reads these too.
+bool IsBinaryPortalFile(const fs::path &name);
+void WritePortalfileBinary(const fs::path &name, const prtfile_t &prtfile);
+
 void WriteDebugPortals(const std::vector<polylib::winding_t> &portals, fs::path name);
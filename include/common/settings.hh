@@ -77,7 +77,10 @@ public:
 enum class expected_source
 {
     commandline,
-    worldspawn
+    worldspawn,
+    // command-line only, for checking an optimization against its plain
+    // reference path; left out of -help and the documentation
+    testing
 };
 
 struct setting_group
@@ -290,10 +293,12 @@ public:
     void set_value(const T &f, source new_source) override
     {
         if (f < _min) {
-            logging::print("WARNING: '{}': {} is less than minimum value {}.\n", this->primary_name(), f, _min);
+            logging::print(logging::flag::WARNING, "WARNING: '{}': {} is less than minimum value {}.\n",
+                this->primary_name(), f, _min);
         }
         if (f > _max) {
-            logging::print("WARNING: '{}': {} is greater than maximum value {}.\n", this->primary_name(), f, _max);
+            logging::print(logging::flag::WARNING, "WARNING: '{}': {} is greater than maximum value {}.\n",
+                this->primary_name(), f, _max);
         }
 
         this->setting_value<T>::set_value(std::clamp(f, _min, _max), new_source);
@@ -595,7 +600,7 @@ public:
 };
 
 // global groups
-extern setting_group performance_group, logging_group, game_group;
+extern setting_group performance_group, logging_group, game_group, testing_group;
 
 enum class search_priority_t
 {
@@ -43,7 +43,6 @@ constexpr float MAX_SKY_DIST = 1000000;
 struct lightsample_t
 {
     qvec3f color;
-    qvec3f direction;
 };
 
 // CHECK: isn't average a bad algorithm for color brightness?
@@ -80,6 +79,8 @@ class lightmap_t
 public:
     int style;
     std::vector<lightsample_t> samples;
+    // per-sample light direction; only allocated when a .lux file or LIGHTINGDIR lump is written
+    std::vector<qvec3f> directions;
     qvec3f bounce_color;
 };
 
@@ -408,6 +409,8 @@ public:
     setting_bool lightgrid;
     setting_vec3 lightgrid_dist;
     setting_enum<lightgrid_format_t> lightgrid_format;
+    setting_bool lightgrid_adaptive;
+    setting_scalar lightgrid_adaptive_threshold;
 
     setting_func dirtdebug;
     setting_func bouncedebug;
@@ -418,6 +421,12 @@ public:
     setting_func debugneighbours;
     setting_func debugmottle;
     setting_bool debug_lightgrid_octree;
+    setting_bool noraypackets;
+    setting_bool lightstats;
+    setting_bool nosurflightbvh;
+    setting_bool nolightbvh;
+    setting_bool nostreamlightmaps;
+    setting_bool nobatchsky;
 
     light_settings();
 
@@ -464,3 +473,7 @@ const qvec3f &Face_LookupTextureBounceColor(const mbsp_t *bsp, const mface_t *fa
 void light_reset();
 int light_main(int argc, const char **argv);
 int light_main(const std::vector<std::string> &args);
+struct pipeline_data_t;
+// run light on the bsp in `data` instead of loading it from disk, using
+// the extended texinfo flags qbsp left there; the lit .bsp is still written
+int light_main(const std::vector<std::string> &args, pipeline_data_t &data);
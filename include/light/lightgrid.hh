@@ -25,3 +25,7 @@ struct bspdata_t;
 
 std::tuple<lightgrid_samples_t, bool> FixPointAndCalcLightgrid(const mbsp_t *bsp, qvec3f world_point);
 void LightGrid(bspdata_t *bspdata);
+
+// number of grid points traced by the last LightGrid call; with -lightgrid_adaptive
+// this excludes the interpolated and skipped points
+size_t LightGridPointsTraced();
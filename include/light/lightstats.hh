@@ -0,0 +1,101 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#pragma once
+
+#include <common/cmdlib.hh>
+#include <common/fs.hh>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+struct mbsp_t;
+
+// Per-thread instrumentation for the light pipeline. Counters are always
+// collected (per thread, merged at the end); -lightstats additionally
+// writes a JSON report next to the bsp.
+
+enum class lightstat_source_t : uint8_t
+{
+    ENTITY,
+    SKY,
+    SURFACE,
+    BOUNCE,
+    DIRT,
+    MINLIGHT,
+    COUNT
+};
+
+enum class lightstat_phase_t : uint8_t
+{
+    DIRECT,
+    INDIRECT,
+    POSTPROCESS,
+    COUNT
+};
+
+constexpr size_t LIGHTSTAT_SOURCES = static_cast<size_t>(lightstat_source_t::COUNT);
+constexpr size_t LIGHTSTAT_PHASES = static_cast<size_t>(lightstat_phase_t::COUNT);
+
+// number of faces/lights listed in the JSON report
+constexpr size_t LIGHTSTAT_TOP_N = 32;
+
+// the emitter of rays that don't come from a light, i.e. dirt
+constexpr size_t LIGHTSTAT_NO_LIGHT = std::numeric_limits<size_t>::max();
+
+// prepare for lighting `numfaces` faces; clears any previous data.
+// the lights and suns must already be set up.
+void LightStats_Init(size_t numfaces);
+void ResetLightStats();
+
+// record one batch of rays traced for `face` from `source`.
+// `light` is the emitter's index: into GetLights() for entity and minlight
+// rays, into GetSuns() for sky rays, or the face number of the emitting
+// surface for surface and bounce rays; LIGHTSTAT_NO_LIGHT for dirt.
+// `elapsed` is how long the batch took.
+void LightStats_AddRays(lightstat_source_t source, int32_t face, size_t light, size_t rays, size_t occluded,
+    qclock::duration elapsed);
+// as above, for a batch that began at `start` and just finished
+void LightStats_AddRays(lightstat_source_t source, int32_t face, size_t light, size_t rays, size_t occluded,
+    qclock::time_point start);
+
+// times one of DirectLightFace / IndirectLightFace / PostProcessLightFace
+// for a single face
+class lightstats_phase_timer_t
+{
+    lightstat_phase_t phase;
+    int32_t face;
+    qclock::time_point start;
+
+public:
+    inline lightstats_phase_timer_t(lightstat_phase_t phase, int32_t face)
+        : phase(phase),
+          face(face),
+          start(qclock::now())
+    {
+    }
+    ~lightstats_phase_timer_t();
+};
+
+// print the merged totals
+void LightStats_Print();
+
+// write the merged totals, plus the most expensive faces and lights, as JSON
+void LightStats_WriteJSON(const mbsp_t *bsp, const fs::path &filename);
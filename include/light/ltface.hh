@@ -37,15 +37,12 @@ class faceextents_t;
 class light_t;
 struct facesup_t;
 
-#if 0
-extern std::atomic<uint32_t> total_light_rays, total_light_ray_hits, total_samplepoints;
-extern std::atomic<uint32_t> total_bounce_rays, total_bounce_ray_hits;
-extern std::atomic<uint32_t> total_surflight_rays, total_surflight_ray_hits; // mxd
-#endif
 extern std::atomic<uint32_t> fully_transparent_lightmaps; // write.cc
 
 void PrintFaceInfo(const mface_t *face, const mbsp_t *bsp);
 void SetupDirt(settings::worldspawn_keys &cfg);
+// builds the light entity BVH DirectLightFace uses to cull lights; call after SetupLights
+void BuildLightBVH(const settings::worldspawn_keys &cfg);
 lightsurf_t CreateLightmapSurface(const mbsp_t *bsp, const mface_t *face, const facesup_t *facesup,
     const bspx_decoupled_lm_perface *facesup_decoupled, const settings::worldspawn_keys &cfg);
 bool Face_IsLightmapped(const mbsp_t *bsp, const mface_t *face);
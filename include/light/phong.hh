@@ -22,6 +22,7 @@
 
 #include <set>
 #include <map>
+#include <span>
 #include <vector>
 
 #include <common/qvec.hh>
@@ -38,8 +39,9 @@ struct neighbour_t
 void CalculateVertexNormals(const mbsp_t *bsp);
 const face_normal_t &GetSurfaceVertexNormal(const mbsp_t *bsp, const mface_t *f, const int vertindex);
 bool FacesSmoothed(const mface_t *f1, const mface_t *f2);
-const std::set<const mface_t *> &GetSmoothFaces(const mface_t *face);
-const std::vector<const mface_t *> &GetPlaneFaces(const mface_t *face);
+// faces to smooth with / faces on the same plane, sorted in face order
+std::span<const mface_t *const> GetSmoothFaces(const mface_t *face);
+std::span<const mface_t *const> GetPlaneFaces(const mface_t *face);
 const mface_t *Face_EdgeIndexSmoothed(const mbsp_t *bsp, const mface_t *f, const int edgeindex);
 int Q2_FacePhongValue(const mbsp_t *bsp, const mface_t *face);
 
@@ -47,7 +49,7 @@ int Q2_FacePhongValue(const mbsp_t *bsp, const mface_t *face);
 using edgeToFaceMap_t = std::map<std::pair<int, int>, std::vector<const mface_t *>>;
 
 std::vector<neighbour_t> NeighbouringFaces_new(const mbsp_t *bsp, const mface_t *face);
-std::vector<const mface_t *> FacesUsingVert(int vertnum);
+std::span<const mface_t *const> FacesUsingVert(int vertnum);
 const edgeToFaceMap_t &GetEdgeToFaceMap();
 
 class face_cache_t
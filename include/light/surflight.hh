@@ -23,6 +23,7 @@ See file, 'COPYING', for details.
 #include <vector>
 #include <optional>
 #include <tuple>
+#include <limits>
 
 #include <common/qvec.hh>
 #include <common/aabb.hh>
@@ -71,9 +72,78 @@ struct surfacelight_t
 };
 
 class light_t;
+struct lightsurf_t;
+
+/**
+ * Bounding volume hierarchy over the styles of the emissive surfaces that
+ * share one bounce level. Each node holds aggregate bounds of its subtree
+ * so callers can reject whole groups of surface lights at once.
+ */
+struct surflight_bvh_t
+{
+    // one style of one emissive surface
+    struct entry_t
+    {
+        uint32_t surf; // index into EmissiveLightSurfaces()
+        uint32_t style; // index into surfacelight_t::styles
+    };
+
+    struct node_t
+    {
+        aabb3f bounds; // of surfacelight_t::pos
+        aabb3f visible_bounds; // union of surfacelight_t::bounds, only set for -visapprox rays
+        // largest totalintensity * max color component, for non-sky/sky styles
+        float max_intensity[2] = {};
+        float min_atten = std::numeric_limits<float>::max();
+        // leafs: range of entries. inner nodes: first is the index of the left child; right child follows it
+        uint32_t first = 0;
+        uint32_t count = 0;
+
+        constexpr bool is_leaf() const { return count != 0; }
+    };
+
+    std::vector<node_t> nodes;
+    std::vector<entry_t> entries;
+
+    /**
+     * Calls f(entry) for each entry in every leaf whose ancestors all pass
+     * !cull(node). Entries come out in tree order, not surface order.
+     */
+    template<typename Cull, typename F>
+    void for_each(Cull &&cull, F &&f) const
+    {
+        if (nodes.empty()) {
+            return;
+        }
+
+        uint32_t stack[64];
+        size_t stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while (stack_size) {
+            const node_t &node = nodes[stack[--stack_size]];
+
+            if (cull(node)) {
+                continue;
+            }
+
+            if (node.is_leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    f(entries[i]);
+                }
+            } else {
+                stack[stack_size++] = node.first + 1;
+                stack[stack_size++] = node.first;
+            }
+        }
+    }
+};
 
 void ResetSurflight();
 size_t GetSurflightPoints();
 std::optional<std::tuple<int32_t, int32_t, qvec3f, light_t *>> IsSurfaceLitFace(const mbsp_t *bsp, const mface_t *face);
 const std::vector<int> &SurfaceLightsForFaceNum(int facenum);
 void MakeRadiositySurfaceLights(const settings::worldspawn_keys &cfg, const mbsp_t *bsp);
+void BuildSurfaceLightBVHs(const std::vector<lightsurf_t *> &emissive_surfaces);
+// returns nullptr if there are no surface lights at this bounce level
+const surflight_bvh_t *SurfaceLightBVH(std::optional<size_t> bounce_level);
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <common/aligned_allocator.hh>
+#include <common/aabb.hh>
 #include <common/qvec.hh>
 #include <common/log.hh> // for FError
 
@@ -47,6 +48,8 @@ struct texture;
 
 void ResetEmbree();
 void Embree_TraceInit(const mbsp_t *bsp);
+// bounds of all of the geometry in the scene; nothing can be hit outside of this
+const aabb3f &Embree_SceneBounds();
 const std::set<const mface_t *> &ShadowCastingSolidFacesSet();
 
 struct ray_io
@@ -77,6 +80,17 @@ class raystream_embree_common_t
 {
 protected:
     aligned_vector<ray_io> _rays;
+#ifdef HAVE_EMBREE4
+    // (sort key, ray index) scratch space for packet tracing
+    std::vector<std::pair<uint64_t, uint32_t>> _packet_order;
+
+    // trace all of _rays, as 8-wide packets of coherent rays unless -noraypackets is set
+    void traceOccluded(RTCOccludedArguments *args);
+    void traceIntersection(RTCIntersectArguments *args);
+
+private:
+    void sortRaysForPackets();
+#endif
 
 public:
     inline raystream_embree_common_t() = default;
@@ -235,8 +249,7 @@ public:
 
 #ifdef HAVE_EMBREE4
         RTCIntersectArguments embree4_args = ctx2.setup_intersection_arguments();
-        for (auto &ray : _rays)
-            rtcIntersect1(scene, &ray.ray, &embree4_args);
+        traceIntersection(&embree4_args);
 #else
         rtcIntersect1M(scene, &ctx2, &_rays.data()->ray, _rays.size(), sizeof(_rays[0]));
 #endif
@@ -299,8 +312,7 @@ public:
         ray_source_info ctx2(this, self, shadowmask);
 #ifdef HAVE_EMBREE4
         RTCOccludedArguments embree4_args = ctx2.setup_occluded_arguments();
-        for (auto &ray : _rays)
-            rtcOccluded1(scene, &ray.ray.ray, &embree4_args);
+        traceOccluded(&embree4_args);
 #else
         rtcOccluded1M(scene, &ctx2, &_rays.data()->ray.ray, _rays.size(), sizeof(_rays[0]));
 #endif
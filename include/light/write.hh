@@ -45,4 +45,9 @@ void WriteLitFile(const mbsp_t *bsp, const std::vector<facesup_t> &facesup, cons
     const std::vector<uint8_t> &hdr_filebase);
 void WriteLuxFile(const mbsp_t *bsp, const fs::path &filename, int version, const std::vector<uint8_t> &lux_filebase);
 
+// without bounce, LightWorld writes each face's lightmaps as soon as the face is lit,
+// instead of keeping every face's samples until SaveLightmapSurfaces
+void BeginStreamingLightmapSurfaces(const mbsp_t *bsp);
+void StreamLightmapSurface(mbsp_t *bsp, size_t facenum);
+void ResetLightmapStream();
 void SaveLightmapSurfaces(bspdata_t *bspdata, const fs::path &source);
@@ -23,11 +23,15 @@
 
 #include <qbsp/winding.hh>
 #include <common/aabb.hh>
+#include <array>
+#include <cstddef>
 #include <optional>
 #include <list>
 #include <vector>
 #include <memory>
 
+#include <tbb/enumerable_thread_specific.h>
+
 class mapentity_t;
 struct maptexinfo_t;
 struct mapface_t;
@@ -42,6 +46,7 @@ struct side_t
     bool onnode; // has this face been used as a BSP node plane yet?
     bool bevel; // don't ever use for bsp splitting
     mapface_t *source; // the mapface we were generated from
+    uint8_t hullnum = 0; // which of source's per-hull visibility flags we use
 
     bool tested;
 
@@ -49,6 +54,7 @@ struct side_t
     side_t clone() const;
 
     bool is_visible() const;
+    void set_visible(bool visible);
     const maptexinfo_t &get_texinfo() const;
     const qbsp_plane_t &get_plane() const;
     const qbsp_plane_t &get_positive_plane() const;
@@ -56,11 +62,119 @@ struct side_t
 
 class mapbrush_t;
 
+/*
+ * Memory pool for the brush fragments that BrushBSP creates and destroys
+ * while splitting. Each thread carves blocks out of its own chunks and
+ * recycles freed blocks through its own free lists, so allocation takes no
+ * locks and doesn't touch the global heap once the pool is warm.
+ *
+ * Chunks are only released by clear() or destruction, so everything
+ * allocated from the pool must be gone by then.
+ */
+class bspbrush_pool_t
+{
+public:
+    bspbrush_pool_t() = default;
+    bspbrush_pool_t(const bspbrush_pool_t &) = delete;
+    bspbrush_pool_t &operator=(const bspbrush_pool_t &) = delete;
+
+    void *allocate(size_t bytes);
+    void deallocate(void *ptr, size_t bytes);
+
+    // release all chunks; nothing may still be allocated from the pool
+    void clear();
+
+    // true if every block allocated from the pool has been freed. must not
+    // race with allocate/deallocate
+    bool empty() const;
+
+    // chunk memory held by all threads. freed blocks are recycled rather
+    // than released, so this is also the peak usage since the last clear()
+    size_t reserved_bytes() const;
+
+    // blocks are aligned to this
+    static constexpr size_t alignment = 16;
+
+private:
+    // block sizes are rounded up to a multiple of this; anything bigger
+    // than the largest size class comes from the heap instead
+    static constexpr size_t block_granularity = 64;
+    static constexpr size_t num_size_classes = 32;
+    static constexpr size_t chunk_size = 64 * 1024;
+
+    struct free_block_t
+    {
+        free_block_t *next;
+    };
+
+    struct thread_pool_t
+    {
+        std::array<free_block_t *, num_size_classes> free_blocks{};
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        std::byte *cursor = nullptr, *end = nullptr;
+        // blocks allocated minus blocks freed by this thread; only the sum
+        // over all threads is meaningful
+        ptrdiff_t live_blocks = 0;
+    };
+
+    tbb::enumerable_thread_specific<thread_pool_t> threads;
+};
+
+// std allocator that allocates from a bspbrush_pool_t, or from the heap if
+// it has no pool
+template<typename T>
+struct bspbrush_allocator_t
+{
+    static_assert(alignof(T) <= bspbrush_pool_t::alignment);
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    bspbrush_pool_t *pool = nullptr;
+
+    bspbrush_allocator_t() = default;
+    explicit bspbrush_allocator_t(bspbrush_pool_t *pool)
+        : pool(pool)
+    {
+    }
+    template<typename U>
+    bspbrush_allocator_t(const bspbrush_allocator_t<U> &other)
+        : pool(other.pool)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        if (!pool) {
+            return std::allocator<T>().allocate(n);
+        }
+        return static_cast<T *>(pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if (!pool) {
+            std::allocator<T>().deallocate(p, n);
+        } else {
+            pool->deallocate(p, n * sizeof(T));
+        }
+    }
+
+    template<typename U>
+    bool operator==(const bspbrush_allocator_t<U> &other) const
+    {
+        return pool == other.pool;
+    }
+};
+
 struct bspbrush_t
 {
     using ptr = std::shared_ptr<bspbrush_t>;
     using container = std::vector<ptr>;
     using list = std::list<ptr>;
+    using side_container = std::vector<side_t, bspbrush_allocator_t<side_t>>;
 
     template<typename... Args>
     static inline ptr make_ptr(Args &&...args)
@@ -68,6 +182,19 @@ struct bspbrush_t
         return std::make_shared<bspbrush_t>(std::forward<Args>(args)...);
     }
 
+    // make an empty brush whose memory (sides included) comes from `pool`,
+    // or from the heap if `pool` is null
+    static inline ptr make_pooled(bspbrush_pool_t *pool)
+    {
+        if (!pool) {
+            return make_ptr();
+        }
+
+        auto brush = std::allocate_shared<bspbrush_t>(bspbrush_allocator_t<bspbrush_t>(pool));
+        brush->sides = side_container(bspbrush_allocator_t<side_t>(pool));
+        return brush;
+    }
+
     /**
      * The brushes in main brush vectors are considered originals. Brush fragments created during
      * the BrushBSP will have this pointing back to the original brush in the list.
@@ -80,7 +207,7 @@ struct bspbrush_t
 
     aabb3d bounds;
     int side, testside; // side of node during construction
-    std::vector<side_t> sides;
+    side_container sides;
     contentflags_t contents; /* BSP contents */
 
     qvec3d sphere_origin;
@@ -37,6 +37,10 @@
 #include <shared_mutex>
 #include <string_view>
 
+#include <tbb/concurrent_vector.h>
+
+struct pipeline_data_t;
+
 struct mapface_t
 {
     size_t planenum;
@@ -68,9 +72,11 @@ struct mapface_t
     // with no transformations; this is for conversions only.
     std::optional<extended_texinfo_t> raw_info;
 
-    bool visible; // can any part of this side be seen from non-void parts of the level?
-                  // non-visible means we can discard the brush side
-                  // (avoiding generating a BSP spit, so expanding it outwards)
+    // can any part of this side be seen from non-void parts of the level?
+    // non-visible means we can discard the brush side
+    // (avoiding generating a BSP spit, so expanding it outwards)
+    // tracked per hull, since the collision hulls are built concurrently
+    std::array<bool, MAX_MAP_HULLS_H2> visible{};
 
     // this face is a bevel added by AddBrushBevels, and shouldn't be used as a splitter
     // for the main hull.
@@ -191,8 +197,9 @@ struct mapdata_t
     // this vector stores all of the planes that can potentially be
     // output in the BSP, from the map's own sides. The positive planes
     // come first (are even-numbered, with 0 being even) and the negative
-    // planes are odd-numbered.
-    std::vector<mapplane_t> planes;
+    // planes are odd-numbered. Element addresses are stable, so
+    // references returned by get_plane survive concurrent insertion.
+    tbb::concurrent_vector<mapplane_t> planes;
 
     // planes indices (into the `planes` vector)
     std::unique_ptr<planehash_t> plane_hash;
@@ -204,6 +211,9 @@ struct mapdata_t
 
     std::optional<size_t> find_plane_nonfatal(const qplane3d &plane);
 
+    // as above, but the caller must hold the plane hash lock
+    std::optional<size_t> find_plane_unlocked(const qplane3d &plane);
+
     // find the specified plane in the list if it exists. throws
     // if not.
     size_t find_plane(const qplane3d &plane);
@@ -236,6 +246,11 @@ struct mapdata_t
 
     /* Misc other global state for the compile process */
     bool leakfile = false; /* Flag once we've written a leak (.por/.pts) file */
+    size_t leakfile_hull = 0; /* hull the leak file was written for, if leakfile is set */
+
+    // if set, the .bsp, .prt and .texinfo.json are handed over here
+    // instead of being written to disk (see ProcessFile)
+    pipeline_data_t *output = nullptr;
 
     // Final, exported BSP
     mbsp_t bsp;
@@ -333,7 +348,8 @@ void WriteEntitiesToString();
 qvec3d FixRotateOrigin(mapentity_t &entity);
 
 /* Create BSP brushes from map brushes */
-void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::container &brushes, size_t &num_clipped);
+void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::container &brushes, aabb3d &bounds,
+    size_t &num_clipped);
 
 size_t EmitFaces(node_t *headnode);
 void EmitVertices(node_t *headnode);
@@ -59,6 +59,13 @@ enum old_texcoord_style_t
     TX_BRUSHPRIM = 4
 };
 
+enum class portalformat_t
+{
+    text,
+    binary,
+    both
+};
+
 enum class conversion_t
 {
     none,
@@ -208,7 +215,9 @@ public:
     setting_scalar worldextent;
     setting_int32 leakdist;
     setting_bool forceprt1;
+    setting_enum<portalformat_t> portalformat;
     setting_tjunc tjunc;
+    setting_int32 tjunc_mwt_max_vertices;
     setting_bool objexport;
     setting_bool noextendedsurfflags;
     setting_bool wrbrushes;
@@ -457,6 +466,12 @@ struct node_t
 void InitQBSP(int argc, const char **argv);
 void InitQBSP(const std::vector<std::string> &args);
 void CountLeafs(node_t *headnode);
-void ProcessFile();
+
+struct pipeline_data_t;
+
+// compile the map set up by InitQBSP. if `output` is set, the compiled bsp,
+// vis portals and extended texinfo flags are moved into it instead of being
+// written to disk, to be passed on to vis/light in the same process.
+void ProcessFile(pipeline_data_t *output = nullptr);
 
 int qbsp_main(int argc, const char **argv);
@@ -48,6 +48,10 @@ struct tree_t
     // which kind of portals (cluster portals or leaf portals) are currently built?
     portaltype_t portaltype = portaltype_t::NONE;
 
+    // brush fragments and node volumes made by BrushBSP are allocated from here;
+    // declared before `nodes` so the nodes (and their volumes) are destroyed first
+    bspbrush_pool_t brush_pool;
+
     // here for ownership/memory management - not intended to be iterated directly
     //
     // concurrent_vector allows BrushBSP to insert nodes in parallel, and also
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <common/cmdlib.hh>
@@ -88,6 +89,25 @@ public:
 
     inline bool operator[](size_t index) const { return !!(bits[index >> shift] & nth_bit(index & mask)); }
 
+    // access for bit strings that other threads may be modifying at the same time
+
+    inline uint32_t atomic_block(size_t block_index) const
+    {
+        return std::atomic_ref<uint32_t>(bits[block_index]).load(std::memory_order_relaxed);
+    }
+
+    inline void atomic_store_block(size_t block_index, uint32_t value)
+    {
+        std::atomic_ref<uint32_t>(bits[block_index]).store(value, std::memory_order_relaxed);
+    }
+
+    // clears the bit, returning whether it was set
+    inline bool atomic_clear(size_t index)
+    {
+        const uint32_t bit = nth_bit<uint32_t>(index & mask);
+        return !!(std::atomic_ref<uint32_t>(bits[index >> shift]).fetch_and(~bit, std::memory_order_relaxed) & bit);
+    }
+
     struct reference
     {
         std::unique_ptr<uint32_t[]> &bits;
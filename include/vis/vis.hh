@@ -36,7 +36,8 @@ enum pstatus_t
 {
     pstat_none = 0,
     pstat_working,
-    pstat_done
+    pstat_done,
+    pstat_reused // visbits carried over by -incremental, becomes pstat_done after the full vis
 };
 
 /**
@@ -135,6 +136,11 @@ struct visportal_t
     leafbits_t visbits, mightsee;
     int nummightsee;
     int numcansee;
+
+    // status is read by other threads during the full vis, so it goes through
+    // std::atomic_ref while the portals are being worked on
+    inline pstatus_t get_status() { return std::atomic_ref<pstatus_t>(status).load(); }
+    inline void set_status(pstatus_t value) { std::atomic_ref<pstatus_t>(status).store(value); }
 };
 
 inline float viswinding_t::distFromPortal(visportal_t &p)
@@ -188,6 +194,8 @@ struct visstats_t
     int64_t c_leafskip = 0;
     int64_t c_portalskip = 0;
     int64_t c_targetcheck = 0;
+    int64_t c_lockcontended = 0;
+    duration lockwait = duration::zero();
 
     visstats_t operator+(const visstats_t &other) const
     {
@@ -203,10 +211,24 @@ struct visstats_t
         result.c_leafskip = this->c_leafskip + other.c_leafskip;
         result.c_portalskip = this->c_portalskip + other.c_portalskip;
         result.c_targetcheck = this->c_targetcheck + other.c_targetcheck;
+        result.c_lockcontended = this->c_lockcontended + other.c_lockcontended;
+        result.lockwait = this->lockwait + other.lockwait;
         return result;
     }
 };
 
+// picks the widest point-plane distance kernel the CPU supports, or the scalar
+// one if allow_simd is false. all of them give bit-identical results.
+void SelectVisKernels(bool allow_simd);
+
+// dists[i] = plane.distance_to(w[i]) for every point of the winding
+void WindingPlaneDistances(const viswinding_t &w, const qplane3d &plane, double *dists);
+
+// true if no point of the winding but w[skip] is more than epsilon behind the plane,
+// and at least one is more than epsilon in front of it. stops at the first chunk of
+// points with one behind the plane.
+bool WindingPlaneSeparates(const viswinding_t &w, const qplane3d &plane, size_t skip, double epsilon);
+
 viswinding_t *AllocStackWinding(pstack_t &stack);
 void FreeStackWinding(viswinding_t *&w, pstack_t &stack);
 viswinding_t *ClipStackWinding(visstats_t &stats, viswinding_t *in, pstack_t &stack, const qplane3d &split);
@@ -233,7 +255,7 @@ extern int leafbytes;
 extern int leafbytes_real;
 extern int leaflongs;
 
-extern fs::path portalfile, statefile, statetmpfile;
+extern fs::path portalfile, statefile, statetmpfile, incrementalfile;
 
 void BasePortalVis();
 
@@ -249,6 +271,9 @@ void SaveVisState();
 bool LoadVisState();
 void CleanVisState();
 
+void SaveIncrementalVis();
+void ReuseIncrementalVis();
+
 #include <common/settings.hh>
 #include <common/fs.hh>
 
@@ -271,10 +296,16 @@ public:
     setting_scalar visdist{
         this, "visdist", 0.0, &vis_advanced_group, "control the distance required for a portal to be considered seen"};
     setting_bool nostate{this, "nostate", false, &vis_advanced_group, "ignore saved state files, for forced re-runs"};
+    setting_bool incremental{this, "incremental", false, &vis_advanced_group,
+        "reuse the vis of portals that can't see any changes since the last -incremental run"};
     setting_bool phsonly{
         this, "phsonly", false, &vis_advanced_group, "re-calculate the PHS of a Quake II BSP without touching the PVS"};
     setting_invertible_bool autoclean{
         this, "autoclean", true, &vis_output_group, "remove any extra files on successful completion"};
+    setting_bool nosimd{this, "nosimd", false, &vis_advanced_group,
+        "don't use the SSE2/AVX winding clipping kernels (output is identical either way)"};
+    setting_bool noportalbvh{this, "noportalbvh", false, &testing_group,
+        "test every portal against every other one in the base vis, instead of culling them through a BVH"};
     setting_scalar targetratio{this, "targetchecks", 0.5, 0.0, 9999.0, &performance_group,
         "target ratio of target checks to regular checks (0.0 = no target checks, 1.0 = equal amounts of regular and target checks)"};
 
@@ -296,3 +327,9 @@ extern settings::vis_settings vis_options;
 void vis_reset();
 int vis_main(int argc, const char **argv);
 int vis_main(const std::vector<std::string> &args);
+struct pipeline_data_t;
+// run vis on the bsp and portals in `data` instead of reading them from disk;
+// the bsp is left in `data` (in the generic format) rather than written out.
+// the map name in `args` is still used for the log and .vic files; state
+// files aren't used, since there is no .prt on disk to validate them against.
+int vis_main(const std::vector<std::string> &args, pipeline_data_t &data);
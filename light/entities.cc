@@ -261,8 +261,8 @@ bool EntDict_CheckNoEmptyValues(const mbsp_t *bsp, const entdict_t &entdict)
     // empty values warning
     for (const auto &keyval : entdict) {
         if (keyval.first.empty() || keyval.second.empty()) {
-            logging::print("WARNING: {} has empty key/value \"{}\" \"{}\"\n", EntDict_PrettyDescription(bsp, entdict),
-                keyval.first, keyval.second);
+            logging::print(logging::flag::WARNING, "WARNING: {} has empty key/value \"{}\" \"{}\"\n",
+                EntDict_PrettyDescription(bsp, entdict), keyval.first, keyval.second);
             ok = false;
         }
     }
@@ -328,15 +328,16 @@ static void CheckEntityFields(const mbsp_t *bsp, const settings::worldspawn_keys
 
     // mxd. Warn about unsupported _falloff / delay combos...
     if (entity->falloff.value() > 0.0f && entity->getFormula() != LF_LINEAR) {
-        logging::print("WARNING: _falloff is currently only supported on linear (delay 0) lights\n"
-                       "   {} at [{}]\n",
+        logging::print(logging::flag::WARNING,
+            "WARNING: _falloff is currently only supported on linear (delay 0) lights\n"
+            "   {} at [{}]\n",
             entity->classname(), entity->origin.value());
         entity->falloff.set_value(0.0f, settings::source::MAP);
     }
 
     if (entity->getFormula() < 0 || entity->getFormula() >= LF_COUNT) {
-        logging::print("WARNING: unknown delay {} on {} at [{}]\n", static_cast<int>(entity->getFormula()),
-            entity->classname(), entity->origin.value());
+        logging::print(logging::flag::WARNING, "WARNING: unknown delay {} on {} at [{}]\n",
+            static_cast<int>(entity->getFormula()), entity->classname(), entity->origin.value());
         entity->formula.set_value(LF_LINEAR, settings::source::MAP);
         entity->light.set_value(0.0f, settings::source::MAP);
     }
@@ -503,7 +504,7 @@ static void SetupSuns(const settings::worldspawn_keys &cfg)
             } else if (qv::length2(entity->mangle.value()) > 0) {
                 sunvec = qv::vec_from_mangle(entity->mangle.value());
             } else { // Use { 0, 0, 0 } as sun target...
-                logging::print("WARNING: sun missing target, entity origin used.\n");
+                logging::print(logging::flag::WARNING, "WARNING: sun missing target, entity origin used.\n");
                 sunvec = -entity->origin.value();
             }
 
@@ -938,7 +939,8 @@ void LoadEntities(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
     for (const auto &epair : WorldEnt()) {
         if (light_options.set_setting(epair.first, epair.second, settings::source::MAP) ==
             settings::setting_error::INVALID) {
-            logging::print("WARNING: worldspawn key {} has invalid value of \"{}\"\n", epair.first, epair.second);
+            logging::print(logging::flag::WARNING, "WARNING: worldspawn key {} has invalid value of \"{}\"\n",
+                epair.first, epair.second);
         }
     }
 
@@ -954,7 +956,7 @@ void LoadEntities(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
         const std::string &lmscale = entdict.get("lightmap_scale");
         if (!lmscale.empty()) {
             // FIXME: line number
-            logging::print("WARNING: lightmap_scale should be _lightmap_scale\n");
+            logging::print(logging::flag::WARNING, "WARNING: lightmap_scale should be _lightmap_scale\n");
 
             entdict.remove("lightmap_scale");
             entdict.set("_lightmap_scale", lmscale);
@@ -1044,7 +1046,7 @@ void LoadEntities(const settings::worldspawn_keys &cfg, const mbsp_t *bsp)
                 auto texname = entity->project_texture.value();
                 entity->projectedmip = img::find(texname);
                 if (entity->projectedmip == nullptr || entity->projectedmip->pixels.empty()) {
-                    logging::print(
+                    logging::print(logging::flag::WARNING,
                         "WARNING: light has \"_project_texture\" \"{}\", but this texture was not found\n", texname);
                     entity->projectedmip = nullptr;
                 }
@@ -1112,7 +1114,7 @@ std::tuple<qvec3f, bool> FixLightOnFace(const mbsp_t *bsp, const qvec3f &point,
     }
 
     if (warn)
-        logging::print("WARNING: couldn't nudge light out of solid at {}\n", point);
+        logging::print(logging::flag::WARNING, "WARNING: couldn't nudge light out of solid at {}\n", point);
     return {point, false};
 }
 
@@ -1554,7 +1556,7 @@ static void MakeSurfaceLights(const mbsp_t *bsp)
                     return !Q_strcasecmp(Face_TextureName(bsp, &face), entity->epairs->get("_surface"));
                 });
             if (!found_face) {
-                logging::print(
+                logging::print(logging::flag::WARNING,
                     "WARNING: no faces found with texture {} (qbsp may have been run with .wad's missing?)\n",
                     entity->epairs->get("_surface"));
             }
@@ -29,6 +29,7 @@
 #include <light/surflight.hh> //mxd
 #include <light/entities.hh>
 #include <light/ltface.hh>
+#include <light/lightstats.hh>
 #include <light/write.hh> // for facesup_t
 #include <light/trace_embree.hh>
 
@@ -55,6 +56,7 @@
 
 #include <common/qvec.hh>
 #include <common/json.hh>
+#include <common/pipeline.hh>
 
 bool dirt_in_use = false;
 
@@ -84,6 +86,8 @@ static void UpdateEmissiveLightSurfacesList()
             emissive_light_surfaces.push_back(&surf_ptr);
         }
     }
+
+    BuildSurfaceLightBVHs(emissive_light_surfaces);
 }
 
 std::vector<facesup_t> faces_sup; // lit2/bspx stuff
@@ -388,6 +392,11 @@ light_settings::light_settings()
           "distance between lightgrid sample points, in world units. controls lightgrid size."},
       lightgrid_format{this, "lightgrid_format", lightgrid_format_t::OCTREE, {{"octree", lightgrid_format_t::OCTREE}},
           &experimental_group, "lightgrid BSPX lump to use"},
+      lightgrid_adaptive{this, "lightgrid_adaptive", false, &experimental_group,
+          "only trace lightgrid points where the lighting or geometry changes, interpolating the rest"},
+      lightgrid_adaptive_threshold{this, "lightgrid_adaptive_threshold", 4.0, 0.0, 255.0, &experimental_group,
+          "maximum difference (0..255 per channel) between lightgrid samples for -lightgrid_adaptive to interpolate "
+          "between them"},
 
       dirtdebug{this, {"dirtdebug", "debugdirt"},
           [&](const std::string &, parser_base_t &, source) {
@@ -454,7 +463,21 @@ light_settings::light_settings()
           &debug_group, "save mottle pattern to lightmap"},
 
       debug_lightgrid_octree{
-          this, "debug_lightgrid_octree", false, &debug_group, "write .octree.prt file for light grid"}
+          this, "debug_lightgrid_octree", false, &debug_group, "write .octree.prt file for light grid"},
+      noraypackets{this, "noraypackets", false, &testing_group,
+          "with Embree 4, trace rays one at a time instead of as sorted 8-wide packets"},
+      lightstats{this, "lightstats", false, &performance_group,
+          "write a .lightstats.json report with per-face and per-light ray counts and timings"},
+      nosurflightbvh{this, "nosurflightbvh", false, &testing_group,
+          "test every surface light against every face instead of culling them through a BVH"},
+      nolightbvh{this, "nolightbvh", false, &testing_group,
+          "test every light entity against every face instead of culling them through a BVH"},
+      nostreamlightmaps{this, "nostreamlightmaps", false, &testing_group,
+          "without bounce, still keep every face's lightmaps until all faces are lit, instead of writing each "
+          "face as it finishes"},
+      nobatchsky{this, "nobatchsky", false, &testing_group,
+          "trace each sun in its own stream out to the maximum sky distance, instead of batching all suns and "
+          "stopping rays at the map bounds"}
 {
 }
 
@@ -477,7 +500,7 @@ void light_settings::initialize(int argc, const char **argv)
         sourceMap = remainder[0];
     } catch (parse_exception &ex) {
         print_help(false);
-        logging::print("ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
+        logging::print(logging::flag::FAILURE, "ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
         logging::print(ex.what());
         logging::print("\n\n");
         throw settings::quit_after_help_exception();
@@ -487,7 +510,7 @@ void light_settings::initialize(int argc, const char **argv)
 void light_settings::light_postinitialize(int argc, const char **argv)
 {
     if (gate.value() > 1) {
-        logging::print("WARNING: -gate value greater than 1 may cause artifacts\n");
+        logging::print(logging::flag::WARNING, "WARNING: -gate value greater than 1 may cause artifacts\n");
     }
 
     if (radlights.is_changed()) {
@@ -727,7 +750,7 @@ static void FindModelInfo(const mbsp_t *bsp)
             i++;
         }
         if (i != lightmapscale) {
-            logging::print("WARNING: lightmap scale is not a power of 2\n");
+            logging::print(logging::flag::WARNING, "WARNING: lightmap scale is not a power of 2\n");
         }
     }
 
@@ -836,6 +859,8 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
     // create lightmap surfaces
     CreateLightmapSurfaces(&bsp);
 
+    LightStats_Init(bsp.dfaces.size());
+
     const bool bouncerequired =
         light_options.bounce.value() &&
         (light_options.debugmode == debugmodes::none || light_options.debugmode == debugmodes::bounce ||
@@ -844,15 +869,35 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
     MakeRadiositySurfaceLights(light_options, &bsp);
     UpdateEmissiveLightSurfacesList();
 
+    // without bounces, no other face reads a face's lightmaps, so each face can be
+    // post-processed and written as soon as its direct lighting is done, while its samples
+    // are still hot, and its samples freed instead of held until every face is lit
+    const bool postprocess_with_direct = !bouncerequired && !light_options.nolighting.value() &&
+                                         !light_options.nostreamlightmaps.value();
+    const bool stream_lightmaps = postprocess_with_direct && !light_options.litonly.value();
+
+    if (stream_lightmaps) {
+        BeginStreamingLightmapSurfaces(&bsp);
+    }
+
     logging::header("Direct Lighting"); // mxd
-    logging::parallel_for(static_cast<size_t>(0), bsp.dfaces.size(), [&bsp](size_t i) {
-        if (Face_IsLightmapped(&bsp, &bsp.dfaces[i])) {
+    logging::parallel_for(
+        static_cast<size_t>(0), bsp.dfaces.size(), [&bsp, postprocess_with_direct, stream_lightmaps](size_t i) {
+            if (Face_IsLightmapped(&bsp, &bsp.dfaces[i])) {
 #if defined(HAVE_EMBREE) && defined(__SSE2__)
-            _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+                _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
 #endif
-            DirectLightFace(&bsp, light_surfaces[i], light_options);
-        }
-    });
+                DirectLightFace(&bsp, light_surfaces[i], light_options);
+
+                if (postprocess_with_direct) {
+                    PostProcessLightFace(&bsp, light_surfaces[i], light_options);
+                }
+
+                if (stream_lightmaps) {
+                    StreamLightmapSurface(&bsp, i);
+                }
+            }
+        });
 
     if (bouncerequired && !light_options.nolighting.value()) {
 
@@ -878,7 +923,7 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
         }
     }
 
-    if (!light_options.nolighting.value()) {
+    if (!light_options.nolighting.value() && !postprocess_with_direct) {
         logging::header("Post-Processing"); // mxd
         logging::parallel_for(static_cast<size_t>(0), bsp.dfaces.size(), [&bsp](size_t i) {
             if (Face_IsLightmapped(&bsp, &bsp.dfaces[i])) {
@@ -893,6 +938,12 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
 
     SaveLightmapSurfaces(bspdata, source);
 
+    LightStats_Print();
+
+    if (light_options.lightstats.value()) {
+        LightStats_WriteJSON(&bsp, fs::path(source).replace_extension("lightstats.json"));
+    }
+
     // kill this stuff if its somehow found.
     bspdata->bspx.entries.erase("LMSTYLE16");
     bspdata->bspx.entries.erase("LMSTYLE");
@@ -923,7 +974,7 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
         }
 
         if (stylesperface >= light_options.facestyles.value()) {
-            logging::print(
+            logging::print(logging::flag::WARNING,
                 "WARNING: styles per face {} exceeds compiler-set max styles {}; use `-facestyles` if you need more.\n",
                 stylesperface, light_options.facestyles.value());
             stylesperface = light_options.facestyles.value();
@@ -996,30 +1047,14 @@ static void LightWorld(bspdata_t *bspdata, const fs::path &source, bool forcedsc
     }
 }
 
-static void LoadExtendedTexinfoFlags(const fs::path &sourcefilename, const mbsp_t *bsp)
+static void ParseExtendedTexinfoFlags(const json &j, const fs::path &filename, const mbsp_t *bsp)
 {
-    // always create the zero'ed array
-    extended_texinfo_flags.resize(bsp->texinfo.size());
-
-    fs::path filename(sourcefilename);
-    filename.replace_extension("texinfo.json");
-
-    std::ifstream texinfofile(filename, std::ios_base::in | std::ios_base::binary);
-
-    if (!texinfofile)
-        return;
-
-    logging::print("Loading extended texinfo flags from {}...\n", filename);
-
-    json j;
-
-    texinfofile >> j;
-
     for (auto it = j.begin(); it != j.end(); ++it) {
         size_t index = std::stoull(it.key());
 
         if (index >= bsp->texinfo.size()) {
-            logging::print("WARNING: Extended texinfo flags in {} does not match bsp, ignoring\n", filename);
+            logging::print(logging::flag::WARNING,
+                "WARNING: Extended texinfo flags in {} does not match bsp, ignoring\n", filename);
             memset(extended_texinfo_flags.data(), 0, bsp->texinfo.size() * sizeof(surfflags_t));
             return;
         }
@@ -1114,6 +1149,36 @@ static void LoadExtendedTexinfoFlags(const fs::path &sourcefilename, const mbsp_
     }
 }
 
+static void LoadExtendedTexinfoFlags(const fs::path &sourcefilename, const mbsp_t *bsp, const json *input)
+{
+    // always create the zero'ed array
+    extended_texinfo_flags.resize(bsp->texinfo.size());
+
+    fs::path filename(sourcefilename);
+    filename.replace_extension("texinfo.json");
+
+    // in-process, qbsp hands the flags over directly
+    if (input) {
+        if (!input->is_null()) {
+            ParseExtendedTexinfoFlags(*input, filename, bsp);
+        }
+        return;
+    }
+
+    std::ifstream texinfofile(filename, std::ios_base::in | std::ios_base::binary);
+
+    if (!texinfofile)
+        return;
+
+    logging::print("Loading extended texinfo flags from {}...\n", filename);
+
+    json j;
+
+    texinfofile >> j;
+
+    ParseExtendedTexinfoFlags(j, filename, bsp);
+}
+
 // obj
 
 static void ExportObjFace(std::ofstream &f, const mbsp_t *bsp, const mface_t *face, int *vertcount)
@@ -1352,6 +1417,7 @@ static void ResetLight()
 {
     dirt_in_use = false;
     ClearLightmapSurfaces();
+    ResetLightmapStream();
     faces_sup.clear();
     facesup_decoupled_global.clear();
 
@@ -1386,11 +1452,13 @@ void light_reset()
  * light modelfile
  * ==================
  */
-int light_main(int argc, const char **argv)
+static int LightMain(int argc, const char **argv, pipeline_data_t *input)
 {
     light_reset();
 
-    bspdata_t bspdata;
+    // in-process, the bsp comes from the previous tool instead of disk
+    bspdata_t loaded_bspdata;
+    bspdata_t &bspdata = input ? input->bspdata : loaded_bspdata;
 
     light_options.preinitialize(argc, argv);
     light_options.initialize(argc, argv);
@@ -1414,14 +1482,19 @@ int light_main(int argc, const char **argv)
     ParseLightsFile(source); // map-specific file name
 
     source.replace_extension("bsp");
-    LoadBSPFile(source, &bspdata);
 
-    bspdata.version->game->init_filesystem(source, light_options);
+    if (!input) {
+        LoadBSPFile(source, &bspdata);
+    } else if (!bspdata.version) {
+        FError("no bsp was generated for {}", source);
+    }
 
     ConvertBSPFormat(&bspdata, &bspver_generic);
 
     mbsp_t &bsp = std::get<mbsp_t>(bspdata.bsp);
 
+    bspdata.loadversion->game->init_filesystem(source, light_options);
+
     // mxd. Use 1.0 rangescale as a default to better match with qrad3/arghrad
     if (bspdata.loadversion->game->id == GAME_QUAKE_II) {
         if (!light_options.rangescale.is_changed()) {
@@ -1461,7 +1534,7 @@ int light_main(int argc, const char **argv)
 
     img::load_textures(&bsp, light_options);
 
-    LoadExtendedTexinfoFlags(source, &bsp);
+    LoadExtendedTexinfoFlags(source, &bsp, input ? &input->extended_texinfo_flags : nullptr);
 
     CacheTextures(bsp);
 
@@ -1488,6 +1561,7 @@ int light_main(int argc, const char **argv)
     }
 
     SetupLights(light_options, &bsp);
+    BuildLightBVH(light_options);
 
     // PrintLights();
 
@@ -1535,25 +1609,17 @@ int light_main(int argc, const char **argv)
 
     auto end = I_FloatTime();
     logging::print("{:.3} seconds elapsed\n", (end - start));
-#if 0
-    logging::print("\n");
-    logging::print("stats:\n");
-    logging::print("{} lights tested, {} hits per sample point\n",
-        static_cast<float>(total_light_rays) / static_cast<float>(total_samplepoints),
-        static_cast<float>(total_light_ray_hits) / static_cast<float>(total_samplepoints));
-    logging::print("{} surface lights tested, {} hits per sample point\n",
-        static_cast<float>(total_surflight_rays) / static_cast<float>(total_samplepoints),
-        static_cast<float>(total_surflight_ray_hits) / static_cast<float>(total_samplepoints)); // mxd
-    logging::print("{} bounce lights tested, {} hits per sample point\n",
-        static_cast<float>(total_bounce_rays) / static_cast<float>(total_samplepoints),
-        static_cast<float>(total_bounce_ray_hits) / static_cast<float>(total_samplepoints));
-#endif
     logging::print("{} empty lightmaps\n", static_cast<int>(fully_transparent_lightmaps));
     logging::close();
 
     return 0;
 }
 
+int light_main(int argc, const char **argv)
+{
+    return LightMain(argc, argv, nullptr);
+}
+
 int light_main(const std::vector<std::string> &args)
 {
     std::vector<const char *> argPtrs;
@@ -1563,3 +1629,13 @@ int light_main(const std::vector<std::string> &args)
 
     return light_main(argPtrs.size(), argPtrs.data());
 }
+
+int light_main(const std::vector<std::string> &args, pipeline_data_t &data)
+{
+    std::vector<const char *> argPtrs;
+    for (const std::string &arg : args) {
+        argPtrs.push_back(arg.data());
+    }
+
+    return LightMain(argPtrs.size(), argPtrs.data(), &data);
+}
@@ -19,11 +19,13 @@
 
 #include <light/lightgrid.hh>
 
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -31,11 +33,14 @@
 #include <light/entities.hh>
 #include <light/ltface.hh>
 
+#include <common/bsputils.hh>
 #include <common/prtfile.hh>
 #include <common/parallel.hh>
 #include <common/qvec.hh>
 #include <common/cmdlib.hh>
 
+#include <tbb/parallel_for.h>
+
 static aabb3f LightGridBounds(const mbsp_t &bsp)
 {
     aabb3f result;
@@ -74,62 +79,107 @@ struct lightgrid_raw_data
     qvec3f grid_index_to_world(const qvec3i &index) const { return grid_mins + (index * grid_dist); }
 };
 
-static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_raw_data &data)
+constexpr int OCTREE_MAX_DEPTH = 5;
+// if any axis is fewer than this many grid points, don't bother subdividing further, just create a leaf
+constexpr int OCTREE_MIN_NODE_DIMENSION = 4;
+
+// if set, it's an index in the leafs array
+constexpr uint32_t OCTREE_FLAG_LEAF = 1u << 31;
+constexpr uint32_t OCTREE_FLAG_OCCLUDED = 1u << 30;
+// if neither flags are set, it's a node index
+
+struct octree_node
 {
-    /**
-     * returns the octant index in [0..7]
-     */
-    auto child_index = [](qvec3i division_point, qvec3i test_point) -> int {
-        int sign[3];
-        for (int i = 0; i < 3; ++i)
-            sign[i] = (test_point[i] >= division_point[i]);
+    qvec3i division_point;
+    std::array<uint32_t, 8> children;
+};
 
-        return (4 * sign[0]) + (2 * sign[1]) + (sign[2]);
-    };
+struct octree_leaf
+{
+    qvec3i mins, size;
+};
+
+struct lightgrid_octree_t
+{
+    std::vector<octree_node> nodes;
+    std::vector<octree_leaf> leafs;
+    uint32_t root_node = 0;
+    int occluded_cells = 0;
+};
 
-    Q_assert(child_index({1, 1, 1}, {2, 2, 2}) == 7);
-    Q_assert(child_index({1, 1, 1}, {1, 1, 0}) == 6);
-    Q_assert(child_index({1, 1, 1}, {1, 0, 1}) == 5);
-    Q_assert(child_index({1, 1, 1}, {1, 0, 0}) == 4);
-    Q_assert(child_index({1, 1, 1}, {0, 1, 1}) == 3);
-    Q_assert(child_index({1, 1, 1}, {0, 1, 0}) == 2);
-    Q_assert(child_index({1, 1, 1}, {0, 0, 1}) == 1);
-    Q_assert(child_index({1, 1, 1}, {0, 0, 0}) == 0);
+/**
+ * returns the octant index in [0..7]
+ */
+static int ChildIndex(qvec3i division_point, qvec3i test_point)
+{
+    int sign[3];
+    for (int i = 0; i < 3; ++i)
+        sign[i] = (test_point[i] >= division_point[i]);
 
-    /**
-     * returns octant index `i`'s mins and size
-     */
-    auto get_octant = [](int i, qvec3i mins, qvec3i size, qvec3i division_point) -> std::tuple<qvec3i, qvec3i> {
-        qvec3i child_mins;
-        qvec3i child_size;
-        for (int axis = 0; axis < 3; ++axis) {
-            int bit;
-            if (axis == 0) {
-                bit = 4;
-            } else if (axis == 1) {
-                bit = 2;
-            } else {
-                bit = 1;
-            }
+    return (4 * sign[0]) + (2 * sign[1]) + (sign[2]);
+}
 
-            if (i & bit) {
-                child_mins[axis] = division_point[axis];
-                child_size[axis] = mins[axis] + size[axis] - division_point[axis];
-            } else {
-                child_mins[axis] = mins[axis];
-                child_size[axis] = division_point[axis] - mins[axis];
-            }
+/**
+ * returns octant index `i`'s mins and size
+ */
+static std::tuple<qvec3i, qvec3i> GetOctant(int i, qvec3i mins, qvec3i size, qvec3i division_point)
+{
+    qvec3i child_mins;
+    qvec3i child_size;
+    for (int axis = 0; axis < 3; ++axis) {
+        int bit;
+        if (axis == 0) {
+            bit = 4;
+        } else if (axis == 1) {
+            bit = 2;
+        } else {
+            bit = 1;
         }
-        return {child_mins, child_size};
-    };
 
-    Q_assert(get_octant(0, {0, 0, 0}, {2, 2, 2}, {1, 1, 1}) == (std::tuple<qvec3i, qvec3i>{{0, 0, 0}, {1, 1, 1}}));
-    Q_assert(get_octant(7, {0, 0, 0}, {2, 2, 2}, {1, 1, 1}) == (std::tuple<qvec3i, qvec3i>{{1, 1, 1}, {1, 1, 1}}));
+        if (i & bit) {
+            child_mins[axis] = division_point[axis];
+            child_size[axis] = mins[axis] + size[axis] - division_point[axis];
+        } else {
+            child_mins[axis] = mins[axis];
+            child_size[axis] = division_point[axis] - mins[axis];
+        }
+    }
+    return {child_mins, child_size};
+}
 
-    /**
-     * given a bounding box, selects the division point.
-     */
-    auto get_division_point = [](qvec3i mins, qvec3i size) -> qvec3i { return mins + (size / 2); };
+/**
+ * given a bounding box, selects the division point.
+ */
+static qvec3i GetDivisionPoint(qvec3i mins, qvec3i size)
+{
+    return mins + (size / 2);
+}
+
+/**
+ * whether a box of grid points is allowed to be an octree node, rather than a leaf
+ */
+static bool CanBeOctreeNode(qvec3i size, int depth)
+{
+    if (size[0] < OCTREE_MIN_NODE_DIMENSION || size[1] < OCTREE_MIN_NODE_DIMENSION ||
+        size[2] < OCTREE_MIN_NODE_DIMENSION)
+        return false;
+
+    return depth < OCTREE_MAX_DEPTH;
+}
+
+static lightgrid_octree_t BuildOctree(const lightgrid_raw_data &data)
+{
+    Q_assert(ChildIndex({1, 1, 1}, {2, 2, 2}) == 7);
+    Q_assert(ChildIndex({1, 1, 1}, {1, 1, 0}) == 6);
+    Q_assert(ChildIndex({1, 1, 1}, {1, 0, 1}) == 5);
+    Q_assert(ChildIndex({1, 1, 1}, {1, 0, 0}) == 4);
+    Q_assert(ChildIndex({1, 1, 1}, {0, 1, 1}) == 3);
+    Q_assert(ChildIndex({1, 1, 1}, {0, 1, 0}) == 2);
+    Q_assert(ChildIndex({1, 1, 1}, {0, 0, 1}) == 1);
+    Q_assert(ChildIndex({1, 1, 1}, {0, 0, 0}) == 0);
+
+    Q_assert(GetOctant(0, {0, 0, 0}, {2, 2, 2}, {1, 1, 1}) == (std::tuple<qvec3i, qvec3i>{{0, 0, 0}, {1, 1, 1}}));
+    Q_assert(GetOctant(7, {0, 0, 0}, {2, 2, 2}, {1, 1, 1}) == (std::tuple<qvec3i, qvec3i>{{1, 1, 1}, {1, 1, 1}}));
 
     auto count_occluded_unoccluded = [&](qvec3i mins, qvec3i size) -> std::tuple<int, int> {
         std::tuple<int, int> occluded_unoccluded;
@@ -148,31 +198,7 @@ static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_ra
         return occluded_unoccluded;
     };
 
-    constexpr int MAX_DEPTH = 5;
-    // if any axis is fewer than this many grid points, don't bother subdividing further, just create a leaf
-    constexpr int MIN_NODE_DIMENSION = 4;
-
-    // if set, it's an index in the leafs array
-    [[maybe_unused]] constexpr uint32_t FLAG_LEAF = 1 << 31;
-    [[maybe_unused]] constexpr uint32_t FLAG_OCCLUDED = 1 << 30;
-    [[maybe_unused]] constexpr uint32_t FLAGS = (FLAG_LEAF | FLAG_OCCLUDED);
-    // if neither flags are set, it's a node index
-
-    struct octree_node
-    {
-        qvec3i division_point;
-        std::array<uint32_t, 8> children;
-    };
-
-    struct octree_leaf
-    {
-        qvec3i mins, size;
-    };
-
-    std::vector<octree_node> octree_nodes;
-    std::vector<octree_leaf> octree_leafs;
-
-    int occluded_cells = 0;
+    lightgrid_octree_t octree;
 
     /**
      * - inserts either a node or leaf
@@ -190,16 +216,12 @@ static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_ra
         // special case: fully occluded leaf, just represented as a flag bit
         auto [occluded_count, unoccluded_count] = count_occluded_unoccluded(mins, size);
         if (!unoccluded_count) {
-            occluded_cells += size[0] * size[1] * size[2];
-            return FLAG_OCCLUDED;
+            octree.occluded_cells += size[0] * size[1] * size[2];
+            return OCTREE_FLAG_OCCLUDED;
         }
 
         // decide whether we are creating a regular leaf or a node?
-        bool make_leaf = false;
-        if (size[0] < MIN_NODE_DIMENSION || size[1] < MIN_NODE_DIMENSION || size[2] < MIN_NODE_DIMENSION)
-            make_leaf = true;
-        if (depth == MAX_DEPTH)
-            make_leaf = true;
+        bool make_leaf = !CanBeOctreeNode(size, depth);
 
         if (occluded_count < 8) {
             // force a leaf if it's mostly unoccluded
@@ -208,31 +230,40 @@ static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_ra
 
         if (make_leaf) {
             // make a leaf
-            const uint32_t leafnum = static_cast<uint32_t>(octree_leafs.size());
-            octree_leafs.push_back({.mins = mins, .size = size});
-            return FLAG_LEAF | leafnum;
+            const uint32_t leafnum = static_cast<uint32_t>(octree.leafs.size());
+            octree.leafs.push_back({.mins = mins, .size = size});
+            return OCTREE_FLAG_LEAF | leafnum;
         }
 
         // make a node
 
-        const qvec3i division_point = get_division_point(mins, size);
+        const qvec3i division_point = GetDivisionPoint(mins, size);
 
         // create the 8 child nodes/leafs recursively, store the returned indices
         std::array<uint32_t, 8> children;
         for (int i = 0; i < 8; ++i) {
             // figure out the mins/size of this child
-            auto [child_mins, child_size] = get_octant(i, mins, size, division_point);
+            auto [child_mins, child_size] = GetOctant(i, mins, size, division_point);
             children[i] = build_octree(child_mins, child_size, depth + 1);
         }
 
         // insert the node
-        const uint32_t nodenum = static_cast<uint32_t>(octree_nodes.size());
-        octree_nodes.push_back({.division_point = division_point, .children = children});
+        const uint32_t nodenum = static_cast<uint32_t>(octree.nodes.size());
+        octree.nodes.push_back({.division_point = division_point, .children = children});
         return nodenum;
     };
 
     // build the root node
-    const uint32_t root_node = build_octree(qvec3i{0, 0, 0}, data.grid_size, 0);
+    octree.root_node = build_octree(qvec3i{0, 0, 0}, data.grid_size, 0);
+
+    return octree;
+}
+
+static std::vector<uint8_t> MakeOctreeLump(const lightgrid_raw_data &data, const lightgrid_octree_t &octree)
+{
+    const auto &octree_nodes = octree.nodes;
+    const auto &octree_leafs = octree.leafs;
+    const uint32_t root_node = octree.root_node;
 
     // visualize the leafs
     if (light_options.debug_lightgrid_octree.value()) {
@@ -259,7 +290,7 @@ static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_ra
         stored_cells += leaf.size[0] * leaf.size[1] * leaf.size[2];
     }
     logging::print("octree stored {} grid nodes + {} occluded = {} total, full stored {} (octree is {} percent)\n",
-        stored_cells, occluded_cells, stored_cells + occluded_cells, data.occlusion.size(),
+        stored_cells, octree.occluded_cells, stored_cells + octree.occluded_cells, data.occlusion.size(),
         100.0f * stored_cells / (float)data.occlusion.size());
 
     logging::print("octree nodes size: {} bytes ({} * {})\n", octree_nodes.size() * sizeof(octree_node),
@@ -271,16 +302,16 @@ static std::vector<uint8_t> MakeOctreeLump(const mbsp_t &bsp, const lightgrid_ra
     // lookup function
     std::function<std::tuple<lightgrid_samples_t, bool>(uint32_t, qvec3i)> octree_lookup_r;
     octree_lookup_r = [&](uint32_t node_index, qvec3i test_point) -> std::tuple<lightgrid_samples_t, bool> {
-        if (node_index & FLAG_OCCLUDED) {
+        if (node_index & OCTREE_FLAG_OCCLUDED) {
             return {lightgrid_samples_t{}, true};
         }
-        if (node_index & FLAG_LEAF) {
+        if (node_index & OCTREE_FLAG_LEAF) {
             // in actuality, we'd pull the data from a 3D grid stored in the leaf.
             int i = data.get_grid_index(test_point[0], test_point[1], test_point[2]);
             return {data.grid_result[i], data.occlusion[i]};
         }
         auto &node = octree_nodes[node_index];
-        int i = child_index(node.division_point, test_point); // [0..7]
+        int i = ChildIndex(node.division_point, test_point); // [0..7]
         return octree_lookup_r(node.children[i], test_point);
     };
 
@@ -384,8 +415,350 @@ std::tuple<lightgrid_samples_t, bool> FixPointAndCalcLightgrid(const mbsp_t *bsp
     return {samples, occluded};
 }
 
+/*
+ * ============================================================================
+ * ADAPTIVE SAMPLING
+ *
+ * Instead of tracing every grid point, start from the corners of the whole
+ * grid and only subdivide regions where something changes between the
+ * corners: the samples differ by more than lightgrid_adaptive_threshold,
+ * the region contains solid geometry, or the trilinear interpolation of the
+ * corners doesn't predict the sample at the region's division point.
+ * Regions that don't need subdividing are filled in by interpolation,
+ * and regions entirely inside solid are skipped as occluded.
+ * ============================================================================
+ */
+
+// how far FixPointAndCalcLightgrid can move an occluded point, plus some slack
+constexpr double ADAPTIVE_SOLID_MARGIN = 4.0;
+
+enum class adaptive_region_kind_t
+{
+    OCCLUDED, // entirely in solid, no samples stored
+    LEAF, // all points sampled or interpolated
+    SPLIT // subdivided into 8 children
+};
+
+struct adaptive_region_t
+{
+    qvec3i mins, size;
+    adaptive_region_kind_t kind;
+    qvec3i division_point;
+    // only for SPLIT; zero-sized octants are left null
+    std::array<std::unique_ptr<adaptive_region_t>, 8> children;
+};
+
+struct box_contents_t
+{
+    bool solid = false;
+    bool empty = false;
+};
+
+static void Lightgrid_BoxContents_r(
+    const mbsp_t &bsp, const int nodenum, const qvec3d &mins, const qvec3d &maxs, box_contents_t &result)
+{
+    if (result.solid && result.empty)
+        return;
+
+    if (nodenum < 0) {
+        const mleaf_t *leaf = BSP_GetLeafFromNodeNum(&bsp, nodenum);
+
+        // same as Light_PointInSolid_r
+        bool solid;
+        if (bsp.loadversion->game->id == GAME_QUAKE_II) {
+            solid = leaf->contents & Q2_CONTENTS_SOLID;
+        } else {
+            solid = (leaf->contents == CONTENTS_SOLID || leaf->contents == CONTENTS_SKY);
+        }
+
+        if (solid) {
+            result.solid = true;
+        } else {
+            result.empty = true;
+        }
+        return;
+    }
+
+    const bsp2_dnode_t *node = &bsp.dnodes[nodenum];
+    const dplane_t &plane = bsp.dplanes[node->planenum];
+
+    // distance range of the box from the plane
+    double min_dist = -plane.dist, max_dist = -plane.dist;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (plane.normal[axis] >= 0) {
+            min_dist += plane.normal[axis] * mins[axis];
+            max_dist += plane.normal[axis] * maxs[axis];
+        } else {
+            min_dist += plane.normal[axis] * maxs[axis];
+            max_dist += plane.normal[axis] * mins[axis];
+        }
+    }
+
+    if (max_dist > -0.1)
+        Lightgrid_BoxContents_r(bsp, node->children[0], mins, maxs, result);
+    if (min_dist < 0.1)
+        Lightgrid_BoxContents_r(bsp, node->children[1], mins, maxs, result);
+}
+
+class adaptive_lightgrid_t
+{
+    const mbsp_t &bsp;
+    lightgrid_raw_data &data;
+    const float threshold;
+
+    // per grid point; set once the point has been traced. sibling regions
+    // are disjoint, so these are only ever written by one task at a time.
+    std::vector<uint8_t> sampled;
+
+public:
+    std::atomic<int> num_sampled = 0;
+    std::atomic<int> num_interpolated = 0;
+    std::atomic<int> num_occluded = 0;
+
+    adaptive_lightgrid_t(const mbsp_t &bsp, lightgrid_raw_data &data, float threshold)
+        : bsp(bsp),
+          data(data),
+          threshold(threshold),
+          sampled(data.grid_result.size())
+    {
+    }
+
+private:
+    void sample(qvec3i point)
+    {
+        const int i = data.get_grid_index(point[0], point[1], point[2]);
+        if (sampled[i])
+            return;
+
+        bool occluded;
+        std::tie(data.grid_result[i], occluded) =
+            FixPointAndCalcLightgrid(&bsp, data.grid_index_to_world(point));
+        data.occlusion[i] = occluded;
+        sampled[i] = true;
+        num_sampled++;
+    }
+
+    const lightgrid_samples_t &result_at(qvec3i point) const
+    {
+        return data.grid_result[data.get_grid_index(point[0], point[1], point[2])];
+    }
+
+    bool occluded_at(qvec3i point) const { return data.occlusion[data.get_grid_index(point[0], point[1], point[2])]; }
+
+    static qvec3i corner(int i, qvec3i mins, qvec3i size)
+    {
+        qvec3i result = mins;
+        if (i & 4)
+            result[0] += size[0] - 1;
+        if (i & 2)
+            result[1] += size[1] - 1;
+        if (i & 1)
+            result[2] += size[2] - 1;
+        return result;
+    }
+
+    static bool same_styles(const lightgrid_samples_t &a, const lightgrid_samples_t &b)
+    {
+        for (size_t i = 0; i < a.samples_by_style.size(); ++i) {
+            if (a.samples_by_style[i].used != b.samples_by_style[i].used)
+                return false;
+            if (a.samples_by_style[i].used && a.samples_by_style[i].style != b.samples_by_style[i].style)
+                return false;
+        }
+        return true;
+    }
+
+    bool within_threshold(const lightgrid_samples_t &a, const lightgrid_samples_t &b) const
+    {
+        for (size_t i = 0; i < a.samples_by_style.size(); ++i) {
+            if (!a.samples_by_style[i].used)
+                break;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (fabs(a.samples_by_style[i].color[axis] - b.samples_by_style[i].color[axis]) > threshold)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * trilinear interpolation of the 8 corner samples of the region at `point`.
+     * the corners must all have the same styles.
+     */
+    lightgrid_samples_t interpolate(qvec3i mins, qvec3i size, qvec3i point) const
+    {
+        qvec3f t;
+        for (int axis = 0; axis < 3; ++axis) {
+            t[axis] = (size[axis] > 1) ? (point[axis] - mins[axis]) / static_cast<float>(size[axis] - 1) : 0.0f;
+        }
+
+        lightgrid_samples_t result = result_at(mins);
+        for (auto &sample : result.samples_by_style) {
+            sample.color = {};
+        }
+
+        for (int c = 0; c < 8; ++c) {
+            const float weight = ((c & 4) ? t[0] : 1.0f - t[0]) * ((c & 2) ? t[1] : 1.0f - t[1]) *
+                                 ((c & 1) ? t[2] : 1.0f - t[2]);
+            const lightgrid_samples_t &corner_result = result_at(corner(c, mins, size));
+
+            for (size_t i = 0; i < result.samples_by_style.size(); ++i) {
+                if (!result.samples_by_style[i].used)
+                    break;
+                result.samples_by_style[i].color += corner_result.samples_by_style[i].color * weight;
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * whether the region can be filled by interpolating its corners
+     */
+    bool can_interpolate(qvec3i mins, qvec3i size)
+    {
+        const lightgrid_samples_t &first = result_at(mins);
+
+        for (int c = 0; c < 8; ++c) {
+            const qvec3i p = corner(c, mins, size);
+            if (occluded_at(p))
+                return false;
+
+            const lightgrid_samples_t &other = result_at(p);
+            if (!same_styles(first, other) || !within_threshold(first, other))
+                return false;
+        }
+
+        // check the corners predict the middle of the region
+        const qvec3i middle = GetDivisionPoint(mins, size);
+        sample(middle);
+        if (occluded_at(middle))
+            return false;
+        if (!same_styles(first, result_at(middle)))
+            return false;
+        return within_threshold(result_at(middle), interpolate(mins, size, middle));
+    }
+
+    template<typename F>
+    static void for_each_point(qvec3i mins, qvec3i size, F &&f)
+    {
+        for (int z = mins[2]; z < (mins[2] + size[2]); ++z) {
+            for (int y = mins[1]; y < (mins[1] + size[1]); ++y) {
+                for (int x = mins[0]; x < (mins[0] + size[0]); ++x) {
+                    f(qvec3i{x, y, z});
+                }
+            }
+        }
+    }
+
+public:
+    std::unique_ptr<adaptive_region_t> resolve(qvec3i mins, qvec3i size)
+    {
+        auto region = std::make_unique<adaptive_region_t>();
+        region->mins = mins;
+        region->size = size;
+
+        // skip regions that are entirely in solid, without tracing anything.
+        // (expand the box so points FixPointAndCalcLightgrid would move out of solid aren't missed)
+        box_contents_t contents;
+        const qvec3d margin{ADAPTIVE_SOLID_MARGIN};
+        const qvec3d world_mins = qvec3d(data.grid_index_to_world(mins)) - margin;
+        const qvec3d world_maxs = qvec3d(data.grid_index_to_world(mins + size - qvec3i(1, 1, 1))) + margin;
+        Lightgrid_BoxContents_r(bsp, bsp.dmodels[0].headnode[0], world_mins, world_maxs, contents);
+
+        if (!contents.empty) {
+            for_each_point(mins, size, [&](qvec3i p) {
+                const int i = data.get_grid_index(p[0], p[1], p[2]);
+                if (!sampled[i]) {
+                    data.grid_result[i] = {};
+                    data.occlusion[i] = true;
+                    sampled[i] = true;
+                    num_occluded++;
+                }
+            });
+            region->kind = adaptive_region_kind_t::OCCLUDED;
+            return region;
+        }
+
+        for (int c = 0; c < 8; ++c) {
+            sample(corner(c, mins, size));
+        }
+
+        // every point is a corner; nothing left to decide
+        if (size[0] <= 2 && size[1] <= 2 && size[2] <= 2) {
+            region->kind = adaptive_region_kind_t::LEAF;
+            return region;
+        }
+
+        if (!contents.solid && can_interpolate(mins, size)) {
+            for_each_point(mins, size, [&](qvec3i p) {
+                const int i = data.get_grid_index(p[0], p[1], p[2]);
+                if (!sampled[i]) {
+                    data.grid_result[i] = interpolate(mins, size, p);
+                    data.occlusion[i] = false;
+                    sampled[i] = true;
+                    num_interpolated++;
+                }
+            });
+            region->kind = adaptive_region_kind_t::LEAF;
+            return region;
+        }
+
+        region->kind = adaptive_region_kind_t::SPLIT;
+        region->division_point = GetDivisionPoint(mins, size);
+
+        tbb::parallel_for(0, 8, [&](int i) {
+            auto [child_mins, child_size] = GetOctant(i, mins, size, region->division_point);
+            if (child_size[0] > 0 && child_size[1] > 0 && child_size[2] > 0) {
+                region->children[i] = resolve(child_mins, child_size);
+            }
+        });
+
+        return region;
+    }
+};
+
+/**
+ * converts the adaptive regions into the same octree MakeOctreeLump writes out for the dense grid
+ */
+static uint32_t BuildOctreeFromRegions_r(const adaptive_region_t &region, int depth, lightgrid_octree_t &octree)
+{
+    const qvec3i &size = region.size;
+
+    if (region.kind == adaptive_region_kind_t::OCCLUDED) {
+        octree.occluded_cells += size[0] * size[1] * size[2];
+        return OCTREE_FLAG_OCCLUDED;
+    }
+
+    if (region.kind == adaptive_region_kind_t::LEAF || !CanBeOctreeNode(size, depth)) {
+        const uint32_t leafnum = static_cast<uint32_t>(octree.leafs.size());
+        octree.leafs.push_back({.mins = region.mins, .size = size});
+        return OCTREE_FLAG_LEAF | leafnum;
+    }
+
+    std::array<uint32_t, 8> children;
+    for (int i = 0; i < 8; ++i) {
+        // nodes are at least OCTREE_MIN_NODE_DIMENSION on each axis, so every octant is non-empty
+        Q_assert(region.children[i] != nullptr);
+        children[i] = BuildOctreeFromRegions_r(*region.children[i], depth + 1, octree);
+    }
+
+    const uint32_t nodenum = static_cast<uint32_t>(octree.nodes.size());
+    octree.nodes.push_back({.division_point = region.division_point, .children = children});
+    return nodenum;
+}
+
+static size_t lightgrid_points_traced = 0;
+
+size_t LightGridPointsTraced()
+{
+    return lightgrid_points_traced;
+}
+
 void LightGrid(bspdata_t *bspdata)
 {
+    lightgrid_points_traced = 0;
+
     if (!light_options.lightgrid.value())
         return;
 
@@ -410,21 +783,40 @@ void LightGrid(bspdata_t *bspdata)
 
     data.occlusion.resize(data.grid_size[0] * data.grid_size[1] * data.grid_size[2]);
 
-    logging::parallel_for(0, data.grid_size[0] * data.grid_size[1] * data.grid_size[2], [&](int sample_index) {
-        const int z = (sample_index / (data.grid_size[0] * data.grid_size[1]));
-        const int y = (sample_index / data.grid_size[0]) % data.grid_size[1];
-        const int x = sample_index % data.grid_size[0];
+    lightgrid_octree_t octree;
 
-        qvec3f world_point = data.grid_mins + (qvec3f{x, y, z} * data.grid_dist);
+    if (light_options.lightgrid_adaptive.value()) {
+        adaptive_lightgrid_t adaptive(bsp, data, light_options.lightgrid_adaptive_threshold.value());
 
-        bool occluded;
-        lightgrid_samples_t samples;
+        const auto root = adaptive.resolve(qvec3i{0, 0, 0}, data.grid_size);
+        octree.root_node = BuildOctreeFromRegions_r(*root, 0, octree);
+
+        const size_t total = data.grid_result.size();
+        logging::print("     {} of {} grid points sampled, {} interpolated, {} skipped as occluded ({:.1f} percent "
+                       "traced)\n",
+            adaptive.num_sampled.load(), total, adaptive.num_interpolated.load(), adaptive.num_occluded.load(),
+            100.0f * adaptive.num_sampled.load() / (float)total);
+
+        lightgrid_points_traced = adaptive.num_sampled.load();
+    } else {
+        logging::parallel_for(0, data.grid_size[0] * data.grid_size[1] * data.grid_size[2], [&](int sample_index) {
+            const int z = (sample_index / (data.grid_size[0] * data.grid_size[1]));
+            const int y = (sample_index / data.grid_size[0]) % data.grid_size[1];
+            const int x = sample_index % data.grid_size[0];
 
-        std::tie(samples, occluded) = FixPointAndCalcLightgrid(&bsp, world_point);
+            qvec3f world_point = data.grid_mins + (qvec3f{x, y, z} * data.grid_dist);
 
-        data.grid_result[sample_index] = samples;
-        data.occlusion[sample_index] = occluded;
-    });
+            bool occluded;
+            lightgrid_samples_t samples;
+
+            std::tie(samples, occluded) = FixPointAndCalcLightgrid(&bsp, world_point);
+
+            data.grid_result[sample_index] = samples;
+            data.occlusion[sample_index] = occluded;
+        });
+
+        lightgrid_points_traced = data.grid_result.size();
+    }
 
     // the maximum used styles across the map.
     data.num_styles = [&]() {
@@ -443,6 +835,9 @@ void LightGrid(bspdata_t *bspdata)
 
     // octree lump
     if (light_options.lightgrid_format.value() == lightgrid_format_t::OCTREE) {
-        bspdata->bspx.transfer("LIGHTGRID_OCTREE", MakeOctreeLump(bsp, data));
+        if (!light_options.lightgrid_adaptive.value()) {
+            octree = BuildOctree(data);
+        }
+        bspdata->bspx.transfer("LIGHTGRID_OCTREE", MakeOctreeLump(data, octree));
     }
 }
@@ -0,0 +1,343 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#include <light/lightstats.hh>
+
+#include <light/entities.hh>
+#include <light/light.hh>
+
+#include <common/bsputils.hh>
+#include <common/json.hh>
+#include <common/log.hh>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+#include <tbb/enumerable_thread_specific.h>
+
+using namespace std::chrono_literals;
+
+static constexpr std::array<const char *, LIGHTSTAT_SOURCES> source_names{
+    "entity", "sky", "surface", "bounce", "dirt", "minlight"};
+static constexpr std::array<const char *, LIGHTSTAT_PHASES> phase_names{"direct", "indirect", "postprocess"};
+
+struct lightstat_totals_t
+{
+    uint64_t rays = 0;
+    uint64_t occluded = 0;
+    std::chrono::nanoseconds time = 0ns;
+
+    inline lightstat_totals_t &operator+=(const lightstat_totals_t &other)
+    {
+        rays += other.rays;
+        occluded += other.occluded;
+        time += other.time;
+        return *this;
+    }
+};
+
+struct lightstat_thread_t
+{
+    std::array<lightstat_totals_t, LIGHTSTAT_SOURCES> sources;
+    std::array<std::chrono::nanoseconds, LIGHTSTAT_PHASES> phases{};
+    // per-emitter totals, by the index passed to LightStats_AddRays;
+    // sized on a thread's first batch from each source
+    std::array<std::vector<lightstat_totals_t>, LIGHTSTAT_SOURCES> lights;
+};
+
+// a face is only ever lit by one thread at a time, so these
+// don't need to be per-thread
+struct lightstat_face_t
+{
+    std::array<std::chrono::nanoseconds, LIGHTSTAT_PHASES> phases{};
+    std::array<uint64_t, LIGHTSTAT_SOURCES> rays{};
+
+    inline std::chrono::nanoseconds total_time() const
+    {
+        std::chrono::nanoseconds total = 0ns;
+        for (auto &t : phases) {
+            total += t;
+        }
+        return total;
+    }
+};
+
+static tbb::enumerable_thread_specific<lightstat_thread_t> thread_stats;
+static std::vector<lightstat_face_t> face_stats;
+// number of emitters of each source
+static std::array<size_t, LIGHTSTAT_SOURCES> light_counts{};
+
+void LightStats_Init(size_t numfaces)
+{
+    ResetLightStats();
+    face_stats.resize(numfaces);
+
+    light_counts[static_cast<size_t>(lightstat_source_t::ENTITY)] = GetLights().size();
+    light_counts[static_cast<size_t>(lightstat_source_t::MINLIGHT)] = GetLights().size();
+    light_counts[static_cast<size_t>(lightstat_source_t::SKY)] = GetSuns().size();
+    light_counts[static_cast<size_t>(lightstat_source_t::SURFACE)] = numfaces;
+    light_counts[static_cast<size_t>(lightstat_source_t::BOUNCE)] = numfaces;
+}
+
+void ResetLightStats()
+{
+    thread_stats.clear();
+    face_stats.clear();
+    light_counts = {};
+}
+
+void LightStats_AddRays(lightstat_source_t source, int32_t face, size_t light, size_t rays, size_t occluded,
+    qclock::duration elapsed)
+{
+    const size_t s = static_cast<size_t>(source);
+    const lightstat_totals_t batch{rays, occluded, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)};
+
+    lightstat_thread_t &stats = thread_stats.local();
+    stats.sources[s] += batch;
+
+    if (light < light_counts[s]) {
+        std::vector<lightstat_totals_t> &lights = stats.lights[s];
+
+        if (lights.empty()) {
+            lights.resize(light_counts[s]);
+        }
+
+        lights[light] += batch;
+    }
+
+    if (face >= 0 && static_cast<size_t>(face) < face_stats.size()) {
+        face_stats[face].rays[s] += rays;
+    }
+}
+
+void LightStats_AddRays(lightstat_source_t source, int32_t face, size_t light, size_t rays, size_t occluded,
+    qclock::time_point start)
+{
+    LightStats_AddRays(source, face, light, rays, occluded, qclock::now() - start);
+}
+
+lightstats_phase_timer_t::~lightstats_phase_timer_t()
+{
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(qclock::now() - start);
+    const size_t p = static_cast<size_t>(phase);
+
+    thread_stats.local().phases[p] += elapsed;
+
+    if (face >= 0 && static_cast<size_t>(face) < face_stats.size()) {
+        face_stats[face].phases[p] += elapsed;
+    }
+}
+
+struct lightstat_merged_t
+{
+    std::array<lightstat_totals_t, LIGHTSTAT_SOURCES> sources;
+    std::array<std::chrono::nanoseconds, LIGHTSTAT_PHASES> phases{};
+    std::array<std::vector<lightstat_totals_t>, LIGHTSTAT_SOURCES> lights;
+};
+
+static lightstat_merged_t LightStats_Merge()
+{
+    lightstat_merged_t merged;
+
+    for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+        merged.lights[s].resize(light_counts[s]);
+    }
+
+    for (const lightstat_thread_t &stats : thread_stats) {
+        for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+            merged.sources[s] += stats.sources[s];
+
+            for (size_t i = 0; i < stats.lights[s].size(); i++) {
+                merged.lights[s][i] += stats.lights[s][i];
+            }
+        }
+
+        for (size_t p = 0; p < LIGHTSTAT_PHASES; p++) {
+            merged.phases[p] += stats.phases[p];
+        }
+    }
+
+    return merged;
+}
+
+static double seconds(std::chrono::nanoseconds ns)
+{
+    return std::chrono::duration<double>(ns).count();
+}
+
+void LightStats_Print()
+{
+    const lightstat_merged_t merged = LightStats_Merge();
+
+    logging::print("ray stats (thread-seconds):\n");
+
+    for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+        const lightstat_totals_t &totals = merged.sources[s];
+
+        if (!totals.rays) {
+            continue;
+        }
+
+        logging::print("{:>12} rays, {:>12} occluded, {:10.3f}s {}\n", totals.rays, totals.occluded,
+            seconds(totals.time), source_names[s]);
+    }
+
+    for (size_t p = 0; p < LIGHTSTAT_PHASES; p++) {
+        if (merged.phases[p] == 0ns) {
+            continue;
+        }
+
+        logging::print("{:10.3f}s {}\n", seconds(merged.phases[p]), phase_names[p]);
+    }
+}
+
+static json LightStats_DescribeLight(const mbsp_t *bsp, lightstat_source_t source, size_t light)
+{
+    json j = json::object();
+
+    switch (source) {
+        case lightstat_source_t::ENTITY:
+        case lightstat_source_t::MINLIGHT: {
+            const light_t &entity = *GetLights()[light];
+
+            j["index"] = light;
+            j["classname"] = entity.classname();
+            j["origin"] = entity.origin.value();
+            j["light"] = entity.light.value();
+            j["style"] = entity.style.value();
+            break;
+        }
+        case lightstat_source_t::SKY: {
+            const sun_t &sun = GetSuns()[light];
+
+            j["index"] = light;
+            j["sunvec"] = sun.sunvec;
+            j["sunlight"] = sun.sunlight;
+            j["style"] = sun.style;
+            break;
+        }
+        case lightstat_source_t::SURFACE:
+        case lightstat_source_t::BOUNCE: {
+            j["face"] = light;
+            j["texture"] = Face_TextureName(bsp, BSP_GetFace(bsp, light));
+            break;
+        }
+        default: break;
+    }
+
+    return j;
+}
+
+void LightStats_WriteJSON(const mbsp_t *bsp, const fs::path &filename)
+{
+    const lightstat_merged_t merged = LightStats_Merge();
+
+    json j = json::object();
+
+    // totals
+    json &phases = j["phases"] = json::object();
+
+    for (size_t p = 0; p < LIGHTSTAT_PHASES; p++) {
+        phases[phase_names[p]] = {{"seconds", seconds(merged.phases[p])}};
+    }
+
+    json &sources = j["sources"] = json::object();
+
+    for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+        const lightstat_totals_t &totals = merged.sources[s];
+        sources[source_names[s]] = {
+            {"rays", totals.rays}, {"occluded", totals.occluded}, {"seconds", seconds(totals.time)}};
+    }
+
+    // most expensive faces
+    std::vector<size_t> faces;
+    faces.reserve(face_stats.size());
+
+    for (size_t i = 0; i < face_stats.size(); i++) {
+        if (face_stats[i].total_time() > 0ns) {
+            faces.push_back(i);
+        }
+    }
+
+    const size_t num_faces = std::min(faces.size(), LIGHTSTAT_TOP_N);
+    std::partial_sort(faces.begin(), faces.begin() + num_faces, faces.end(),
+        [](size_t a, size_t b) { return face_stats[a].total_time() > face_stats[b].total_time(); });
+
+    json &top_faces = j["faces"] = json::array();
+
+    for (size_t i = 0; i < num_faces; i++) {
+        const lightstat_face_t &stats = face_stats[faces[i]];
+        const mface_t *face = BSP_GetFace(bsp, faces[i]);
+        json &entry = top_faces.emplace_back(json::object());
+
+        entry["face"] = faces[i];
+        entry["texture"] = Face_TextureName(bsp, face);
+        entry["seconds"] = seconds(stats.total_time());
+
+        for (size_t p = 0; p < LIGHTSTAT_PHASES; p++) {
+            entry["phases"][phase_names[p]] = seconds(stats.phases[p]);
+        }
+
+        for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+            if (stats.rays[s]) {
+                entry["rays"][source_names[s]] = stats.rays[s];
+            }
+        }
+    }
+
+    // most expensive lights, across all types
+    struct light_cost_t
+    {
+        lightstat_source_t source;
+        size_t light;
+        lightstat_totals_t totals;
+    };
+
+    std::vector<light_cost_t> lights;
+
+    for (size_t s = 0; s < LIGHTSTAT_SOURCES; s++) {
+        for (size_t i = 0; i < merged.lights[s].size(); i++) {
+            if (merged.lights[s][i].rays) {
+                lights.push_back({static_cast<lightstat_source_t>(s), i, merged.lights[s][i]});
+            }
+        }
+    }
+
+    const size_t num_lights = std::min(lights.size(), LIGHTSTAT_TOP_N);
+    std::partial_sort(lights.begin(), lights.begin() + num_lights, lights.end(),
+        [](const light_cost_t &a, const light_cost_t &b) { return a.totals.time > b.totals.time; });
+
+    json &top_lights = j["lights"] = json::array();
+
+    for (size_t i = 0; i < num_lights; i++) {
+        const light_cost_t &cost = lights[i];
+        json &entry = top_lights.emplace_back(LightStats_DescribeLight(bsp, cost.source, cost.light));
+
+        entry["type"] = source_names[static_cast<size_t>(cost.source)];
+        entry["rays"] = cost.totals.rays;
+        entry["occluded"] = cost.totals.occluded;
+        entry["seconds"] = seconds(cost.totals.time);
+    }
+
+    logging::print("writing light stats to {}\n", filename);
+
+    std::ofstream(filename, std::fstream::out | std::fstream::trunc) << std::setw(4) << j;
+}
@@ -27,6 +27,7 @@
 #include <light/lightgrid.hh>
 #include <light/trace.hh>
 #include <light/write.hh> // for facesup_t
+#include <light/lightstats.hh>
 
 #include <common/imglib.hh>
 #include <common/log.hh>
@@ -40,12 +41,6 @@
 #include <algorithm>
 #include <fstream>
 
-#if 0
-std::atomic<uint32_t> total_light_rays, total_light_ray_hits, total_samplepoints;
-std::atomic<uint32_t> total_bounce_rays, total_bounce_ray_hits;
-std::atomic<uint32_t> total_surflight_rays, total_surflight_ray_hits; // mxd
-#endif
-
 thread_local static raystream_occlusion_t occlusion_stream;
 thread_local static raystream_intersection_t intersection_stream;
 
@@ -735,9 +730,13 @@ static void Lightmap_AllocOrClear(lightmap_t *lightmap, const lightsurf_t *light
     if (!lightmap->samples.size()) {
         /* first use of this lightmap, allocate the storage for it. */
         lightmap->samples.resize(lightsurf->samples.size());
+        if (light_options.write_luxfile) {
+            lightmap->directions.resize(lightsurf->samples.size());
+        }
     } else if (lightmap->style != INVALID_LIGHTSTYLE) {
         /* clear only the data that is going to be merged to it. there's no point clearing more */
         std::fill_n(lightmap->samples.begin(), lightsurf->samples.size(), lightsample_t{});
+        std::fill(lightmap->directions.begin(), lightmap->directions.end(), qvec3f{});
         lightmap->bounce_color = {};
     }
 }
@@ -1195,13 +1194,229 @@ static bool VisCullEntity(const mbsp_t *bsp, const std::vector<uint8_t> &pvs, co
     return !Pvs_LeafVisible(bsp, pvs, entleaf);
 }
 
+/*
+ * ============================================================================
+ * LIGHT ENTITY BVH
+ *
+ * Bounding volume hierarchy over the light entities, so each face only
+ * visits the lights that CullLight could possibly keep. Every candidate
+ * still goes through the full tests in LightFace_Entity.
+ * ============================================================================
+ */
+
+struct light_bvh_t
+{
+    struct node_t
+    {
+        // union of origin +/- cull range of each light (see LightCullRange)
+        aabb3f reach;
+        // union of light_t::bounds, for -visapprox rays. infinite if any light
+        // in the subtree can't be culled by its visible bounds
+        aabb3f visible_bounds;
+        // leafs: range of entries. inner nodes: first is the index of the left child; right child follows it
+        uint32_t first = 0;
+        uint32_t count = 0;
+
+        constexpr bool is_leaf() const { return count != 0; }
+    };
+
+    std::vector<node_t> nodes;
+    // indices into GetLights()
+    std::vector<uint32_t> entries;
+    // per light, indexed like GetLights()
+    std::vector<aabb3f> reach;
+};
+
+static light_bvh_t light_bvh;
+
+static constexpr uint32_t LIGHT_BVH_LEAF_SIZE = 4;
+
+static const aabb3f INFINITE_AABB{qvec3f(-FLT_MAX), qvec3f(FLT_MAX)};
+
+/*
+ * returns the distance from the light at which fabs(GetLightValue()) drops to
+ * the gate, and stays there, or infinity if it never does (infinite lights,
+ * no attenuation, etc.). CullLight culls anything at least this far away.
+ */
+static float LightCullRange(const settings::worldspawn_keys &cfg, const light_t *entity)
+{
+    constexpr float MAX_RANGE = 1048576.0f;
+
+    const float gate = light_options.gate.value();
+    auto is_culled = [&](float dist) { return fabs(GetLightValue(cfg, entity, dist)) <= gate; };
+
+    if (entity->getFormula() == LF_INFINITE || entity->getFormula() == LF_LOCALMIN) {
+        return std::numeric_limits<float>::infinity();
+    }
+
+    // all the other formulas fall off monotonically with distance, so find a distance where the
+    // light is culled, then binary search back towards the light
+    float hi = 1.0f;
+    while (!is_culled(hi)) {
+        hi *= 2.0f;
+        if (hi > MAX_RANGE) {
+            return std::numeric_limits<float>::infinity();
+        }
+    }
+
+    float lo = 0.0f;
+    for (int i = 0; i < 32; i++) {
+        const float mid = (lo + hi) * 0.5f;
+        if (is_culled(mid)) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+
+    return hi;
+}
+
+static void BuildLightBVH_r(uint32_t nodenum, uint32_t first, uint32_t count)
+{
+    light_bvh_t &bvh = light_bvh;
+    light_bvh_t::node_t node;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        const light_t *entity = GetLights()[bvh.entries[i]].get();
+
+        node.reach += bvh.reach[bvh.entries[i]];
+
+        // same conditions as the bounds test in CullLight
+        if (entity->light_channel_mask.value() == CHANNEL_MASK_DEFAULT &&
+            entity->shadow_channel_mask.value() == CHANNEL_MASK_DEFAULT) {
+            node.visible_bounds += entity->bounds;
+        } else {
+            node.visible_bounds = INFINITE_AABB;
+        }
+    }
+
+    if (count <= LIGHT_BVH_LEAF_SIZE) {
+        node.first = first;
+        node.count = count;
+        bvh.nodes[nodenum] = node;
+        return;
+    }
+
+    // median split along the longest axis, by origin
+    aabb3f origins;
+    for (uint32_t i = first; i < first + count; i++) {
+        origins += GetLights()[bvh.entries[i]]->origin.value();
+    }
+
+    const qvec3f size = origins.size();
+    const int axis = (size[0] >= size[1] && size[0] >= size[2]) ? 0 : (size[1] >= size[2]) ? 1 : 2;
+    const uint32_t half = count / 2;
+
+    std::nth_element(bvh.entries.begin() + first, bvh.entries.begin() + first + half,
+        bvh.entries.begin() + first + count, [axis](uint32_t a, uint32_t b) {
+            return GetLights()[a]->origin.value()[axis] < GetLights()[b]->origin.value()[axis];
+        });
+
+    node.first = bvh.nodes.size();
+    node.count = 0;
+    bvh.nodes[nodenum] = node;
+    bvh.nodes.resize(bvh.nodes.size() + 2);
+
+    BuildLightBVH_r(node.first, first, half);
+    BuildLightBVH_r(node.first + 1, first + half, count - half);
+}
+
+void BuildLightBVH(const settings::worldspawn_keys &cfg)
+{
+    light_bvh = {};
+
+    const auto &lights = GetLights();
+
+    if (lights.empty()) {
+        return;
+    }
+
+    light_bvh.reach.resize(lights.size());
+    light_bvh.entries.resize(lights.size());
+
+    for (size_t i = 0; i < lights.size(); i++) {
+        const float range = LightCullRange(cfg, lights[i].get());
+
+        if (std::isinf(range)) {
+            light_bvh.reach[i] = INFINITE_AABB;
+        } else {
+            light_bvh.reach[i] = aabb3f(lights[i]->origin.value()).grow(qvec3f(range));
+        }
+
+        light_bvh.entries[i] = static_cast<uint32_t>(i);
+    }
+
+    light_bvh.nodes.resize(1);
+    BuildLightBVH_r(0, 0, light_bvh.entries.size());
+}
+
+/*
+ * returns the indices into GetLights() of the lights that might reach lightsurf,
+ * in GetLights() order
+ */
+static const std::vector<uint32_t> &LightBVH_CandidateLights(const lightsurf_t *lightsurf)
+{
+    thread_local static std::vector<uint32_t> result;
+    result.clear();
+
+    const light_bvh_t &bvh = light_bvh;
+
+    // not built for this set of lights, or turned off; don't cull anything
+    if (light_options.nolightbvh.value() || bvh.entries.size() != GetLights().size()) {
+        for (uint32_t i = 0; i < GetLights().size(); i++) {
+            result.push_back(i);
+        }
+        return result;
+    }
+
+    if (bvh.nodes.empty()) {
+        return result;
+    }
+
+    // the box around the surface bounding sphere; CullLight measures distance to the sphere
+    const aabb3f surf_sphere_bounds = aabb3f(lightsurf->extents.origin).grow(qvec3f(lightsurf->extents.radius));
+    const bool use_visible_bounds = light_options.visapprox.value() == visapprox_t::RAYS;
+
+    uint32_t stack[64];
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size) {
+        const light_bvh_t::node_t &node = bvh.nodes[stack[--stack_size]];
+
+        if (node.reach.disjoint(surf_sphere_bounds, 1.0f)) {
+            continue;
+        }
+        if (use_visible_bounds && node.visible_bounds.disjoint(lightsurf->extents.bounds, 0.001f)) {
+            continue;
+        }
+
+        if (node.is_leaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (!bvh.reach[bvh.entries[i]].disjoint(surf_sphere_bounds, 1.0f)) {
+                    result.push_back(bvh.entries[i]);
+                }
+            }
+        } else {
+            stack[stack_size++] = node.first + 1;
+            stack[stack_size++] = node.first;
+        }
+    }
+
+    // return them in GetLights() order so the sums come out the same as a plain loop
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
 /*
  * ================
  * LightFace_Entity
  * ================
  */
 static void LightFace_Entity(
-    const mbsp_t *bsp, const light_t *entity, lightsurf_t *lightsurf, lightmapdict_t *lightmaps)
+    const mbsp_t *bsp, const light_t *entity, size_t lightnum, lightsurf_t *lightsurf, lightmapdict_t *lightmaps)
 {
     const settings::worldspawn_keys &cfg = *lightsurf->cfg;
     const modelinfo_t *modelinfo = lightsurf->modelinfo;
@@ -1241,6 +1456,7 @@ static void LightFace_Entity(
     /*
      * Check it for real
      */
+    const auto stat_start = qclock::now();
     raystream_occlusion_t &rs = occlusion_stream;
     rs.clearPushedRays();
 
@@ -1274,23 +1490,18 @@ static void LightFace_Entity(
 
     // don't need closest hit, just checking for occlusion between light and surface point
     rs.tracePushedRaysOcclusion(modelinfo, entity->shadow_channel_mask.value());
-#if 0
-    total_light_rays += rs.numPushedRays();
-#endif
 
     int cached_style = entity->style.value();
     lightmap_t *cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
 
     const int N = rs.numPushedRays();
+    size_t occluded = 0;
     for (int j = 0; j < N; j++) {
         if (rs.getPushedRayOccluded(j)) {
+            occluded++;
             continue;
         }
 
-#if 0
-        total_light_ray_hits++;
-#endif
-
         const ray_io &ray = rs.getRay(j);
 
         int i = ray.index;
@@ -1321,10 +1532,15 @@ static void LightFace_Entity(
 
         sample.color += rs.getPushedRayColor(j);
         cached_lightmap->bounce_color += rs.getPushedRayColor(j);
-        sample.direction += ray.normalcontrib;
+        if (!cached_lightmap->directions.empty()) {
+            cached_lightmap->directions[i] += ray.normalcontrib;
+        }
 
         Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
     }
+
+    LightStats_AddRays(
+        lightstat_source_t::ENTITY, Face_GetNum(bsp, lightsurf->face), lightnum, N, occluded, stat_start);
 }
 
 #define LIGHTPOINT_TAKE_MAX
@@ -1384,125 +1600,236 @@ static void LightPoint_Entity(const mbsp_t *bsp, raystream_occlusion_t &rs, cons
     }
 }
 
+// upper bound on rays traced in one batch by LightFace_Sky, to bound the per-thread stream size
+constexpr size_t SKY_MAX_BATCH_RAYS = 65536;
+
+// how far past the scene bounds sky rays are traced, to be safe against rounding
+constexpr float SKY_TRACE_MARGIN = 16.0f;
+
+/*
+ * =============
+ * SkyTraceDist
+ *
+ * Distance along `dir` from `origin` to just past the edge of the scene.
+ * A sky face can't be further away than that, so this is used instead of
+ * MAX_SKY_DIST to keep rays that escape the map short.
+ * =============
+ */
+static float SkyTraceDist(const qvec3f &origin, const qvec3f &dir)
+{
+    const aabb3f &bounds = Embree_SceneBounds();
+
+    if (light_options.nobatchsky.value() || !bounds.valid()) {
+        return MAX_SKY_DIST;
+    }
+
+    float dist = MAX_SKY_DIST;
+
+    for (int i = 0; i < 3; i++) {
+        if (dir[i] > 0) {
+            dist = std::min(dist, (bounds.maxs()[i] - origin[i]) / dir[i]);
+        } else if (dir[i] < 0) {
+            dist = std::min(dist, (bounds.mins()[i] - origin[i]) / dir[i]);
+        }
+    }
+
+    return std::clamp(dist + SKY_TRACE_MARGIN, SKY_TRACE_MARGIN, MAX_SKY_DIST);
+}
+
 /*
  * =============
  * LightFace_Sky
+ *
+ * Light the face from every sun with positive (or negative) sunlight.
+ * The rays for all of the suns go in as few intersection streams as
+ * possible, with the suns grouped by style and suntexture so consecutive
+ * hits mostly land in the same lightmap.
  * =============
  */
-static void LightFace_Sky(const mbsp_t *bsp, const sun_t *sun, lightsurf_t *lightsurf, lightmapdict_t *lightmaps)
+static void LightFace_Sky(const mbsp_t *bsp, bool negative, lightsurf_t *lightsurf, lightmapdict_t *lightmaps)
 {
     const settings::worldspawn_keys &cfg = *lightsurf->cfg;
     const modelinfo_t *modelinfo = lightsurf->modelinfo;
     const qplane3f &plane = lightsurf->plane;
 
-    // FIXME: Normalized sun vector should be stored in the sun_t. Also clarify which way the vector points (towards or
-    // away..)
-    // FIXME: Much of this is copied/pasted from LightFace_Entity, should probably be merged
-    qvec3f incoming = qv::normalize(sun->sunvec);
-
-    /* Don't bother if surface facing away from sun */
-    const float dp = qv::dot(incoming, plane.normal);
-    if (dp < -LIGHT_ANGLE_EPSILON && !lightsurf->curved && !lightsurf->twosided) {
+    // check lighting channels (currently sunlight is always on CHANNEL_MASK_DEFAULT)
+    if (!(lightsurf->object_channel_mask & CHANNEL_MASK_DEFAULT)) {
         return;
     }
 
-    // check lighting channels (currently sunlight is always on CHANNEL_MASK_DEFAULT)
-    if (!(lightsurf->object_channel_mask & CHANNEL_MASK_DEFAULT)) {
+    thread_local static std::vector<const sun_t *> suns;
+    thread_local static std::vector<uint32_t> ray_suns; // index into suns of each pushed ray
+    thread_local static std::vector<size_t> sun_rays, sun_occluded;
+
+    suns.clear();
+
+    for (const sun_t &sun : GetSuns()) {
+        if (negative ? (sun.sunlight < 0) : (sun.sunlight > 0)) {
+            suns.push_back(&sun);
+        }
+    }
+
+    if (suns.empty()) {
         return;
     }
 
-    /* Check each point... */
+    // -nobatchsky traces each sun on its own, in GetSuns() order
+    const bool batch_suns = !light_options.nobatchsky.value();
+
+    if (batch_suns) {
+        std::stable_sort(suns.begin(), suns.end(), [](const sun_t *a, const sun_t *b) {
+            return std::tie(a->style, a->suntexture_value) < std::tie(b->style, b->suntexture_value);
+        });
+    }
+
+    sun_rays.assign(suns.size(), 0);
+    sun_occluded.assign(suns.size(), 0);
+
+    const auto stat_start = qclock::now();
     raystream_intersection_t &rs = intersection_stream;
     rs.clearPushedRays();
+    ray_suns.clear();
 
-    for (int i = 0; i < lightsurf->samples.size(); i++) {
-        const auto &sample = lightsurf->samples[i];
+    // the lightmap being written to; only one is held at a time, since
+    // Lightmap_ForStyle can invalidate the others
+    int cached_style = INVALID_LIGHTSTYLE;
+    lightmap_t *cached_lightmap = nullptr;
 
-        if (sample.occluded)
-            continue;
+    auto trace_batch = [&]() {
+        // We need to check if the first hit face is a sky face, so we need
+        // to test intersection (not occlusion)
+        rs.tracePushedRaysIntersection(modelinfo, CHANNEL_MASK_DEFAULT);
 
-        const qvec3f &surfpoint = sample.point;
-        const qvec3f &surfnorm = sample.normal;
+        const int N = rs.numPushedRays();
+
+        for (int j = 0; j < N; j++) {
+            const uint32_t s = ray_suns[j];
+            const sun_t *sun = suns[s];
 
-        float angle = qv::dot(incoming, surfnorm);
-        if (lightsurf->twosided) {
-            if (angle < 0) {
-                angle = -angle;
+            sun_rays[s]++;
+
+            if (rs.getPushedRayHitType(j) != hittype_t::SKY) {
+                sun_occluded[s]++;
+                continue;
+            }
+
+            // check if we hit the wrong texture
+            if (sun->suntexture_value) {
+                const triinfo *face = rs.getPushedRayHitFaceInfo(j);
+                if (sun->suntexture_value != face->texture) {
+                    sun_occluded[s]++;
+                    continue;
+                }
+            }
+
+            const ray_io &ray = rs.getRay(j);
+            const int i = ray.index;
+
+            // check if we hit a dynamic shadow caster
+            int desired_style = sun->style;
+            if (desired_style == 0) {
+                desired_style = ray.dynamic_style;
+            }
+
+            // if necessary, switch which lightmap we are writing to.
+            if (!cached_lightmap || desired_style != cached_style) {
+                cached_style = desired_style;
+                cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
             }
-        }
 
-        angle = std::max(0.0f, angle);
+            lightsample_t &sample = cached_lightmap->samples[i];
 
-        angle = (1.0f - sun->anglescale) + sun->anglescale * angle;
-        float value = angle * sun->sunlight;
+            sample.color += rs.getPushedRayColor(j);
+            cached_lightmap->bounce_color += rs.getPushedRayColor(j);
+            if (!cached_lightmap->directions.empty()) {
+                cached_lightmap->directions[i] += ray.normalcontrib;
+            }
 
-        if (sun->dirt) {
-            value *= Dirt_GetScaleFactor(cfg, sample.occlusion, NULL, 0.0f, lightsurf);
+            Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
         }
 
-        qvec3f color = sun->sunlight_color * (value / 255.0f);
+        rs.clearPushedRays();
+        ray_suns.clear();
+    };
 
-        /* Quick distance check first */
-        if (fabs(LightSample_Brightness(color)) <= light_options.gate.value()) {
+    for (uint32_t s = 0; s < suns.size(); s++) {
+        const sun_t *sun = suns[s];
+
+        // FIXME: Normalized sun vector should be stored in the sun_t. Also clarify which way the vector points
+        // (towards or away..)
+        // FIXME: Much of this is copied/pasted from LightFace_Entity, should probably be merged
+        qvec3f incoming = qv::normalize(sun->sunvec);
+
+        /* Don't bother if surface facing away from sun */
+        const float dp = qv::dot(incoming, plane.normal);
+        if (dp < -LIGHT_ANGLE_EPSILON && !lightsurf->curved && !lightsurf->twosided) {
             continue;
         }
 
-        qvec3f normalcontrib = incoming * value;
+        /* Check each point... */
+        for (int i = 0; i < lightsurf->samples.size(); i++) {
+            const auto &sample = lightsurf->samples[i];
 
-        rs.pushRay(i, surfpoint, incoming, MAX_SKY_DIST, &color, &normalcontrib);
-    }
+            if (sample.occluded)
+                continue;
 
-    // We need to check if the first hit face is a sky face, so we need
-    // to test intersection (not occlusion)
-    rs.tracePushedRaysIntersection(modelinfo, CHANNEL_MASK_DEFAULT);
+            const qvec3f &surfpoint = sample.point;
+            const qvec3f &surfnorm = sample.normal;
 
-    /* if sunlight is set, use a style 0 light map */
-    int cached_style = sun->style;
-    lightmap_t *cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
+            float angle = qv::dot(incoming, surfnorm);
+            if (lightsurf->twosided) {
+                if (angle < 0) {
+                    angle = -angle;
+                }
+            }
 
-    const int N = rs.numPushedRays();
-#if 0
-    total_light_rays += N;
-#endif
+            angle = std::max(0.0f, angle);
 
-    for (int j = 0; j < N; j++) {
-        if (rs.getPushedRayHitType(j) != hittype_t::SKY) {
-            continue;
-        }
+            angle = (1.0f - sun->anglescale) + sun->anglescale * angle;
+            float value = angle * sun->sunlight;
+
+            if (sun->dirt) {
+                value *= Dirt_GetScaleFactor(cfg, sample.occlusion, NULL, 0.0f, lightsurf);
+            }
+
+            qvec3f color = sun->sunlight_color * (value / 255.0f);
 
-        // check if we hit the wrong texture
-        if (sun->suntexture_value) {
-            const triinfo *face = rs.getPushedRayHitFaceInfo(j);
-            if (sun->suntexture_value != face->texture) {
+            /* Quick distance check first */
+            if (fabs(LightSample_Brightness(color)) <= light_options.gate.value()) {
                 continue;
             }
-        }
 
-        const ray_io &ray = rs.getRay(j);
-        const int i = ray.index;
+            qvec3f normalcontrib = incoming * value;
 
-        // check if we hit a dynamic shadow caster
-        int desired_style = sun->style;
-        if (desired_style == 0) {
-            desired_style = ray.dynamic_style;
+            rs.pushRay(i, surfpoint, incoming, SkyTraceDist(surfpoint, incoming), &color, &normalcontrib);
+            ray_suns.push_back(s);
         }
 
-        // if necessary, switch which lightmap we are writing to.
-        if (desired_style != cached_style) {
-            cached_style = desired_style;
-            cached_lightmap = Lightmap_ForStyle(lightmaps, cached_style, lightsurf);
+        if (!batch_suns || rs.numPushedRays() >= SKY_MAX_BATCH_RAYS) {
+            trace_batch();
         }
+    }
 
-        lightsample_t &sample = cached_lightmap->samples[i];
+    trace_batch();
 
-        sample.color += rs.getPushedRayColor(j);
-        cached_lightmap->bounce_color += rs.getPushedRayColor(j);
-        sample.direction += ray.normalcontrib;
-#if 0
-        total_light_ray_hits++;
-#endif
+    // the suns were traced together, so split the time between them by ray count
+    const auto elapsed = qclock::now() - stat_start;
+    size_t total_rays = 0;
 
-        Lightmap_Save(bsp, lightmaps, lightsurf, cached_lightmap, cached_style);
+    for (size_t rays : sun_rays) {
+        total_rays += rays;
+    }
+
+    for (size_t s = 0; s < suns.size(); s++) {
+        if (!sun_rays[s]) {
+            continue;
+        }
+
+        const auto share = std::chrono::duration_cast<qclock::duration>(
+            elapsed * (static_cast<double>(sun_rays[s]) / static_cast<double>(total_rays)));
+
+        LightStats_AddRays(lightstat_source_t::SKY, Face_GetNum(bsp, lightsurf->face), suns[s] - GetSuns().data(),
+            sun_rays[s], sun_occluded[s], share);
     }
 }
 
@@ -1552,7 +1879,7 @@ static void LightPoint_Sky(const mbsp_t *bsp, raystream_intersection_t &rs, cons
 
         qvec3f normalcontrib{}; // unused
 
-        rs.pushRay(0, surfpoint, incoming, MAX_SKY_DIST, &color, &normalcontrib);
+        rs.pushRay(0, surfpoint, incoming, SkyTraceDist(surfpoint, incoming), &color, &normalcontrib);
     }
 
     // We need to check if the first hit face is a sky face, so we need
@@ -1727,7 +2054,8 @@ static void LightFace_LocalMin(
         return;
 
     /* Cast rays for local minlight entities */
-    for (const auto &entity : GetLights()) {
+    for (size_t lightnum = 0; lightnum < GetLights().size(); lightnum++) {
+        const auto &entity = GetLights()[lightnum];
         if (entity->getFormula() != LF_LOCALMIN) {
             continue;
         }
@@ -1739,6 +2067,7 @@ static void LightFace_LocalMin(
             continue;
         }
 
+        const auto stat_start = qclock::now();
         raystream_occlusion_t &rs = occlusion_stream;
         rs.clearPushedRays();
 
@@ -1763,13 +2092,12 @@ static void LightFace_LocalMin(
 
         // local minlight just needs occlusion, not closest hit
         rs.tracePushedRaysOcclusion(modelinfo, CHANNEL_MASK_DEFAULT);
-#if 0
-        total_light_rays += rs.numPushedRays();
-#endif
 
         const int N = rs.numPushedRays();
+        size_t occluded = 0;
         for (int j = 0; j < N; j++) {
             if (rs.getPushedRayOccluded(j)) {
+                occluded++;
                 continue;
             }
 
@@ -1786,15 +2114,14 @@ static void LightFace_LocalMin(
             } else {
                 hit = Light_ClampMin(sample, value, entity->color.value()) || hit;
             }
-
-#if 0
-            total_light_ray_hits++;
-#endif
         }
 
         if (hit) {
             Lightmap_Save(bsp, lightmaps, lightsurf, lightmap, entity->style.value());
         }
+
+        LightStats_AddRays(
+            lightstat_source_t::MINLIGHT, Face_GetNum(bsp, face), lightnum, N, occluded, stat_start);
     }
 }
 
@@ -1999,6 +2326,47 @@ SurfaceLight_SphereCull(const surfacelight_t *vpl, const lightsurf_t *lightsurf,
     return qv::gate(color, (float)bouncelight_gate);
 }
 
+// conservative SurfaceLight_SphereCull for every style under a BVH node
+static bool SurfaceLight_NodeCull(
+    const surflight_bvh_t::node_t &node, const lightsurf_t *lightsurf, float bouncelight_gate, float hotspot_clamp)
+{
+    if (light_options.visapprox.value() == visapprox_t::RAYS &&
+        node.visible_bounds.disjoint(lightsurf->extents.bounds, 0.001f)) {
+        return true;
+    } else if (!bouncelight_gate) {
+        return false;
+    }
+
+    const settings::worldspawn_keys &cfg = *lightsurf->cfg;
+    const qvec3f origin = lightsurf->extents.origin;
+
+    // distance from the sample origin to the closest vpl position in the node
+    qvec3f delta;
+    for (int i = 0; i < 3; i++) {
+        delta[i] = std::max({0.0f, node.bounds.mins()[i] - origin[i], origin[i] - node.bounds.maxs()[i]});
+    }
+
+    // back off a little so float rounding can't make the bound cull something SphereCull wouldn't
+    const float dist = std::max(0.0f, qv::length(delta) + lightsurf->extents.radius - 1.0f);
+
+    const float scales[2] = {cfg.surflightscale.value(), cfg.surflightskyscale.value()};
+
+    for (int i = 0; i < 2; i++) {
+        if (!node.max_intensity[i]) {
+            continue;
+        }
+
+        const qvec3f color =
+            SurfaceLight_ColorAtDist(cfg, scales[i], node.max_intensity[i], {1, 1, 1}, dist, node.min_atten, hotspot_clamp);
+
+        if (!qv::gate(color, bouncelight_gate)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static bool SurfaceLight_VisCull(const mbsp_t *bsp, const std::vector<uint8_t> *pvs, const lightsurf_t *lightsurf_b)
 {
     if (pvs && light_options.visapprox.value() == visapprox_t::VIS) {
@@ -2024,96 +2392,130 @@ LightFace_SurfaceLight(const mbsp_t *bsp, lightsurf_t *lightsurf, lightmapdict_t
         return;
     }
 
-    for (const auto &surf_ptr : EmissiveLightSurfaces()) {
-        auto &vpl = *surf_ptr->vpl.get();
+    const surflight_bvh_t *bvh = SurfaceLightBVH(bounce_depth);
 
-        for (const auto &vpl_setting : surf_ptr->vpl->styles) {
+    if (!bvh) {
+        return;
+    }
 
-            if (vpl_setting.bounce_level != bounce_depth)
-                continue;
-            else if (SurfaceLight_SphereCull(&vpl, lightsurf, vpl_setting, surflight_gate, hotspot_clamp))
-                continue;
+    // gather the styles that survive culling, then light them in surface order so
+    // the sums come out the same as a plain loop over EmissiveLightSurfaces()
+    std::vector<surflight_bvh_t::entry_t> entries;
+
+    // -nosurflightbvh visits every entry, which is the same as the plain loop
+    const bool node_cull = !light_options.nosurflightbvh.value();
+
+    bvh->for_each(
+        [&](const surflight_bvh_t::node_t &node) {
+            return node_cull && SurfaceLight_NodeCull(node, lightsurf, surflight_gate, hotspot_clamp);
+        },
+        [&](const surflight_bvh_t::entry_t &entry) {
+            const lightsurf_t *surf_ptr = EmissiveLightSurfaces()[entry.surf];
+            const surfacelight_t &vpl = *surf_ptr->vpl;
+
+            if (SurfaceLight_SphereCull(&vpl, lightsurf, vpl.styles[entry.style], surflight_gate, hotspot_clamp))
+                return;
             else if (SurfaceLight_VisCull(bsp, &lightsurf->pvs, surf_ptr))
-                continue;
+                return;
 
-            raystream_occlusion_t &rs = occlusion_stream;
+            entries.push_back(entry);
+        });
 
-            for (int c = 0; c < vpl.points.size(); c++) {
-                rs.clearPushedRays();
+    std::sort(entries.begin(), entries.end(), [](const surflight_bvh_t::entry_t &a, const surflight_bvh_t::entry_t &b) {
+        return std::tie(a.surf, a.style) < std::tie(b.surf, b.style);
+    });
 
-                for (int i = 0; i < lightsurf->samples.size(); i++) {
-                    const auto &sample = lightsurf->samples[i];
+    const lightstat_source_t stat_source =
+        bounce_depth.has_value() ? lightstat_source_t::BOUNCE : lightstat_source_t::SURFACE;
+    const int32_t stat_face = Face_GetNum(bsp, lightsurf->face);
 
-                    if (sample.occluded)
-                        continue;
+    for (const surflight_bvh_t::entry_t &entry : entries) {
+        const lightsurf_t *surf_ptr = EmissiveLightSurfaces()[entry.surf];
+        const surfacelight_t &vpl = *surf_ptr->vpl;
+        const surfacelight_t::per_style_t &vpl_setting = vpl.styles[entry.style];
 
-                    const qvec3f &lightsurf_pos = sample.point;
-                    const qvec3f &lightsurf_normal = sample.normal;
-
-                    const qvec3f &pos = vpl.points[c];
-                    qvec3f dir = lightsurf_pos - pos;
-                    float dist = std::max(0.01f, qv::length(dir));
-                    bool use_normal = true;
-
-                    if (lightsurf->twosided) {
-                        use_normal = false;
-                        dir /= dist;
-                    } else if (dist == 0.0f) {
-                        dir = lightsurf_normal;
-                        use_normal = false;
-                    } else {
-                        dir /= dist;
-                    }
+        const auto stat_start = qclock::now();
+        size_t stat_rays = 0, stat_occluded = 0;
 
-                    const qvec3f indirect = GetSurfaceLighting(cfg, vpl, vpl_setting, dir, dist, lightsurf_normal,
-                        use_normal, standard_scale, sky_scale, hotspot_clamp);
-                    if (!qv::gate(indirect, surflight_gate)) { // Each point contributes very little to the final result
-                        rs.pushRay(i, pos, dir, dist, &indirect);
-                    }
-                }
+        raystream_occlusion_t &rs = occlusion_stream;
 
-                if (!rs.numPushedRays())
+        for (int c = 0; c < vpl.points.size(); c++) {
+            rs.clearPushedRays();
+
+            for (int i = 0; i < lightsurf->samples.size(); i++) {
+                const auto &sample = lightsurf->samples[i];
+
+                if (sample.occluded)
                     continue;
 
-#if 0
-                total_surflight_rays += rs.numPushedRays();
-#endif
-                rs.tracePushedRaysOcclusion(lightsurf->modelinfo, CHANNEL_MASK_DEFAULT);
+                const qvec3f &lightsurf_pos = sample.point;
+                const qvec3f &lightsurf_normal = sample.normal;
 
-                const int lightmapstyle = vpl_setting.style;
-                lightmap_t *lightmap = Lightmap_ForStyle(lightmaps, lightmapstyle, lightsurf);
+                const qvec3f &pos = vpl.points[c];
+                qvec3f dir = lightsurf_pos - pos;
+                float dist = std::max(0.01f, qv::length(dir));
+                bool use_normal = true;
 
-                bool hit = false;
-                const int numrays = rs.numPushedRays();
-                for (int j = 0; j < numrays; j++) {
-                    if (rs.getPushedRayOccluded(j))
-                        continue;
+                if (lightsurf->twosided) {
+                    use_normal = false;
+                    dir /= dist;
+                } else if (dist == 0.0f) {
+                    dir = lightsurf_normal;
+                    use_normal = false;
+                } else {
+                    dir /= dist;
+                }
 
-                    const ray_io &ray = rs.getRay(j);
-                    const int i = ray.index;
-                    qvec3f indirect = rs.getPushedRayColor(j);
+                const qvec3f indirect = GetSurfaceLighting(cfg, vpl, vpl_setting, dir, dist, lightsurf_normal,
+                    use_normal, standard_scale, sky_scale, hotspot_clamp);
+                if (!qv::gate(indirect, surflight_gate)) { // Each point contributes very little to the final result
+                    rs.pushRay(i, pos, dir, dist, &indirect);
+                }
+            }
 
-                    // Q_assert(!std::isnan(indirect[0]));
+            if (!rs.numPushedRays())
+                continue;
 
-                    // Use dirt scaling on the surface lighting.
-                    const float dirtscale =
-                        Dirt_GetScaleFactor(cfg, lightsurf->samples[i].occlusion, nullptr, 0.0, lightsurf);
-                    indirect *= dirtscale;
+            rs.tracePushedRaysOcclusion(lightsurf->modelinfo, CHANNEL_MASK_DEFAULT);
 
-                    lightsample_t &sample = lightmap->samples[i];
-                    sample.color += indirect;
-                    lightmap->bounce_color += indirect;
+            const int lightmapstyle = vpl_setting.style;
+            lightmap_t *lightmap = Lightmap_ForStyle(lightmaps, lightmapstyle, lightsurf);
 
-                    hit = true;
-#if 0
-                    ++total_surflight_ray_hits;
-#endif
+            bool hit = false;
+            const int numrays = rs.numPushedRays();
+            stat_rays += numrays;
+            for (int j = 0; j < numrays; j++) {
+                if (rs.getPushedRayOccluded(j)) {
+                    stat_occluded++;
+                    continue;
                 }
 
-                // If surface light contributed anything, save.
-                if (hit)
-                    Lightmap_Save(bsp, lightmaps, lightsurf, lightmap, lightmapstyle);
+                const ray_io &ray = rs.getRay(j);
+                const int i = ray.index;
+                qvec3f indirect = rs.getPushedRayColor(j);
+
+                // Q_assert(!std::isnan(indirect[0]));
+
+                // Use dirt scaling on the surface lighting.
+                const float dirtscale =
+                    Dirt_GetScaleFactor(cfg, lightsurf->samples[i].occlusion, nullptr, 0.0, lightsurf);
+                indirect *= dirtscale;
+
+                lightsample_t &sample = lightmap->samples[i];
+                sample.color += indirect;
+                lightmap->bounce_color += indirect;
+
+                hit = true;
             }
+
+            // If surface light contributed anything, save.
+            if (hit)
+                Lightmap_Save(bsp, lightmaps, lightsurf, lightmap, lightmapstyle);
+        }
+
+        if (stat_rays) {
+            LightStats_AddRays(
+                stat_source, stat_face, Face_GetNum(bsp, surf_ptr->face), stat_rays, stat_occluded, stat_start);
         }
     }
 }
@@ -2268,6 +2670,9 @@ constexpr size_t DIRT_NUM_ANGLE_STEPS = 16;
 constexpr size_t DIRT_NUM_ELEVATION_STEPS = 3;
 constexpr size_t DIRT_NUM_VECTORS = (DIRT_NUM_ANGLE_STEPS * DIRT_NUM_ELEVATION_STEPS);
 
+// upper bound on rays traced in one batch by LightFace_CalculateDirt, to bound the per-thread stream size
+constexpr size_t DIRT_MAX_BATCH_RAYS = 65536;
+
 static qvec3f dirtVectors[DIRT_NUM_VECTORS];
 int numDirtVectors = 0;
 
@@ -2366,42 +2771,57 @@ static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
 
     Q_assert(dirt_in_use);
 
+    const float dirtdepth = cfg.dirtdepth.value();
+
     // batch implementation:
 
     thread_local static std::vector<qvec3f> myUps, myRts;
+    thread_local static std::vector<int> unoccluded;
 
     myUps.resize(lightsurf->samples.size());
     myRts.resize(lightsurf->samples.size());
-
-    // init
-    for (int i = 0; i < lightsurf->samples.size(); i++) {
-        lightsurf->samples[i].occlusion = 0;
-    }
+    unoccluded.clear();
 
     // this stuff is just per-point
     for (int i = 0; i < lightsurf->samples.size(); i++) {
-        const auto [tangent, bitangent] = qv::MakeTangentAndBitangentUnnormalized(lightsurf->samples[i].normal);
+        auto &sample = lightsurf->samples[i];
+
+        sample.occlusion = 0;
+
+        if (sample.occluded)
+            continue;
+
+        const auto [tangent, bitangent] = qv::MakeTangentAndBitangentUnnormalized(sample.normal);
 
         myUps[i] = qv::normalize(tangent);
         myRts[i] = qv::normalize(bitangent);
+        unoccluded.push_back(i);
     }
 
-    for (int j = 0; j < numDirtVectors; j++) {
+    const auto stat_start = qclock::now();
+    size_t stat_rays = 0, stat_occluded = 0;
+
+    // trace as many directions per batch as fit in DIRT_MAX_BATCH_RAYS, rather than one batch per
+    // direction; the stream orders the rays by direction octant and origin for coherence.
+    const int dirs_per_batch = std::max<int>(1, DIRT_MAX_BATCH_RAYS / std::max<size_t>(1, unoccluded.size()));
+
+    for (int first = 0; first < numDirtVectors && !unoccluded.empty(); first += dirs_per_batch) {
+        const int last = std::min(numDirtVectors, first + dirs_per_batch);
+
         raystream_intersection_t &rs = intersection_stream;
         rs.clearPushedRays();
 
         // fill in input buffers
 
-        for (int i = 0; i < lightsurf->samples.size(); i++) {
-            const auto &sample = lightsurf->samples[i];
-
-            if (sample.occluded)
-                continue;
+        for (int j = first; j < last; j++) {
+            for (const int i : unoccluded) {
+                const auto &sample = lightsurf->samples[i];
 
-            qvec3f dirtvec = GetDirtVector(cfg, j);
-            qvec3f dir = TransformToTangentSpace(sample.normal, myUps[i], myRts[i], dirtvec);
+                qvec3f dirtvec = GetDirtVector(cfg, j);
+                qvec3f dir = TransformToTangentSpace(sample.normal, myUps[i], myRts[i], dirtvec);
 
-            rs.pushRay(i, sample.point, dir, cfg.dirtdepth.value());
+                rs.pushRay(i, sample.point, dir, dirtdepth);
+            }
         }
 
         // trace the batch. need closest hit for dirt, so intersection.
@@ -2411,14 +2831,16 @@ static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
         rs.tracePushedRaysIntersection(lightsurf->modelinfo, lightsurf->object_channel_mask);
 
         // accumulate hitdists
+        stat_rays += rs.numPushedRays();
         for (int k = 0; k < rs.numPushedRays(); k++) {
             const ray_io &ray = rs.getRay(k);
             const int i = ray.index;
             if (rs.getPushedRayHitType(k) == hittype_t::SOLID) {
+                stat_occluded++;
                 const float dist = rs.getPushedRayHitDist(k);
-                lightsurf->samples[i].occlusion += std::min(cfg.dirtdepth.value(), dist);
+                lightsurf->samples[i].occlusion += std::min(dirtdepth, dist);
             } else {
-                lightsurf->samples[i].occlusion += cfg.dirtdepth.value();
+                lightsurf->samples[i].occlusion += dirtdepth;
             }
         }
     }
@@ -2426,8 +2848,11 @@ static void LightFace_CalculateDirt(lightsurf_t *lightsurf)
     // process the results.
     for (int i = 0; i < lightsurf->samples.size(); i++) {
         float avgHitdist = lightsurf->samples[i].occlusion / (float)numDirtVectors;
-        lightsurf->samples[i].occlusion = 1.0f - (avgHitdist / cfg.dirtdepth.value());
+        lightsurf->samples[i].occlusion = 1.0f - (avgHitdist / dirtdepth);
     }
+
+    LightStats_AddRays(lightstat_source_t::DIRT, Face_GetNum(lightsurf->bsp, lightsurf->face), LIGHTSTAT_NO_LIGHT,
+        stat_rays, stat_occluded, stat_start);
 }
 
 /**
@@ -2598,6 +3023,7 @@ lightsurf_t CreateLightmapSurface(const mbsp_t *bsp, const mface_t *face, const
 void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg)
 {
     auto face = lightsurf.face;
+    lightstats_phase_timer_t stat_timer(lightstat_phase_t::DIRECT, Face_GetNum(bsp, face));
     const modelinfo_t *modelinfo = ModelInfoForFace(bsp, Face_GetNum(bsp, face));
 
     lightmapdict_t *lightmaps = &lightsurf.lightmapsByStyle;
@@ -2613,25 +3039,20 @@ void DirectLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::
      */
 
     if (light_options.debugmode == debugmodes::none) {
-#if 0
-        total_samplepoints += lightsurf.samples.size();
-#endif
-
         const surfflags_t &extended_flags = extended_texinfo_flags[face->texinfo];
 
         /* positive lights */
         if (!(modelinfo->lightignore.value() || extended_flags.light_ignore)) {
-            for (const auto &entity : GetLights()) {
+            for (const uint32_t i : LightBVH_CandidateLights(&lightsurf)) {
+                const auto &entity = GetLights()[i];
                 if (entity->getFormula() == LF_LOCALMIN)
                     continue;
                 if (entity->nostaticlight.value())
                     continue;
                 if (entity->light.value() > 0)
-                    LightFace_Entity(bsp, entity.get(), &lightsurf, lightmaps);
+                    LightFace_Entity(bsp, entity.get(), i, &lightsurf, lightmaps);
             }
-            for (const sun_t &sun : GetSuns())
-                if (sun.sunlight > 0)
-                    LightFace_Sky(bsp, &sun, &lightsurf, lightmaps);
+            LightFace_Sky(bsp, false, &lightsurf, lightmaps);
 
             // mxd. Add surface lights...
             // FIXME: negative surface lights
@@ -2665,6 +3086,7 @@ void IndirectLightFace(
     const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg, size_t bounce_depth)
 {
     auto face = lightsurf.face;
+    lightstats_phase_timer_t stat_timer(lightstat_phase_t::INDIRECT, Face_GetNum(bsp, face));
     const modelinfo_t *modelinfo = ModelInfoForFace(bsp, Face_GetNum(bsp, face));
     lightmapdict_t *lightmaps = &lightsurf.lightmapsByStyle;
 
@@ -2690,15 +3112,12 @@ void IndirectLightFace(
 void PostProcessLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const settings::worldspawn_keys &cfg)
 {
     auto face = lightsurf.face;
+    lightstats_phase_timer_t stat_timer(lightstat_phase_t::POSTPROCESS, Face_GetNum(bsp, face));
     const modelinfo_t *modelinfo = ModelInfoForFace(bsp, Face_GetNum(bsp, face));
 
     lightmapdict_t *lightmaps = &lightsurf.lightmapsByStyle;
 
     if (light_options.debugmode == debugmodes::none) {
-#if 0
-        total_samplepoints += lightsurf.samples.size();
-#endif
-
         const surfflags_t &extended_flags = extended_texinfo_flags[face->texinfo];
 
         float minlight = 0;
@@ -2738,17 +3157,16 @@ void PostProcessLightFace(const mbsp_t *bsp, lightsurf_t &lightsurf, const setti
 
         /* negative lights */
         if (!(modelinfo->lightignore.value() || extended_flags.light_ignore)) {
-            for (const auto &entity : GetLights()) {
+            for (const uint32_t i : LightBVH_CandidateLights(&lightsurf)) {
+                const auto &entity = GetLights()[i];
                 if (entity->getFormula() == LF_LOCALMIN)
                     continue;
                 if (entity->nostaticlight.value())
                     continue;
                 if (entity->light.value() < 0)
-                    LightFace_Entity(bsp, entity.get(), &lightsurf, lightmaps);
+                    LightFace_Entity(bsp, entity.get(), i, &lightsurf, lightmaps);
             }
-            for (const sun_t &sun : GetSuns())
-                if (sun.sunlight < 0)
-                    LightFace_Sky(bsp, &sun, &lightsurf, lightmaps);
+            LightFace_Sky(bsp, true, &lightsurf, lightmaps);
         }
     }
 
@@ -2956,14 +3374,6 @@ lightgrid_samples_t CalcLightgridAtPoint(const mbsp_t *bsp, const qvec3f &world_
 
 void ResetLtFace()
 {
-#if 0
-    total_light_rays = 0;
-    total_light_ray_hits = 0;
-    total_samplepoints = 0;
-
-    total_bounce_rays = 0;
-    total_bounce_ray_hits = 0;
-    total_surflight_rays = 0;
-    total_surflight_ray_hits = 0;
-#endif
+    ResetLightStats();
+    light_bvh = {};
 }
@@ -33,9 +33,11 @@
 #include <unordered_map>
 #include <set>
 #include <algorithm>
-#include <mutex>
+#include <atomic>
+#include <span>
 
 #include <common/qvec.hh>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
 
 face_cache_t::face_cache_t() { };
@@ -177,17 +179,38 @@ static float AngleBetweenPoints(const qvec3f &p1, const qvec3f &p2, const qvec3f
     return result;
 }
 
+/**
+ * Compressed sparse row adjacency: the faces for key `i` are
+ * items[first[i]] .. items[first[i + 1] - 1], sorted in face order.
+ */
+struct face_adjacency_t
+{
+    std::vector<uint32_t> first;
+    std::vector<const mface_t *> items;
+
+    inline std::span<const mface_t *const> operator[](size_t key) const
+    {
+        if (key + 1 >= first.size())
+            return {};
+        return {items.data() + first[key], items.data() + first[key + 1]};
+    }
+};
+
 static bool s_builtPhongCaches;
-static std::unordered_map<const mface_t *, std::vector<face_normal_t>> vertex_normals;
-static std::map<const mface_t *, std::set<const mface_t *>> smoothFaces;
-static std::map<int, std::vector<const mface_t *>> vertsToFaces;
-static std::map<int, std::vector<const mface_t *>> planesToFaces;
+// start of bsp->dfaces, for turning face pointers back into face numbers
+static const mface_t *s_faces;
+// indexed by face number; empty for degenerate faces
+static std::vector<std::vector<face_normal_t>> vertex_normals;
+static face_adjacency_t smoothFaces;
+static face_adjacency_t vertsToFaces;
+static face_adjacency_t planesToFaces;
 static edgeToFaceMap_t EdgeToFaceMap;
 static std::vector<face_cache_t> FaceCache;
 
 void ResetPhong()
 {
     s_builtPhongCaches = false;
+    s_faces = nullptr;
     vertex_normals = {};
     smoothFaces = {};
     vertsToFaces = {};
@@ -196,14 +219,9 @@ void ResetPhong()
     FaceCache = {};
 }
 
-std::vector<const mface_t *> FacesUsingVert(int vertnum)
+std::span<const mface_t *const> FacesUsingVert(int vertnum)
 {
-    const auto &vertsToFaces_const = vertsToFaces;
-
-    auto it = vertsToFaces_const.find(vertnum);
-    if (it != vertsToFaces_const.end())
-        return it->second;
-    return {};
+    return vertsToFaces[vertnum];
 }
 
 const edgeToFaceMap_t &GetEdgeToFaceMap()
@@ -215,43 +233,22 @@ const edgeToFaceMap_t &GetEdgeToFaceMap()
 // Uses `smoothFaces` static var
 bool FacesSmoothed(const mface_t *f1, const mface_t *f2)
 {
-    Q_assert(s_builtPhongCaches);
-
-    const auto &facesIt = smoothFaces.find(f1);
-    if (facesIt == smoothFaces.end())
-        return false;
-
-    const std::set<const mface_t *> &faceSet = facesIt->second;
-    if (faceSet.find(f2) == faceSet.end())
-        return false;
-
-    return true;
+    const auto faces = GetSmoothFaces(f1);
+    return std::binary_search(faces.begin(), faces.end(), f2);
 }
 
-const std::set<const mface_t *> &GetSmoothFaces(const mface_t *face)
+std::span<const mface_t *const> GetSmoothFaces(const mface_t *face)
 {
     Q_assert(s_builtPhongCaches);
 
-    static std::set<const mface_t *> empty;
-    const auto it = smoothFaces.find(face);
-
-    if (it == smoothFaces.end())
-        return empty;
-
-    return it->second;
+    return smoothFaces[face - s_faces];
 }
 
-const std::vector<const mface_t *> &GetPlaneFaces(const mface_t *face)
+std::span<const mface_t *const> GetPlaneFaces(const mface_t *face)
 {
     Q_assert(s_builtPhongCaches);
 
-    static std::vector<const mface_t *> empty;
-    const auto it = planesToFaces.find(face->planenum);
-
-    if (it == planesToFaces.end())
-        return empty;
-
-    return it->second;
+    return planesToFaces[face->planenum];
 }
 
 // Adapted from https://github.com/NVIDIAGameWorks/donut/blob/main/src/engine/GltfImporter.cpp#L684
@@ -277,13 +274,12 @@ const face_normal_t &GetSurfaceVertexNormal(const mbsp_t *bsp, const mface_t *f,
     Q_assert(s_builtPhongCaches);
 
     // handle degenerate faces
-    const auto it = vertex_normals.find(f);
-    if (it == vertex_normals.end()) {
+    const size_t fnum = f - s_faces;
+    if (fnum >= vertex_normals.size() || vertex_normals[fnum].empty()) {
         static const face_normal_t empty{};
         return empty;
     }
-    const auto &face_normals_vec = it->second;
-    return face_normals_vec.at(vertindex);
+    return vertex_normals[fnum].at(vertindex);
 }
 
 const mface_t *Face_EdgeIndexSmoothed(const mbsp_t *bsp, const mface_t *f, const int edgeindex)
@@ -421,12 +417,166 @@ inline bool isDegenerate(const qvec3f &a, const qvec3f &b, const qvec3f &c)
     return false;
 }
 
+/**
+ * Builds a key -> faces adjacency in parallel. `keys(face, emit)` calls
+ * `emit(key)` for each key the face belongs to (repeats are kept).
+ */
+template<typename KeysFn>
+static face_adjacency_t MakeFaceAdjacency(const mbsp_t *bsp, size_t numkeys, const KeysFn &keys)
+{
+    face_adjacency_t result;
+    std::vector<std::atomic<uint32_t>> cursors(numkeys);
+
+    // count the faces per key
+    tbb::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(), [&](size_t i) {
+        keys(bsp->dfaces[i], [&](size_t key) { cursors[key].fetch_add(1, std::memory_order_relaxed); });
+    });
+
+    result.first.resize(numkeys + 1);
+    result.first[0] = 0;
+
+    for (size_t key = 0; key < numkeys; key++) {
+        result.first[key + 1] = result.first[key] + cursors[key].load(std::memory_order_relaxed);
+        cursors[key].store(result.first[key], std::memory_order_relaxed);
+    }
+
+    // scatter the faces into their rows
+    result.items.resize(result.first[numkeys]);
+
+    tbb::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(), [&](size_t i) {
+        const mface_t *f = &bsp->dfaces[i];
+        keys(*f, [&](size_t key) { result.items[cursors[key].fetch_add(1, std::memory_order_relaxed)] = f; });
+    });
+
+    // the scatter order depends on scheduling; faces live in one array, so
+    // sorting by pointer gives face order
+    tbb::parallel_for(static_cast<size_t>(0), numkeys, [&](size_t key) {
+        std::sort(result.items.begin() + result.first[key], result.items.begin() + result.first[key + 1]);
+    });
+
+    return result;
+}
+
+/**
+ * Per-face values used by the smoothing passes, computed once up front
+ * rather than for every neighbouring face.
+ */
+struct phong_face_t
+{
+    std::vector<qvec3f> points;
+    qvec3f centroid;
+    qvec3f normal;
+    qplane3f plane;
+    float area;
+    std::tuple<qvec3f, qvec3f> tangents;
+
+    const mtexinfo_t *texinfo;
+    int phong_value;
+    float phong_angle;
+    float phong_angle_concave;
+    // false if the face doesn't want phong or has _phong 0 / no_phong
+    bool may_phong;
+};
+
+static phong_face_t MakePhongFace(const mbsp_t *bsp, const mface_t *f)
+{
+    phong_face_t result;
+
+    result.points = Face_Points(bsp, f);
+    result.centroid = qv::PolyCentroid(result.points.begin(), result.points.end());
+    result.normal = Face_Normal(bsp, f);
+    result.plane = Face_Plane(bsp, f);
+    result.area = qv::PolyArea(result.points.begin(), result.points.end());
+
+    auto t = TexSpaceToWorld(bsp, f);
+    result.tangents = {t.col(0).xyz(), qv::normalize(t.col(1).xyz())};
+
+    // Q2 shading groups
+    result.texinfo = Face_Texinfo(bsp, f);
+    result.phong_value = Q2_FacePhongValue(bsp, f);
+
+    // any face normal within this many degrees can be smoothed with this face
+    result.phong_angle = extended_texinfo_flags[f->texinfo].phong_angle;
+    if (result.phong_angle == 0 && result.phong_value != 0) {
+        // if Q2 style phong is requested, but Q1 is not in use, set the default phong angle
+        result.phong_angle = modelinfo_t::DEFAULT_PHONG_ANGLE;
+    }
+    result.phong_angle_concave = extended_texinfo_flags[f->texinfo].phong_angle_concave;
+    if (result.phong_angle_concave == 0) {
+        result.phong_angle_concave = result.phong_angle;
+    }
+    const bool wants_phong = (result.phong_angle || result.phong_angle_concave);
+
+    result.may_phong = wants_phong && !extended_texinfo_flags[f->texinfo].no_phong;
+
+    return result;
+}
+
+/**
+ * Returns the faces sharing a vertex with `f` that it should be smoothed
+ * with, in face order.
+ */
+static std::vector<const mface_t *> FaceSmoothFaces(
+    const mbsp_t *bsp, const std::vector<phong_face_t> &faces, const mface_t *f)
+{
+    std::vector<const mface_t *> result;
+    const phong_face_t &pf = faces[f - s_faces];
+
+    if (!pf.may_phong)
+        return result;
+
+    for (int j = 0; j < f->numedges; j++) {
+        const int v = Face_VertexAtIndex(bsp, f, j);
+        // walk over all faces incident to f (we will walk over neighbours multiple times, doesn't matter)
+        for (const mface_t *f2 : vertsToFaces[v]) {
+            if (f2 == f)
+                continue;
+
+            const phong_face_t &pf2 = faces[f2 - s_faces];
+
+            if (!pf2.may_phong)
+                continue;
+
+            if (pf2.texinfo != nullptr && pf.texinfo != nullptr) {
+                if (!bsp->loadversion->game->surfflags_may_phong(pf.texinfo->flags, pf2.texinfo->flags)) {
+                    // phong may be blocked by the gamedef, e.g. warping and non-warping never phong
+                    continue;
+                }
+            }
+
+            if (pf.phong_value != pf2.phong_value) {
+                // mismatched smoothing groups never phong
+                continue;
+            }
+
+            const float cosangle = qv::dot(pf.normal, pf2.normal);
+
+            const bool concave = pf.plane.distance_to(pf2.centroid) > 0.1;
+            const float f_threshold = concave ? pf.phong_angle_concave : pf.phong_angle;
+            const float f2_threshold = concave ? pf2.phong_angle_concave : pf2.phong_angle;
+            const float min_threshold = std::min(f_threshold, f2_threshold);
+            const float cosmaxangle = cos(DEG2RAD(min_threshold));
+
+            // check the angle between the face normals
+            if (cosangle >= cosmaxangle) {
+                result.push_back(f2);
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
 void CalculateVertexNormals(const mbsp_t *bsp)
 {
     logging::funcheader();
 
     Q_assert(!s_builtPhongCaches);
     s_builtPhongCaches = true;
+    s_faces = bsp->dfaces.data();
 
     EdgeToFaceMap = MakeEdgeToFaceMap(bsp);
 
@@ -446,111 +596,48 @@ void CalculateVertexNormals(const mbsp_t *bsp)
         }
     }
 
-    for (auto &f : bsp->dfaces) {
-        // build "plane -> faces" map
-        planesToFaces[f.planenum].push_back(&f);
+    // build "plane -> faces" map
+    planesToFaces = MakeFaceAdjacency(
+        bsp, bsp->dplanes.size(), [](const mface_t &f, const auto &emit) { emit(f.planenum); });
 
-        // build "vert index -> faces" map
-        for (size_t j = 0; j < f.numedges; j++) {
-            const int v = Face_VertexAtIndex(bsp, &f, j);
-            vertsToFaces[v].push_back(&f);
+    // build "vert index -> faces" map
+    vertsToFaces = MakeFaceAdjacency(bsp, bsp->dvertexes.size(), [bsp](const mface_t &f, const auto &emit) {
+        for (int j = 0; j < f.numedges; j++) {
+            emit(Face_VertexAtIndex(bsp, &f, j));
         }
-    }
+    });
+
+    std::vector<phong_face_t> faces(bsp->dfaces.size());
+    tbb::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(),
+        [&](size_t i) { faces[i] = MakePhongFace(bsp, &bsp->dfaces[i]); });
 
     // build the "face -> faces to smooth with" map
-    for (auto &f : bsp->dfaces) {
-        // Q2 shading groups
-        const int f_phongValue = Q2_FacePhongValue(bsp, &f);
-
-        // Q1 phong angle stuff
-        auto *f_texinfo = Face_Texinfo(bsp, &f);
-        const auto f_points = Face_Points(bsp, &f);
-        const qvec3f f_norm = Face_Normal(bsp, &f);
-        const qplane3f f_plane = Face_Plane(bsp, &f);
-
-        // any face normal within this many degrees can be smoothed with this face
-        float f_phong_angle = extended_texinfo_flags[f.texinfo].phong_angle;
-        if (f_phong_angle == 0 && f_phongValue != 0) {
-            // if Q2 style phong is requested, but Q1 is not in use, set the default phong angle
-            f_phong_angle = modelinfo_t::DEFAULT_PHONG_ANGLE;
-        }
-        float f_phong_angle_concave = extended_texinfo_flags[f.texinfo].phong_angle_concave;
-        if (f_phong_angle_concave == 0) {
-            f_phong_angle_concave = f_phong_angle;
+    {
+        std::vector<std::vector<const mface_t *>> rows(bsp->dfaces.size());
+        tbb::parallel_for(static_cast<size_t>(0), bsp->dfaces.size(),
+            [&](size_t i) { rows[i] = FaceSmoothFaces(bsp, faces, &bsp->dfaces[i]); });
+
+        size_t numsmoothed = 0;
+        smoothFaces.first.resize(rows.size() + 1);
+        smoothFaces.first[0] = 0;
+
+        for (size_t i = 0; i < rows.size(); i++) {
+            smoothFaces.first[i + 1] = smoothFaces.first[i] + rows[i].size();
+            numsmoothed += !rows[i].empty();
         }
-        const bool f_wants_phong = (f_phong_angle || f_phong_angle_concave);
 
-        if (!f_wants_phong)
-            continue;
-
-        if (extended_texinfo_flags[f.texinfo].no_phong)
-            continue;
+        smoothFaces.items.resize(smoothFaces.first.back());
+        tbb::parallel_for(static_cast<size_t>(0), rows.size(), [&](size_t i) {
+            std::copy(rows[i].begin(), rows[i].end(), smoothFaces.items.begin() + smoothFaces.first[i]);
+        });
 
-        for (int j = 0; j < f.numedges; j++) {
-            const int v = Face_VertexAtIndex(bsp, &f, j);
-            // walk over all faces incident to f (we will walk over neighbours multiple times, doesn't matter)
-            for (const mface_t *f2 : vertsToFaces[v]) {
-                if (f2 == &f)
-                    continue;
-
-                // FIXME: factor out and share with above?
-                const int f2_phongValue = Q2_FacePhongValue(bsp, f2);
-                float f2_phong_angle = extended_texinfo_flags[f2->texinfo].phong_angle;
-                if (f2_phong_angle == 0 && f2_phongValue != 0) {
-                    // if Q2 style phong is requested, but Q1 is not in use, set the default phong angle
-                    f2_phong_angle = modelinfo_t::DEFAULT_PHONG_ANGLE;
-                }
-                float f2_phong_angle_concave = extended_texinfo_flags[f2->texinfo].phong_angle_concave;
-                if (f2_phong_angle_concave == 0) {
-                    f2_phong_angle_concave = f2_phong_angle;
-                }
-                const bool f2_wants_phong = (f2_phong_angle || f2_phong_angle_concave);
-
-                if (!f2_wants_phong)
-                    continue;
-
-                if (extended_texinfo_flags[f2->texinfo].no_phong)
-                    continue;
-
-                auto *f2_texinfo = Face_Texinfo(bsp, f2);
-                if (f2_texinfo != nullptr && f_texinfo != nullptr) {
-                    if (!bsp->loadversion->game->surfflags_may_phong(f_texinfo->flags, f2_texinfo->flags)) {
-                        // phong may be blocked by the gamedef, e.g. warping and non-warping never phong
-                        continue;
-                    }
-                }
-
-                const auto f2_points = Face_Points(bsp, f2);
-                const qvec3f f2_centroid = qv::PolyCentroid(f2_points.begin(), f2_points.end());
-                const qvec3f f2_norm = Face_Normal(bsp, f2);
-
-                const float cosangle = qv::dot(f_norm, f2_norm);
-
-                const bool concave = f_plane.distance_to(f2_centroid) > 0.1;
-                const float f_threshold = concave ? f_phong_angle_concave : f_phong_angle;
-                const float f2_threshold = concave ? f2_phong_angle_concave : f2_phong_angle;
-                const float min_threshold = std::min(f_threshold, f2_threshold);
-                const float cosmaxangle = cos(DEG2RAD(min_threshold));
-
-                if (f_phongValue != f2_phongValue) {
-                    // mismatched smoothing groups never phong
-                    continue;
-                }
-
-                // check the angle between the face normals
-                if (cosangle >= cosmaxangle) {
-                    smoothFaces[&f].insert(f2);
-                }
-            }
-        }
+        logging::print(logging::flag::VERBOSE, "        {} faces for smoothing\n", numsmoothed);
     }
 
-    logging::print(logging::flag::VERBOSE, "        {} faces for smoothing\n", smoothFaces.size());
-
     // finally do the smoothing for each face
-    std::mutex normalsMutex;
+    vertex_normals.resize(bsp->dfaces.size());
 
-    logging::parallel_for_each(bsp->dfaces, [bsp, &normalsMutex](const mface_t &f) {
+    logging::parallel_for_each(bsp->dfaces, [bsp, &faces](const mface_t &f) {
         if (f.numedges < 3) {
             logging::funcprint("face {} is degenerate with {} edges\n", Face_GetNum(bsp, &f), f.numedges);
             for (int j = 0; j < f.numedges; j++) {
@@ -559,34 +646,30 @@ void CalculateVertexNormals(const mbsp_t *bsp)
             return;
         }
 
-        const qvec3f f_norm = Face_Normal(bsp, &f); // get the face normal
+        const phong_face_t &pf = faces[&f - s_faces];
+        const qvec3f &f_norm = pf.normal; // get the face normal
 
         // face tangent
-        auto t1 = TexSpaceToWorld(bsp, &f);
-        std::tuple<qvec3f, qvec3f> tangents(t1.col(0).xyz(), qv::normalize(t1.col(1).xyz()));
+        const std::tuple<qvec3f, qvec3f> &tangents = pf.tangents;
 
         // gather up f and neighboursToSmooth
+        const auto neighboursToSmooth = smoothFaces[&f - s_faces];
         std::vector<const mface_t *> fPlusNeighbours;
+        fPlusNeighbours.reserve(neighboursToSmooth.size() + 1);
         fPlusNeighbours.push_back(&f);
-        auto neighboursIt = smoothFaces.find(&f);
-
-        if (neighboursIt != smoothFaces.end()) {
-            const auto &neighboursToSmooth = neighboursIt->second;
-            std::copy(neighboursToSmooth.begin(), neighboursToSmooth.end(), std::back_inserter(fPlusNeighbours));
-        }
+        std::copy(neighboursToSmooth.begin(), neighboursToSmooth.end(), std::back_inserter(fPlusNeighbours));
 
         // global vertex index -> smoothed normal
         std::unordered_map<int, face_normal_t> smoothedNormals;
 
         // walk fPlusNeighbours
         for (auto f2 : fPlusNeighbours) {
-            const auto f2_poly = Face_Points(bsp, f2);
-            const float f2_area = qv::PolyArea(f2_poly.begin(), f2_poly.end());
-            const qvec3f f2_norm = Face_Normal(bsp, f2);
+            const phong_face_t &pf2 = faces[f2 - s_faces];
+            const float f2_area = pf2.area;
+            const qvec3f &f2_norm = pf2.normal;
 
             // f2 face tangent
-            auto t2 = TexSpaceToWorld(bsp, f2);
-            std::tuple<qvec3f, qvec3f> f2_tangents(t2.col(0).xyz(), qv::normalize(t2.col(1).xyz()));
+            const std::tuple<qvec3f, qvec3f> &f2_tangents = pf2.tangents;
 
             // walk the vertices of f2, and add their contribution to smoothedNormals
             for (int j = 0; j < f2->numedges; j++) {
@@ -650,23 +733,22 @@ void CalculateVertexNormals(const mbsp_t *bsp)
         }
 
         // sanity check
-        if (neighboursIt != smoothFaces.end()) {
-            const auto &neighboursToSmooth = neighboursIt->second;
-            if (!neighboursToSmooth.size()) {
-                for (auto &vertIndexNormalPair : smoothedNormals) {
-                    Q_assert(qv::epsilonEqual(vertIndexNormalPair.second.normal, f_norm, (float)LIGHT_EQUAL_EPSILON));
-                }
+        if (neighboursToSmooth.empty()) {
+            for (auto &vertIndexNormalPair : smoothedNormals) {
+                Q_assert(qv::epsilonEqual(vertIndexNormalPair.second.normal, f_norm, (float)LIGHT_EQUAL_EPSILON));
             }
         }
 
-        // now, record all of the smoothed normals that are actually part of `f`
+        // now, record all of the smoothed normals that are actually part of `f`.
+        // each face only writes its own slot, so no locking is needed
+        std::vector<face_normal_t> &f_normals = vertex_normals[&f - s_faces];
+        f_normals.reserve(f.numedges);
+
         for (int j = 0; j < f.numedges; j++) {
             int v = Face_VertexAtIndex(bsp, &f, j);
             Q_assert(smoothedNormals.find(v) != smoothedNormals.end());
 
-            normalsMutex.lock();
-            vertex_normals[&f].push_back(smoothedNormals[v]);
-            normalsMutex.unlock();
+            f_normals.push_back(smoothedNormals[v]);
         }
     });
 
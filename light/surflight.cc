@@ -30,6 +30,7 @@ See file, 'COPYING', for details.
 #include <common/bsputils.hh>
 #include <common/parallel.hh>
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <mutex>
@@ -37,10 +38,12 @@ See file, 'COPYING', for details.
 #include <common/qvec.hh>
 
 static std::atomic_size_t total_surflight_points;
+static std::map<std::optional<size_t>, surflight_bvh_t> surflight_bvhs;
 
 void ResetSurflight()
 {
     total_surflight_points = {};
+    surflight_bvhs.clear();
 }
 
 size_t GetSurflightPoints()
@@ -245,7 +248,7 @@ static void MakeSurfaceLightsThread(const mbsp_t *bsp, const settings::worldspaw
             if (!(info->flags.native & Q2_SURF_LIGHT) || info->value == 0) {
                 if (info->flags.native & Q2_SURF_LIGHT) {
                     qvec3f wc = polylib::winding3f_t::from_face(bsp, face).center();
-                    logging::print(
+                    logging::print(logging::flag::WARNING,
                         "WARNING: surface light '{}' at [{}] has 0 intensity.\n", Face_TextureName(bsp, face), wc);
                 }
             } else {
@@ -284,3 +287,89 @@ MakeRadiositySurfaceLights(const settings::worldspawn_keys &cfg, const mbsp_t *b
 
     logging::print("{} surface light points in use.\n", total_surflight_points.load());
 }
+
+/*
+ * Surface light BVH
+ */
+
+static constexpr uint32_t SURFLIGHT_BVH_LEAF_SIZE = 4;
+
+static const surfacelight_t &EntryVPL(const surflight_bvh_t::entry_t &entry)
+{
+    return *EmissiveLightSurfaces()[entry.surf]->vpl;
+}
+
+static void BuildSurfaceLightBVH_r(surflight_bvh_t &bvh, uint32_t nodenum, uint32_t first, uint32_t count)
+{
+    surflight_bvh_t::node_t node;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        const surfacelight_t &vpl = EntryVPL(bvh.entries[i]);
+        const surfacelight_t::per_style_t &style = vpl.styles[bvh.entries[i].style];
+
+        node.bounds += vpl.pos;
+        if (light_options.visapprox.value() == visapprox_t::RAYS) {
+            node.visible_bounds += vpl.bounds;
+        }
+
+        float &max_intensity = node.max_intensity[style.omnidirectional];
+        max_intensity = std::max(max_intensity, style.totalintensity * qv::max(style.color));
+        node.min_atten = std::min(node.min_atten, style.atten);
+    }
+
+    if (count <= SURFLIGHT_BVH_LEAF_SIZE) {
+        node.first = first;
+        node.count = count;
+        bvh.nodes[nodenum] = node;
+        return;
+    }
+
+    // median split along the longest axis
+    const qvec3f size = node.bounds.size();
+    const int axis = (size[0] >= size[1] && size[0] >= size[2]) ? 0 : (size[1] >= size[2]) ? 1 : 2;
+    const uint32_t half = count / 2;
+
+    std::nth_element(bvh.entries.begin() + first, bvh.entries.begin() + first + half,
+        bvh.entries.begin() + first + count,
+        [axis](const surflight_bvh_t::entry_t &a, const surflight_bvh_t::entry_t &b) {
+            return EntryVPL(a).pos[axis] < EntryVPL(b).pos[axis];
+        });
+
+    node.first = bvh.nodes.size();
+    node.count = 0;
+    bvh.nodes[nodenum] = node;
+    bvh.nodes.resize(bvh.nodes.size() + 2);
+
+    BuildSurfaceLightBVH_r(bvh, node.first, first, half);
+    BuildSurfaceLightBVH_r(bvh, node.first + 1, first + half, count - half);
+}
+
+void BuildSurfaceLightBVHs(const std::vector<lightsurf_t *> &emissive_surfaces)
+{
+    surflight_bvhs.clear();
+
+    for (size_t i = 0; i < emissive_surfaces.size(); i++) {
+        const surfacelight_t &vpl = *emissive_surfaces[i]->vpl;
+
+        for (size_t j = 0; j < vpl.styles.size(); j++) {
+            surflight_bvhs[vpl.styles[j].bounce_level].entries.push_back(
+                {static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+        }
+    }
+
+    for (auto &[bounce_level, bvh] : surflight_bvhs) {
+        bvh.nodes.resize(1);
+        BuildSurfaceLightBVH_r(bvh, 0, 0, bvh.entries.size());
+    }
+}
+
+const surflight_bvh_t *SurfaceLightBVH(std::optional<size_t> bounce_level)
+{
+    auto it = surflight_bvhs.find(bounce_level);
+
+    if (it == surflight_bvhs.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
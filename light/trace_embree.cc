@@ -24,6 +24,7 @@
 
 #include <common/bsputils.hh>
 #include <common/polylib.hh>
+#include <algorithm>
 #include <vector>
 #include <climits>
 #include <set>
@@ -37,8 +38,12 @@ std::set<const mface_t *> shadow_casting_solid_faces;
 
 static RTCDevice device;
 RTCScene scene;
+static aabb3f scene_bounds;
 
 static const mbsp_t *bsp_static;
+#ifdef HAVE_EMBREE4
+static bool use_ray_packets;
+#endif
 
 void ResetEmbree()
 {
@@ -46,6 +51,7 @@ void ResetEmbree()
     solidgeom = {};
     filtergeom = {};
     shadow_casting_solid_faces = {};
+    scene_bounds = {};
 
     if (scene) {
         rtcReleaseScene(scene);
@@ -498,7 +504,7 @@ static void Leaf_MakeFaces(const mbsp_t *bsp, const modelinfo_t *modelinfo, cons
         }
 
         if (!winding) {
-            // logging::print("WARNING: winding clipped away\n");
+            // logging::print(logging::flag::WARNING, "WARNING: winding clipped away\n");
         } else {
             result.push_back(winding->translate(modelinfo->offset));
         }
@@ -540,11 +546,20 @@ static void MakeFaces(
     Q_assert(planes.empty());
 }
 
+const aabb3f &Embree_SceneBounds()
+{
+    return scene_bounds;
+}
+
 void Embree_TraceInit(const mbsp_t *bsp)
 {
     bsp_static = bsp;
     Q_assert(device == nullptr);
 
+#ifdef HAVE_EMBREE4
+    use_ray_packets = !light_options.noraypackets.value();
+#endif
+
     std::vector<const mface_t *> skyfaces, solidfaces, filterfaces;
 
     // check all modelinfos
@@ -688,6 +703,11 @@ void Embree_TraceInit(const mbsp_t *bsp)
 
     rtcCommitScene(scene);
 
+    RTCBounds bounds;
+    rtcGetSceneBounds(scene, &bounds);
+    scene_bounds = aabb3f{
+        qvec3f{bounds.lower_x, bounds.lower_y, bounds.lower_z}, qvec3f{bounds.upper_x, bounds.upper_y, bounds.upper_z}};
+
     // keep a backup of solidfaces
     for (const mface_t *face : solidfaces) {
         shadow_casting_solid_faces.insert(face);
@@ -782,4 +802,164 @@ RTCOccludedArguments ray_source_info::setup_occluded_arguments()
 
     return result;
 }
-#endif
\ No newline at end of file
+
+/*
+ * Packet tracing
+ *
+ * Embree 4 dropped the rtcOccluded1M/rtcIntersect1M stream API, so streams
+ * are traced as 8-wide packets instead. Packets only pay off if their rays
+ * traverse the same BVH nodes, so the rays are first sorted by direction
+ * octant, then along a Morton curve through their origins.
+ */
+
+static constexpr size_t RAY_PACKET_SIZE = 8;
+
+// spreads the low 10 bits of v out to every third bit
+static uint32_t Morton_SpreadBits(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+void raystream_embree_common_t::sortRaysForPackets()
+{
+    aabb3f bounds;
+
+    for (const ray_io &ray : _rays) {
+        bounds += qvec3f{ray.ray.ray.org_x, ray.ray.ray.org_y, ray.ray.ray.org_z};
+    }
+
+    const qvec3f size = bounds.size();
+    const qvec3f scale{size[0] > 0 ? 1023.0f / size[0] : 0.0f, size[1] > 0 ? 1023.0f / size[1] : 0.0f,
+        size[2] > 0 ? 1023.0f / size[2] : 0.0f};
+
+    _packet_order.resize(_rays.size());
+
+    for (size_t i = 0; i < _rays.size(); i++) {
+        const RTCRay &ray = _rays[i].ray.ray;
+
+        const uint64_t octant = (ray.dir_x < 0 ? 1 : 0) | (ray.dir_y < 0 ? 2 : 0) | (ray.dir_z < 0 ? 4 : 0);
+        const uint32_t x = static_cast<uint32_t>((ray.org_x - bounds.mins()[0]) * scale[0]);
+        const uint32_t y = static_cast<uint32_t>((ray.org_y - bounds.mins()[1]) * scale[1]);
+        const uint32_t z = static_cast<uint32_t>((ray.org_z - bounds.mins()[2]) * scale[2]);
+        const uint32_t morton = Morton_SpreadBits(x) | (Morton_SpreadBits(y) << 1) | (Morton_SpreadBits(z) << 2);
+
+        _packet_order[i] = {(octant << 30) | morton, static_cast<uint32_t>(i)};
+    }
+
+    std::sort(_packet_order.begin(), _packet_order.end());
+}
+
+void raystream_embree_common_t::traceOccluded(RTCOccludedArguments *args)
+{
+    // not enough rays to fill a packet
+    if (!use_ray_packets || _rays.size() < RAY_PACKET_SIZE / 2) {
+        for (auto &ray : _rays)
+            rtcOccluded1(scene, &ray.ray.ray, args);
+        return;
+    }
+
+    sortRaysForPackets();
+
+    alignas(32) int valid[RAY_PACKET_SIZE];
+    RTCRay8 packet;
+
+    for (size_t first = 0; first < _packet_order.size(); first += RAY_PACKET_SIZE) {
+        const size_t count = std::min(RAY_PACKET_SIZE, _packet_order.size() - first);
+
+        for (size_t k = 0; k < RAY_PACKET_SIZE; k++) {
+            if (k >= count) {
+                valid[k] = 0;
+                continue;
+            }
+
+            const RTCRay &ray = _rays[_packet_order[first + k].second].ray.ray;
+
+            valid[k] = -1;
+            packet.org_x[k] = ray.org_x;
+            packet.org_y[k] = ray.org_y;
+            packet.org_z[k] = ray.org_z;
+            packet.tnear[k] = ray.tnear;
+            packet.dir_x[k] = ray.dir_x;
+            packet.dir_y[k] = ray.dir_y;
+            packet.dir_z[k] = ray.dir_z;
+            packet.time[k] = ray.time;
+            packet.tfar[k] = ray.tfar;
+            packet.mask[k] = ray.mask;
+            packet.id[k] = ray.id; // the filter function looks the ray_io up by this
+            packet.flags[k] = ray.flags;
+        }
+
+        rtcOccluded8(valid, scene, &packet, args);
+
+        for (size_t k = 0; k < count; k++) {
+            _rays[_packet_order[first + k].second].ray.ray.tfar = packet.tfar[k];
+        }
+    }
+}
+
+void raystream_embree_common_t::traceIntersection(RTCIntersectArguments *args)
+{
+    // not enough rays to fill a packet
+    if (!use_ray_packets || _rays.size() < RAY_PACKET_SIZE / 2) {
+        for (auto &ray : _rays)
+            rtcIntersect1(scene, &ray.ray, args);
+        return;
+    }
+
+    sortRaysForPackets();
+
+    alignas(32) int valid[RAY_PACKET_SIZE];
+    RTCRayHit8 packet;
+
+    for (size_t first = 0; first < _packet_order.size(); first += RAY_PACKET_SIZE) {
+        const size_t count = std::min(RAY_PACKET_SIZE, _packet_order.size() - first);
+
+        for (size_t k = 0; k < RAY_PACKET_SIZE; k++) {
+            if (k >= count) {
+                valid[k] = 0;
+                continue;
+            }
+
+            const RTCRayHit &ray = _rays[_packet_order[first + k].second].ray;
+
+            valid[k] = -1;
+            packet.ray.org_x[k] = ray.ray.org_x;
+            packet.ray.org_y[k] = ray.ray.org_y;
+            packet.ray.org_z[k] = ray.ray.org_z;
+            packet.ray.tnear[k] = ray.ray.tnear;
+            packet.ray.dir_x[k] = ray.ray.dir_x;
+            packet.ray.dir_y[k] = ray.ray.dir_y;
+            packet.ray.dir_z[k] = ray.ray.dir_z;
+            packet.ray.time[k] = ray.ray.time;
+            packet.ray.tfar[k] = ray.ray.tfar;
+            packet.ray.mask[k] = ray.ray.mask;
+            packet.ray.id[k] = ray.ray.id; // the filter function looks the ray_io up by this
+            packet.ray.flags[k] = ray.ray.flags;
+            packet.hit.geomID[k] = ray.hit.geomID;
+            packet.hit.primID[k] = ray.hit.primID;
+            packet.hit.instID[0][k] = ray.hit.instID[0];
+        }
+
+        rtcIntersect8(valid, scene, &packet, args);
+
+        for (size_t k = 0; k < count; k++) {
+            RTCRayHit &ray = _rays[_packet_order[first + k].second].ray;
+
+            ray.ray.tfar = packet.ray.tfar[k];
+            ray.hit.Ng_x = packet.hit.Ng_x[k];
+            ray.hit.Ng_y = packet.hit.Ng_y[k];
+            ray.hit.Ng_z = packet.hit.Ng_z[k];
+            ray.hit.u = packet.hit.u[k];
+            ray.hit.v = packet.hit.v[k];
+            ray.hit.primID = packet.hit.primID[k];
+            ray.hit.geomID = packet.hit.geomID[k];
+            ray.hit.instID[0] = packet.hit.instID[0][k];
+        }
+    }
+}
+#endif
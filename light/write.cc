@@ -118,7 +118,7 @@ static std::vector<qvec4f> LightmapNormalsToGLMVector(const lightsurf_t *lightsu
 {
     std::vector<qvec4f> res;
     for (int i = 0; i < lightsurf->samples.size(); i++) {
-        const qvec3f &color = lm->samples[i].direction;
+        const qvec3f &color = lm->directions[i];
         const float alpha = lightsurf->samples[i].occluded ? 0.0f : 1.0f;
         res.emplace_back(color[0], color[1], color[2], alpha);
     }
@@ -597,6 +597,17 @@ void FinishLightmapSurface(const mbsp_t *bsp, lightsurf_t *lightsurf)
     LightFace_ScaleAndClamp(lightsurf);
 }
 
+/**
+ * Frees the per-sample data of a face once its lightmaps are written, so memory is
+ * returned while the remaining faces are saved. Emitter data (vpl, leaves) is kept
+ * for the lightgrid.
+ */
+static void ReleaseLightmapSurface(lightsurf_t *lightsurf)
+{
+    lightsurf->lightmapsByStyle = {};
+    lightsurf->samples = {};
+}
+
 static float Lightmap_AvgBrightness(const lightmap_t *lm, const lightsurf_t *lightsurf)
 {
     float avgb = 0;
@@ -724,7 +735,7 @@ int CalculateLightmapStyles(const mbsp_t *bsp, mface_t *face, facesup_t *facesup
                         "INFO: a face has exceeded max light style id ({});\n LMSTYLE16 will be output to hold the non-truncated data.\n Use -verbose to find which faces.\n",
                         maxstyle, lightsurf->samples[0].point);
                 } else {
-                    logging::print(
+                    logging::print(logging::flag::WARNING,
                         "WARNING: a face has exceeded max light style id ({}). Use -verbose to find which faces.\n",
                         maxstyle, lightsurf->samples[0].point);
                 }
@@ -773,7 +784,7 @@ int CalculateLightmapStyles(const mbsp_t *bsp, mface_t *face, facesup_t *facesup
                         "INFO: a face has exceeded max light styles ({});\n LMSTYLE/LMSTYLE16 will be output to hold the non-truncated data.\n Use -verbose to find which faces.\n",
                         maxfstyles, lightsurf->samples[0].point);
                 } else {
-                    logging::print(
+                    logging::print(logging::flag::WARNING,
                         "WARNING: a face has exceeded max light styles ({}). Use -verbose to find which faces.\n",
                         maxfstyles, lightsurf->samples[0].point);
                 }
@@ -977,20 +988,193 @@ void SaveLightmapSurface(const mbsp_t *bsp, mface_t *face, facesup_t *facesup,
     }
 }
 
+/**
+ * Finishes a face's lightmaps, picks the styles to keep and reserves their space
+ * in the output lump.
+ */
+static void CalculateFaceLightmapSpace(mbsp_t *bsp, size_t i, lightsurf_t &surf, std::atomic_size_t &lightmap_size,
+    lightmap_intermediate_data_t &id)
+{
+    FinishLightmapSurface(bsp, &surf);
+
+    auto f = &bsp->dfaces[i];
+    const modelinfo_t *face_modelinfo = ModelInfoForFace(bsp, i);
+    int num_styles;
+
+    if (!facesup_decoupled_global.empty()) {
+        num_styles = CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, id);
+
+        if (!light_options.novanilla.value()) {
+            id.vanilla_lightofs = GetFileSpace(lightmap_size, surf.vanilla_extents.numsamples() * num_styles);
+        }
+    } else if (faces_sup.empty()) {
+        num_styles = CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, id);
+    } else if (light_options.novanilla.value() || faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
+        num_styles = CalculateLightmapStyles(bsp, f, &faces_sup[i], &surf, surf.extents, lightmap_size, id);
+    } else {
+        num_styles = CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, id);
+        id.vanilla_lightofs = GetFileSpace(lightmap_size, surf.vanilla_extents.numsamples() * num_styles);
+    }
+
+    if (num_styles) {
+        id.lightofs = GetFileSpace(lightmap_size, surf.extents.numsamples() * num_styles);
+    }
+}
+
+/**
+ * Upper bound of what CalculateFaceLightmapSpace can reserve for a face, used to
+ * size the output before any face is lit.
+ */
+static size_t MaxFaceLightmapSpace(const mbsp_t *bsp, size_t i, const lightsurf_t &surf)
+{
+    const size_t maxfstyles =
+        std::min((size_t)light_options.facestyles.value(), faces_sup.empty() ? MAXLIGHTMAPS : MAXLIGHTMAPSSUP);
+    size_t vanilla_samples = 0;
+
+    if (!facesup_decoupled_global.empty()) {
+        if (!light_options.novanilla.value()) {
+            vanilla_samples = surf.vanilla_extents.numsamples();
+        }
+    } else if (!faces_sup.empty() && !light_options.novanilla.value() &&
+               faces_sup[i].lmscale != ModelInfoForFace(bsp, i)->lightmapscale) {
+        vanilla_samples = surf.vanilla_extents.numsamples();
+    }
+
+    return align_value<4>(surf.extents.numsamples() * maxfstyles) + align_value<4>(vanilla_samples * maxfstyles);
+}
+
+/**
+ * Writes a face's lightmaps at the offsets CalculateFaceLightmapSpace reserved, then
+ * frees its samples.
+ */
+static void SaveFaceLightmaps(mbsp_t *bsp, size_t i, lightsurf_t &surf, std::vector<uint8_t> &filebase,
+    std::vector<uint8_t> &lit_filebase, std::vector<uint8_t> &lux_filebase, std::vector<uint8_t> &hdr_filebase,
+    lightmap_intermediate_data_t &id)
+{
+    auto f = &bsp->dfaces[i];
+    const modelinfo_t *face_modelinfo = ModelInfoForFace(bsp, i);
+
+    if (!facesup_decoupled_global.empty()) {
+        SaveLightmapSurface(bsp, f, nullptr, &facesup_decoupled_global[i], &surf, surf.extents, surf.extents,
+            filebase, lit_filebase, lux_filebase, hdr_filebase, id);
+    } else if (faces_sup.empty()) {
+        SaveLightmapSurface(bsp, f, nullptr, nullptr, &surf, surf.extents, surf.extents, filebase, lit_filebase,
+            lux_filebase, hdr_filebase, id);
+    } else if (light_options.novanilla.value() || faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
+        if (faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
+            f->lightofs = faces_sup[i].lightofs;
+        } else {
+            f->lightofs = -1;
+        }
+        SaveLightmapSurface(bsp, f, &faces_sup[i], nullptr, &surf, surf.extents, surf.extents, filebase,
+            lit_filebase, lux_filebase, hdr_filebase, id);
+        for (int j = 0; j < MAXLIGHTMAPS; j++) {
+            f->styles[j] =
+                faces_sup[i].styles[j] == INVALID_LIGHTSTYLE ? INVALID_LIGHTSTYLE_OLD : faces_sup[i].styles[j];
+        }
+    } else {
+        SaveLightmapSurface(bsp, f, nullptr, nullptr, &surf, surf.extents, surf.vanilla_extents, filebase,
+            lit_filebase, lux_filebase, hdr_filebase, id);
+        SaveLightmapSurface(bsp, f, &faces_sup[i], nullptr, &surf, surf.extents, surf.extents, filebase,
+            lit_filebase, lux_filebase, hdr_filebase, id);
+    }
+
+    id = {};
+    ReleaseLightmapSurface(&surf);
+}
+
+static void ResizeLightmapBuffers(const mbsp_t *bsp, size_t lightmap_size, std::vector<uint8_t> &filebase,
+    std::vector<uint8_t> &lit_filebase, std::vector<uint8_t> &lux_filebase, std::vector<uint8_t> &hdr_filebase)
+{
+    if (!bsp->loadversion->game->has_rgb_lightmap) {
+        filebase.resize(lightmap_size);
+    }
+
+    if (bsp->loadversion->game->has_rgb_lightmap || light_options.write_litfile) {
+        lit_filebase.resize(lightmap_size * 3);
+    }
+
+    if (light_options.write_luxfile) {
+        lux_filebase.resize(lightmap_size * 3);
+    }
+
+    if (light_options.write_litfile & lightfile::hdr) {
+        hdr_filebase.resize(lightmap_size * 4);
+    }
+}
+
+// output of faces written from the direct lighting pass; see BeginStreamingLightmapSurfaces
+static struct
+{
+    bool active = false;
+    std::atomic_size_t lightmap_size = 0;
+    std::vector<uint8_t> filebase, lit_filebase, lux_filebase, hdr_filebase;
+} lightmap_stream;
+
+void BeginStreamingLightmapSurfaces(const mbsp_t *bsp)
+{
+    warned_about_light_map_overflow = warned_about_light_style_overflow = false;
+    fully_transparent_lightmaps = 0;
+
+    // the styles a face keeps aren't known until it's lit, so size the output for the
+    // most styles every face could have; SaveLightmapSurfaces trims it afterwards
+    size_t max_size = 0;
+
+    for (size_t i = 0; i < bsp->dfaces.size(); i++) {
+        const auto &surf = LightSurfaces()[i];
+
+        if (!surf.samples.empty()) {
+            max_size += MaxFaceLightmapSpace(bsp, i, surf);
+        }
+    }
+
+    ResizeLightmapBuffers(bsp, max_size, lightmap_stream.filebase, lightmap_stream.lit_filebase,
+        lightmap_stream.lux_filebase, lightmap_stream.hdr_filebase);
+
+    lightmap_stream.lightmap_size = 0;
+    lightmap_stream.active = true;
+}
+
+void ResetLightmapStream()
+{
+    lightmap_stream.active = false;
+    lightmap_stream.lightmap_size = 0;
+    lightmap_stream.filebase = {};
+    lightmap_stream.lit_filebase = {};
+    lightmap_stream.lux_filebase = {};
+    lightmap_stream.hdr_filebase = {};
+}
+
+void StreamLightmapSurface(mbsp_t *bsp, size_t facenum)
+{
+    auto &surf = LightSurfaces()[facenum];
+
+    if (surf.samples.empty()) {
+        return;
+    }
+
+    lightmap_intermediate_data_t id;
+    CalculateFaceLightmapSpace(bsp, facenum, surf, lightmap_stream.lightmap_size, id);
+    SaveFaceLightmaps(bsp, facenum, surf, lightmap_stream.filebase, lightmap_stream.lit_filebase,
+        lightmap_stream.lux_filebase, lightmap_stream.hdr_filebase, id);
+}
+
 void SaveLightmapSurfaces(bspdata_t *bspdata, const fs::path &source)
 {
     mbsp_t *bsp = &std::get<mbsp_t>(bspdata->bsp);
 
     logging::funcheader();
 
-    warned_about_light_map_overflow = warned_about_light_style_overflow = false;
-    fully_transparent_lightmaps = 0;
+    // faces written from the direct lighting pass have already been counted
+    if (!lightmap_stream.active) {
+        warned_about_light_map_overflow = warned_about_light_style_overflow = false;
+        fully_transparent_lightmaps = 0;
+    }
 
     // lightmap data storage
     std::vector<uint8_t> filebase, lit_filebase, lux_filebase, hdr_filebase;
 
     if (light_options.litonly.value()) {
-
         if (bsp->dlightdata.empty()) {
             Error("no light data, but litonly was specified");
         } else if (bsp->loadversion->game->has_rgb_lightmap) {
@@ -1024,7 +1208,32 @@ void SaveLightmapSurfaces(bspdata_t *bspdata, const fs::path &source)
 
             SaveLitOnlyLightmapSurface(
                 bsp, f, &surf, surf.extents, surf.extents, filebase, lit_filebase, lux_filebase, hdr_filebase);
+
+            ReleaseLightmapSurface(&surf);
         });
+    } else if (lightmap_stream.active) {
+        // lit faces were already written from the direct lighting pass; write any
+        // that weren't lit (emissive but not lightmapped) the same way
+        logging::parallel_for(
+            static_cast<size_t>(0), bsp->dfaces.size(), [&](size_t i) { StreamLightmapSurface(bsp, i); });
+
+        lightmap_stream.active = false;
+
+        // trim the output down from the worst case size
+
+        filebase = std::move(lightmap_stream.filebase);
+        lit_filebase = std::move(lightmap_stream.lit_filebase);
+        lux_filebase = std::move(lightmap_stream.lux_filebase);
+        hdr_filebase = std::move(lightmap_stream.hdr_filebase);
+
+        ResizeLightmapBuffers(bsp, lightmap_stream.lightmap_size, filebase, lit_filebase, lux_filebase, hdr_filebase);
+
+        for (auto *buffer : {&filebase, &lit_filebase, &lux_filebase, &hdr_filebase}) {
+            buffer->shrink_to_fit();
+        }
+
+        logging::print(logging::flag::STAT, "lightmap size (total): {}\n",
+            filebase.size() + lit_filebase.size() + lux_filebase.size() + hdr_filebase.size());
     } else {
         std::atomic_size_t lightmap_size = 0;
         std::vector<lightmap_intermediate_data_t> intermediate_data;
@@ -1039,54 +1248,11 @@ void SaveLightmapSurfaces(bspdata_t *bspdata, const fs::path &source)
                 return;
             }
 
-            FinishLightmapSurface(bsp, &surf);
-
-            auto f = &bsp->dfaces[i];
-            const modelinfo_t *face_modelinfo = ModelInfoForFace(bsp, i);
-            int num_styles;
-
-            if (!facesup_decoupled_global.empty()) {
-                num_styles =
-                    CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, intermediate_data[i]);
-
-                if (!light_options.novanilla.value()) {
-                    intermediate_data[i].vanilla_lightofs =
-                        GetFileSpace(lightmap_size, surf.vanilla_extents.numsamples() * num_styles);
-                }
-            } else if (faces_sup.empty()) {
-                num_styles =
-                    CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, intermediate_data[i]);
-            } else if (light_options.novanilla.value() || faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
-                num_styles = CalculateLightmapStyles(
-                    bsp, f, &faces_sup[i], &surf, surf.extents, lightmap_size, intermediate_data[i]);
-            } else {
-                num_styles =
-                    CalculateLightmapStyles(bsp, f, nullptr, &surf, surf.extents, lightmap_size, intermediate_data[i]);
-                intermediate_data[i].vanilla_lightofs =
-                    GetFileSpace(lightmap_size, surf.vanilla_extents.numsamples() * num_styles);
-            }
-
-            if (num_styles) {
-                intermediate_data[i].lightofs = GetFileSpace(lightmap_size, surf.extents.numsamples() * num_styles);
-            }
+            CalculateFaceLightmapSpace(bsp, i, surf, lightmap_size, intermediate_data[i]);
         });
 
         // allocate required space
-        if (!bsp->loadversion->game->has_rgb_lightmap) {
-            filebase.resize(lightmap_size);
-        }
-
-        if (bsp->loadversion->game->has_rgb_lightmap || light_options.write_litfile) {
-            lit_filebase.resize(lightmap_size * 3);
-        }
-
-        if (light_options.write_luxfile) {
-            lux_filebase.resize(lightmap_size * 3);
-        }
-
-        if (light_options.write_litfile & lightfile::hdr) {
-            hdr_filebase.resize(lightmap_size * 4);
-        }
+        ResizeLightmapBuffers(bsp, lightmap_size, filebase, lit_filebase, lux_filebase, hdr_filebase);
 
         logging::print(logging::flag::STAT, "lightmap size (total): {}\n",
             filebase.size() + lit_filebase.size() + lux_filebase.size() + hdr_filebase.size());
@@ -1098,33 +1264,8 @@ void SaveLightmapSurfaces(bspdata_t *bspdata, const fs::path &source)
                 return;
             }
 
-            auto f = &bsp->dfaces[i];
-            const modelinfo_t *face_modelinfo = ModelInfoForFace(bsp, i);
-
-            if (!facesup_decoupled_global.empty()) {
-                SaveLightmapSurface(bsp, f, nullptr, &facesup_decoupled_global[i], &surf, surf.extents, surf.extents,
-                    filebase, lit_filebase, lux_filebase, hdr_filebase, intermediate_data[i]);
-            } else if (faces_sup.empty()) {
-                SaveLightmapSurface(bsp, f, nullptr, nullptr, &surf, surf.extents, surf.extents, filebase, lit_filebase,
-                    lux_filebase, hdr_filebase, intermediate_data[i]);
-            } else if (light_options.novanilla.value() || faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
-                if (faces_sup[i].lmscale == face_modelinfo->lightmapscale) {
-                    f->lightofs = faces_sup[i].lightofs;
-                } else {
-                    f->lightofs = -1;
-                }
-                SaveLightmapSurface(bsp, f, &faces_sup[i], nullptr, &surf, surf.extents, surf.extents, filebase,
-                    lit_filebase, lux_filebase, hdr_filebase, intermediate_data[i]);
-                for (int j = 0; j < MAXLIGHTMAPS; j++) {
-                    f->styles[j] =
-                        faces_sup[i].styles[j] == INVALID_LIGHTSTYLE ? INVALID_LIGHTSTYLE_OLD : faces_sup[i].styles[j];
-                }
-            } else {
-                SaveLightmapSurface(bsp, f, nullptr, nullptr, &surf, surf.extents, surf.vanilla_extents, filebase,
-                    lit_filebase, lux_filebase, hdr_filebase, intermediate_data[i]);
-                SaveLightmapSurface(bsp, f, &faces_sup[i], nullptr, &surf, surf.extents, surf.extents, filebase,
-                    lit_filebase, lux_filebase, hdr_filebase, intermediate_data[i]);
-            }
+            SaveFaceLightmaps(
+                bsp, i, surf, filebase, lit_filebase, lux_filebase, hdr_filebase, intermediate_data[i]);
         });
     }
 
@@ -55,6 +55,7 @@ See file, 'COPYING', for details.
 
 #include <common/bspfile.hh>
 #include <common/litfile.hh>
+#include <common/pipeline.hh>
 #include <qbsp/qbsp.hh>
 #include <vis/vis.hh>
 #include <light/light.hh>
@@ -771,16 +772,20 @@ bspdata_t MainWindow::QbspVisLight_Common(const std::filesystem::path &name, std
     }
     args.push_back(name.string());
 
+    // the tools hand their output to each other in memory; only the final
+    // .bsp (and .lit) are written to disk
+    pipeline_data_t data;
+
     // run qbsp
     m_activeLogTab = ETLogTab::TAB_BSP;
 
     InitQBSP(args);
-    ProcessFile();
+    ProcessFile(&data);
 
     resetActiveTabText();
 
-    // run vis
-    if (run_vis) {
+    // run vis (a leaked map has no portals to vis)
+    if (run_vis && data.portals) {
         m_activeLogTab = ETLogTab::TAB_VIS;
         std::vector<std::string> vis_args{
             "", // the exe path, which we're ignoring in this case
@@ -792,7 +797,7 @@ bspdata_t MainWindow::QbspVisLight_Common(const std::filesystem::path &name, std
             vis_args.push_back(extra);
         }
         vis_args.push_back(name.string());
-        vis_main(vis_args);
+        vis_main(vis_args, data);
     }
 
     resetActiveTabText();
@@ -811,22 +816,22 @@ bspdata_t MainWindow::QbspVisLight_Common(const std::filesystem::path &name, std
         }
         light_args.push_back(name.string());
 
-        light_main(light_args);
+        light_main(light_args, data);
+    } else if (data.bspdata.version) {
+        // light would have written the .bsp; do it ourselves
+        if (data.bspdata.loadversion) {
+            ConvertBSPFormat(&data.bspdata, data.bspdata.loadversion);
+        }
+        WriteBSPFile(bsp_path, &data.bspdata);
     }
 
     resetActiveTabText();
 
     m_activeLogTab = ETLogTab::TAB_LIGHTPREVIEW;
 
-    // serialize obj
-    {
-        bspdata_t bspdata;
-        LoadBSPFile(bsp_path, &bspdata);
+    ConvertBSPFormat(&data.bspdata, &bspver_generic);
 
-        ConvertBSPFormat(&bspdata, &bspver_generic);
-
-        return bspdata;
-    }
+    return std::move(data.bspdata);
 }
 
 static std::vector<std::string> ParseArgs(const QLineEdit *line_edit)
@@ -982,7 +987,7 @@ int MainWindow::compileMap(const QString &file, bool is_reload)
             m_hdr_litdata = std::move(lit_hdr_ptr->samples);
         }
     } catch (const std::runtime_error &error) {
-        logging::print("error loading lit: {}", error.what());
+        logging::print(logging::flag::FAILURE, "error loading lit: {}", error.what());
         m_litdata = {};
         m_hdr_litdata = {};
     }
@@ -36,6 +36,7 @@ side_t side_t::clone_non_winding_data() const
     result.onnode = this->onnode;
     result.bevel = this->bevel;
     result.source = this->source;
+    result.hullnum = this->hullnum;
     result.tested = this->tested;
     return result;
 }
@@ -59,7 +60,14 @@ bool side_t::is_visible() const
         return false;
     }
 
-    return source && source->visible;
+    return source && source->visible[hullnum];
+}
+
+void side_t::set_visible(bool visible)
+{
+    if (source) {
+        source->visible[hullnum] = visible;
+    }
 }
 
 const maptexinfo_t &side_t::get_texinfo() const
@@ -77,6 +85,80 @@ const qbsp_plane_t &side_t::get_positive_plane() const
     return map.get_plane(planenum & ~1);
 }
 
+void *bspbrush_pool_t::allocate(size_t bytes)
+{
+    const size_t size_class = (bytes + block_granularity - 1) / block_granularity;
+
+    if (!size_class || size_class > num_size_classes) {
+        return ::operator new(bytes);
+    }
+
+    thread_pool_t &local = threads.local();
+    free_block_t *&free_block = local.free_blocks[size_class - 1];
+
+    local.live_blocks++;
+
+    if (free_block) {
+        return std::exchange(free_block, free_block->next);
+    }
+
+    const size_t block_size = size_class * block_granularity;
+
+    if (local.end - local.cursor < static_cast<ptrdiff_t>(block_size)) {
+        // the tail of the old chunk is abandoned; at most one block's worth
+        auto &chunk = local.chunks.emplace_back(new std::byte[chunk_size]);
+        local.cursor = chunk.get();
+        local.end = local.cursor + chunk_size;
+    }
+
+    return std::exchange(local.cursor, local.cursor + block_size);
+}
+
+void bspbrush_pool_t::deallocate(void *ptr, size_t bytes)
+{
+    const size_t size_class = (bytes + block_granularity - 1) / block_granularity;
+
+    if (!size_class || size_class > num_size_classes) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    // the block goes to this thread's free list, even if another thread
+    // allocated it; the memory stays in the pool either way
+    thread_pool_t &local = threads.local();
+    free_block_t *&free_block = local.free_blocks[size_class - 1];
+
+    local.live_blocks--;
+    free_block = new (ptr) free_block_t{free_block};
+}
+
+void bspbrush_pool_t::clear()
+{
+    threads.clear();
+}
+
+bool bspbrush_pool_t::empty() const
+{
+    ptrdiff_t live_blocks = 0;
+
+    for (auto &local : threads) {
+        live_blocks += local.live_blocks;
+    }
+
+    return live_blocks == 0;
+}
+
+size_t bspbrush_pool_t::reserved_bytes() const
+{
+    size_t total = 0;
+
+    for (auto &local : threads) {
+        total += local.chunks.size() * chunk_size;
+    }
+
+    return total;
+}
+
 bspbrush_t::ptr bspbrush_t::copy_unique() const
 {
     return bspbrush_t::make_ptr(this->clone());
@@ -129,13 +211,14 @@ static void CheckFace(
     if (face->w.size() < 3) {
         if (qbsp_options.verbose.value()) {
             if (face->w.size() == 2) {
-                logging::print("WARNING: {}: partially clipped into degenerate polygon @ ({}) - ({})\n",
-                    sourceface.line, face->w[0], face->w[1]);
+                logging::print(logging::flag::WARNING,
+                    "WARNING: {}: partially clipped into degenerate polygon @ ({}) - ({})\n", sourceface.line,
+                    face->w[0], face->w[1]);
             } else if (face->w.size() == 1) {
-                logging::print(
+                logging::print(logging::flag::WARNING,
                     "WARNING: {}: partially clipped into degenerate polygon @ ({})\n", sourceface.line, face->w[0]);
             } else {
-                logging::print("WARNING: {}: completely clipped away\n", sourceface.line);
+                logging::print(logging::flag::WARNING, "WARNING: {}: completely clipped away\n", sourceface.line);
             }
         }
 
@@ -165,8 +248,8 @@ static void CheckFace(
         {
             double dist = face->get_plane().distance_to(p1);
             if (fabs(dist) > qbsp_options.epsilon.value()) {
-                logging::print("WARNING: {}: Point ({:.3} {:.3} {:.3}) off plane by {:2.4}\n", sourceface.line, p1[0],
-                    p1[1], p1[2], dist);
+                logging::print(logging::flag::WARNING, "WARNING: {}: Point ({:.3} {:.3} {:.3}) off plane by {:2.4}\n",
+                    sourceface.line, p1[0], p1[1], p1[2], dist);
             }
         }
 
@@ -174,8 +257,9 @@ static void CheckFace(
         qvec3d edgevec = p2 - p1;
         double length = qv::length(edgevec);
         if (length < qbsp_options.epsilon.value()) {
-            logging::print("WARNING: {}: Healing degenerate edge ({}) at ({:.3f} {:.3} {:.3})\n", sourceface.line,
-                length, p1[0], p1[1], p1[2]);
+            logging::print(logging::flag::WARNING,
+                "WARNING: {}: Healing degenerate edge ({}) at ({:.3f} {:.3} {:.3})\n", sourceface.line, length, p1[0],
+                p1[1], p1[2]);
             for (size_t j = i + 1; j < face->w.size(); j++)
                 face->w[j - 1] = face->w[j];
             face->w.resize(face->w.size() - 1);
@@ -193,7 +277,8 @@ static void CheckFace(
                 continue;
             double dist = qv::dot(face->w[j], edgenormal);
             if (dist > edgedist) {
-                logging::print("WARNING: {}: Found a non-convex face (error size {}, point: {})\n", sourceface.line,
+                logging::print(logging::flag::WARNING,
+                    "WARNING: {}: Found a non-convex face (error size {}, point: {})\n", sourceface.line,
                     dist - edgedist, face->w[j]);
                 face->w.clear();
                 return;
@@ -248,7 +333,8 @@ qvec3d FixRotateOrigin(mapentity_t &entity)
     if (target) {
         target->epairs.get_vector("origin", offset);
     } else {
-        logging::print("WARNING: No target for rotation entity \"{}\"", entity.epairs.get("classname"));
+        logging::print(logging::flag::WARNING, "WARNING: No target for rotation entity \"{}\"",
+            entity.epairs.get("classname"));
         offset = {};
     }
 
@@ -287,7 +373,7 @@ bool CreateBrushWindings(bspbrush_t &brush)
             for (auto &p : *w) {
                 for (auto &v : p) {
                     if (fabs(v) > qbsp_options.worldextent.value()) {
-                        logging::print("WARNING: {}: invalid winding point\n",
+                        logging::print(logging::flag::WARNING, "WARNING: {}: invalid winding point\n",
                             brush.mapbrush ? brush.mapbrush->line : parser_source_location{});
                         w = std::nullopt;
                         break;
@@ -300,14 +386,10 @@ bool CreateBrushWindings(bspbrush_t &brush)
             }
 
             side.w = std::move(*w);
-            if (side.source) {
-                side.source->visible = true;
-            }
+            side.set_visible(true);
         } else {
             side.w.clear();
-            if (side.source) {
-                side.source->visible = false;
-            }
+            side.set_visible(false);
         }
     }
 
@@ -596,6 +678,7 @@ std::optional<bspbrush_t> LoadBrush(const mapentity_t &src, mapbrush_t &mapbrush
         dst.planenum = src.planenum;
         dst.bevel = src.bevel;
         dst.source = &src;
+        dst.hullnum = hullnum.value_or(0);
     }
 
     // expand the brushes for the hull
@@ -679,7 +762,7 @@ std::optional<bspbrush_t> LoadBrush(const mapentity_t &src, mapbrush_t &mapbrush
 //=============================================================================
 
 static void Brush_LoadEntity(mapentity_t &dst, mapentity_t &src, hull_index_t hullnum, content_stats_base_t &stats,
-    bspbrush_t::container &brushes, logging::percent_clock &clock, size_t &num_clipped)
+    bspbrush_t::container &brushes, aabb3d &bounds, logging::percent_clock &clock, size_t &num_clipped)
 {
     clock.max += src.mapbrushes.size();
 
@@ -798,7 +881,7 @@ static void Brush_LoadEntity(mapentity_t &dst, mapentity_t &src, hull_index_t hu
         if (hullnum.has_value() && contents.is_clip(qbsp_options.target_game)) {
             if (hullnum.value() == 0) {
                 if (auto brush = LoadBrush(src, mapbrush, contents, hullnum, num_clipped)) {
-                    dst.bounds += brush->bounds;
+                    bounds += brush->bounds;
                 }
                 continue;
                 // for hull1, 2, etc., convert clip to CONTENTS_SOLID
@@ -851,7 +934,7 @@ static void Brush_LoadEntity(mapentity_t &dst, mapentity_t &src, hull_index_t hu
 
         qbsp_options.target_game->count_contents_in_stats(brush->contents, stats);
 
-        dst.bounds += brush->bounds;
+        bounds += brush->bounds;
         brushes.push_back(bspbrush_t::make_ptr(std::move(*brush)));
     }
 }
@@ -862,9 +945,12 @@ Brush_LoadEntity
 
 hullnum nullopt should contain ALL brushes; BSPX and Quake II, etc.
 hullnum 0 does not contain clip brushes.
+`bounds` is grown to cover every loaded brush, including
+ones (like hull 0 clip) that don't end up in `brushes`.
 ============
 */
-void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::container &brushes, size_t &num_clipped)
+void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::container &brushes, aabb3d &bounds,
+    size_t &num_clipped)
 {
     logging::funcheader();
 
@@ -874,7 +960,7 @@ void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::con
     logging::percent_clock clock(0);
     clock.displayElapsed = is_world_entity;
 
-    Brush_LoadEntity(entity, entity, hullnum, *stats, brushes, clock, num_clipped);
+    Brush_LoadEntity(entity, entity, hullnum, *stats, brushes, bounds, clock, num_clipped);
 
     /*
      * If this is the world entity, find all func_group and func_detail
@@ -888,10 +974,14 @@ void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::con
         for (int i = 1; i < map.entities.size(); i++) {
             mapentity_t &source = map.entities.at(i);
 
-            ProcessAreaPortal(source);
+            // only once, from the first hull; the clipping hulls are loaded
+            // concurrently and would race on the areaportal numbering
+            if (!hullnum.value_or(0)) {
+                ProcessAreaPortal(source);
+            }
 
             if (IsWorldBrushEntity(source) || IsNonRemoveWorldBrushEntity(source)) {
-                Brush_LoadEntity(entity, source, hullnum, *stats, brushes, clock, num_clipped);
+                Brush_LoadEntity(entity, source, hullnum, *stats, brushes, bounds, clock, num_clipped);
             }
         }
     }
@@ -910,7 +1000,7 @@ void Brush_LoadEntity(mapentity_t &entity, hull_index_t hullnum, bspbrush_t::con
         for (auto &side : brush->sides) {
             if (!side.source) {
                 sourceless_sides_stat.count++;
-            } else if (side.source->visible) {
+            } else if (side.source->visible[side.hullnum]) {
                 visible_sides_stat.count++;
             } else {
                 invisible_sides_stat.count++;
@@ -934,7 +1024,7 @@ bool bspbrush_t::update_bounds(bool warn_on_failures)
         if (this->bounds.mins()[i] <= -qbsp_options.worldextent.value() ||
             this->bounds.maxs()[i] >= qbsp_options.worldextent.value()) {
             if (warn_on_failures) {
-                logging::print(
+                logging::print(logging::flag::WARNING,
                     "WARNING: {}: brush bounds out of range\n", mapbrush ? mapbrush->line : parser_source_location());
             }
             return false;
@@ -942,7 +1032,7 @@ bool bspbrush_t::update_bounds(bool warn_on_failures)
         if (this->bounds.mins()[i] >= qbsp_options.worldextent.value() ||
             this->bounds.maxs()[i] <= -qbsp_options.worldextent.value()) {
             if (warn_on_failures) {
-                logging::print(
+                logging::print(logging::flag::WARNING,
                     "WARNING: {}: no visible sides on brush\n", mapbrush ? mapbrush->line : parser_source_location());
             }
             return false;
@@ -69,6 +69,8 @@ struct bspstats_t : logging::stat_tracker_t
     stat &c_brushesonesided = register_stat("brushes split only on one side");
     // tiny volumes after clipping
     stat &c_tinyvolumes = register_stat("tiny volumes removed after splits");
+    // memory held by the tree's brush pool once the tree is built
+    stat &c_poolkib = register_stat("KiB peak brush fragment memory");
 };
 
 /*
@@ -108,6 +110,31 @@ bspbrush_t::ptr BrushFromBounds(const aabb3d &bounds)
     return b;
 }
 
+/*
+==================
+ReserveBrushBSPPlanes
+
+Adds the planes of the head node volume BrushBSP will create for these
+brushes, so building the tree only has to look planes up. Trees built
+concurrently then can't change the plane numbers by racing to add them.
+==================
+*/
+void ReserveBrushBSPPlanes(const aabb3d &bounds, const bspbrush_t::container &brushes)
+{
+    // BrushBSP doesn't make a volume for an empty tree
+    if (brushes.empty()) {
+        return;
+    }
+
+    aabb3d tree_bounds = bounds;
+
+    for (const auto &b : brushes) {
+        tree_bounds += b->bounds;
+    }
+
+    BrushFromBounds(tree_bounds.grow(SIDESPACE));
+}
+
 /*
 ==================
 BrushVolume
@@ -403,11 +430,13 @@ SplitBrush
 Note, it's useful to take/return std::unique_ptr so it can quickly return the
 input.
 
+New fragments are allocated from `pool`, or from the heap if it's null.
+
 https://github.com/id-Software/Quake-2-Tools/blob/master/bsp/qbsp3/brushbsp.c#L935
 ================
 */
-static twosided<bspbrush_t::ptr> SplitBrush(
-    bspbrush_t::ptr brush, size_t planenum, std::optional<std::reference_wrapper<bspstats_t>> stats)
+static twosided<bspbrush_t::ptr> SplitBrush(bspbrush_t::ptr brush, size_t planenum, bspbrush_pool_t *pool,
+    std::optional<std::reference_wrapper<bspstats_t>> stats)
 {
     const qplane3d &split = map.planes[planenum];
     twosided<bspbrush_t::ptr> result;
@@ -455,7 +484,7 @@ static twosided<bspbrush_t::ptr> SplitBrush(
     }
 
     if (WindingIsHuge(*w)) {
-        logging::print("WARNING: huge winding\n");
+        logging::print(logging::flag::WARNING, "WARNING: huge winding\n");
     }
 
     winding_t &midwinding = *w;
@@ -465,7 +494,7 @@ static twosided<bspbrush_t::ptr> SplitBrush(
     // start with 2 empty brushes
 
     for (int i = 0; i < 2; i++) {
-        result[i] = bspbrush_t::make_ptr();
+        result[i] = bspbrush_t::make_pooled(pool);
         result[i]->original_ptr = brush->original_ptr ? brush->original_ptr : brush;
         result[i]->mapbrush = brush->mapbrush;
         // fixme-brushbsp: add a bspbrush_t copy constructor to make sure we get all fields
@@ -769,7 +798,7 @@ inline bool CheckPlaneAgainstVolume(size_t planenum, const node_t *node)
 
     bool valid = CheckSplitBrush(node->volume, planenum);
 #ifdef PARANOID
-    auto [front, back] = SplitBrush(node->volume, planenum, std::nullopt);
+    auto [front, back] = SplitBrush(node->volume, planenum, nullptr, std::nullopt);
     Q_assert(valid == (front && back));
 #endif
     return valid;
@@ -1120,7 +1149,7 @@ SplitBrushList
 ================
 */
 static std::array<bspbrush_t::container, 2> SplitBrushList(
-    bspbrush_t::container brushes, size_t planenum, bspstats_t &stats)
+    bspbrush_t::container brushes, size_t planenum, bspbrush_pool_t &pool, bspstats_t &stats)
 {
     std::array<bspbrush_t::container, 2> result;
 
@@ -1129,7 +1158,7 @@ static std::array<bspbrush_t::container, 2> SplitBrushList(
 
         if (sides == PSIDE_BOTH) {
             // split into two brushes (destructively)
-            auto [front, back] = SplitBrush(std::move(brush), planenum, stats);
+            auto [front, back] = SplitBrush(std::move(brush), planenum, &pool, stats);
 
             if (front) {
                 result[0].push_back(std::move(front));
@@ -1203,7 +1232,7 @@ static void BuildTree_r(tree_t &tree, int level, node_t *node, bspbrush_t::conta
     nodedata->planenum = bestplane;
 
     auto &plane = map.get_plane(bestplane);
-    auto children = SplitBrushList(std::move(brushes), bestplane, stats);
+    auto children = SplitBrushList(std::move(brushes), bestplane, tree.brush_pool, stats);
 
     // allocate children before recursing
     for (int i = 0; i < 2; i++) {
@@ -1222,7 +1251,7 @@ static void BuildTree_r(tree_t &tree, int level, node_t *node, bspbrush_t::conta
 
     // to save time/memory we can destroy node's volume at this point
     if (node->volume) {
-        auto children_volumes = SplitBrush(std::move(node->volume), bestplane, stats);
+        auto children_volumes = SplitBrush(std::move(node->volume), bestplane, &tree.brush_pool, stats);
         node->volume = nullptr;
         nodedata->children[0]->volume = std::move(children_volumes[0]);
         nodedata->children[1]->volume = std::move(children_volumes[1]);
@@ -1252,14 +1281,14 @@ struct brushbsp_input_stats_t : logging::stat_tracker_t
 BrushBSP
 ==================
 */
-void BrushBSP(tree_t &tree, mapentity_t &entity, const bspbrush_t::container &brushlist, tree_split_t split_type)
+void BrushBSP(tree_t &tree, const aabb3d &bounds, const bspbrush_t::container &brushlist, tree_split_t split_type)
 {
     logging::header(__func__);
 
-    // NOTE: entity bounds may include brushes that were deleted
+    // NOTE: `bounds` are the entity bounds, which may include brushes that were deleted
     // from the brush list (e.g. clip brushes in Q1 hull 0 still need to affect the model/node bounds)
     // so start with that.
-    tree.bounds = entity.bounds;
+    tree.bounds = bounds;
 
     if (brushlist.empty()) {
         /*
@@ -1269,7 +1298,7 @@ void BrushBSP(tree_t &tree, mapentity_t &entity, const bspbrush_t::container &br
          * smarter, but this works.
          */
         auto headnode = tree.create_node();
-        headnode->bounds = entity.bounds;
+        headnode->bounds = bounds;
 
         auto *nodedata = headnode->get_nodedata();
 
@@ -1301,7 +1330,7 @@ void BrushBSP(tree_t &tree, mapentity_t &entity, const bspbrush_t::container &br
             // the brush be removed?
             double volume = BrushVolume(*b);
             if (volume < qbsp_options.microvolume.value()) {
-                logging::print("WARNING: {}: microbrush\n",
+                logging::print(logging::flag::WARNING, "WARNING: {}: microbrush\n",
                     b->mapbrush->line);
             }
 #endif
@@ -1343,6 +1372,14 @@ void BrushBSP(tree_t &tree, mapentity_t &entity, const bspbrush_t::container &br
         BuildTree_r(tree, 0, tree.headnode, brushlist, split_type, stats, clock);
     }
 
+    stats.c_poolkib += tree.brush_pool.reserved_bytes() / 1024;
+
+    // leafs drop their fragments and volumes unless they were kept for
+    // debugging, so the pool can usually be released right away
+    if (tree.brush_pool.empty()) {
+        tree.brush_pool.clear();
+    }
+
     stats.print_stats();
 
     CountLeafs(tree.headnode);
@@ -1412,7 +1449,8 @@ inline bspbrush_t::list SubtractBrush(const bspbrush_t::ptr &a, const bspbrush_t
     bspbrush_t::ptr in = a;
 
     for (auto &side : b->sides) {
-        auto [front, back] = SplitBrush(in, side.planenum, std::nullopt);
+        // the chopped brushes outlive any tree, so they come from the heap
+        auto [front, back] = SplitBrush(in, side.planenum, nullptr, std::nullopt);
 
         if (front) {
             // add to list
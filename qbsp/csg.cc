@@ -174,9 +174,9 @@ inside  (inout)     input is the starting set of faces of `brush`, output is the
 outside (out)       outputs the faces of `brush` that are definitely not touching `clipbrush`
 =================
 */
-static void RemoveOutsideFaces(const bspbrush_t &clipbrush, std::vector<side_t> &inside, std::vector<side_t> &outside)
+static void RemoveOutsideFaces(const bspbrush_t &clipbrush, bspbrush_t::side_container &inside, bspbrush_t::side_container &outside)
 {
-    std::vector<side_t> oldinside;
+    bspbrush_t::side_container oldinside;
 
     // clear `inside`, transfer it to `oldinside`
     std::swap(inside, oldinside);
@@ -214,9 +214,9 @@ clipface    a face of the clipbrush
 =================
 */
 static void ClipInside(
-    const side_t &clipface, bool precedence, std::vector<side_t> &inside, std::vector<side_t> &outside)
+    const side_t &clipface, bool precedence, bspbrush_t::side_container &inside, bspbrush_t::side_container &outside)
 {
-    std::vector<side_t> oldinside;
+    bspbrush_t::side_container oldinside;
 
     // effectively make a copy of `inside`, and clear it
     std::swap(inside, oldinside);
@@ -341,7 +341,7 @@ bspbrush_t::container CSGFaces(bspbrush_t::container brushes)
         bspbrush_t::ptr brush_result = bspbrush_t::make_ptr(brush->clone());
 
         // temporarily move brush_result's sides to the `outside` vector
-        std::vector<side_t> outside;
+        bspbrush_t::side_container outside;
         std::swap(outside, brush_result->sides);
 
         bool overwrite = false;
@@ -373,7 +373,7 @@ bspbrush_t::container CSGFaces(bspbrush_t::container brushes)
                 continue;
 
             // divide faces by the planes of the new brush
-            std::vector<side_t> inside;
+            bspbrush_t::side_container inside;
 
             std::swap(inside, outside);
 
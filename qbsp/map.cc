@@ -30,6 +30,7 @@
 #include <utility>
 #include <optional>
 #include <fstream>
+#include <shared_mutex>
 
 #include <qbsp/brush.hh>
 #include <qbsp/map.hh>
@@ -56,6 +57,9 @@ struct planehash_t
 {
     // planes indices (into the `planes` vector)
     pareto::spatial_map<double, 4, size_t> hash;
+    // collision hulls are built in parallel, so lookups take a shared
+    // lock and insertions an exclusive one
+    std::shared_mutex lock;
 };
 
 struct vertexhash_t
@@ -73,6 +77,14 @@ mapdata_t::mapdata_t()
 // add the specified plane to the list
 size_t mapdata_t::add_plane(const qplane3d &plane)
 {
+    std::unique_lock lock(plane_hash->lock);
+
+    // another thread may have added an equivalent plane while we
+    // were waiting on the lock
+    if (auto index = find_plane_unlocked(plane)) {
+        return *index;
+    }
+
     planes.emplace_back(plane);
     planes.emplace_back(-plane);
 
@@ -102,6 +114,12 @@ size_t mapdata_t::add_plane(const qplane3d &plane)
 }
 
 std::optional<size_t> mapdata_t::find_plane_nonfatal(const qplane3d &plane)
+{
+    std::shared_lock lock(plane_hash->lock);
+    return find_plane_unlocked(plane);
+}
+
+std::optional<size_t> mapdata_t::find_plane_unlocked(const qplane3d &plane)
 {
     constexpr double HALF_NORMAL_EPSILON = NORMAL_EPSILON * 0.5;
     constexpr double HALF_DIST_EPSILON = DIST_EPSILON * 0.5;
@@ -196,7 +214,7 @@ const std::optional<img::texture_meta> &mapdata_t::load_image_meta(std::string_v
         }
 
         if (!texture_meta->width || !texture_meta->height) {
-            logging::print("WARNING: texture {} has empty width/height \n", name);
+            logging::print(logging::flag::WARNING, "WARNING: texture {} has empty width/height \n", name);
         }
 
         return meta_cache.emplace(name, texture_meta).first->second;
@@ -207,7 +225,7 @@ const std::optional<img::texture_meta> &mapdata_t::load_image_meta(std::string_v
         return meta_cache.emplace(name, texture->meta).first->second;
     }
 
-    logging::print("WARNING: Couldn't locate texture for {}\n", name);
+    logging::print(logging::flag::WARNING, "WARNING: Couldn't locate texture for {}\n", name);
     meta_cache.emplace(name, std::nullopt);
     return nullmeta;
 }
@@ -257,7 +275,7 @@ static void EnsureTexturesLoaded()
     bool loaded_any_archive = false;
 
     if (wadstring.empty()) {
-        logging::print("WARNING: No wad or _wad key exists in the worldmodel\n");
+        logging::print(logging::flag::WARNING, "WARNING: No wad or _wad key exists in the worldmodel\n");
     } else {
         imemstream stream(wadstring.data(), wadstring.size());
         std::string wad;
@@ -271,7 +289,7 @@ static void EnsureTexturesLoaded()
 
     if (!loaded_any_archive) {
         if (!wadstring.empty()) {
-            logging::print("WARNING: No valid WAD filenames in worldmodel\n");
+            logging::print(logging::flag::WARNING, "WARNING: No valid WAD filenames in worldmodel\n");
         }
 
         /* Try the default wad name */
@@ -352,11 +370,11 @@ inline void CalculateBrushBounds(mapbrush_t &ob)
     for (size_t i = 0; i < 3; i++) {
         if (ob.bounds.mins()[i] <= -qbsp_options.worldextent.value() ||
             ob.bounds.maxs()[i] >= qbsp_options.worldextent.value()) {
-            logging::print("WARNING: {}: brush bounds out of range\n", ob.line);
+            logging::print(logging::flag::WARNING, "WARNING: {}: brush bounds out of range\n", ob.line);
         }
         if (ob.bounds.mins()[i] >= qbsp_options.worldextent.value() ||
             ob.bounds.maxs()[i] <= -qbsp_options.worldextent.value()) {
-            logging::print("WARNING: {}: no visible sides on brush\n", ob.line);
+            logging::print(logging::flag::WARNING, "WARNING: {}: no visible sides on brush\n", ob.line);
         }
     }
 }
@@ -870,7 +888,8 @@ static void ParseTextureDef(const mapentity_t &entity, const mapfile::brush_side
                 extinfo.info->contents_native |= Q2_CONTENTS_DETAIL;
 
                 if (qbsp_options.verbose.value()) {
-                    logging::print("WARNING: {}: swapped TRANSLUCENT for DETAIL\n", mapface.line);
+                    logging::print(logging::flag::WARNING, "WARNING: {}: swapped TRANSLUCENT for DETAIL\n",
+                        mapface.line);
                 } else {
                     issue_stats.num_translucent++;
                 }
@@ -882,7 +901,8 @@ static void ParseTextureDef(const mapentity_t &entity, const mapfile::brush_side
             extinfo.info->flags.native &= ~Q2_SURF_NODRAW;
 
             if (qbsp_options.verbose.value()) {
-                logging::print("WARNING: {}: SKY | NODRAW mixed. Removing NODRAW.\n", mapface.line);
+                logging::print(logging::flag::WARNING, "WARNING: {}: SKY | NODRAW mixed. Removing NODRAW.\n",
+                    mapface.line);
             } else {
                 issue_stats.num_sky_nodraw++;
             }
@@ -924,7 +944,8 @@ static void ParseTextureDef(const mapentity_t &entity, const mapfile::brush_side
         }
 
         if (wants_phong && mirrored) {
-            logging::print("WARNING: {}: Q2 phong (value set, LIGHT unset) used on a mirrored face.\n", mapface.line);
+            logging::print(logging::flag::WARNING,
+                "WARNING: {}: Q2 phong (value set, LIGHT unset) used on a mirrored face.\n", mapface.line);
         }
     }
 
@@ -939,8 +960,8 @@ static void ParseTextureDef(const mapentity_t &entity, const mapfile::brush_side
     if (!mapface.contents.is_valid(qbsp_options.target_game, false)) {
         auto old_contents = mapface.contents;
         qbsp_options.target_game->contents_make_valid(mapface.contents);
-        logging::print("WARNING: {}: face has invalid contents {}, remapped to {}\n", mapface.line,
-            old_contents.to_string(), mapface.contents.to_string());
+        logging::print(logging::flag::WARNING, "WARNING: {}: face has invalid contents {}, remapped to {}\n",
+            mapface.line, old_contents.to_string(), mapface.contents.to_string());
     }
 
     tx->vecs = input_side.vecs;
@@ -1010,7 +1031,7 @@ static std::optional<mapface_t> ParseBrushFace(const mapfile::brush_side_t &inpu
     ParseTextureDef(entity, input_side, face, brush, &tx, face.planepts, face.get_plane(), issue_stats);
 
     if (!normal_ok) {
-        logging::print("WARNING: {}: Brush plane with no normal\n", input_side.location);
+        logging::print(logging::flag::WARNING, "WARNING: {}: Brush plane with no normal\n", input_side.location);
         return std::nullopt;
     }
 
@@ -1464,8 +1485,9 @@ static contentflags_t Brush_GetContents(const mapentity_t &entity, const mapbrus
         }
 
         if (!contents.types_equal(base_contents, qbsp_options.target_game)) {
-            logging::print("WARNING: {}: brush has multiple face contents ({} vs {}), the former will be used.\n",
-                mapface.line, base_contents.to_string(), contents.to_string());
+            logging::print(logging::flag::WARNING,
+                "WARNING: {}: brush has multiple face contents ({} vs {}), the former will be used.\n", mapface.line,
+                base_contents.to_string(), contents.to_string());
             break;
         }
     }
@@ -2159,10 +2181,10 @@ void ProcessMapBrushes()
                 // with its centroid.
                 if (brush.contents.is_origin(qbsp_options.target_game)) {
                     if (map.is_world_entity(entity)) {
-                        logging::print("WARNING: Ignoring origin brush in worldspawn\n");
+                        logging::print(logging::flag::WARNING, "WARNING: Ignoring origin brush in worldspawn\n");
                     } else if (entity.epairs.has("origin")) {
                         // fixme-brushbsp: entity.line
-                        logging::print(
+                        logging::print(logging::flag::WARNING,
                             "WARNING: Entity at {} has multiple origin brushes\n", entity.mapbrushes.front().line);
                     } else {
                         entity.origin = brush.bounds.centroid();
@@ -2488,14 +2510,15 @@ void WriteEntitiesToString()
             }
 
             if (ep.first.size() >= qbsp_options.target_game->max_entity_key - 1) {
-                logging::print("WARNING: {} at {} has long key {} (length {} >= {})\n", entity.epairs.get("classname"),
-                    entity.origin, ep.first, ep.first.size(), qbsp_options.target_game->max_entity_key - 1);
+                logging::print(logging::flag::WARNING, "WARNING: {} at {} has long key {} (length {} >= {})\n",
+                    entity.epairs.get("classname"), entity.origin, ep.first, ep.first.size(),
+                    qbsp_options.target_game->max_entity_key - 1);
             }
 
             if (ep.second.size() >= qbsp_options.target_game->max_entity_value - 1) {
-                logging::print("WARNING: {} at {} has long value for key {} (length {} >= {})\n",
-                    entity.epairs.get("classname"), entity.origin, ep.first, ep.second.size(),
-                    qbsp_options.target_game->max_entity_value - 1);
+                logging::print(logging::flag::WARNING,
+                    "WARNING: {} at {} has long value for key {} (length {} >= {})\n", entity.epairs.get("classname"),
+                    entity.origin, ep.first, ep.second.size(), qbsp_options.target_game->max_entity_value - 1);
             }
 
             fmt::format_to(std::back_inserter(map.bsp.dentdata), "\"{}\" \"{}\"\n", ep.first, ep.second);
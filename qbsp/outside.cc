@@ -33,6 +33,7 @@
 #include <vector>
 #include <set>
 #include <list>
+#include <mutex>
 #include <unordered_set>
 #include <utility>
 
@@ -410,11 +411,8 @@ void MarkBrushSidesInvisible(bspbrush_t::container &brushes)
     for (auto &brush : brushes) {
         for (auto &face : brush->sides) {
             if (face.source) {
-                face.source->visible = false;
-
-                if (face.source->get_texinfo().flags.is_hint) {
-                    face.source->visible = true; // hints are always visible
-                }
+                // hints are always visible
+                face.set_visible(face.source->get_texinfo().flags.is_hint);
             }
         }
     }
@@ -460,7 +458,7 @@ static void MarkVisibleBrushSides_R(node_t *node)
                     if (side.source && qv::epsilonEqual(side.get_positive_plane(), portal->plane)) {
                         // we've found a brush side in an original brush in the neighbouring
                         // leaf, on a portal to this (non-opaque) leaf, so mark it as visible.
-                        side.source->visible = true;
+                        side.set_visible(true);
                     }
                 }
             }
@@ -699,7 +697,8 @@ bool FillOutside(tree_t &tree, hull_index_t hullnum, bspbrush_t::container &brus
     }
 
     if (occupied_leafs.empty()) {
-        logging::print("WARNING: No entities in empty space -- no filling performed (hull {})\n", hullnum.value_or(0));
+        logging::print(logging::flag::WARNING,
+            "WARNING: No entities in empty space -- no filling performed (hull {})\n", hullnum.value_or(0));
         return false;
     }
 
@@ -753,13 +752,20 @@ bool FillOutside(tree_t &tree, hull_index_t hullnum, bspbrush_t::container &brus
     }
 
     if (leakentity) {
-        logging::print("WARNING: Reached occupant \"{}\" at ({}), no filling performed.\n",
+        logging::print(logging::flag::WARNING, "WARNING: Reached occupant \"{}\" at ({}), no filling performed.\n",
             leakentity->epairs.get("classname"), leakentity->origin);
-        if (map.leakfile)
+
+        // the clipping hulls are filled concurrently; keep the leak
+        // from the lowest hull so the output doesn't depend on timing
+        static std::mutex leakfile_lock;
+        std::unique_lock lock(leakfile_lock);
+
+        if (map.leakfile && map.leakfile_hull <= hullnum.value_or(0))
             return false;
 
         WriteLeakLine(*leakentity, leakline);
         map.leakfile = true;
+        map.leakfile_hull = hullnum.value_or(0);
 
         // also write the leak portals to `<bsp_path>.leak.prt`
         WriteDebugPortals(leakline, "leak");
@@ -769,16 +775,13 @@ bool FillOutside(tree_t &tree, hull_index_t hullnum, bspbrush_t::container &brus
             WriteLeafVolumes(leakline, "leak-leaf-volumes");
         }
 
-        /* Get rid of the .prt file since the map has a leak */
+        /* Get rid of the .prt/.prtb files since the map has a leak */
         if (!qbsp_options.keepprt.value()) {
             fs::path name = qbsp_options.bsp_path;
             name.replace_extension("prt");
             remove(name);
-        }
-
-        if (qbsp_options.leaktest.value()) {
-            logging::print("Aborting because -leaktest was used.\n");
-            exit(1);
+            name.replace_extension("prtb");
+            remove(name);
         }
 
         // clear occupied state, so areas can be flooded in Q2
@@ -840,7 +843,8 @@ void FillDetail(tree_t &tree, hull_index_t hullnum, bspbrush_t::container &brush
     const std::vector<node_t *> occupied_leafs = FindOccupiedLeafs(tree.headnode);
 
     if (occupied_leafs.empty()) {
-        logging::print("WARNING: No entities in empty space -- no filling performed (hull {})\n", hullnum.value_or(0));
+        logging::print(logging::flag::WARNING,
+            "WARNING: No entities in empty space -- no filling performed (hull {})\n", hullnum.value_or(0));
         return;
     }
 
@@ -412,7 +412,7 @@ static void CalcTreeBounds_r(node_t *node, logging::percent_clock &clock)
     }
 
     if (node->bounds.mins()[0] >= node->bounds.maxs()[0]) {
-        // logging::print("WARNING: {} without a volume\n", node->is_leaf ? "leaf" : "node");
+        // logging::print(logging::flag::WARNING, "WARNING: {} without a volume\n", node->is_leaf ? "leaf" : "node");
 
         // fixme-brushbsp: added this to work around leafs with no portals showing up in "qbspfeatures.map" among other
         // test maps. Not sure if correct or there's another underlying problem.
@@ -421,7 +421,8 @@ static void CalcTreeBounds_r(node_t *node, logging::percent_clock &clock)
 
     for (auto &v : node->bounds.mins()) {
         if (fabs(v) > qbsp_options.worldextent.value()) {
-            logging::print("WARNING: {} with unbounded volume\n", node->is_leaf() ? "leaf" : "node");
+            logging::print(logging::flag::WARNING, "WARNING: {} with unbounded volume\n",
+                node->is_leaf() ? "leaf" : "node");
             break;
         }
     }
@@ -613,7 +614,8 @@ static void FloodAreas_r(node_t *node)
         mapentity_t *entity = AreanodeEntityForLeaf(node);
 
         if (entity == nullptr) {
-            logging::print("WARNING: areaportal contents in node, but no entity found {} -> {}\n", node->bounds.mins(),
+            logging::print(logging::flag::WARNING,
+                "WARNING: areaportal contents in node, but no entity found {} -> {}\n", node->bounds.mins(),
                 node->bounds.maxs());
             return;
         }
@@ -626,7 +628,8 @@ static void FloodAreas_r(node_t *node)
 
         // note the current area as bounding the portal
         if (entity->portalareas[1]) {
-            logging::print("WARNING: {}: areaportal touches > 2 areas\n  Entity Bounds: {} -> {}\n", entity->location,
+            logging::print(logging::flag::WARNING,
+                "WARNING: {}: areaportal touches > 2 areas\n  Entity Bounds: {} -> {}\n", entity->location,
                 entity->bounds.mins(), entity->bounds.maxs());
             return;
         }
@@ -814,7 +817,7 @@ static void DebugAreaPortalBothSidesLeak(node_t *node)
     std::vector<exit_t> exits = FindAreaPortalExits(node);
 
     if (exits.size() < 2) {
-        logging::funcprint("WARNING: only found {} exits\n", exits.size());
+        logging::funcwarning("WARNING: only found {} exits\n", exits.size());
         return;
     }
 
@@ -903,7 +906,8 @@ static void SetAreaPortalAreas_r(node_t *node)
     mapentity_t *entity = AreanodeEntityForLeaf(node);
 
     if (!entity) {
-        logging::print("WARNING: areaportal missing for node: {} -> {}\n", node->bounds.mins(), node->bounds.maxs());
+        logging::print(logging::flag::WARNING, "WARNING: areaportal missing for node: {} -> {}\n", node->bounds.mins(),
+            node->bounds.maxs());
         return;
     }
 
@@ -911,7 +915,7 @@ static void SetAreaPortalAreas_r(node_t *node)
     if (!entity->portalareas[1]) {
         if (!entity->wrote_doesnt_touch_two_areas_warning) {
             entity->wrote_doesnt_touch_two_areas_warning = true;
-            logging::print(
+            logging::print(logging::flag::WARNING,
                 "WARNING: {}: areaportal entity {} with targetname {} doesn't touch two areas\n  Node bounds: {} -> {}\n",
                 entity->location, entity - map.entities.data(), entity->epairs.get("targetname"), node->bounds.mins(),
                 node->bounds.maxs());
@@ -1150,7 +1154,7 @@ static void MarkVisibleSides_r(node_t *node, visible_faces_stats_t &stats)
         }
         for (int i = 0; i < 2; ++i) {
             if (p->sides[i] && p->sides[i]->source) {
-                p->sides[i]->source->visible = true;
+                p->sides[i]->set_visible(true);
                 stats.sides_visible++;
             }
         }
@@ -24,6 +24,7 @@
 #include <common/log.hh>
 #include <common/ostream.hh>
 #include <common/prtfile.hh>
+#include <common/pipeline.hh>
 #include <qbsp/map.hh>
 #include <qbsp/portals.hh>
 #include <qbsp/qbsp.hh>
@@ -213,7 +214,35 @@ static void WritePortalfile(node_t *headnode, portal_state_t &state)
         WritePTR2ClusterMapping_r(headnode, portalFile);
     }
 
-    WritePortalfile(name, portalFile, qbsp_options.target_version, state.uses_detail, qbsp_options.forceprt1.value());
+    // what LoadPrtFile would have read back from the PRT1 variants; the
+    // binary format and the in-process pipeline store this directly
+    if (qbsp_options.target_game->id == GAME_QUAKE_II) {
+        portalFile.portalleafs_real = 0;
+    } else if (!state.uses_detail || qbsp_options.forceprt1.value()) {
+        portalFile.portalleafs_real = portalFile.portalleafs;
+        portalFile.dleafinfos.resize(portalFile.portalleafs + 1);
+
+        for (int i = 0; i < portalFile.portalleafs; i++) {
+            portalFile.dleafinfos[i + 1].cluster = i;
+        }
+    }
+
+    if (map.output) {
+        map.output->portals = std::move(portalFile);
+        return;
+    }
+
+    const portalformat_t format = qbsp_options.portalformat.value();
+
+    if (format != portalformat_t::binary) {
+        WritePortalfile(
+            name, portalFile, qbsp_options.target_version, state.uses_detail, qbsp_options.forceprt1.value());
+    }
+
+    if (format != portalformat_t::text) {
+        name.replace_extension("prtb");
+        WritePortalfileBinary(name, portalFile);
+    }
 }
 
 /*
@@ -44,6 +44,8 @@
 
 #include <fmt/chrono.h>
 
+#include <tbb/parallel_for_each.h>
+
 namespace settings
 {
 bool wadpath::operator<(const wadpath &other) const
@@ -516,10 +518,15 @@ qbsp_settings::qbsp_settings()
       leakdist{this, "leakdist", 0, &debugging_group, "space between leakfile points (default 0: no inbetween points)"},
       forceprt1{
           this, "forceprt1", false, &debugging_group, "force a PRT1 output file even if PRT2 is required for vis"},
+      portalformat{this, "portalformat", portalformat_t::text,
+          {{"text", portalformat_t::text}, {"binary", portalformat_t::binary}, {"both", portalformat_t::both}},
+          &common_format_group, "write the vis portals as a text .prt, a binary .prtb, or both"},
       tjunc{this, {"tjunc", "notjunc"}, tjunclevel_t::MWT,
           {{"none", tjunclevel_t::NONE}, {"rotate", tjunclevel_t::ROTATE}, {"retopologize", tjunclevel_t::RETOPOLOGIZE},
               {"mwt", tjunclevel_t::MWT}},
           &debugging_group, "T-junction fix level"},
+      tjunc_mwt_max_vertices{this, "tjunc_mwt_max_vertices", 128, &debugging_group,
+          "faces with more vertices than this use a greedy triangulation instead of MWT (0 = always use MWT)"},
       objexport{
           this, "objexport", false, &debugging_group, "export the map file as .OBJ models during various CSG phases"},
       noextendedsurfflags{this, "noextendedsurfflags", false, &debugging_group, "suppress writing a .texinfo file"},
@@ -599,7 +606,7 @@ void qbsp_settings::initialize(int argc, const char **argv)
         }
     } catch (parse_exception &ex) {
         print_help(false);
-        logging::print("ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
+        logging::print(logging::flag::FAILURE, "ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
         logging::print(ex.what());
         logging::print("\n\n");
         throw settings::quit_after_help_exception();
@@ -1003,16 +1010,15 @@ static bool ShouldGenerateClipnodes(mapentity_t &entity, hull_index_t hullnum)
 }
 
 /*
-===============
-ProcessEntity
-===============
-*/
-static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
+ * Returns true if the entity gets a bmodel of its own; func_group and
+ * friends have their brushes added to the worldspawn instead.
+ */
+static bool IsBrushModelEntity(const mapentity_t &entity)
 {
     /* No map brushes means non-bmodel entity.
        We need to handle worldspawn containing no brushes, though. */
     if (!entity.mapbrushes.size() && !map.is_world_entity(entity)) {
-        return;
+        return false;
     }
 
     /*
@@ -1020,7 +1026,189 @@ static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
      * worldspawn
      */
     if (IsWorldBrushEntity(entity) || IsNonRemoveWorldBrushEntity(entity))
+        return false;
+
+    return true;
+}
+
+/*
+===============
+LoadEntityBrushes
+
+Converts the map brushes (planes) of the entity into BSP brushes
+(polygons) for the given hull, sorted and chopped ready for BrushBSP.
+`bounds` receives the entity bounds for this hull.
+===============
+*/
+static bspbrush_t::container LoadEntityBrushes(mapentity_t &entity, hull_index_t hullnum, aabb3d &bounds)
+{
+    // reserve enough brushes; we would only make less,
+    // never more
+    bspbrush_t::container brushes;
+    brushes.reserve(entity.mapbrushes.size());
+
+    size_t num_clipped = 0;
+    Brush_LoadEntity(entity, hullnum, brushes, bounds, num_clipped);
+
+    if (num_clipped && !qbsp_options.verbose.value()) {
+        logging::print(logging::flag::STAT,
+            "WARNING: {} faces were crunched away by being too small. {}Use -verbose to see which faces were affected.\n",
+            num_clipped, hullnum.value_or(0) ? "This is normal for the hulls. " : "");
+    }
+
+    size_t num_sides = 0;
+    for (size_t i = 0; i < brushes.size(); ++i) {
+        num_sides += brushes[i]->sides.size();
+    }
+
+    logging::print(
+        logging::flag::STAT, "INFO: calculating BSP for {} brushes with {} sides\n", brushes.size(), num_sides);
+
+    // sort by ascending (chop_index, line_number) pair
+    std::ranges::sort(
+        brushes, [](const auto &a, const auto &b) { return a->mapbrush->sort_key() < b->mapbrush->sort_key(); });
+
+    // always chop the other hulls to reduce brush tests
+    if (qbsp_options.chop.value() || hullnum.value_or(0)) {
+        ChopBrushes(brushes, qbsp_options.chopfragment.value());
+    }
+
+    return brushes;
+}
+
+/*
+ * One entity's collision hull. Loading its brushes adds planes, so that
+ * runs serially in (hull, entity) order, and the plane numbers don't depend
+ * on scheduling. Building the tree then only reads shared map state, so
+ * hulls can be built concurrently; exporting appends to map.bsp, so that
+ * part runs serially in (hull, entity) order again.
+ */
+struct entity_hull_t
+{
+    mapentity_t *entity;
+    hull_index_t::value_type hullnum;
+
+    aabb3d bounds;
+    // from LoadEntityHull; consumed by BuildEntityHull
+    bspbrush_t::container brushes;
+    // -notriggermodels discarded the entity; only its bounds are exported
+    bool discarded_trigger = false;
+    // null if there's nothing to export (e.g. -omitdetail with all detail in a bmodel)
+    std::unique_ptr<tree_t> tree;
+};
+
+/*
+===============
+LoadEntityHull
+
+Loads the entity's brushes for the hull, and adds every plane
+BuildEntityHull will need to the plane list.
+===============
+*/
+static void LoadEntityHull(entity_hull_t &hull)
+{
+    mapentity_t &entity = *hull.entity;
+    const hull_index_t hullnum = hull.hullnum;
+
+    // for notriggermodels: if we have at least one trigger-like texture, do special trigger stuff
+    hull.discarded_trigger =
+        !map.is_world_entity(entity) && qbsp_options.notriggermodels.value() && IsTrigger(entity);
+
+    hull.brushes = LoadEntityBrushes(entity, hullnum, hull.bounds);
+
+    if (!hull.discarded_trigger && ShouldGenerateClipnodes(entity, hullnum)) {
+        ReserveBrushBSPPlanes(hull.bounds, hull.brushes);
+    }
+}
+
+/*
+===============
+BuildEntityHull
+===============
+*/
+static void BuildEntityHull(entity_hull_t &hull)
+{
+    mapentity_t &entity = *hull.entity;
+    const hull_index_t hullnum = hull.hullnum;
+
+    bspbrush_t::container brushes = std::move(hull.brushes);
+
+    // we're discarding the brush
+    if (hull.discarded_trigger) {
+        return;
+    }
+
+    // corner case, -omitdetail with all detail in an bmodel
+    if (brushes.empty() && hull.bounds == aabb3d()) {
+        return;
+    }
+
+    hull.tree = std::make_unique<tree_t>();
+    tree_t &tree = *hull.tree;
+
+    // _hulls key
+    if (!ShouldGenerateClipnodes(entity, hullnum)) {
+        // We still need to emit an empty tree otherwise hull 0 will point past
+        // the clipnode array (FIXME?).
+        BrushBSP(tree, hull.bounds, {}, tree_split_t::FAST);
         return;
+    }
+
+    BrushBSP(tree, hull.bounds, brushes, tree_split_t::FAST);
+    if (map.is_world_entity(entity) && !qbsp_options.nofill.value()) {
+        // assume non-world bmodels are simple
+        MakeTreePortals(tree);
+        if (FillOutside(tree, hullnum, brushes)) {
+            if (qbsp_options.filldetail.value())
+                FillDetail(tree, hullnum, brushes);
+
+            // make a really good tree
+            tree.clear();
+            BrushBSP(tree, hull.bounds, brushes, tree_split_t::PRECISE);
+
+            // fill again so PruneNodes works
+            MakeTreePortals(tree);
+            FillOutside(tree, hullnum, brushes);
+            if (qbsp_options.filldetail.value())
+                FillDetail(tree, hullnum, brushes);
+
+            FreeTreePortals(tree);
+            PruneNodes(tree.headnode);
+        }
+        CountLeafs(tree.headnode);
+    }
+}
+
+/*
+===============
+ExportEntityHull
+===============
+*/
+static void ExportEntityHull(entity_hull_t &hull)
+{
+    mapentity_t &entity = *hull.entity;
+
+    if (hull.discarded_trigger) {
+        entity.epairs.set("mins", fmt::to_string(hull.bounds.mins()));
+        entity.epairs.set("maxs", fmt::to_string(hull.bounds.maxs()));
+        return;
+    }
+
+    if (hull.tree) {
+        ExportClipNodes(entity, hull.tree->headnode, hull.hullnum);
+    }
+}
+
+/*
+===============
+ProcessEntity
+===============
+*/
+static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
+{
+    if (!IsBrushModelEntity(entity)) {
+        return;
+    }
 
     // for notriggermodels: if we have at least one trigger-like texture, do special trigger stuff
     bool discarded_trigger = !map.is_world_entity(entity) && qbsp_options.notriggermodels.value() && IsTrigger(entity);
@@ -1055,42 +1243,19 @@ static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
         entity.epairs.set("_lmscale", std::to_string(qbsp_options.lmscale.value()));
     }
 
-    // Init the entity
-    entity.bounds = {};
-
-    // reserve enough brushes; we would only make less,
-    // never more
-    bspbrush_t::container brushes;
-    brushes.reserve(entity.mapbrushes.size());
-
-    /*
-     * Convert the map brushes (planes) into BSP brushes (polygons)
-     */
-    size_t num_clipped = 0;
-    Brush_LoadEntity(entity, hullnum, brushes, num_clipped);
-
-    if (num_clipped && !qbsp_options.verbose.value()) {
-        logging::print(logging::flag::STAT,
-            "WARNING: {} faces were crunched away by being too small. {}Use -verbose to see which faces were affected.\n",
-            num_clipped, hullnum.value_or(0) ? "This is normal for the hulls. " : "");
-    }
-
-    size_t num_sides = 0;
-    for (size_t i = 0; i < brushes.size(); ++i) {
-        num_sides += brushes[i]->sides.size();
+    // simpler operation for hulls
+    if (hullnum.value_or(0)) {
+        entity_hull_t hull{&entity, hullnum.value()};
+        LoadEntityHull(hull);
+        BuildEntityHull(hull);
+        ExportEntityHull(hull);
+        return;
     }
 
-    logging::print(
-        logging::flag::STAT, "INFO: calculating BSP for {} brushes with {} sides\n", brushes.size(), num_sides);
+    // Init the entity
+    entity.bounds = {};
 
-    // sort by ascending (chop_index, line_number) pair
-    std::ranges::sort(
-        brushes, [](const auto &a, const auto &b) { return a->mapbrush->sort_key() < b->mapbrush->sort_key(); });
-
-    // always chop the other hulls to reduce brush tests
-    if (qbsp_options.chop.value() || hullnum.value_or(0)) {
-        ChopBrushes(brushes, qbsp_options.chopfragment.value());
-    }
+    bspbrush_t::container brushes = LoadEntityBrushes(entity, hullnum, entity.bounds);
 
     // we're discarding the brush
     if (discarded_trigger) {
@@ -1108,52 +1273,17 @@ static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
     if (!ShouldGenerateClipnodes(entity, hullnum)) {
         // We still need to emit an empty tree otherwise hull 0 will point past
         // the clipnode array (FIXME?).
-        bspbrush_t::container empty;
-        tree_t tree;
-        BrushBSP(tree, entity, empty, tree_split_t::FAST);
-        if (hullnum.value_or(0)) {
-            ExportClipNodes(entity, tree.headnode, hullnum.value());
-        } else {
-            MakeTreePortals(tree); // needed to assign leaf bounds
-            ExportDrawNodes(entity, tree.headnode, map.bsp.dfaces.size());
-        }
-        return;
-    }
-
-    // simpler operation for hulls
-    if (hullnum.value_or(0)) {
         tree_t tree;
-        BrushBSP(tree, entity, brushes, tree_split_t::FAST);
-        if (map.is_world_entity(entity) && !qbsp_options.nofill.value()) {
-            // assume non-world bmodels are simple
-            MakeTreePortals(tree);
-            if (FillOutside(tree, hullnum, brushes)) {
-                if (qbsp_options.filldetail.value())
-                    FillDetail(tree, hullnum, brushes);
-
-                // make a really good tree
-                tree.clear();
-                BrushBSP(tree, entity, brushes, tree_split_t::PRECISE);
-
-                // fill again so PruneNodes works
-                MakeTreePortals(tree);
-                FillOutside(tree, hullnum, brushes);
-                if (qbsp_options.filldetail.value())
-                    FillDetail(tree, hullnum, brushes);
-
-                FreeTreePortals(tree);
-                PruneNodes(tree.headnode);
-            }
-            CountLeafs(tree.headnode);
-        }
-        ExportClipNodes(entity, tree.headnode, hullnum.value());
+        BrushBSP(tree, entity.bounds, {}, tree_split_t::FAST);
+        MakeTreePortals(tree); // needed to assign leaf bounds
+        ExportDrawNodes(entity, tree.headnode, map.bsp.dfaces.size());
         return;
     }
 
     // full operation for collision (or main hull)
     tree_t tree;
 
-    BrushBSP(tree, entity, brushes,
+    BrushBSP(tree, entity.bounds, brushes,
         qbsp_options.forcegoodtree.value() ? tree_split_t::PRECISE : // we asked for the slow method
             !map.is_world_entity(entity) ? tree_split_t::FAST
                                          : // brush models are assumed to be simple
@@ -1188,7 +1318,7 @@ static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
 
             // make a really good tree
             tree.clear();
-            BrushBSP(tree, entity, brushes, tree_split_t::PRECISE);
+            BrushBSP(tree, entity.bounds, brushes, tree_split_t::PRECISE);
 
             // debug output of bspbrushes
             if (!hullnum.value_or(0)) {
@@ -1223,7 +1353,7 @@ static void ProcessEntity(mapentity_t &entity, hull_index_t hullnum)
 
         // rebuild BSP now that we've marked invisible brush sides
         tree.clear();
-        BrushBSP(tree, entity, brushes, tree_split_t::PRECISE);
+        BrushBSP(tree, entity.bounds, brushes, tree_split_t::PRECISE);
     }
 
     MakeTreePortals(tree);
@@ -1411,7 +1541,8 @@ static bspxbrushes_permodel BSPX_Brushes_AddModel(int modelnum, const std::vecto
                 if (contents.is_clip(qbsp_options.target_game)) {
                     perbrush.contents = BSPXBRUSHES_CONTENTS_CLIP;
                 } else {
-                    logging::print("WARNING: Unknown contents: {}. Translating to solid.\n", contents.to_string());
+                    logging::print(logging::flag::WARNING, "WARNING: Unknown contents: {}. Translating to solid.\n",
+                        contents.to_string());
                     perbrush.contents = CONTENTS_SOLID;
                 }
                 break;
@@ -1539,6 +1670,72 @@ static void CreateSingleHull(hull_index_t hullnum)
     }
 }
 
+/*
+=================
+CreateClipHulls
+
+Builds collision hulls 1 through numhulls - 1 of every entity concurrently,
+then exports them in the same (hull, entity) order CreateSingleHull would.
+=================
+*/
+static void CreateClipHulls(size_t numhulls)
+{
+    logging::print("Processing hulls 1-{}...\n", numhulls - 1);
+
+    // hull 0 already reserved the models and set the model keys, so only
+    // the clipnodes are left
+    std::vector<entity_hull_t> hulls;
+
+    for (size_t i = 1; i < numhulls; i++) {
+        for (auto &entity : map.entities) {
+            if (IsBrushModelEntity(entity)) {
+                hulls.push_back({&entity, static_cast<hull_index_t::value_type>(i)});
+            }
+        }
+    }
+
+    // the collision hulls only log with -loghulls, which keeps them sequential;
+    // also silence the percent clocks, which would fight over the console.
+    // this is masked per thread, so anything else printing meanwhile still shows
+    const auto quiet_flags = bitflags<logging::flag>(logging::flag::STAT) | logging::flag::PROGRESS |
+                             logging::flag::CLOCK_ELAPSED | logging::flag::PERCENT;
+
+    {
+        logging::thread_mask_scope quiet(quiet_flags);
+
+        for (auto &hull : hulls) {
+            LoadEntityHull(hull);
+        }
+    }
+
+    tbb::parallel_for_each(hulls, [quiet_flags](entity_hull_t &hull) {
+        logging::thread_mask_scope quiet(quiet_flags);
+        BuildEntityHull(hull);
+    });
+
+    for (auto &hull : hulls) {
+        ExportEntityHull(hull);
+        hull.tree.reset();
+    }
+}
+
+/*
+=================
+CheckLeakTest
+
+-leaktest stops the compile once a hull has leaked. FillOutside only
+records the leak, since the clipping hulls are filled on worker threads;
+this exits from the main thread once they are done.
+=================
+*/
+static void CheckLeakTest()
+{
+    if (qbsp_options.leaktest.value() && map.leakfile) {
+        logging::print("Aborting because -leaktest was used.\n");
+        exit(1);
+    }
+}
+
 /*
 =================
 CreateHulls
@@ -1546,23 +1743,36 @@ CreateHulls
 */
 static void CreateHulls()
 {
-    /* create the hulls sequentially */
     auto &hulls = qbsp_options.target_game->get_hull_sizes();
 
     // game has no hulls, so we have to export brush lists and stuff.
     if (!hulls.size()) {
         CreateSingleHull(std::nullopt);
+        CheckLeakTest();
         return;
     }
 
-    // all the hulls
-    for (size_t i = 0; i < hulls.size(); i++) {
-        CreateSingleHull(i);
+    // hull 0 reserves the models and exports the faces, so it comes first
+    CreateSingleHull(0);
+    CheckLeakTest();
 
-        // only create hull 0 if fNoclip is set
-        if (qbsp_options.noclip.value()) {
-            break;
+    // only create hull 0 if fNoclip is set
+    if (qbsp_options.noclip.value()) {
+        return;
+    }
+
+    // keep the per-hull log output readable by creating the hulls sequentially
+    if (qbsp_options.loghulls.value()) {
+        for (size_t i = 1; i < hulls.size(); i++) {
+            CreateSingleHull(i);
+            CheckLeakTest();
         }
+        return;
+    }
+
+    if (hulls.size() > 1) {
+        CreateClipHulls(hulls.size());
+        CheckLeakTest();
     }
 }
 
@@ -1583,10 +1793,10 @@ static void LoadTextureData()
 
             if (!tex) {
                 if (pos.archive) {
-                    logging::print("WARNING: unable to load texture {} in archive {}\n", map.miptex[i].name,
-                        pos.archive->pathname);
+                    logging::print(logging::flag::WARNING, "WARNING: unable to load texture {} in archive {}\n",
+                        map.miptex[i].name, pos.archive->pathname);
                 } else {
-                    logging::print("WARNING: unable to find texture {}\n", map.miptex[i].name);
+                    logging::print(logging::flag::WARNING, "WARNING: unable to find texture {}\n", map.miptex[i].name);
                 }
             } else {
                 miptex.width = tex->meta.width;
@@ -1607,7 +1817,7 @@ static void LoadTextureData()
 
         dmiptex_t header{};
         if (miptex.name.size() >= 16) {
-            logging::print("WARNING: texture {} name too long for Quake miptex\n", miptex.name);
+            logging::print(logging::flag::WARNING, "WARNING: texture {} name too long for Quake miptex\n", miptex.name);
             std::copy_n(miptex.name.begin(), 15, header.name.begin());
         } else {
             std::copy(miptex.name.begin(), miptex.name.end(), header.name.begin());
@@ -1676,8 +1886,10 @@ static void LoadSecondaryTextures()
 ProcessFile
 =================
 */
-void ProcessFile()
+void ProcessFile(pipeline_data_t *output)
 {
+    map.output = output;
+
     if (qbsp_options.convertmapformat.value() != conversion_t::none) {
         ConvertMapFile();
         return;
@@ -1762,6 +1974,9 @@ void InitQBSP(int argc, const char **argv)
         prtfile.replace_extension("prt");
         remove(prtfile);
 
+        prtfile.replace_extension("prtb");
+        remove(prtfile);
+
         fs::path ptsfile = qbsp_options.bsp_path;
         ptsfile.replace_extension("pts");
         remove(ptsfile);
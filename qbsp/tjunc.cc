@@ -503,11 +503,27 @@ static std::vector<qvectri> minimum_weight_triangulation(
     // get the number of vertices in the polygon
     size_t n = vertices.size();
 
+    // weight given to triangles that fail TriangleIsValid; still below the
+    // initial table value, so some `k` is always picked
+    const double invalid_weight = std::nexttoward(std::numeric_limits<double>::max(), 0.0);
+
     // create a table for storing the solutions to subproblems
     // `T[i][j]` stores the weight of the minimum-weight triangulation
-    // of the polygon below edge `ij`
-    std::vector<double> T(n * n);
-    std::vector<std::optional<size_t>> K(n * n);
+    // of the polygon below edge `ij`.
+    // `D[i][j]` is the length of edge `ij`, computed once up front.
+    // these are reused across faces on the same thread.
+    thread_local static std::vector<double> T, D;
+    thread_local static std::vector<std::optional<size_t>> K;
+
+    T.assign(n * n, 0.0);
+    D.resize(n * n);
+    K.assign(n * n, std::nullopt);
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            D[i + (j * n)] = D[j + (i * n)] = qv::distance(vertices[i], vertices[j]);
+        }
+    }
 
     // fill the table diagonally using the recurrence relation
     for (size_t diagonal = 0; diagonal < n; diagonal++) {
@@ -517,24 +533,28 @@ static std::vector<qvectri> minimum_weight_triangulation(
                 continue;
             }
 
-            T[i + (j * n)] = std::numeric_limits<double>::max();
+            double &t_weight = T[i + (j * n)];
+            t_weight = std::numeric_limits<double>::max();
+
+            const double d_ij = D[i + (j * n)];
 
             // consider all possible triangles `ikj` within the polygon
             for (size_t k = i + 1; k <= j - 1; k++) {
                 // The weight of triangulation is the length of its perimeter
-                double weight;
+                const double weight = (d_ij + D[j + (k * n)] + D[k + (i * n)]) + T[i + (k * n)] + T[k + (j * n)];
 
-                if (!TriangleIsValid(indices[i], indices[j], indices[k], 0.01)) {
-                    weight = std::nexttoward(std::numeric_limits<double>::max(), 0.0);
-                } else {
-                    weight = (qv::distance(vertices[i], vertices[j]) + qv::distance(vertices[j], vertices[k]) +
-                                 qv::distance(vertices[k], vertices[i])) +
-                             T[i + (k * n)] + T[k + (j * n)];
+                // only check validity if `k` could be picked either way
+                if (weight >= t_weight && invalid_weight >= t_weight) {
+                    continue;
                 }
-                double &t_weight = T[i + (j * n)];
 
-                // choose vertex `k` that leads to the minimum total weight
-                if (weight < t_weight) {
+                if (!TriangleIsValid(indices[i], indices[j], indices[k], 0.01)) {
+                    // choose vertex `k` that leads to the minimum total weight
+                    if (invalid_weight < t_weight) {
+                        t_weight = invalid_weight;
+                        K[i + (j * n)] = k;
+                    }
+                } else if (weight < t_weight) {
                     t_weight = weight;
                     K[i + (j * n)] = k;
                 }
@@ -573,6 +593,90 @@ static std::vector<qvectri> minimum_weight_triangulation(
     return triangles;
 }
 
+// O(n^2) stand-in for minimum_weight_triangulation on faces with too many
+// vertices for the O(n^3) table: repeatedly clip the valid ear with the
+// smallest perimeter. returns an empty list if it runs out of valid ears.
+static std::vector<qvectri> greedy_ear_triangulation(
+    const std::vector<size_t> &indices, const std::vector<qvec2d> &vertices)
+{
+    const size_t n = vertices.size();
+
+    thread_local static std::vector<size_t> prev, next;
+    // perimeter of the ear at each vertex, or nullopt if it's not a valid triangle
+    thread_local static std::vector<std::optional<double>> ear_weight;
+
+    prev.resize(n);
+    next.resize(n);
+    ear_weight.resize(n);
+
+    auto calc_ear = [&](size_t v) {
+        const size_t a = prev[v], b = next[v];
+
+        if (!TriangleIsValid(indices[a], indices[v], indices[b], 0.01)) {
+            ear_weight[v] = std::nullopt;
+        } else {
+            ear_weight[v] = qv::distance(vertices[a], vertices[v]) + qv::distance(vertices[v], vertices[b]) +
+                            qv::distance(vertices[b], vertices[a]);
+        }
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        prev[i] = (i + n - 1) % n;
+        next[i] = (i + 1) % n;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        calc_ear(i);
+    }
+
+    std::vector<qvectri> triangles;
+    triangles.reserve(n - 2);
+
+    size_t remaining = n, start = 0;
+
+    while (remaining > 3) {
+        std::optional<size_t> best;
+        size_t v = start;
+
+        for (size_t i = 0; i < remaining; i++, v = next[v]) {
+            if (ear_weight[v] && (!best || *ear_weight[v] < *ear_weight[*best])) {
+                best = v;
+            }
+        }
+
+        if (!best) {
+            return {};
+        }
+
+        const size_t a = prev[*best], b = next[*best];
+
+        qvectri tri{a, *best, b};
+        std::sort(tri.begin(), tri.end());
+        triangles.push_back(tri);
+
+        next[a] = b;
+        prev[b] = a;
+        remaining--;
+        start = a;
+
+        calc_ear(a);
+        calc_ear(b);
+    }
+
+    // the last triangle
+    const size_t a = prev[start], b = next[start];
+
+    if (!TriangleIsValid(indices[a], indices[start], indices[b], 0.01)) {
+        return {};
+    }
+
+    qvectri tri{a, start, b};
+    std::sort(tri.begin(), tri.end());
+    triangles.push_back(tri);
+
+    return triangles;
+}
+
 static std::list<std::vector<size_t>> mwt_face(
     const face_t *f, const std::vector<size_t> &vertices, tjunc_stats_t &stats)
 {
@@ -587,7 +691,11 @@ static std::list<std::vector<size_t>> mwt_face(
         points_2d[i] = {qv::dot(map.bsp.dvertexes[vertices[i]], u), qv::dot(map.bsp.dvertexes[vertices[i]], v)};
     }
 
-    auto tris = minimum_weight_triangulation(vertices, points_2d);
+    const int32_t max_vertices = qbsp_options.tjunc_mwt_max_vertices.value();
+
+    auto tris = (max_vertices > 0 && vertices.size() > static_cast<size_t>(max_vertices))
+                    ? greedy_ear_triangulation(vertices, points_2d)
+                    : minimum_weight_triangulation(vertices, points_2d);
 
     stats.trimwt += tris.size();
 
@@ -50,6 +50,7 @@ void tree_t::clear()
 
     FreeTreePortals(*this);
     nodes.clear();
+    brush_pool.clear();
 }
 
 /*
@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <common/json.hh>
+#include <common/pipeline.hh>
 #include <fstream>
 
 #include <stdexcept>
@@ -83,7 +84,8 @@ size_t ExportMapTexinfo(size_t texinfonum)
 
     const std::string &src_name = map.texinfoTextureName(texinfonum);
     if (src_name.size() > (dest.texture.size() - 1)) {
-        logging::print("WARNING: texture name '{}' exceeds maximum length {} and will be truncated\n", src_name,
+        logging::print(logging::flag::WARNING,
+            "WARNING: texture name '{}' exceeds maximum length {} and will be truncated\n", src_name,
             dest.texture.size() - 1);
     }
     for (size_t i = 0; i < (dest.texture.size() - 1); ++i) {
@@ -458,6 +460,11 @@ static void WriteExtendedTexinfoFlags()
         texinfofile[std::to_string(*tx.outputnum)].swap(t);
     }
 
+    if (map.output) {
+        map.output->extended_texinfo_flags = std::move(texinfofile);
+        return;
+    }
+
     std::ofstream(file, std::ios_base::out | std::ios_base::binary) << texinfofile;
 }
 
@@ -519,14 +526,23 @@ static void WriteBSPFile()
         if (!qbsp_options.allow_upgrade.value()) {
             FError("{} faces requires an extended-limits BSP, but allow_upgrade was disabled", num_faces);
         } else {
-            logging::print("WARNING: {} faces requires unsigned marksurfaces, which is not supported by all "
-                           "engines. Recompile with -bsp2 if targeting ezQuake.\n",
+            logging::print(logging::flag::WARNING,
+                "WARNING: {} faces requires unsigned marksurfaces, which is not supported by all "
+                "engines. Recompile with -bsp2 if targeting ezQuake.\n",
                 num_faces);
         }
     }
 
     qbsp_options.bsp_path.replace_extension("bsp");
 
+    if (map.output) {
+        PrintBSPFileSizes(&bspdata);
+
+        bspdata.file = qbsp_options.bsp_path;
+        map.output->bspdata = std::move(bspdata);
+        return;
+    }
+
     WriteBSPFile(qbsp_options.bsp_path, &bspdata);
     logging::print("Wrote {}\n", qbsp_options.bsp_path);
 
@@ -575,8 +591,23 @@ void UpdateBSPFileEntitiesLump()
     // replace the existing entities lump with map's exported entities
     bsp.dentdata = std::move(map.bsp.dentdata);
 
-    // write the .bsp back to disk
     ConvertBSPFormat(&bspdata, bspdata.loadversion);
+
+    if (map.output) {
+        // the texinfo is unchanged, so the flags written by the full compile still apply
+        std::ifstream texinfofile(fs::path(qbsp_options.bsp_path).replace_extension("texinfo.json"),
+            std::ios_base::in | std::ios_base::binary);
+
+        if (texinfofile) {
+            texinfofile >> map.output->extended_texinfo_flags;
+        }
+
+        bspdata.file = qbsp_options.bsp_path;
+        map.output->bspdata = std::move(bspdata);
+        return;
+    }
+
+    // write the .bsp back to disk
     WriteBSPFile(qbsp_options.bsp_path, &bspdata);
 
     logging::print("Wrote {}\n", qbsp_options.bsp_path);
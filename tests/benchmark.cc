@@ -3,6 +3,7 @@
 #include <vis/vis.hh>
 #include <common/qvec.hh>
 #include <common/polylib.hh>
+#include <qbsp/brush.hh>
 
 #include <array>
 #include <vector>
@@ -143,6 +144,29 @@ TEST(benchmark, visWindings)
     });
 }
 
+static void make_brush_fragments(bspbrush_pool_t *pool)
+{
+    // roughly what SplitBrush does: two new fragments, each with a few sides
+    twosided<bspbrush_t::ptr> result;
+
+    for (auto &fragment : result) {
+        fragment = bspbrush_t::make_pooled(pool);
+        fragment->sides.resize(7);
+    }
+
+    ankerl::nanobench::doNotOptimizeAway(result);
+}
+
+TEST(benchmark, brushFragments)
+{
+    ankerl::nanobench::Bench b;
+
+    b.run("split brush fragments (heap)", [&]() { make_brush_fragments(nullptr); });
+
+    bspbrush_pool_t pool;
+    b.run("split brush fragments (bspbrush_pool_t)", [&]() { make_brush_fragments(&pool); });
+}
+
 TEST(benchmark, vectorMath)
 {
     ankerl::nanobench::Bench b;
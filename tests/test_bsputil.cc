@@ -7,6 +7,7 @@
 #include <bsputil/bsputil.hh>
 
 #include <fstream>
+#include <sstream>
 
 #include "testmaps.hh"
 #include "test_qbsp.hh"
@@ -48,6 +49,22 @@ TEST(bsputil, q1DecompilerTest)
     }
 }
 
+TEST(bsputil, decompileDeterministic)
+{
+    const auto [bsp, bspx, prt] = LoadTestmapQ1("q1_decompiler_test.map");
+
+    // entities are decompiled concurrently; the output should still be in entity order
+    // and identical from run to run
+    decomp_options options;
+    std::ostringstream first, second;
+    DecompileBSP(&bsp, options, first);
+    DecompileBSP(&bsp, options, second);
+
+    EXPECT_FALSE(first.str().empty());
+    EXPECT_EQ(first.str(), second.str());
+    EXPECT_LT(first.str().find("\"worldspawn\""), first.str().find("\"info_player_start\""));
+}
+
 TEST(bsputil, extractTextures)
 {
     const auto [bsp, bspx, prt] = LoadTestmapQ1("q1_extract_textures.map");
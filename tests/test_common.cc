@@ -1,10 +1,15 @@
 #include <gtest/gtest.h>
 
 #include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
 #include <common/bspfile.hh>
 #include <common/bspfile_q1.hh>
 #include <common/bspfile_q2.hh>
+#include <common/fs.hh>
 #include <common/imglib.hh>
+#include <common/parallel.hh>
 #include <common/settings.hh>
 #include <testmaps.hh>
 
@@ -411,4 +416,115 @@ TEST(string, strncasecmp)
 {
     EXPECT_EQ(Q_strncasecmp("*lava123", "*LAVA", 5), 0);
     EXPECT_EQ(Q_strncasecmp("*lava123", "*LAVA", 8), 1);
-}
\ No newline at end of file
+}
+
+TEST(fs, mapMatchesLoad)
+{
+    const fs::path path = fs::temp_directory_path() / "ericw-tools-map-test.bin";
+
+    std::vector<uint8_t> contents(100000);
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i] = static_cast<uint8_t>(i * 31);
+    }
+
+    {
+        std::ofstream stream(path, std::ios_base::out | std::ios_base::binary);
+        stream.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+    }
+
+    {
+        fs::mapped_data mapped = fs::map(path);
+        ASSERT_TRUE(mapped);
+        EXPECT_TRUE(mapped.is_mapped());
+        ASSERT_EQ(mapped.size(), contents.size());
+        EXPECT_TRUE(std::equal(mapped.begin(), mapped.end(), contents.begin()));
+
+        // moving keeps the view alive
+        fs::mapped_data moved = std::move(mapped);
+        EXPECT_FALSE(mapped);
+        ASSERT_EQ(moved.size(), contents.size());
+        EXPECT_TRUE(std::equal(moved.begin(), moved.end(), fs::load(path)->begin()));
+    }
+
+    fs::remove(path);
+
+    EXPECT_FALSE(fs::map(path));
+}
+
+TEST(logging, parallelForVisitsEachItemOnce)
+{
+    std::vector<std::atomic<int>> visits(10000);
+
+    logging::parallel_for(static_cast<size_t>(0), visits.size(), [&](size_t i) { visits[i]++; });
+
+    for (auto &v : visits) {
+        ASSERT_EQ(1, v.load());
+    }
+
+    // random access container: split into ranges
+    std::vector<int> items(10000, 0);
+    logging::parallel_for_each(items, [](int &i) { i++; });
+
+    for (int i : items) {
+        ASSERT_EQ(1, i);
+    }
+
+    // forward-only container: visited one by one
+    std::unordered_set<int> set;
+    for (int i = 0; i < 1000; i++) {
+        set.insert(i);
+    }
+
+    std::atomic<int> sum = 0;
+    logging::parallel_for_each(set, [&](int i) { sum += i; });
+
+    EXPECT_EQ(999 * 1000 / 2, sum.load());
+
+    // empty loops still finish
+    logging::parallel_for(0, 0, [](int) { FAIL(); });
+}
+
+TEST(logging, writerKeepsPerThreadOrder)
+{
+    const fs::path log_path = fs::temp_directory_path() / "ericw-tools-test-logging.log";
+
+    settings::common_settings settings;
+    logging::init(log_path, settings);
+
+    constexpr int num_threads = 4, num_lines = 5000;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < num_lines; i++) {
+                logging::print(logging::flag::DEFAULT, "logtest {} {}\n", t, i);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // flushes the writer thread
+    logging::close();
+
+    std::ifstream stream(log_path);
+    std::array<int, num_threads> next{};
+    std::string line;
+
+    while (std::getline(stream, line)) {
+        int t, i;
+
+        if (sscanf(line.c_str(), "logtest %d %d", &t, &i) != 2) {
+            continue;
+        }
+
+        ASSERT_EQ(next[t], i);
+        next[t]++;
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        EXPECT_EQ(num_lines, next[t]);
+    }
+}
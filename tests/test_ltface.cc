@@ -1,10 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <light/entities.hh>
 #include <light/light.hh>
+#include <light/lightgrid.hh>
 #include <light/ltface.hh>
 #include <light/surflight.hh>
 #include <common/bspinfo.hh>
+#include <common/json.hh>
 #include <common/litfile.hh>
+#include <common/pipeline.hh>
 #include <qbsp/qbsp.hh>
 #include <testmaps.hh>
 #include <vis/vis.hh>
@@ -12,7 +16,7 @@
 #include "test_main.hh"
 
 static testresults_t QbspVisLight_Common(const std::filesystem::path &name, std::vector<std::string> extra_qbsp_args,
-    std::vector<std::string> extra_light_args, runvis_t run_vis)
+    std::vector<std::string> extra_light_args, runvis_t run_vis, bool in_memory = false)
 {
     const bool is_q2 = std::find(extra_qbsp_args.begin(), extra_qbsp_args.end(), "-q2bsp") != extra_qbsp_args.end();
     const bool is_hl = std::find(extra_qbsp_args.begin(), extra_qbsp_args.end(), "-hlbsp") != extra_qbsp_args.end();
@@ -59,10 +63,12 @@ static testresults_t QbspVisLight_Common(const std::filesystem::path &name, std:
     args.push_back(map_path.string());
     args.push_back(bsp_path.string());
 
-    // run qbsp
+    // run qbsp; with in_memory, the tools hand their output to each other
+    // directly and only light writes to disk
+    pipeline_data_t data;
 
     InitQBSP(args);
-    ProcessFile();
+    ProcessFile(in_memory ? &data : nullptr);
 
     // run vis
     if (run_vis == runvis_t::yes) {
@@ -70,7 +76,11 @@ static testresults_t QbspVisLight_Common(const std::filesystem::path &name, std:
             "", // the exe path, which we're ignoring in this case
         };
         vis_args.push_back(bsp_path.string());
-        vis_main(vis_args);
+        if (in_memory) {
+            vis_main(vis_args, data);
+        } else {
+            vis_main(vis_args);
+        }
     }
 
     // run light
@@ -85,7 +95,11 @@ static testresults_t QbspVisLight_Common(const std::filesystem::path &name, std:
         }
         light_args.push_back(bsp_path.string());
 
-        light_main(light_args);
+        if (in_memory) {
+            light_main(light_args, data);
+        } else {
+            light_main(light_args);
+        }
 
         // ensure a .lit is never created in q2
         if (is_q2) {
@@ -218,6 +232,166 @@ TEST(worldunitsperluxel, lightgrid)
     }
 }
 
+struct decoded_lightgrid_t
+{
+    qvec3f grid_dist, grid_mins;
+    qvec3i grid_size;
+
+    struct point_t
+    {
+        bool occluded = true;
+        std::map<uint8_t, qvec3b> colors; // style -> color
+    };
+
+    std::vector<point_t> points;
+};
+
+/**
+ * decodes a LIGHTGRID_OCTREE lump into one entry per grid point; points outside
+ * every octree leaf are occluded
+ */
+static decoded_lightgrid_t DecodeLightgridOctree(const std::vector<uint8_t> &lump)
+{
+    decoded_lightgrid_t result;
+
+    imemstream stream(lump.data(), lump.size());
+    stream >> endianness<std::endian::little>;
+
+    uint8_t num_styles;
+    uint32_t root_node, num_nodes, num_leafs;
+
+    stream >= result.grid_dist;
+    stream >= result.grid_size;
+    stream >= result.grid_mins;
+    stream >= num_styles;
+    stream >= root_node;
+
+    stream >= num_nodes;
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        qvec3i division_point;
+        std::array<uint32_t, 8> children;
+        stream >= division_point;
+        for (auto &child : children) {
+            stream >= child;
+        }
+    }
+
+    result.points.resize(result.grid_size[0] * result.grid_size[1] * result.grid_size[2]);
+
+    stream >= num_leafs;
+    for (uint32_t i = 0; i < num_leafs; i++) {
+        qvec3i mins, size;
+        stream >= mins;
+        stream >= size;
+
+        for (int z = mins[2]; z < mins[2] + size[2]; z++) {
+            for (int y = mins[1]; y < mins[1] + size[1]; y++) {
+                for (int x = mins[0]; x < mins[0] + size[0]; x++) {
+                    auto &point = result.points[(result.grid_size[0] * result.grid_size[1] * z) +
+                                                (result.grid_size[0] * y) + x];
+
+                    uint8_t used_styles;
+                    stream >= used_styles;
+
+                    if (used_styles == 0xff) {
+                        continue;
+                    }
+
+                    point.occluded = false;
+
+                    for (uint8_t j = 0; j < used_styles; j++) {
+                        uint8_t style;
+                        qvec3b color;
+                        stream >= style;
+                        stream >= color;
+                        point.colors[style] = color;
+                    }
+                }
+            }
+        }
+    }
+
+    EXPECT_TRUE(stream.good());
+    EXPECT_EQ(lump.size(), static_cast<size_t>(stream.tellg()));
+
+    return result;
+}
+
+TEST(worldunitsperluxel, lightgridAdaptive)
+{
+    auto [dense_bsp, dense_bspx] = QbspVisLight_Q2("q2_lightmap_custom_scale.map", {"-lightgrid"});
+    const size_t dense_traced = LightGridPointsTraced();
+
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_lightmap_custom_scale.map", {"-lightgrid", "-lightgrid_adaptive"});
+    const size_t adaptive_traced = LightGridPointsTraced();
+
+    ASSERT_NE(dense_bspx.find("LIGHTGRID_OCTREE"), dense_bspx.end());
+    ASSERT_NE(bspx.find("LIGHTGRID_OCTREE"), bspx.end());
+
+    const decoded_lightgrid_t dense = DecodeLightgridOctree(dense_bspx.at("LIGHTGRID_OCTREE"));
+    const decoded_lightgrid_t adaptive = DecodeLightgridOctree(bspx.at("LIGHTGRID_OCTREE"));
+
+    EXPECT_EQ(dense.grid_dist, adaptive.grid_dist);
+    EXPECT_EQ(dense.grid_size, adaptive.grid_size);
+    EXPECT_EQ(dense.grid_mins, adaptive.grid_mins);
+    ASSERT_EQ(dense.points.size(), adaptive.points.size());
+
+    // interpolated points may differ from traced ones by up to the threshold,
+    // plus one for rounding each of them to bytes
+    const int tolerance = static_cast<int>(light_options.lightgrid_adaptive_threshold.value()) + 1;
+
+    for (size_t i = 0; i < dense.points.size(); i++) {
+        SCOPED_TRACE(i);
+
+        const auto &dense_point = dense.points[i];
+        const auto &adaptive_point = adaptive.points[i];
+
+        ASSERT_EQ(dense_point.occluded, adaptive_point.occluded);
+
+        for (const auto &[style, color] : dense_point.colors) {
+            const auto it = adaptive_point.colors.find(style);
+            const qvec3b adaptive_color = (it != adaptive_point.colors.end()) ? it->second : qvec3b{};
+
+            for (int axis = 0; axis < 3; axis++) {
+                EXPECT_LE(std::abs(color[axis] - adaptive_color[axis]), tolerance) << "style " << +style;
+            }
+        }
+    }
+
+    EXPECT_EQ(dense.points.size(), dense_traced);
+    EXPECT_LT(adaptive_traced, dense_traced);
+}
+
+TEST(worldunitsperluxel, lightgridSkyStopsAtSceneBounds)
+{
+    SCOPED_TRACE("lightgrid sun rays stopped just past the scene bounds still find the sky");
+
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_light_sunlight_default_mangle.map", {"-lightgrid"});
+    auto [far_bsp, far_bspx] = QbspVisLight_Q2("q2_light_sunlight_default_mangle.map", {"-lightgrid", "-nobatchsky"});
+
+    const decoded_lightgrid_t grid = DecodeLightgridOctree(bspx.at("LIGHTGRID_OCTREE"));
+    const decoded_lightgrid_t far_grid = DecodeLightgridOctree(far_bspx.at("LIGHTGRID_OCTREE"));
+
+    ASSERT_EQ(far_grid.points.size(), grid.points.size());
+
+    size_t sunlit = 0;
+
+    for (size_t i = 0; i < grid.points.size(); i++) {
+        SCOPED_TRACE(i);
+
+        EXPECT_EQ(far_grid.points[i].occluded, grid.points[i].occluded);
+        EXPECT_EQ(far_grid.points[i].colors, grid.points[i].colors);
+
+        auto it = grid.points[i].colors.find(0);
+        if (it != grid.points[i].colors.end() && it->second != qvec3b{}) {
+            sunlit++;
+        }
+    }
+
+    // the map has nothing but the sun, so this checks the sky was actually hit
+    EXPECT_GT(sunlit, 0);
+}
+
 TEST(ltfaceQ2, emissiveCubeArtifacts)
 {
     // A cube with surface flags "light", value "100", placed in a hallway.
@@ -389,6 +563,58 @@ static void CheckFaceLuxelAtPoint_HDR(const mbsp_t *bsp, const dmodelh2_t *model
     EXPECT_LE(delta[2], allowed_delta[2]);
 }
 
+/**
+ * Compares the styles and lightmap samples of every face in two compiles of the same map.
+ * The order faces are packed into the lightmap lump depends on thread scheduling, so the
+ * lumps themselves can't be compared directly.
+ */
+static void CheckFaceLightmapsMatch(const mbsp_t &expected, const mbsp_t &actual, int allowed_delta = 0,
+    const lit_variant_t *expected_lit = nullptr, const lit_variant_t *actual_lit = nullptr)
+{
+    // FIXME: assumes no DECOUPLED_LM lump
+
+    ASSERT_EQ(expected.dfaces.size(), actual.dfaces.size());
+
+    const int bytes_per_sample = expected.loadversion->game->has_rgb_lightmap ? 3 : 1;
+
+    auto check_bytes = [allowed_delta](const std::vector<uint8_t> &expected_data, size_t expected_ofs,
+                           const std::vector<uint8_t> &actual_data, size_t actual_ofs, size_t size) {
+        ASSERT_LE(expected_ofs + size, expected_data.size());
+        ASSERT_LE(actual_ofs + size, actual_data.size());
+
+        int max_delta = 0;
+        for (size_t j = 0; j < size; j++) {
+            max_delta = std::max(max_delta, std::abs(expected_data[expected_ofs + j] - actual_data[actual_ofs + j]));
+        }
+        EXPECT_LE(max_delta, allowed_delta);
+    };
+
+    for (size_t i = 0; i < expected.dfaces.size(); i++) {
+        const mface_t &expected_face = expected.dfaces[i];
+        const mface_t &actual_face = actual.dfaces[i];
+        SCOPED_TRACE(fmt::format("face num: {}", i));
+
+        ASSERT_EQ(expected_face.styles, actual_face.styles);
+        ASSERT_EQ(expected_face.lightofs == -1, actual_face.lightofs == -1);
+
+        if (expected_face.lightofs == -1) {
+            continue;
+        }
+
+        const size_t numstyles = std::count_if(expected_face.styles.begin(), expected_face.styles.end(),
+            [](uint8_t style) { return style != INVALID_LIGHTSTYLE_OLD; });
+        const size_t size = faceextents_t(expected_face, expected, LMSCALE_DEFAULT).numsamples() * numstyles;
+
+        check_bytes(expected.dlightdata, expected_face.lightofs, actual.dlightdata, actual_face.lightofs,
+            size * bytes_per_sample);
+
+        if (expected_lit && actual_lit) {
+            check_bytes(std::get<lit1_t>(*expected_lit).rgbdata, expected_face.lightofs * 3,
+                std::get<lit1_t>(*actual_lit).rgbdata, actual_face.lightofs * 3, size * 3);
+        }
+    }
+}
+
 TEST(ltfaceQ2, emissiveLights)
 {
     auto [bsp, bspx] = QbspVisLight_Q2("q2_light_flush.map", {});
@@ -453,6 +679,63 @@ TEST(ltfaceQ2, dirtDebug)
     CheckFaceLuxelAtPoint(&bsp, &bsp.dmodels[0], {0, 0, 0}, {-124, 300, 32});
 }
 
+TEST(ltfaceQ2, lightstats)
+{
+    SCOPED_TRACE("-lightstats writes a json report of ray counts per light type");
+
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_light_cone.map", {"-lightstats", "-dirt"});
+
+    const fs::path stats_path = fs::path(qbsp_options.bsp_path).replace_extension("lightstats.json");
+    ASSERT_TRUE(fs::exists(stats_path));
+
+    std::ifstream stream(stats_path);
+    json j;
+    stream >> j;
+
+    EXPECT_GT(j.at("sources").at("entity").at("rays").get<uint64_t>(), 0);
+    EXPECT_GT(j.at("sources").at("dirt").at("rays").get<uint64_t>(), 0);
+    EXPECT_LE(j.at("sources").at("dirt").at("occluded").get<uint64_t>(),
+        j.at("sources").at("dirt").at("rays").get<uint64_t>());
+
+    ASSERT_FALSE(j.at("faces").empty());
+    ASSERT_FALSE(j.at("lights").empty());
+
+    // the report is sorted by cost, so look for the light entity anywhere in it
+    const json &lights = j.at("lights");
+    EXPECT_TRUE(std::any_of(lights.begin(), lights.end(), [](const json &light) {
+        return light.at("type") == "entity" && light.value("classname", "") == "light";
+    }));
+}
+
+TEST(ltfaceQ2, inMemoryPipeline)
+{
+    SCOPED_TRACE("running qbsp/vis/light in-process without the intermediate files gives the same result");
+
+    auto [disk_bsp, disk_bspx] =
+        QbspVisLight_Common("q2_func_illusionary_visblocker.map", {"-q2bsp"}, {}, runvis_t::yes);
+    auto [bsp, bspx] =
+        QbspVisLight_Common("q2_func_illusionary_visblocker.map", {"-q2bsp"}, {}, runvis_t::yes, true);
+
+    EXPECT_EQ(disk_bsp.dvis.bits, bsp.dvis.bits);
+    CheckFaceLightmapsMatch(disk_bsp, bsp);
+    EXPECT_EQ(disk_bspx, bspx);
+}
+
+TEST(ltfaceQ1, inMemoryPipelineOnlyents)
+{
+    SCOPED_TRACE("in-process, -onlyents hands the bsp it updated on to light instead of writing it");
+
+    auto [disk_bsp, disk_bspx] = QbspVisLight_Common("q1_func_illusionary_visblocker.map", {}, {}, runvis_t::yes);
+
+    // updates the entities of the .bsp just written, keeping its vis
+    auto [bsp, bspx] =
+        QbspVisLight_Common("q1_func_illusionary_visblocker.map", {"-onlyents"}, {}, runvis_t::no, true);
+
+    EXPECT_EQ(disk_bsp.dentdata, bsp.dentdata);
+    EXPECT_EQ(disk_bsp.dvis.bits, bsp.dvis.bits);
+    CheckFaceLightmapsMatch(disk_bsp, bsp);
+}
+
 TEST(ltfaceQ2, lightTranslucency)
 {
     SCOPED_TRACE("liquids cast translucent colored shadows (sampling texture) by default");
@@ -1192,3 +1475,85 @@ TEST(ltfaceQ1, surflightGroup)
         CheckFaceLuxelAtPoint(&bsp, &bsp.dmodels[0], {0, 0, 75}, {720, 1376, 960}, {0, 0, 1}, &lit, &bspx);
     }
 }
+
+TEST(ltfaceQ1, surflightBVHMatchesPlainLoop)
+{
+    SCOPED_TRACE("culling surface and bounce lights through the BVH doesn't change the lightmaps");
+
+    // the two groups light the brush next to them and fall off before reaching
+    // the other one, which is what the node range bound has to get right; the
+    // bounce pass adds the separate BVH built over bounce lights
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_surflight_group.map", {"-bounce", "1"});
+    auto [plain_bsp, plain_bspx, plain_lit] =
+        QbspVisLight_Q1("q1_light_surflight_group.map", {"-bounce", "1", "-nosurflightbvh"});
+
+    ASSERT_FALSE(bsp.dlightdata.empty());
+    CheckFaceLightmapsMatch(plain_bsp, bsp);
+}
+
+TEST(ltfaceQ1, rayPacketsMatchSingleRays)
+{
+    SCOPED_TRACE("tracing ray streams as 8-wide packets gives the same lightmaps as single rays");
+
+    // direct lights trace occlusion streams and dirt traces intersection streams; face
+    // sample counts are rarely a multiple of 8, so the last packet of a stream is partial
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_bounce_litwater.map", {"-dirt"});
+    auto [single_bsp, single_bspx, single_lit] =
+        QbspVisLight_Q1("q1_light_bounce_litwater.map", {"-dirt", "-noraypackets"});
+
+    ASSERT_FALSE(bsp.dlightdata.empty());
+
+    // packet and single ray traversal may round a hit distance differently, so allow
+    // for the occasional off-by-one luxel
+    CheckFaceLightmapsMatch(single_bsp, bsp, 1);
+}
+
+TEST(ltfaceQ1, streamedLightmapsMatchDeferred)
+{
+    SCOPED_TRACE("without bounce, writing each face as soon as it's lit gives the same lightmaps");
+
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_bounce_litwater.map", {"-lit"});
+    auto [deferred_bsp, deferred_bspx, deferred_lit] =
+        QbspVisLight_Q1("q1_light_bounce_litwater.map", {"-lit", "-nostreamlightmaps"});
+
+    ASSERT_FALSE(bsp.dlightdata.empty());
+
+    // the streamed output is sized for the worst case up front, then trimmed
+    EXPECT_EQ(deferred_bsp.dlightdata.size(), bsp.dlightdata.size());
+    EXPECT_EQ(std::get<lit1_t>(deferred_lit).rgbdata.size(), std::get<lit1_t>(lit).rgbdata.size());
+
+    CheckFaceLightmapsMatch(deferred_bsp, bsp, 0, &deferred_lit, &lit);
+}
+
+TEST(ltfaceQ2, lightBVHMatchesPlainLoop)
+{
+    SCOPED_TRACE("culling light entities through the BVH doesn't change the lightmaps");
+
+    // has both positive and negative lights, which are gathered separately
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_light_negative.map", {});
+    auto [plain_bsp, plain_bspx] = QbspVisLight_Q2("q2_light_negative.map", {"-nolightbvh"});
+
+    ASSERT_FALSE(bsp.dlightdata.empty());
+    CheckFaceLightmapsMatch(plain_bsp, bsp);
+}
+
+TEST(ltfaceQ1, batchedSkyMatchesPerSun)
+{
+    SCOPED_TRACE("tracing all suns of a face in shared, bounded streams gives the same lightmaps as one sun at a time");
+
+    // two suns limited to different sky textures, plus a _sunlight2 dome of a few hundred
+    // suns in the same style; sorting by suntexture reorders them, and with that many
+    // suns every face bigger than a couple of hundred samples fills more than one batch
+    const std::vector<std::string> args{"-lit", "-sunlight2", "100", "-sunsamples", "256"};
+    std::vector<std::string> per_sun_args = args;
+    per_sun_args.push_back("-nobatchsky");
+
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_light_suntexture.map", args);
+    auto [per_sun_bsp, per_sun_bspx, per_sun_lit] = QbspVisLight_Q1("q1_light_suntexture.map", per_sun_args);
+
+    ASSERT_FALSE(bsp.dlightdata.empty());
+    ASSERT_GT(GetSuns().size(), 256);
+
+    // the suns are summed in a different order, so allow for the occasional off-by-one luxel
+    CheckFaceLightmapsMatch(per_sun_bsp, bsp, 1, &per_sun_lit, &lit);
+}
@@ -1166,6 +1166,46 @@ TEST(testmapsQ1, tjuncManySidedFaceSkyWithDefaultTjuncMode)
     }
 }
 
+TEST(testmapsQ1, tjuncManySidedFaceSkyGreedyTriangulation)
+{
+    // force the greedy ear clipping fallback instead of MWT
+    const auto [bsp, bspx, prt] = LoadTestmapQ1("qbsp_tjunc_many_sided_sky.map", {"-tjunc_mwt_max_vertices", "4"});
+    const auto [untouched_bsp, untouched_bspx, untouched_prt] =
+        LoadTestmapQ1("qbsp_tjunc_many_sided_sky.map", {"-tjunc", "none"});
+
+    // total face area on each plane, to check the triangulated faces cover the original ones
+    auto area_by_plane = [](const mbsp_t &bsp) {
+        std::map<std::pair<qvec3d, double>, double> result;
+        for (auto &face : bsp.dfaces) {
+            const auto winding = Face_Winding(&bsp, &face);
+            const qvec3d normal = Face_Normal(&bsp, &face);
+            result[{normal, std::round(qv::dot(normal, winding[0]))}] += winding.area();
+        }
+        return result;
+    };
+
+    for (auto &face : bsp.dfaces) {
+        EXPECT_LE(face.numedges, 64);
+
+        // every face is a fan of triangles around its first vertex; none of them may be degenerate
+        const auto winding = Face_Winding(&bsp, &face);
+        for (size_t i = 1; i + 1 < winding.size(); i++) {
+            const double tri_area = qv::length(qv::cross(winding[i] - winding[0], winding[i + 1] - winding[0])) / 2;
+            EXPECT_GT(tri_area, 0.01) << "face " << Face_GetNum(&bsp, &face) << " triangle " << i;
+        }
+    }
+
+    const auto areas = area_by_plane(bsp);
+    const auto untouched_areas = area_by_plane(untouched_bsp);
+
+    ASSERT_EQ(untouched_areas.size(), areas.size());
+
+    for (auto &[plane, area] : untouched_areas) {
+        ASSERT_TRUE(areas.contains(plane));
+        EXPECT_NEAR(area, areas.at(plane), 0.1);
+    }
+}
+
 TEST(testmapsQ1, manySidedFace)
 {
     // FIXME: 360 sided cylinder is really slow to compile
@@ -1455,6 +1495,49 @@ TEST(testmapsQ1, qbspFuncDetailVariousTypes)
     EXPECT_GT(prt->portalleafs_real, 3);
 }
 
+TEST(testmapsQ1, binaryPortalFile)
+{
+    const auto [bsp, bspx, prt] = LoadTestmapQ1("qbsp_func_detail.map", {"-portalformat", "both"});
+
+    ASSERT_TRUE(prt);
+
+    const fs::path prtbpath = fs::path(qbsp_options.bsp_path).replace_extension(".prtb");
+    ASSERT_TRUE(IsBinaryPortalFile(prtbpath));
+
+    const prtfile_t prtb = LoadPrtFile(prtbpath, qbsp_options.target_version);
+
+    // the binary file should read back the same as the PRT2 text file
+    EXPECT_EQ(prtb.portalleafs, prt->portalleafs);
+    EXPECT_EQ(prtb.portalleafs_real, prt->portalleafs_real);
+
+    ASSERT_EQ(prtb.portals.size(), prt->portals.size());
+    for (size_t i = 0; i < prtb.portals.size(); i++) {
+        EXPECT_EQ(prtb.portals[i].leafnums[0], prt->portals[i].leafnums[0]);
+        EXPECT_EQ(prtb.portals[i].leafnums[1], prt->portals[i].leafnums[1]);
+        EXPECT_TRUE(PortalMatcher(prtb.portals[i].winding, prt->portals[i].winding));
+    }
+
+    ASSERT_EQ(prtb.dleafinfos.size(), prt->dleafinfos.size());
+    for (size_t i = 0; i < prtb.dleafinfos.size(); i++) {
+        EXPECT_EQ(prtb.dleafinfos[i].cluster, prt->dleafinfos[i].cluster);
+    }
+
+    // writing it back out is lossless
+    const fs::path roundtrippath = fs::path(qbsp_options.bsp_path).replace_extension(".roundtrip.prtb");
+    WritePortalfileBinary(roundtrippath, prtb);
+
+    const prtfile_t roundtrip = LoadPrtFile(roundtrippath, qbsp_options.target_version);
+
+    ASSERT_EQ(roundtrip.portals.size(), prtb.portals.size());
+    for (size_t i = 0; i < roundtrip.portals.size(); i++) {
+        ASSERT_EQ(roundtrip.portals[i].winding.size(), prtb.portals[i].winding.size());
+
+        for (size_t j = 0; j < roundtrip.portals[i].winding.size(); j++) {
+            EXPECT_EQ(roundtrip.portals[i].winding[j], prtb.portals[i].winding[j]);
+        }
+    }
+}
+
 TEST(testmapsQ1, angledBrush)
 {
     const auto [bsp, bspx, prt] = LoadTestmapQ1("qbsp_angled_brush.map");
@@ -1526,6 +1609,37 @@ TEST(testmapsQ1, hullsFlag)
     }
 }
 
+TEST(testmapsQ1, parallelHullsMatchSequential)
+{
+    // -loghulls builds the collision hulls one at a time
+    const auto [sequential, sequential_bspx, sequential_prt] = LoadTestmapQ1("q1_hulls.map", {"-loghulls"});
+
+    // the hulls finish in a different order each time, which must not change the plane numbering
+    for (int run = 0; run < 3; run++) {
+        SCOPED_TRACE(fmt::format("run {}", run));
+
+        const auto [parallel, parallel_bspx, parallel_prt] = LoadTestmapQ1("q1_hulls.map");
+
+        ASSERT_EQ(sequential.dmodels.size(), parallel.dmodels.size());
+        for (size_t i = 0; i < sequential.dmodels.size(); i++) {
+            EXPECT_EQ(sequential.dmodels[i].headnode, parallel.dmodels[i].headnode);
+        }
+
+        ASSERT_EQ(sequential.dplanes.size(), parallel.dplanes.size());
+        for (size_t i = 0; i < sequential.dplanes.size(); i++) {
+            EXPECT_EQ(sequential.dplanes[i].normal, parallel.dplanes[i].normal);
+            EXPECT_EQ(sequential.dplanes[i].dist, parallel.dplanes[i].dist);
+            EXPECT_EQ(sequential.dplanes[i].type, parallel.dplanes[i].type);
+        }
+
+        ASSERT_EQ(sequential.dclipnodes.size(), parallel.dclipnodes.size());
+        for (size_t i = 0; i < sequential.dclipnodes.size(); i++) {
+            EXPECT_EQ(sequential.dclipnodes[i].planenum, parallel.dclipnodes[i].planenum);
+            EXPECT_EQ(sequential.dclipnodes[i].children, parallel.dclipnodes[i].children);
+        }
+    }
+}
+
 TEST(testmapsQ1, 0125UnitFaces)
 {
     GTEST_SKIP();
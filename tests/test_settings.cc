@@ -265,6 +265,26 @@ TEST(settings, grouping)
     // settings.printHelp();
 }
 
+TEST(settings, testingGroupHiddenFromHelp)
+{
+    settings::setting_container settings;
+    settings::setting_bool boolSetting(&settings, "fast", false, &settings::performance_group, "use faster algorithm");
+    settings::setting_bool testingSetting(
+        &settings, "noaccel", false, &settings::testing_group, "skip the acceleration structure");
+
+    const char *arguments[] = {"qbsp.exe", "-noaccel"};
+    token_parser_t p{std::size(arguments) - 1, arguments + 1, {}};
+    settings.parse(p);
+    EXPECT_TRUE(testingSetting.value());
+
+    testing::internal::CaptureStdout();
+    settings.print_help(false);
+    const std::string help = testing::internal::GetCapturedStdout();
+
+    EXPECT_NE(help.find("-fast"), std::string::npos);
+    EXPECT_EQ(help.find("-noaccel"), std::string::npos);
+}
+
 TEST(settings, copy)
 {
     settings::setting_container settings;
@@ -1,7 +1,10 @@
 #include <common/bsputils.hh>
 #include <common/qvec.hh>
 
+#include <cstring>
+#include <random>
 #include <stdexcept>
+#include <qbsp/qbsp.hh>
 #include <vis/vis.hh>
 
 #include "test_qbsp.hh"
@@ -57,6 +60,40 @@ TEST(vis, detailLeakTest)
     }
 }
 
+TEST(vis, q2PHSIsUnionOfVisiblePVS)
+{
+    auto [bsp, bspx] = QbspVisLight_Q2("q2_detail_leak_test.map", {}, runvis_t::yes);
+
+    const int num_clusters = bsp.dvis.bit_offsets.size();
+    const size_t rowbytes = (num_clusters + 7) >> 3;
+    ASSERT_GT(num_clusters, 0);
+
+    auto decompress_row = [&](vistype_t vis_type, int cluster) {
+        std::vector<uint8_t> row(rowbytes);
+        DecompressVis(bsp.dvis.bits.data() + bsp.dvis.get_bit_offset(vis_type, cluster),
+            bsp.dvis.bits.data() + bsp.dvis.bits.size(), row.data(), row.data() + row.size());
+        return row;
+    };
+
+    for (int i = 0; i < num_clusters; i++) {
+        SCOPED_TRACE(fmt::format("cluster {}", i));
+
+        const std::vector<uint8_t> pvs = decompress_row(VIS_PVS, i);
+        std::vector<uint8_t> expected = pvs;
+
+        for (int j = 0; j < num_clusters; j++) {
+            if (pvs[j >> 3] & (1 << (j & 7))) {
+                const std::vector<uint8_t> other = decompress_row(VIS_PVS, j);
+                for (size_t k = 0; k < rowbytes; k++) {
+                    expected[k] |= other[k];
+                }
+            }
+        }
+
+        EXPECT_EQ(expected, decompress_row(VIS_PHS, i));
+    }
+}
+
 TEST(vis, q2FuncIllusionaryVisblocker)
 {
     auto [bsp, bspx] = QbspVisLight_Q2("q2_func_illusionary_visblocker.map", {}, runvis_t::yes);
@@ -143,6 +180,18 @@ TEST(vis, q1FuncIllusionaryVisblocker)
     }
 }
 
+TEST(vis, q1AmbientSky)
+{
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_sky_window.map", {}, runvis_t::yes);
+
+    const auto player_start = qvec3d(-96, -304, -40);
+    auto *player_start_leaf = BSP_FindLeafAtPoint(&bsp, &bsp.dmodels[0], player_start);
+
+    EXPECT_EQ(player_start_leaf->contents, CONTENTS_EMPTY);
+    // the sky window is visible from the player start
+    EXPECT_EQ(player_start_leaf->ambient_level[AMBIENT_SKY], 255);
+}
+
 TEST(vis, q1FuncIllusionaryVisblockerInteractions)
 {
     SCOPED_TRACE("make sure illusionary_visblocker covered by detail_illusionary doesn't break the visblocker");
@@ -181,3 +230,183 @@ TEST(vis, ClipStackWinding)
 
     FreeStackWinding(w1, stack);
 }
+
+TEST(vis, WindingPlaneDistancesMatchScalar)
+{
+    std::mt19937 engine(1234);
+    std::uniform_real_distribution<double> dis(-4096, 4096);
+
+    for (size_t numpoints = 1; numpoints <= MAX_WINDING_FIXED; numpoints++) {
+        SCOPED_TRACE(numpoints);
+
+        viswinding_t w;
+        w.numpoints = numpoints;
+        for (size_t i = 0; i < numpoints; i++) {
+            w.points[i] = {dis(engine), dis(engine), dis(engine)};
+        }
+
+        const qplane3d plane(qv::normalize(qvec3d(dis(engine), dis(engine), dis(engine))), dis(engine));
+
+        double scalar[MAX_WINDING_FIXED], simd[MAX_WINDING_FIXED];
+
+        SelectVisKernels(false);
+        WindingPlaneDistances(w, plane, scalar);
+        SelectVisKernels(true);
+        WindingPlaneDistances(w, plane, simd);
+
+        // must be bit-identical, not just close
+        EXPECT_EQ(0, memcmp(scalar, simd, sizeof(double) * numpoints));
+
+        for (size_t i = 0; i < numpoints; i++) {
+            EXPECT_EQ(plane.distance_to(w[i]), scalar[i]);
+        }
+    }
+}
+
+TEST(vis, WindingPlaneSeparatesMatchesScalar)
+{
+    std::mt19937 engine(1234);
+    std::uniform_real_distribution<double> dis(-4096, 4096);
+
+    const qplane3d plane({0, 0, 1}, 0);
+
+    for (size_t numpoints = 1; numpoints <= MAX_WINDING_FIXED; numpoints++) {
+        SCOPED_TRACE(numpoints);
+
+        // all points in front, one point behind in each position, and all points on the plane,
+        // with each point skipped in turn (numpoints skips none)
+        for (size_t behind = 0; behind <= numpoints + 1; behind++) {
+            viswinding_t w;
+            w.numpoints = numpoints;
+            for (size_t i = 0; i < numpoints; i++) {
+                const double z = (behind == numpoints + 1) ? 0.0 : 1.0 + std::abs(dis(engine));
+                w.points[i] = {dis(engine), dis(engine), (i == behind) ? -z : z};
+            }
+
+            for (size_t skip = 0; skip <= numpoints; skip++) {
+                SCOPED_TRACE(fmt::format("behind {} skip {}", behind, skip));
+
+                bool expected = false;
+                for (size_t i = 0; i < numpoints; i++) {
+                    if (i != skip && i != behind && behind != numpoints + 1) {
+                        expected = true;
+                    }
+                }
+                if (behind < numpoints && behind != skip) {
+                    expected = false;
+                }
+
+                SelectVisKernels(false);
+                EXPECT_EQ(expected, WindingPlaneSeparates(w, plane, skip, VIS_ON_EPSILON));
+                SelectVisKernels(true);
+                EXPECT_EQ(expected, WindingPlaneSeparates(w, plane, skip, VIS_ON_EPSILON));
+            }
+        }
+    }
+}
+
+TEST(vis, portalBVHMatchesPlainLoop)
+{
+    // -fast stops at the base vis, so its PVS is exactly the mightsee flood
+    auto check_map = [](const fs::path &bsp_path) {
+        for (const bool fast : {true, false}) {
+            SCOPED_TRACE(fast ? "-fast" : "full vis");
+
+            auto vis_with = [&](bool plain) {
+                std::vector<std::string> args{""};
+                if (fast) {
+                    args.push_back("-fast");
+                }
+                if (plain) {
+                    args.push_back("-noportalbvh");
+                }
+                args.push_back(bsp_path.string());
+                vis_main(args);
+
+                bspdata_t bspdata;
+                fs::path path = bsp_path;
+                LoadBSPFile(path, &bspdata);
+                ConvertBSPFormat(&bspdata, &bspver_generic);
+                return DecompressAllVis(&std::get<mbsp_t>(bspdata.bsp));
+            };
+
+            const auto vis = vis_with(false);
+            ASSERT_FALSE(vis.empty());
+            EXPECT_EQ(vis_with(true), vis);
+        }
+    };
+
+    {
+        SCOPED_TRACE("q1_func_illusionary_visblocker_interactions.map");
+        auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_func_illusionary_visblocker_interactions.map", {});
+        check_map(qbsp_options.bsp_path);
+    }
+
+    {
+        SCOPED_TRACE("q2_detail_leak_test.map");
+        auto [bsp, bspx] = QbspVisLight_Q2("q2_detail_leak_test.map", {});
+        check_map(qbsp_options.bsp_path);
+    }
+}
+
+TEST(vis, incrementalMatchesFullVis)
+{
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_func_illusionary_visblocker.map", {}, runvis_t::yes);
+
+    fs::path bsp_path = qbsp_options.bsp_path;
+    const fs::path incremental_path = fs::path(bsp_path).replace_extension("vic");
+    fs::remove(incremental_path);
+
+    // first run has nothing to reuse, second run reuses everything
+    vis_main({"", "-incremental", bsp_path.string()});
+    ASSERT_TRUE(fs::exists(incremental_path));
+    vis_main({"", "-incremental", bsp_path.string()});
+
+    bspdata_t bspdata;
+    LoadBSPFile(bsp_path, &bspdata);
+    ConvertBSPFormat(&bspdata, &bspver_generic);
+
+    EXPECT_EQ(DecompressAllVis(&bsp), DecompressAllVis(&std::get<mbsp_t>(bspdata.bsp)));
+}
+
+TEST(vis, incrementalMatchesFullVisAfterEdit)
+{
+    // vis the original map, keeping its incremental data
+    auto [bsp, bspx, lit] = QbspVisLight_Q1("q1_func_illusionary_visblocker.map", {}, runvis_t::yes);
+
+    const fs::path bsp_path = qbsp_options.bsp_path;
+    const fs::path incremental_path = fs::path(bsp_path).replace_extension("vic");
+    fs::remove(incremental_path);
+
+    vis_main({"", "-incremental", bsp_path.string()});
+    ASSERT_TRUE(fs::exists(incremental_path));
+
+    // same map with the visblocker removed, so the middle of the corridor
+    // changes and both ends can now see each other
+    auto [edited_bsp, edited_bspx, edited_lit] =
+        QbspVisLight_Q1("q1_func_illusionary_visblocker_removed.map", {}, runvis_t::yes);
+
+    fs::path edited_bsp_path = qbsp_options.bsp_path;
+    const auto edited_vis = DecompressAllVis(&edited_bsp);
+
+    // a stale reuse of the original vis would leave these hidden from each other
+    ASSERT_NE(DecompressAllVis(&bsp), edited_vis);
+
+    {
+        const auto *player_start_leaf = BSP_FindLeafAtPoint(&edited_bsp, &edited_bsp.dmodels[0], {64, -176, 40});
+        const auto *nailgun_leaf = BSP_FindLeafAtPoint(&edited_bsp, &edited_bsp.dmodels[0], {48, 464, 32});
+        EXPECT_TRUE(q1_leaf_sees(edited_bsp, edited_vis, player_start_leaf, nailgun_leaf));
+    }
+
+    // incremental vis of the edited map, starting from the original's data
+    const fs::path edited_incremental_path = fs::path(edited_bsp_path).replace_extension("vic");
+    fs::copy_file(incremental_path, edited_incremental_path, fs::copy_options::overwrite_existing);
+
+    vis_main({"", "-incremental", edited_bsp_path.string()});
+
+    bspdata_t bspdata;
+    LoadBSPFile(edited_bsp_path, &bspdata);
+    ConvertBSPFormat(&bspdata, &bspver_generic);
+
+    EXPECT_EQ(edited_vis, DecompressAllVis(&std::get<mbsp_t>(bspdata.bsp)));
+}
@@ -2,7 +2,9 @@
 #include <vis/leafbits.hh>
 #include <common/log.hh>
 #include <common/parallel.hh>
+#include <algorithm>
 #include <bit> // for std::popcount
+#include <numeric>
 
 /*
   ==============
@@ -27,6 +29,15 @@
 static void ClipToSeparators(visstats_t &stats, const viswinding_t *source, const qplane3d src_pl,
     const viswinding_t *pass, viswinding_t *&target, unsigned int test, pstack_t &stack)
 {
+    // which side of the source plane each pass point is on doesn't depend on
+    // the source edge, so work it out once up front
+    double src_dists[MAX_WINDING];
+
+    if (pass->size() > MAX_WINDING)
+        FError("pass->numpoints > MAX_WINDING ({} > {})", pass->size(), MAX_WINDING);
+
+    WindingPlaneDistances(*pass, src_pl, src_dists);
+
     // check all combinations
     for (size_t i = 0; i < source->size(); i++) {
         const size_t l = (i + 1) % source->size();
@@ -41,7 +52,7 @@ static void ClipToSeparators(visstats_t &stats, const viswinding_t *source, cons
             // This also tells us which side of the separating plane has
             //  the source portal.
             bool fliptest;
-            double d = src_pl.distance_to(pass->at(j));
+            double d = src_dists[j];
             if (d < -VIS_ON_EPSILON)
                 fliptest = true;
             else if (d > VIS_ON_EPSILON)
@@ -72,21 +83,8 @@ static void ClipToSeparators(visstats_t &stats, const viswinding_t *source, cons
             // if all of the pass portal points are now on the positive side,
             // this is the separating plane
             //
-            int count = 0;
-            size_t k = 0;
-            for (; k < pass->size(); k++) {
-                if (k == j)
-                    continue;
-                d = sep.distance_to(pass->at(k));
-                if (d < -VIS_ON_EPSILON)
-                    break;
-                else if (d > VIS_ON_EPSILON)
-                    ++count;
-            }
-            if (k != pass->size())
-                continue; // points on negative side, not a separating plane
-            if (!count)
-                continue; // planar with separating plane
+            if (!WindingPlaneSeparates(*pass, sep, j, VIS_ON_EPSILON))
+                continue; // points on negative side, or planar with separating plane
 
             //
             // flip the normal if we want the back side (tests 1 and 3)
@@ -297,8 +295,12 @@ static unsigned TargetChecks(visstats_t &stats, const pstack_t *const head, cons
         FreeStackWinding(stack.pass, stack);
     }
 
-    // transfer results back to prevstack
-    *prevstack->mightsee = std::move(local);
+    // transfer results back to prevstack. copy rather than move, since the head of
+    // the stack points at the portal's own mightsee, which other threads may be reading
+    const size_t numblocks = (portalleafs + leafbits_t::mask) >> leafbits_t::shift;
+    for (size_t block = 0; block < numblocks; block++) {
+        prevstack->mightsee->atomic_store_block(block, local.data()[block]);
+    }
 
     return numchecks;
 }
@@ -365,7 +367,7 @@ static void RecursiveLeafFlow(int leafnum, threaddata_t *thread, pstack_t &prevs
      * Check we haven't recursed into a leaf already on the stack
      */
     if (CheckStack(leaf, thread)) {
-        logging::funcprint("WARNING: recursion on leaf {}\n", leafnum);
+        logging::funcwarning("WARNING: recursion on leaf {}\n", leafnum);
         return;
     }
 
@@ -544,18 +546,134 @@ visstats_t PortalFlow(visportal_t *p)
   ============================================================================
 */
 
-static void SimpleFlood(visportal_t &srcportal, int leafnum, const leafbits_t &portalsee)
+/*
+ * BVH over the portal winding bounding spheres. Each portal can only see
+ * portals that are at least partly in front of it, so BasePortalThread
+ * walks this to skip whole groups of portals that are behind it.
+ */
+struct portal_bvh_t
 {
-    if (srcportal.mightsee[leafnum])
+    struct node_t
+    {
+        aabb3d bounds; // of the bounding spheres
+        // leafs: range of indices. inner nodes: first is the index of the left child; right child follows it
+        uint32_t first = 0;
+        uint32_t count = 0;
+
+        constexpr bool is_leaf() const { return count != 0; }
+    };
+
+    std::vector<node_t> nodes;
+    std::vector<uint32_t> indices; // into portals
+};
+
+static portal_bvh_t portal_bvh;
+
+constexpr uint32_t PORTAL_BVH_LEAF_SIZE = 8;
+
+static aabb3d PortalSphereBounds(const visportal_t &p)
+{
+    const qvec3d radius{p.winding->radius};
+    return {p.winding->origin - radius, p.winding->origin + radius};
+}
+
+static void BuildPortalBVH_r(uint32_t nodenum, uint32_t first, uint32_t count)
+{
+    aabb3d bounds;
+    aabb3d centers;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        const visportal_t &p = portals[portal_bvh.indices[i]];
+        bounds += PortalSphereBounds(p);
+        centers += p.winding->origin;
+    }
+
+    portal_bvh.nodes[nodenum].bounds = bounds;
+
+    if (count <= PORTAL_BVH_LEAF_SIZE) {
+        portal_bvh.nodes[nodenum].first = first;
+        portal_bvh.nodes[nodenum].count = count;
+        return;
+    }
+
+    // median split along the longest axis of the sphere centers
+    const size_t axis = qv::indexOfLargestMagnitudeComponent(centers.size());
+    const uint32_t half = count / 2;
+    auto begin = portal_bvh.indices.begin() + first;
+
+    std::nth_element(begin, begin + half, begin + count, [axis](uint32_t a, uint32_t b) {
+        return portals[a].winding->origin[axis] < portals[b].winding->origin[axis];
+    });
+
+    const uint32_t left = static_cast<uint32_t>(portal_bvh.nodes.size());
+    portal_bvh.nodes.resize(left + 2);
+    portal_bvh.nodes[nodenum].first = left;
+
+    BuildPortalBVH_r(left, first, half);
+    BuildPortalBVH_r(left + 1, first + half, count - half);
+}
+
+static void BuildPortalBVH()
+{
+    portal_bvh = {};
+
+    const uint32_t count = static_cast<uint32_t>(numportals * 2);
+
+    if (!count) {
         return;
+    }
+
+    portal_bvh.indices.resize(count);
+    std::iota(portal_bvh.indices.begin(), portal_bvh.indices.end(), 0);
+    portal_bvh.nodes.reserve(2 * (count / PORTAL_BVH_LEAF_SIZE + 1));
+    portal_bvh.nodes.emplace_back();
+
+    BuildPortalBVH_r(0, 0, count);
+}
 
-    srcportal.mightsee[leafnum] = true;
-    srcportal.nummightsee++;
+// true if every sphere in the node is entirely behind the plane
+static bool PortalBVH_NodeBehind(const portal_bvh_t::node_t &node, const qplane3d &plane)
+{
+    const qvec3d center = node.bounds.centroid();
+    const qvec3d extents = node.bounds.size() * 0.5;
+    const double radius = fabs(plane.normal[0]) * extents[0] + fabs(plane.normal[1]) * extents[1] +
+                          fabs(plane.normal[2]) * extents[2];
 
-    leaf_t &leaf = leafs[leafnum];
-    for (const visportal_t *p : leaf.portals) {
-        if (portalsee[p - portals.data()]) {
-            SimpleFlood(srcportal, p->leaf, portalsee);
+    // a bit of slack, since the per-portal test is done in single precision
+    return plane.distance_to(center) + radius < -VIS_ON_EPSILON;
+}
+
+// per-thread scratch space for BasePortalThread
+struct baseportal_scratch_t
+{
+    leafbits_t portalsee;
+    std::vector<uint32_t> seen; // set bits in portalsee, so they can be unset afterwards
+    std::vector<uint32_t> candidates;
+    std::vector<int> stack;
+};
+
+static thread_local baseportal_scratch_t baseportal_scratch;
+
+static void SimpleFlood(visportal_t &srcportal, int leafnum, const leafbits_t &portalsee, std::vector<int> &stack)
+{
+    stack.clear();
+    stack.push_back(leafnum);
+
+    while (!stack.empty()) {
+        leafnum = stack.back();
+        stack.pop_back();
+
+        if (srcportal.mightsee[leafnum])
+            continue;
+
+        srcportal.mightsee[leafnum] = true;
+        srcportal.nummightsee++;
+
+        const leaf_t &leaf = leafs[leafnum];
+        for (const visportal_t *p : leaf.portals) {
+            if (portalsee[p - portals.data()] && !srcportal.mightsee[p->leaf]) {
+                stack.push_back(p->leaf);
+            }
         }
     }
 }
@@ -567,14 +685,50 @@ static void SimpleFlood(visportal_t &srcportal, int leafnum, const leafbits_t &p
 */
 static void BasePortalThread(size_t portalnum)
 {
-    leafbits_t portalsee(numportals * 2);
+    baseportal_scratch_t &scratch = baseportal_scratch;
+
+    if (scratch.portalsee.size() != numportals * 2) {
+        scratch.portalsee.resize(numportals * 2);
+    }
+
+    leafbits_t &portalsee = scratch.portalsee;
 
     visportal_t &p = portals[portalnum];
     viswinding_t &w = *p.winding;
 
     p.mightsee.resize(portalleafs);
 
-    for (size_t i = 0; i < numportals * 2; i++) {
+    // gather the portals whose bounding spheres aren't entirely behind p
+    scratch.candidates.clear();
+
+    if (vis_options.noportalbvh.value()) {
+        scratch.candidates.resize(numportals * 2);
+        std::iota(scratch.candidates.begin(), scratch.candidates.end(), 0);
+    } else if (!portal_bvh.nodes.empty()) {
+        uint32_t stack[64];
+        size_t stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while (stack_size) {
+            const portal_bvh_t::node_t &node = portal_bvh.nodes[stack[--stack_size]];
+
+            if (PortalBVH_NodeBehind(node, p.plane)) {
+                continue;
+            }
+
+            if (node.is_leaf()) {
+                scratch.candidates.insert(scratch.candidates.end(), portal_bvh.indices.begin() + node.first,
+                    portal_bvh.indices.begin() + node.first + node.count);
+            } else {
+                stack[stack_size++] = node.first + 1;
+                stack[stack_size++] = node.first;
+            }
+        }
+    }
+
+    scratch.seen.clear();
+
+    for (uint32_t i : scratch.candidates) {
         if (i == portalnum) {
             continue;
         }
@@ -631,12 +785,16 @@ static void BasePortalThread(size_t portalnum)
         }
 
         portalsee[i] = 1;
+        scratch.seen.push_back(i);
     }
 
     p.nummightsee = 0;
-    SimpleFlood(p, p.leaf, portalsee);
+    SimpleFlood(p, p.leaf, portalsee, scratch.stack);
 
-    portalsee.clear();
+    // leave portalsee cleared for the next portal on this thread
+    for (uint32_t i : scratch.seen) {
+        portalsee[i] = 0;
+    }
 }
 
 /*
@@ -646,5 +804,12 @@ static void BasePortalThread(size_t portalnum)
 */
 void BasePortalVis()
 {
+    // -noportalbvh is the plain loop over every portal, for checking the BVH against
+    if (!vis_options.noportalbvh.value()) {
+        BuildPortalBVH();
+    }
+
     logging::parallel_for(0, numportals * 2, BasePortalThread);
+
+    portal_bvh = {};
 }
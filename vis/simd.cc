@@ -0,0 +1,329 @@
+/*  Copyright (C) 1996-1997  Id Software, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+    See file, 'COPYING', for details.
+*/
+
+#include <vis/vis.hh>
+#include <common/log.hh>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define VIS_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/*
+ * Point-plane distance kernels for the winding clipping code.
+ *
+ * The windings store their points as packed qvec3d's, so each kernel
+ * transposes a batch of points into separate x/y/z registers, then
+ * evaluates every distance in the batch at once.
+ *
+ * All kernels must return results bit-identical to qplane3d::distance_to,
+ * otherwise the PVS would depend on the CPU vis was run on. That means
+ * keeping the exact operation order of qv::dot (x * nx + (y * ny + z * nz))
+ * and never fusing the multiplies and adds; the AVX kernel is compiled
+ * for AVX only, not FMA, so the compiler can't contract them either.
+ */
+
+static_assert(sizeof(qvec3d) == sizeof(double) * 3, "kernels assume tightly packed points");
+
+static void WindingPlaneDistances_Scalar(const viswinding_t &w, const qplane3d &plane, double *dists)
+{
+    for (size_t i = 0; i < w.size(); i++) {
+        dists[i] = plane.distance_to(w[i]);
+    }
+}
+
+static bool WindingPlaneSeparates_Scalar(const viswinding_t &w, const qplane3d &plane, size_t skip, double epsilon)
+{
+    bool front = false;
+
+    for (size_t i = 0; i < w.size(); i++) {
+        if (i == skip) {
+            continue;
+        }
+
+        const double d = plane.distance_to(w[i]);
+
+        if (d < -epsilon) {
+            return false;
+        } else if (d > epsilon) {
+            front = true;
+        }
+    }
+
+    return front;
+}
+
+#ifdef VIS_X86_SIMD
+
+// distances of the 2 points starting at p
+static inline __m128d PlaneDistances2_SSE2(const double *p, __m128d nx, __m128d ny, __m128d nz, __m128d dist)
+{
+    // [x0 y0] [z0 x1] [y1 z1]
+    const __m128d a = _mm_loadu_pd(p);
+    const __m128d b = _mm_loadu_pd(p + 2);
+    const __m128d c = _mm_loadu_pd(p + 4);
+
+    const __m128d x = _mm_shuffle_pd(a, b, 2);
+    const __m128d y = _mm_shuffle_pd(a, c, 1);
+    const __m128d z = _mm_shuffle_pd(b, c, 2);
+
+    const __m128d yz = _mm_add_pd(_mm_mul_pd(y, ny), _mm_mul_pd(z, nz));
+    return _mm_sub_pd(_mm_add_pd(_mm_mul_pd(x, nx), yz), dist);
+}
+
+// folds the behind/in front lane masks of the chunk starting at point i into
+// the separator test, ignoring the skipped point; false if any point is behind
+static inline bool SeparatesChunk(int behind, int front, size_t i, size_t skip, bool &any_front)
+{
+    if (skip - i < 4) {
+        const int bit = 1 << (skip - i);
+        behind &= ~bit;
+        front &= ~bit;
+    }
+
+    any_front |= front != 0;
+    return !behind;
+}
+
+static void WindingPlaneDistances_SSE2(const viswinding_t &w, const qplane3d &plane, double *dists)
+{
+    const __m128d nx = _mm_set1_pd(plane.normal[0]);
+    const __m128d ny = _mm_set1_pd(plane.normal[1]);
+    const __m128d nz = _mm_set1_pd(plane.normal[2]);
+    const __m128d dist = _mm_set1_pd(plane.dist);
+
+    const size_t count = w.size();
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(dists + i, PlaneDistances2_SSE2(&w.points[i][0], nx, ny, nz, dist));
+    }
+
+    for (; i < count; i++) {
+        dists[i] = plane.distance_to(w[i]);
+    }
+}
+
+static bool WindingPlaneSeparates_SSE2(const viswinding_t &w, const qplane3d &plane, size_t skip, double epsilon)
+{
+    const __m128d nx = _mm_set1_pd(plane.normal[0]);
+    const __m128d ny = _mm_set1_pd(plane.normal[1]);
+    const __m128d nz = _mm_set1_pd(plane.normal[2]);
+    const __m128d dist = _mm_set1_pd(plane.dist);
+    const __m128d front_eps = _mm_set1_pd(epsilon);
+    const __m128d behind_eps = _mm_set1_pd(-epsilon);
+
+    const size_t count = w.size();
+    size_t i = 0;
+    bool front = false;
+
+    for (; i + 2 <= count; i += 2) {
+        const __m128d d = PlaneDistances2_SSE2(&w.points[i][0], nx, ny, nz, dist);
+
+        if (!SeparatesChunk(_mm_movemask_pd(_mm_cmplt_pd(d, behind_eps)),
+                _mm_movemask_pd(_mm_cmpgt_pd(d, front_eps)), i, skip, front)) {
+            return false;
+        }
+    }
+
+    for (; i < count; i++) {
+        if (i == skip) {
+            continue;
+        }
+
+        const double d = plane.distance_to(w[i]);
+
+        if (d < -epsilon) {
+            return false;
+        } else if (d > epsilon) {
+            front = true;
+        }
+    }
+
+    return front;
+}
+
+// distances of the 4 points starting at p
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx")))
+#endif
+static inline __m256d PlaneDistances4_AVX(const double *p, __m256d nx, __m256d ny, __m256d nz, __m256d dist)
+{
+    // [x0 y0 | z0 x1] [y1 z1 | x2 y2] [z2 x3 | y3 z3]
+    const __m256d m0 = _mm256_loadu_pd(p);
+    const __m256d m1 = _mm256_loadu_pd(p + 4);
+    const __m256d m2 = _mm256_loadu_pd(p + 8);
+
+    // [x0 y0 | x2 y2] [z0 x1 | z2 x3] [y1 z1 | y3 z3]
+    const __m256d a = _mm256_permute2f128_pd(m0, m1, 0x30);
+    const __m256d b = _mm256_permute2f128_pd(m0, m2, 0x21);
+    const __m256d c = _mm256_permute2f128_pd(m1, m2, 0x30);
+
+    const __m256d x = _mm256_shuffle_pd(a, b, 0xa);
+    const __m256d y = _mm256_shuffle_pd(a, c, 0x5);
+    const __m256d z = _mm256_shuffle_pd(b, c, 0xa);
+
+    const __m256d yz = _mm256_add_pd(_mm256_mul_pd(y, ny), _mm256_mul_pd(z, nz));
+    return _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(x, nx), yz), dist);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx")))
+#endif
+static void WindingPlaneDistances_AVX(const viswinding_t &w, const qplane3d &plane, double *dists)
+{
+    const __m256d nx = _mm256_set1_pd(plane.normal[0]);
+    const __m256d ny = _mm256_set1_pd(plane.normal[1]);
+    const __m256d nz = _mm256_set1_pd(plane.normal[2]);
+    const __m256d dist = _mm256_set1_pd(plane.dist);
+
+    const size_t count = w.size();
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(dists + i, PlaneDistances4_AVX(&w.points[i][0], nx, ny, nz, dist));
+    }
+
+    // at most 3 left over
+    if (i + 2 <= count) {
+        _mm_storeu_pd(dists + i,
+            PlaneDistances2_SSE2(&w.points[i][0], _mm256_castpd256_pd128(nx), _mm256_castpd256_pd128(ny),
+                _mm256_castpd256_pd128(nz), _mm256_castpd256_pd128(dist)));
+        i += 2;
+    }
+
+    for (; i < count; i++) {
+        dists[i] = plane.distance_to(w[i]);
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx")))
+#endif
+static bool WindingPlaneSeparates_AVX(const viswinding_t &w, const qplane3d &plane, size_t skip, double epsilon)
+{
+    const __m256d nx = _mm256_set1_pd(plane.normal[0]);
+    const __m256d ny = _mm256_set1_pd(plane.normal[1]);
+    const __m256d nz = _mm256_set1_pd(plane.normal[2]);
+    const __m256d dist = _mm256_set1_pd(plane.dist);
+    const __m256d front_eps = _mm256_set1_pd(epsilon);
+    const __m256d behind_eps = _mm256_set1_pd(-epsilon);
+
+    const size_t count = w.size();
+    size_t i = 0;
+    bool front = false;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m256d d = PlaneDistances4_AVX(&w.points[i][0], nx, ny, nz, dist);
+
+        if (!SeparatesChunk(_mm256_movemask_pd(_mm256_cmp_pd(d, behind_eps, _CMP_LT_OQ)),
+                _mm256_movemask_pd(_mm256_cmp_pd(d, front_eps, _CMP_GT_OQ)), i, skip, front)) {
+            return false;
+        }
+    }
+
+    // at most 3 left over
+    if (i + 2 <= count) {
+        const __m128d d = PlaneDistances2_SSE2(&w.points[i][0], _mm256_castpd256_pd128(nx),
+            _mm256_castpd256_pd128(ny), _mm256_castpd256_pd128(nz), _mm256_castpd256_pd128(dist));
+
+        if (!SeparatesChunk(_mm_movemask_pd(_mm_cmplt_pd(d, _mm256_castpd256_pd128(behind_eps))),
+                _mm_movemask_pd(_mm_cmpgt_pd(d, _mm256_castpd256_pd128(front_eps))), i, skip, front)) {
+            return false;
+        }
+
+        i += 2;
+    }
+
+    for (; i < count; i++) {
+        if (i == skip) {
+            continue;
+        }
+
+        const double d = plane.distance_to(w[i]);
+
+        if (d < -epsilon) {
+            return false;
+        } else if (d > epsilon) {
+            front = true;
+        }
+    }
+
+    return front;
+}
+
+static bool CPUSupportsAVX()
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    // the OS also has to save the AVX registers on context switches
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+using winding_distances_fn = void (*)(const viswinding_t &, const qplane3d &, double *);
+using winding_separates_fn = bool (*)(const viswinding_t &, const qplane3d &, size_t, double);
+
+static winding_distances_fn winding_distances = WindingPlaneDistances_Scalar;
+static winding_separates_fn winding_separates = WindingPlaneSeparates_Scalar;
+static const char *winding_distances_name = "scalar";
+
+void SelectVisKernels(bool allow_simd)
+{
+    winding_distances = WindingPlaneDistances_Scalar;
+    winding_separates = WindingPlaneSeparates_Scalar;
+    winding_distances_name = "scalar";
+
+#ifdef VIS_X86_SIMD
+    if (allow_simd) {
+        if (CPUSupportsAVX()) {
+            winding_distances = WindingPlaneDistances_AVX;
+            winding_separates = WindingPlaneSeparates_AVX;
+            winding_distances_name = "AVX";
+        } else {
+            winding_distances = WindingPlaneDistances_SSE2;
+            winding_separates = WindingPlaneSeparates_SSE2;
+            winding_distances_name = "SSE2";
+        }
+    }
+#endif
+
+    logging::print("Using {} winding clipping kernels\n", winding_distances_name);
+}
+
+void WindingPlaneDistances(const viswinding_t &w, const qplane3d &plane, double *dists)
+{
+    winding_distances(w, plane, dists);
+}
+
+bool WindingPlaneSeparates(const viswinding_t &w, const qplane3d &plane, size_t skip, double epsilon)
+{
+    return winding_separates(w, plane, skip, epsilon);
+}
@@ -21,6 +21,10 @@
 #include <vis/vis.hh>
 #include <common/bsputils.hh>
 #include <common/parallel.hh>
+
+#include <bit>
+#include <cstring>
+#include <optional>
 /*
 
 Some textures (sky, water, slime, lava) are considered ambien sound emiters.
@@ -51,6 +55,97 @@ static aabb3d SurfaceBBox(const mbsp_t *bsp, const mface_t *surf)
     return bounds;
 }
 
+/*
+  ====================
+  AmbientTypeForTexinfo
+
+  Which ambient sound a surface with this texinfo emits, if any
+  ====================
+*/
+static std::optional<ambient_type_t> AmbientTypeForTexinfo(const mbsp_t *bsp, const mtexinfo_t *info)
+{
+    const auto &miptex = bsp->dtex.textures[info->miptex];
+
+    if (!Q_strncasecmp(miptex.name.data(), "sky", 3) && !vis_options.noambientsky.value())
+        return AMBIENT_SKY;
+    else if (!Q_strncasecmp(miptex.name.data(), "*water", 6) && !vis_options.noambientwater.value())
+        return AMBIENT_WATER;
+    else if (!Q_strncasecmp(miptex.name.data(), "*04water", 8) && !vis_options.noambientwater.value())
+        return AMBIENT_WATER;
+    else if (!Q_strncasecmp(miptex.name.data(), "*slime", 6) && !vis_options.noambientslime.value())
+        return AMBIENT_WATER; // AMBIENT_SLIME;
+    else if (!Q_strncasecmp(miptex.name.data(), "*lava", 5) && !vis_options.noambientlava.value())
+        return AMBIENT_LAVA;
+
+    return std::nullopt;
+}
+
+// an ambient sound emitting surface, as seen from the leafs it's marked in
+struct ambient_surface_t
+{
+    aabb3d bounds;
+    ambient_type_t type;
+};
+
+// the ambient sound emitting surfaces of every leaf, indexed by leafnum - 1;
+// leaf i's surfaces are surfaces[first[i], first[i + 1])
+struct ambient_leafs_t
+{
+    std::vector<uint32_t> first;
+    std::vector<ambient_surface_t> surfaces;
+};
+
+/*
+  ====================
+  BuildAmbientLeafs
+
+  Classify each texinfo and bound each emitting surface once, rather than
+  once per leaf it's visible from
+  ====================
+*/
+static ambient_leafs_t BuildAmbientLeafs(const mbsp_t *bsp)
+{
+    std::vector<std::optional<ambient_type_t>> texinfo_types(bsp->texinfo.size());
+
+    for (size_t i = 0; i < bsp->texinfo.size(); i++) {
+        texinfo_types[i] = AmbientTypeForTexinfo(bsp, &bsp->texinfo[i]);
+    }
+
+    // surface bounds, computed on first use
+    std::vector<std::optional<aabb3d>> face_bounds(bsp->dfaces.size());
+
+    ambient_leafs_t result;
+    result.first.reserve(portalleafs_real + 1);
+
+    for (int i = 0; i < portalleafs_real; i++) {
+        const mleaf_t *leaf = &bsp->dleafs[i + 1];
+
+        result.first.push_back(static_cast<uint32_t>(result.surfaces.size()));
+
+        for (int k = 0; k < leaf->nummarksurfaces; k++) {
+            const int facenum = bsp->dleaffaces[leaf->firstmarksurface + k];
+            const mface_t *surf = BSP_GetFace(bsp, facenum);
+            const std::optional<ambient_type_t> &type = texinfo_types[surf->texinfo];
+
+            if (!type) {
+                continue;
+            }
+
+            std::optional<aabb3d> &bounds = face_bounds[facenum];
+
+            if (!bounds) {
+                bounds = SurfaceBBox(bsp, surf);
+            }
+
+            result.surfaces.push_back({*bounds, *type});
+        }
+    }
+
+    result.first.push_back(static_cast<uint32_t>(result.surfaces.size()));
+
+    return result;
+}
+
 /*
   ====================
   CalcAmbientSounds
@@ -72,7 +167,10 @@ void CalcAmbientSounds(mbsp_t *bsp)
         return;
     }
 
-    logging::parallel_for(0, portalleafs_real, [&bsp](int i) {
+    const ambient_leafs_t ambient_leafs = BuildAmbientLeafs(bsp);
+    const size_t visbytes = (portalleafs_real + 7) >> 3;
+
+    logging::parallel_for(0, portalleafs_real, [&bsp, &ambient_leafs, visbytes](int i) {
         mleaf_t *leaf = &bsp->dleafs[i + 1];
 
         float dists[NUM_AMBIENTS];
@@ -90,36 +188,18 @@ void CalcAmbientSounds(mbsp_t *bsp)
             vis = &uncompressed[i * leafbytes_real];
         }
 
-        for (int j = 0; j < portalleafs_real; j++) {
-            if (!(vis[j >> 3] & nth_bit(j & 7)))
-                continue;
+        auto check_leaf = [&](int j) {
+            if (j >= portalleafs_real)
+                return;
 
             //
             // check this leaf for sound textures
             //
-            mleaf_t *hit = &bsp->dleafs[j + 1];
-
-            for (int k = 0; k < hit->nummarksurfaces; k++) {
-                const mface_t *surf = BSP_GetFace(bsp, bsp->dleaffaces[hit->firstmarksurface + k]);
-                const mtexinfo_t *info = &bsp->texinfo[surf->texinfo];
-                const auto &miptex = bsp->dtex.textures[info->miptex];
-
-                ambient_type_t ambient_type;
-                if (!Q_strncasecmp(miptex.name.data(), "sky", 3) && !vis_options.noambientsky.value())
-                    ambient_type = AMBIENT_SKY;
-                else if (!Q_strncasecmp(miptex.name.data(), "*water", 6) && !vis_options.noambientwater.value())
-                    ambient_type = AMBIENT_WATER;
-                else if (!Q_strncasecmp(miptex.name.data(), "*04water", 8) && !vis_options.noambientwater.value())
-                    ambient_type = AMBIENT_WATER;
-                else if (!Q_strncasecmp(miptex.name.data(), "*slime", 6) && !vis_options.noambientslime.value())
-                    ambient_type = AMBIENT_WATER; // AMBIENT_SLIME;
-                else if (!Q_strncasecmp(miptex.name.data(), "*lava", 5) && !vis_options.noambientlava.value())
-                    ambient_type = AMBIENT_LAVA;
-                else
-                    continue;
+            for (uint32_t k = ambient_leafs.first[j]; k < ambient_leafs.first[j + 1]; k++) {
+                const ambient_surface_t &surf = ambient_leafs.surfaces[k];
 
                 // find distance from source leaf to polygon
-                aabb3d bounds = SurfaceBBox(bsp, surf);
+                const aabb3d &bounds = surf.bounds;
                 float maxd = 0;
                 for (int l = 0; l < 3; l++) {
                     float d;
@@ -134,8 +214,31 @@ void CalcAmbientSounds(mbsp_t *bsp)
                 }
 
                 maxd = 0.25;
-                if (maxd < dists[ambient_type])
-                    dists[ambient_type] = maxd;
+                if (maxd < dists[surf.type])
+                    dists[surf.type] = maxd;
+            }
+        };
+
+        // walk the set bits a word at a time, skipping empty words
+        size_t byte = 0;
+
+        for (; byte + sizeof(uint64_t) <= visbytes; byte += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, vis + byte, sizeof(word));
+
+            if (!word)
+                continue;
+
+            for (size_t b = byte; b < byte + sizeof(uint64_t); b++) {
+                for (uint32_t bits = vis[b]; bits; bits &= bits - 1) {
+                    check_leaf(static_cast<int>((b << 3) + std::countr_zero(bits)));
+                }
+            }
+        }
+
+        for (; byte < visbytes; byte++) {
+            for (uint32_t bits = vis[byte]; bits; bits &= bits - 1) {
+                check_leaf(static_cast<int>((byte << 3) + std::countr_zero(bits)));
             }
         }
 
@@ -165,63 +268,80 @@ void CalcPHS(mbsp_t *bsp)
 {
     logging::funcheader();
 
-    const int32_t leafbytes = (portalleafs + 7) >> 3;
-    const int32_t leaflongs = leafbytes / sizeof(long);
+    const size_t leafbytes = (portalleafs + 7) >> 3;
+    // rows are padded to whole words so they can be ORed a word at a time
+    const size_t rowwords = (leafbytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
 
-    // increase the bits size with approximately how much space we'll need
-    bsp->dvis.bits.reserve(bsp->dvis.bits.size() * 2);
+    // decompress every PVS row once, up front
+    std::vector<uint64_t> pvs(rowwords * portalleafs);
 
-    std::vector<uint8_t> uncompressed(leafbytes);
-    std::vector<uint8_t> uncompressed_2(leafbytes);
-    std::vector<uint8_t> compressed(leafbytes * 2);
-    std::vector<uint8_t> uncompressed_orig(leafbytes);
-
-    int32_t count = 0;
-    for (int32_t i = 0; i < portalleafs; i++) {
+    logging::parallel_for(0, portalleafs, [&](int32_t i) {
         const uint8_t *scan = bsp->dvis.bits.data() + bsp->dvis.get_bit_offset(VIS_PVS, i);
+        uint8_t *row = reinterpret_cast<uint8_t *>(&pvs[i * rowwords]);
 
-        DecompressVis(scan, bsp->dvis.bits.data() + bsp->dvis.bits.size(), uncompressed.data(),
-            uncompressed.data() + uncompressed.size());
-        std::copy(uncompressed.begin(), uncompressed.end(), uncompressed_orig.begin());
+        DecompressVis(scan, bsp->dvis.bits.data() + bsp->dvis.bits.size(), row, row + leafbytes);
+    });
 
-        scan = uncompressed_orig.data();
+    // OR together the PVS rows visible from each row, and compress the
+    // result; rows are independent, so this can all be done in parallel
+    std::vector<std::vector<uint8_t>> compressed(portalleafs);
+    std::vector<uint32_t> hearable(portalleafs);
 
-        for (int32_t j = 0; j < leafbytes; j++) {
-            uint8_t bitbyte = scan[j];
-            if (!bitbyte)
+    logging::parallel_for(0, portalleafs, [&](int32_t i) {
+        const uint64_t *src_row = &pvs[i * rowwords];
+        const uint8_t *src_bytes = reinterpret_cast<const uint8_t *>(src_row);
+        std::vector<uint64_t> phs(src_row, src_row + rowwords);
+
+        for (size_t w = 0; w < rowwords; w++) {
+            if (!src_row[w])
                 continue;
-            for (int32_t k = 0; k < 8; k++) {
-                if (!(bitbyte & nth_bit(k)))
+
+            for (size_t j = w * sizeof(uint64_t); j < (w + 1) * sizeof(uint64_t); j++) {
+                const uint8_t bitbyte = src_bytes[j];
+                if (!bitbyte)
                     continue;
-                // OR this pvs row into the phs
-                int32_t index = ((j << 3) + k);
-                if (index >= portalleafs)
-                    FError("Bad bit in PVS"); // pad bits should be 0
-                const uint8_t *src_compressed = bsp->dvis.bits.data() + bsp->dvis.get_bit_offset(VIS_PVS, index);
-                DecompressVis(src_compressed, bsp->dvis.bits.data() + bsp->dvis.bits.size(), uncompressed_2.data(),
-                    uncompressed_2.data() + uncompressed_2.size());
-                const long *src = reinterpret_cast<long *>(uncompressed_2.data());
-                long *dest = reinterpret_cast<long *>(uncompressed.data());
-                for (int32_t l = 0; l < leaflongs; l++)
-                    dest[l] |= src[l];
+                for (int32_t k = 0; k < 8; k++) {
+                    if (!(bitbyte & nth_bit(k)))
+                        continue;
+                    // OR this pvs row into the phs
+                    const size_t index = (j << 3) + k;
+                    if (index >= static_cast<size_t>(portalleafs))
+                        FError("Bad bit in PVS"); // pad bits should be 0
+                    const uint64_t *other = &pvs[index * rowwords];
+                    for (size_t l = 0; l < rowwords; l++)
+                        phs[l] |= other[l];
+                }
             }
         }
-        for (int32_t j = 0; j < portalleafs; j++)
-            if (uncompressed[j >> 3] & nth_bit(j & 7))
-                count++;
+
+        for (uint64_t word : phs) {
+            hearable[i] += std::popcount(word);
+        }
 
         //
         // compress the bit string
         //
-        compressed.clear();
-        CompressRow(uncompressed.data(), leafbytes, std::back_inserter(compressed));
+        compressed[i].reserve(leafbytes);
+        CompressRow(reinterpret_cast<const uint8_t *>(phs.data()), leafbytes, std::back_inserter(compressed[i]));
+    });
 
-        bsp->dvis.set_bit_offset(VIS_PHS, i, bsp->dvis.bits.size());
+    // append the rows in order
+    size_t total_size = bsp->dvis.bits.size();
+    uint64_t count = 0;
+
+    for (int32_t i = 0; i < portalleafs; i++) {
+        total_size += compressed[i].size();
+        count += hearable[i];
+    }
 
-        std::copy(compressed.begin(), compressed.end(), std::back_inserter(bsp->dvis.bits));
+    bsp->dvis.bits.reserve(total_size);
+
+    for (int32_t i = 0; i < portalleafs; i++) {
+        bsp->dvis.set_bit_offset(VIS_PHS, i, bsp->dvis.bits.size());
+        bsp->dvis.bits.insert(bsp->dvis.bits.end(), compressed[i].begin(), compressed[i].end());
     }
 
     fmt::print("Average clusters hearable: {}\n", count / portalleafs);
 
     bsp->dvis.bits.shrink_to_fit();
-}
\ No newline at end of file
+}
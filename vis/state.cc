@@ -29,6 +29,7 @@
 #include "common/fs.hh"
 #include <common/log.hh>
 #include <fstream>
+#include <unordered_map>
 
 constexpr uint32_t VIS_STATE_VERSION = ('T' << 24 | 'Y' << 16 | 'R' << 8 | '1');
 
@@ -54,13 +55,13 @@ struct dportal_t
     auto stream_data() { return std::tie(status, might, vis, nummightsee, numcansee); }
 };
 
-static int CompressBits(uint8_t *out, const leafbits_t &in)
+static int CompressBits(uint8_t *out, const leafbits_t &in, size_t numleafs = portalleafs)
 {
     int i, rep, shift, numbytes;
     uint8_t val, repval, *dst;
 
     dst = out;
-    numbytes = (portalleafs + 7) >> 3;
+    numbytes = (numleafs + 7) >> 3;
     for (i = 0; i < numbytes && dst - out < numbytes; i++) {
         shift = (i << 3) & leafbits_t::mask;
         val = (in.data()[i >> (leafbits_t::shift - 3)] >> shift) & 0xff;
@@ -94,11 +95,11 @@ static int CompressBits(uint8_t *out, const leafbits_t &in)
     return numbytes;
 }
 
-static void DecompressBits(leafbits_t &dst, const uint8_t *src)
+static void DecompressBits(leafbits_t &dst, const uint8_t *src, size_t numleafs = portalleafs)
 {
-    const size_t numbytes = (portalleafs + 7) >> 3;
+    const size_t numbytes = (numleafs + 7) >> 3;
 
-    dst.resize(portalleafs);
+    dst.resize(numleafs);
 
     for (size_t i = 0; i < numbytes; i++) {
         uint8_t val = *src++;
@@ -137,6 +138,10 @@ void SaveVisState()
     dvisstate_t state;
     dportal_t pstate;
 
+    if (portalfile.empty()) {
+        return;
+    }
+
     std::ofstream out(statetmpfile, std::ios_base::out | std::ios_base::binary);
     out << endianness<std::endian::little>;
 
@@ -155,13 +160,13 @@ void SaveVisState()
 
     for (const auto &p : portals) {
         might_len = CompressBits(might.data(), p.mightsee);
-        if (p.status == pstat_done) {
+        if (p.status == pstat_done || p.status == pstat_reused) {
             vis_len = CompressBits(vis.data(), p.visbits);
         } else {
             vis_len = 0;
         }
 
-        pstate.status = p.status;
+        pstate.status = p.status == pstat_reused ? pstat_done : p.status;
         pstate.might = might_len;
         pstate.vis = vis_len;
         pstate.nummightsee = p.nummightsee;
@@ -201,7 +206,7 @@ bool LoadVisState()
     dvisstate_t state;
     dportal_t pstate;
 
-    if (vis_options.nostate.value()) {
+    if (vis_options.nostate.value() || portalfile.empty()) {
         return false;
     }
 
@@ -281,3 +286,309 @@ bool LoadVisState()
 
     return true;
 }
+
+/*
+ * Incremental vis
+ *
+ * After an -incremental run, the final visbits of every portal are saved
+ * along with a hash of its winding and the leafs on either side. The next
+ * -incremental run matches its portals against these by hash; a leaf whose
+ * portals all match up with the portals of a single old leaf is unchanged.
+ *
+ * The full vis of a portal only looks at leafs inside its mightsee, so if
+ * the portal itself and every leaf it might see are unchanged, its old
+ * visbits are still valid and just need renumbering to the new leafs.
+ *
+ * Reused portals are marked pstat_reused rather than pstat_done so that the
+ * portals which do get recalculated don't narrow their flow through them or
+ * have their mightsee pruned by them. The full vis is order dependent, and
+ * letting a large set of portals be "done" up front loses a few leafs
+ * compared to a full run; without that the recalculated portals can only
+ * end up seeing more.
+ */
+
+constexpr uint32_t VIS_INCREMENTAL_VERSION = ('V' << 24 | 'I' << 16 | 'C' << 8 | '1');
+
+struct dvisincremental_t
+{
+    uint32_t version;
+    uint32_t numportals; // memory portals, i.e. twice the .prt portal count
+    uint32_t numleafs;
+    int32_t level;
+    double visdist;
+
+    auto stream_data() { return std::tie(version, numportals, numleafs, level, visdist); }
+};
+
+struct dincrementalportal_t
+{
+    uint64_t hash;
+    uint32_t owner; // leaf the portal is in
+    uint32_t leaf; // neighbor
+    uint32_t vis; // compressed visbits length
+
+    auto stream_data() { return std::tie(hash, owner, leaf, vis); }
+};
+
+static uint64_t HashPortalWinding(const visportal_t &p)
+{
+    // FNV-1a over the exact point coordinates
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    auto add = [&hash](const void *data, size_t size) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    };
+
+    const uint64_t numpoints = p.winding->size();
+    add(&numpoints, sizeof(numpoints));
+
+    for (size_t i = 0; i < p.winding->size(); i++) {
+        add(&p.winding->points[i], sizeof(qvec3d));
+    }
+
+    return hash;
+}
+
+static std::vector<uint32_t> PortalOwners()
+{
+    std::vector<uint32_t> owners(portals.size());
+
+    for (size_t i = 0; i < leafs.size(); i++) {
+        for (const visportal_t *p : leafs[i].portals) {
+            owners[p - portals.data()] = i;
+        }
+    }
+
+    return owners;
+}
+
+void SaveIncrementalVis()
+{
+    std::ofstream out(incrementalfile, std::ios_base::out | std::ios_base::binary);
+    out << endianness<std::endian::little>;
+
+    dvisincremental_t header;
+    header.version = VIS_INCREMENTAL_VERSION;
+    header.numportals = portals.size();
+    header.numleafs = portalleafs;
+    header.level = vis_options.level.value();
+    header.visdist = vis_options.visdist.value();
+
+    out <= header;
+
+    const std::vector<uint32_t> owners = PortalOwners();
+    std::vector<uint8_t> vis((portalleafs + 7) >> 3);
+
+    for (size_t i = 0; i < portals.size(); i++) {
+        const visportal_t &p = portals[i];
+
+        dincrementalportal_t pstate;
+        pstate.hash = HashPortalWinding(p);
+        pstate.owner = owners[i];
+        pstate.leaf = p.leaf;
+        pstate.vis = CompressBits(vis.data(), p.visbits);
+
+        out <= pstate;
+        out.write((const char *)vis.data(), pstate.vis);
+    }
+
+    if (!out) {
+        FError("error writing {}", incrementalfile);
+    }
+}
+
+void ReuseIncrementalVis()
+{
+    if (!fs::exists(incrementalfile)) {
+        logging::print("No incremental data from a previous run, calculating full vis\n");
+        return;
+    }
+
+    std::ifstream in(incrementalfile, std::ios_base::in | std::ios_base::binary);
+    in >> endianness<std::endian::little>;
+
+    dvisincremental_t header;
+    in >= header;
+
+    if (!in || header.version != VIS_INCREMENTAL_VERSION) {
+        logging::print(logging::flag::WARNING, "WARNING: {} is not a valid incremental vis file, ignoring it\n",
+            incrementalfile);
+        return;
+    }
+    if (header.level != vis_options.level.value() || header.visdist != vis_options.visdist.value()) {
+        logging::print("Incremental data was made with different -level/-visdist, calculating full vis\n");
+        return;
+    }
+
+    /* Read back the old portals */
+    struct old_portal_t
+    {
+        uint32_t owner;
+        uint32_t leaf;
+        leafbits_t visbits;
+    };
+
+    std::vector<old_portal_t> old_portals(header.numportals);
+    std::unordered_map<uint64_t, int32_t> old_by_hash;
+    std::vector<uint32_t> old_leaf_numportals(header.numleafs);
+    std::vector<uint8_t> compressed((header.numleafs + 7) >> 3);
+
+    for (size_t i = 0; i < old_portals.size(); i++) {
+        dincrementalportal_t pstate;
+        in >= pstate;
+
+        if (!in || pstate.owner >= header.numleafs || pstate.leaf >= header.numleafs ||
+            pstate.vis > compressed.size()) {
+            logging::print(logging::flag::WARNING, "WARNING: {} is corrupt, ignoring it\n", incrementalfile);
+            return;
+        }
+
+        in.read((char *)compressed.data(), pstate.vis);
+
+        old_portal_t &old = old_portals[i];
+        old.owner = pstate.owner;
+        old.leaf = pstate.leaf;
+
+        if (pstate.vis < compressed.size()) {
+            DecompressBits(old.visbits, compressed.data(), header.numleafs);
+        } else {
+            CopyLeafBits(old.visbits, compressed.data(), header.numleafs);
+        }
+
+        old_leaf_numportals[old.owner]++;
+
+        // identical windings can't be told apart, so don't match either of them
+        auto [it, inserted] = old_by_hash.try_emplace(pstate.hash, i);
+        if (!inserted) {
+            it->second = -1;
+        }
+    }
+
+    /* Match up the new portals with the old ones */
+    const std::vector<uint32_t> owners = PortalOwners();
+    std::vector<int32_t> matches(portals.size(), -1);
+
+    for (size_t i = 0; i < portals.size(); i++) {
+        if (auto it = old_by_hash.find(HashPortalWinding(portals[i])); it != old_by_hash.end()) {
+            matches[i] = it->second;
+        }
+    }
+
+    /*
+     * A leaf is unchanged if all of its portals match the portals of a
+     * single old leaf, which has no others, and no other leaf matches the
+     * same old leaf.
+     */
+    std::vector<int32_t> new_to_old(portalleafs, -1);
+    std::vector<int32_t> old_to_new(header.numleafs, -1);
+
+    for (size_t i = 0; i < portalleafs; i++) {
+        const leaf_t &leaf = leafs[i];
+        int32_t old_leaf = -1;
+
+        for (const visportal_t *p : leaf.portals) {
+            const int32_t match = matches[p - portals.data()];
+
+            if (match == -1) {
+                old_leaf = -1;
+                break;
+            }
+
+            const int32_t owner = old_portals[match].owner;
+
+            if (old_leaf != -1 && owner != old_leaf) {
+                old_leaf = -1;
+                break;
+            }
+
+            old_leaf = owner;
+        }
+
+        if (old_leaf == -1 || old_leaf_numportals[old_leaf] != leaf.portals.size()) {
+            continue;
+        }
+
+        if (old_to_new[old_leaf] == -2) {
+            continue;
+        } else if (old_to_new[old_leaf] != -1) {
+            // claimed twice; neither is trustworthy
+            new_to_old[old_to_new[old_leaf]] = -1;
+            old_to_new[old_leaf] = -2;
+            continue;
+        }
+
+        new_to_old[i] = old_leaf;
+        old_to_new[old_leaf] = i;
+    }
+
+    leafbits_t changed(portalleafs);
+    size_t numchanged = 0;
+
+    for (size_t i = 0; i < portalleafs; i++) {
+        if (new_to_old[i] == -1) {
+            changed[i] = true;
+            numchanged++;
+        }
+    }
+
+    /* Copy over the visbits of portals that can't see any changes */
+    const size_t numblocks = (portalleafs + leafbits_t::mask) >> leafbits_t::shift;
+    size_t numreused = 0;
+
+    for (size_t i = 0; i < portals.size(); i++) {
+        visportal_t &p = portals[i];
+        const int32_t match = matches[i];
+
+        if (match == -1 || changed[owners[i]] || changed[p.leaf]) {
+            continue;
+        }
+
+        const old_portal_t &old = old_portals[match];
+
+        if (new_to_old[owners[i]] != old.owner || new_to_old[p.leaf] != old.leaf) {
+            continue;
+        }
+
+        bool sees_change = false;
+        for (size_t j = 0; j < numblocks; j++) {
+            if (p.mightsee.data()[j] & changed.data()[j]) {
+                sees_change = true;
+                break;
+            }
+        }
+        if (sees_change) {
+            continue;
+        }
+
+        leafbits_t visbits(portalleafs);
+        int numcansee = 0;
+        bool valid = true;
+
+        for (size_t j = 0; j < header.numleafs; j++) {
+            if (!old.visbits[j]) {
+                continue;
+            }
+            if (old_to_new[j] < 0) {
+                valid = false;
+                break;
+            }
+            visbits[old_to_new[j]] = true;
+            numcansee++;
+        }
+
+        if (!valid) {
+            continue;
+        }
+
+        p.visbits = std::move(visbits);
+        p.numcansee = numcansee;
+        p.status = pstat_reused;
+        numreused++;
+    }
+
+    logging::print("Incremental: {} of {} clusters changed, reusing vis of {} of {} portals\n", numchanged,
+        portalleafs, numreused, portals.size());
+}
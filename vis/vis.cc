@@ -52,7 +52,7 @@ void vis_settings::initialize(int argc, const char **argv)
         sourceMap = DefaultExtension(remainder[0], "bsp");
     } catch (parse_exception &ex) {
         print_help(false);
-        logging::print("ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
+        logging::print(logging::flag::FAILURE, "ERROR OCCURRED WHEN TRYING TO PARSE ARGUMENTS:\n");
         logging::print(ex.what());
         logging::print("\n\n");
         throw settings::quit_after_help_exception();
@@ -62,7 +62,7 @@ void vis_settings::initialize(int argc, const char **argv)
 
 settings::vis_settings vis_options;
 
-fs::path portalfile, statefile, statetmpfile;
+fs::path portalfile, statefile, statetmpfile, incrementalfile;
 
 /*
   ==================
@@ -135,9 +135,10 @@ viswinding_t *ClipStackWinding(visstats_t &stats, viswinding_t *in, pstack_t &st
     int counts[3] = {0, 0, 0};
 
     /* determine sides for each point */
+    WindingPlaneDistances(*in, split, dists);
+
     for (i = 0; i < in->size(); i++) {
-        dot = split.distance_to((*in)[i]);
-        dists[i] = dot;
+        dot = dists[i];
         if (dot > VIS_ON_EPSILON)
             sides[i] = SIDE_FRONT;
         else if (dot < -VIS_ON_EPSILON)
@@ -219,41 +220,225 @@ noclip:
 
 //============================================================================
 
+#include <array>
 #include <mutex>
 
-static std::mutex portal_mutex;
-static std::atomic_int64_t portalIndex;
+/*
+  =============
+  PortalLock
+
+  Claiming a portal and removing leafs from the mightsee of a portal that
+  hasn't been claimed yet are serialized per portal, through one of a fixed
+  set of striped locks, rather than by one lock for the whole map.
+  =============
+*/
+constexpr size_t PORTAL_LOCK_STRIPES = 64;
+
+struct alignas(64) portal_lock_t
+{
+    std::mutex mutex;
+};
+
+static std::array<portal_lock_t, PORTAL_LOCK_STRIPES> portal_locks;
+
+static std::mutex &PortalLock(const visportal_t *p)
+{
+    return portal_locks[(p - portals.data()) % PORTAL_LOCK_STRIPES].mutex;
+}
 
 /*
   =============
-  GetNextPortal
+  ContendedLock
 
-  Returns the next portal for a thread to work on
-  Returns the portals from the least complex, so the later ones can reuse
-  the earlier information.
+  Locks the mutex, adding the time spent waiting on another thread (if any)
+  to the stats.
   =============
 */
-visportal_t *GetNextPortal()
+static std::unique_lock<std::mutex> ContendedLock(std::mutex &mutex, visstats_t &stats)
 {
-    visportal_t *ret = nullptr;
-    uint32_t min = INT_MAX;
+    std::unique_lock lk(mutex, std::try_to_lock);
 
-    portal_mutex.lock();
+    if (!lk.owns_lock()) {
+        const time_point start = I_FloatTime();
+        lk.lock();
+        stats.c_lockcontended++;
+        stats.lockwait += I_FloatTime() - start;
+    }
 
-    for (auto &p : portals) {
-        if (p.nummightsee < min && p.status == pstat_none) {
-            min = p.nummightsee;
-            ret = &p;
+    return lk;
+}
+
+/*
+  =============
+  portal_scheduler_t
+
+  Indexed binary min-heap of the portals which haven't been started yet,
+  keyed on nummightsee (ties broken by portal index, which matches the
+  order the old linear scan picked them in).
+
+  UpdateMightsee lowers the key of a queued portal in place, so claiming
+  the next portal is O(log N) instead of a scan over every portal.
+
+  The heap has its own lock, which is only held for the sift, so workers
+  asking for their next portal don't wait on mightsee propagation.
+  Portals leave the heap before they are marked as being worked on, so
+  anything still queued also still has pstat_none.
+  =============
+*/
+class portal_scheduler_t
+{
+    struct entry_t
+    {
+        int32_t key;
+        uint32_t portalnum;
+
+        constexpr bool operator<(const entry_t &other) const
+        {
+            return key < other.key || (key == other.key && portalnum < other.portalnum);
+        }
+    };
+
+    std::mutex lock;
+    std::vector<entry_t> heap;
+    std::vector<int32_t> position; // index into heap per portal, -1 if not queued
+
+    inline void place(size_t index, const entry_t &e)
+    {
+        heap[index] = e;
+        position[e.portalnum] = index;
+    }
+
+    void sift_up(size_t index)
+    {
+        const entry_t e = heap[index];
+
+        while (index > 0) {
+            const size_t parent = (index - 1) >> 1;
+
+            if (!(e < heap[parent])) {
+                break;
+            }
+
+            place(index, heap[parent]);
+            index = parent;
+        }
+
+        place(index, e);
+    }
+
+    void sift_down(size_t index)
+    {
+        const entry_t e = heap[index];
+        const size_t count = heap.size();
+
+        while (true) {
+            size_t child = (index << 1) + 1;
+
+            if (child >= count) {
+                break;
+            }
+            if (child + 1 < count && heap[child + 1] < heap[child]) {
+                child++;
+            }
+            if (!(heap[child] < e)) {
+                break;
+            }
+
+            place(index, heap[child]);
+            index = child;
+        }
+
+        place(index, e);
+    }
+
+public:
+    // queue every portal that hasn't been started yet
+    void build()
+    {
+        std::unique_lock lk(lock);
+
+        heap.clear();
+        position.assign(portals.size(), -1);
+
+        for (size_t i = 0; i < portals.size(); i++) {
+            if (portals[i].status == pstat_none) {
+                heap.push_back({portals[i].nummightsee, static_cast<uint32_t>(i)});
+            }
+        }
+
+        for (size_t i = 0; i < heap.size(); i++) {
+            position[heap[i].portalnum] = i;
+        }
+
+        for (size_t i = heap.size() / 2; i-- > 0;) {
+            sift_down(i);
+        }
+    }
+
+    // remove the least complex portal from the queue and mark it as being worked on
+    visportal_t *claim(visstats_t &stats)
+    {
+        visportal_t *p;
+
+        {
+            auto lk = ContendedLock(lock, stats);
+
+            if (heap.empty()) {
+                return nullptr;
+            }
+
+            p = &portals[heap.front().portalnum];
+            position[heap.front().portalnum] = -1;
+
+            const entry_t last = heap.back();
+            heap.pop_back();
+
+            if (!heap.empty()) {
+                place(0, last);
+                sift_down(0);
+            }
         }
+
+        // once this is set, UpdateMightsee leaves the portal alone
+        auto lk = ContendedLock(PortalLock(p), stats);
+        p->set_status(pstat_working);
+        return p;
     }
 
-    if (ret) {
-        ret->status = pstat_working;
+    // move a portal up the queue after its nummightsee went down
+    void rekey(visportal_t *p, visstats_t &stats)
+    {
+        auto lk = ContendedLock(lock, stats);
+
+        const int32_t index = position[p - portals.data()];
+
+        if (index != -1) {
+            heap[index].key = std::atomic_ref<int>(p->nummightsee).load();
+            sift_up(index);
+        }
     }
 
-    portal_mutex.unlock();
+    void clear()
+    {
+        heap.clear();
+        position.clear();
+    }
+};
+
+static portal_scheduler_t portal_scheduler;
+
+/*
+  =============
+  GetNextPortal
 
-    return ret;
+  Returns the next portal for a thread to work on
+  Returns the portals from the least complex, so the later ones can reuse
+  the earlier information.
+  =============
+*/
+visportal_t *GetNextPortal(visstats_t &stats)
+{
+    return portal_scheduler.claim(stats);
 }
 
 /*
@@ -265,21 +450,34 @@ visportal_t *GetNextPortal()
   must also be true. Update mightsee for any portals on the source leaf which
   haven't yet started processing.
 
-  Called with the lock held.
+  The portal's stripe lock keeps it from being claimed while its mightsee
+  is being updated; the bits themselves are cleared atomically since other
+  threads read them without locking.
   =============
 */
 static void UpdateMightsee(visstats_t &stats, const leaf_t &source, const leaf_t &dest)
 {
     size_t leafnum = &dest - leafs.data();
     for (visportal_t *p : source.portals) {
-        if (p->status != pstat_none) {
+        if (p->get_status() != pstat_none) {
             continue;
         }
-        if (p->mightsee[leafnum]) {
-            p->mightsee[leafnum] = false;
-            p->nummightsee--;
-            stats.c_mightseeupdate++;
+
+        {
+            auto lk = ContendedLock(PortalLock(p), stats);
+
+            if (p->get_status() != pstat_none) {
+                continue;
+            }
+            if (!p->mightsee.atomic_clear(leafnum)) {
+                continue;
+            }
+
+            std::atomic_ref<int>(p->nummightsee)--;
         }
+
+        portal_scheduler.rekey(p, stats);
+        stats.c_mightseeupdate++;
     }
 }
 
@@ -290,14 +488,15 @@ static void UpdateMightsee(visstats_t &stats, const leaf_t &source, const leaf_t
   Mark the portal completed and propogate new vis information across
   to the complementry portals.
 
-  Called with the lock held.
+  Runs without a global lock: the status of the other portals on the leaf
+  is read atomically, and a portal that isn't done yet only contributes its
+  mightsee, which is always a superset of its final visbits. Reading a
+  stale status or mightsee can only skip an update, never make a wrong one.
   =============
 */
 static void PortalCompleted(visstats_t &stats, visportal_t *completed)
 {
-    portal_mutex.lock();
-
-    completed->status = pstat_done;
+    completed->set_status(pstat_done);
 
     /*
      * For each portal on the leaf, check the leafs we eliminated from
@@ -305,8 +504,8 @@ static void PortalCompleted(visstats_t &stats, visportal_t *completed)
      */
     const leaf_t &myleaf = leafs[completed->leaf];
     for (int i = 0; i < myleaf.portals.size(); i++) {
-        const visportal_t *p = myleaf.portals[i];
-        if (p->status != pstat_done)
+        visportal_t *p = myleaf.portals[i];
+        if (p->get_status() != pstat_done)
             continue;
 
         auto might = p->mightsee.data();
@@ -324,11 +523,11 @@ static void PortalCompleted(visstats_t &stats, visportal_t *completed)
             for (int k = 0; k < myleaf.portals.size(); k++) {
                 if (k == i)
                     continue;
-                const visportal_t *p2 = myleaf.portals[k];
-                if (p2->status == pstat_done)
+                visportal_t *p2 = myleaf.portals[k];
+                if (p2->get_status() == pstat_done)
                     changed &= ~p2->visbits.data()[j];
                 else
-                    changed &= ~p2->mightsee.data()[j];
+                    changed &= ~p2->mightsee.atomic_block(j);
                 if (!changed)
                     break;
             }
@@ -344,8 +543,6 @@ static void PortalCompleted(visstats_t &stats, visportal_t *completed)
             }
         }
     }
-
-    portal_mutex.unlock();
 }
 
 time_point starttime, endtime, statetime;
@@ -358,20 +555,13 @@ static duration stateinterval;
 */
 static visstats_t LeafThread()
 {
-    portal_mutex.lock();
-    /* Save state if sufficient time has elapsed */
-    auto now = I_FloatTime();
-    if (now > statetime + stateinterval) {
-        statetime = now;
-        SaveVisState();
-    }
-    portal_mutex.unlock();
+    visstats_t stats;
 
-    visportal_t *p = GetNextPortal();
+    visportal_t *p = GetNextPortal(stats);
     if (!p)
-        return {};
+        return stats;
 
-    visstats_t stats = PortalFlow(p);
+    stats = stats + PortalFlow(p);
 
     PortalCompleted(stats, p);
 
@@ -407,7 +597,7 @@ static void ClusterFlow(int clusternum, leafbits_t &buffer, mbsp_t *bsp)
     }
 
     if (buffer[clusternum])
-        logging::print("WARNING: Leaf portals saw into cluster ({})\n", clusternum);
+        logging::print(logging::flag::WARNING, "WARNING: Leaf portals saw into cluster ({})\n", clusternum);
 
     buffer[clusternum] = true;
 
@@ -502,20 +692,61 @@ visstats_t CalcPortalVis(const mbsp_t *bsp)
      */
     int32_t startcount = 0;
     for (auto &p : portals) {
-        if (p.status == pstat_done) {
+        if (p.status == pstat_done || p.status == pstat_reused) {
             startcount++;
         }
     }
 
-    portalIndex = startcount;
-
-    std::vector<visstats_t> stats_perportal;
-    stats_perportal.resize(numportals * 2);
-
-    logging::parallel_for(startcount, numportals * 2, [&](size_t i) { stats_perportal[i] = LeafThread(); });
+    portal_scheduler.build();
+
+    const size_t numleft = numportals * 2 - startcount;
+    std::vector<visstats_t> stats_perportal(numleft);
+    std::atomic<size_t> numflowed = 0;
+
+    {
+        logging::parallel_progress progress(numleft);
+
+        /*
+         * Workers never stop to save state themselves, since the other workers
+         * would still be updating mightsee/visbits. Once the save interval has
+         * passed, the remaining iterations of the round are skipped; the round
+         * ends when the portals in flight are done, and the state is saved here
+         * before the next round picks up where it left off.
+         */
+        while (numflowed.load() < numleft) {
+            std::atomic<bool> save_due = false;
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(numflowed.load(), numleft),
+                [&](const tbb::blocked_range<size_t> &range) {
+                    for (size_t i = range.begin(); i != range.end(); ++i) {
+                        if (save_due.load(std::memory_order_relaxed)) {
+                            return;
+                        }
+
+                        stats_perportal[numflowed.fetch_add(1)] = LeafThread();
+                        progress.add(1);
+
+                        if (I_FloatTime() > statetime + stateinterval) {
+                            save_due.store(true, std::memory_order_relaxed);
+                        }
+                    }
+                });
+
+            if (save_due.load() && numflowed.load() < numleft) {
+                statetime = I_FloatTime();
+                SaveVisState();
+            }
+        }
+    }
 
     const visstats_t stats = std::accumulate(stats_perportal.begin(), stats_perportal.end(), visstats_t{});
 
+    for (auto &p : portals) {
+        if (p.status == pstat_reused) {
+            p.status = pstat_done;
+        }
+    }
+
     SaveVisState();
 
     logging::print(logging::flag::VERBOSE, "portalcheck: {}  portaltest: {}  portalpass: {}\n", stats.c_portalcheck,
@@ -523,6 +754,8 @@ visstats_t CalcPortalVis(const mbsp_t *bsp)
     logging::print(logging::flag::VERBOSE, "c_vistest: {}  c_mighttest: {}  c_mightseeupdate {}\n", stats.c_vistest,
         stats.c_mighttest, stats.c_mightseeupdate);
     logging::print(logging::flag::VERBOSE, "c_targetcheck: {}\n", stats.c_targetcheck);
+    logging::print(logging::flag::VERBOSE, "lock contention: {} waits, {:.3} spent waiting\n", stats.c_lockcontended,
+        stats.lockwait);
 
     return stats;
 }
@@ -539,11 +772,19 @@ visstats_t CalcVis(mbsp_t *bsp)
     } else {
         logging::print("Calculating Base Vis:\n");
         BasePortalVis();
+
+        if (vis_options.incremental.value() && !vis_options.fast.value()) {
+            ReuseIncrementalVis();
+        }
     }
 
     logging::print("Calculating Full Vis:\n");
     auto stats = CalcPortalVis(bsp);
 
+    if (vis_options.incremental.value() && !vis_options.fast.value()) {
+        SaveIncrementalVis();
+    }
+
     //
     // assemble the leaf vis lists by oring and compressing the portal lists
     //
@@ -573,16 +814,15 @@ visstats_t CalcVis(mbsp_t *bsp)
 
 #include <fstream>
 #include <common/prtfile.hh>
+#include <common/pipeline.hh>
 
 /*
   ============
   LoadPortals
   ============
 */
-static void LoadPortals(const fs::path &name, mbsp_t *bsp)
+static void LoadPortals(const prtfile_t &prtfile, mbsp_t *bsp)
 {
-    const prtfile_t prtfile = LoadPrtFile(name, bsp->loadversion);
-
     portalleafs = prtfile.portalleafs;
     portalleafs_real = prtfile.portalleafs_real;
 
@@ -697,8 +937,9 @@ void vis_reset()
     portalfile = fs::path();
     statefile = fs::path();
     statetmpfile = fs::path();
+    incrementalfile = fs::path();
 
-    portalIndex = 0;
+    portal_scheduler.clear();
 
     starttime = time_point();
     endtime = time_point();
@@ -710,11 +951,13 @@ void vis_reset()
     compressed.clear();
 }
 
-int vis_main(int argc, const char **argv)
+static int VisMain(int argc, const char **argv, pipeline_data_t *input)
 {
     vis_reset();
 
-    bspdata_t bspdata;
+    // in-process, the bsp comes from the previous tool instead of disk
+    bspdata_t loaded_bspdata;
+    bspdata_t &bspdata = input ? input->bspdata : loaded_bspdata;
     const bspversion_t *loadversion;
 
     vis_options.preinitialize(argc, argv);
@@ -730,18 +973,26 @@ int vis_main(int argc, const char **argv)
 
     vis_options.print_summary();
 
+    SelectVisKernels(!vis_options.nosimd.value());
+
     stateinterval = std::chrono::minutes(5); /* 5 minutes */
     starttime = statetime = I_FloatTime();
 
-    LoadBSPFile(vis_options.sourceMap, &bspdata);
-
-    bspdata.version->game->init_filesystem(vis_options.sourceMap, vis_options);
+    if (!input) {
+        LoadBSPFile(vis_options.sourceMap, &bspdata);
+    } else if (!bspdata.version) {
+        FError("no bsp was generated for {}", vis_options.sourceMap);
+    } else if (!input->portals && !vis_options.phsonly.value()) {
+        FError("no portals were generated for {}", vis_options.sourceMap);
+    }
 
     loadversion = bspdata.version;
     ConvertBSPFormat(&bspdata, &bspver_generic);
 
     mbsp_t &bsp = std::get<mbsp_t>(bspdata.bsp);
 
+    bsp.loadversion->game->init_filesystem(vis_options.sourceMap, vis_options);
+
     if (vis_options.phsonly.value()) {
         if (bsp.loadversion->game->id != GAME_QUAKE_II) {
             FError("need a Q2-esque BSP for -phsonly");
@@ -755,11 +1006,30 @@ int vis_main(int argc, const char **argv)
             originalvismapsize = portalleafs * ((portalleafs + 7) / 8);
         }
     } else {
-        portalfile = fs::path(vis_options.sourceMap).replace_extension("prt");
-        LoadPortals(portalfile, &bsp);
+        // in-process there's no .prt on disk to check a state file against,
+        // so portalfile is left empty and state files aren't used
+        if (input) {
+            LoadPortals(*input->portals, &bsp);
+        } else {
+            portalfile = fs::path(vis_options.sourceMap).replace_extension("prt");
+
+            // prefer the binary portal file, unless it's stale
+            fs::path binaryportalfile = fs::path(vis_options.sourceMap).replace_extension("prtb");
+            std::error_code ec;
+
+            if (fs::exists(binaryportalfile, ec) &&
+                (!fs::exists(portalfile, ec) ||
+                    fs::last_write_time(binaryportalfile, ec) >= fs::last_write_time(portalfile, ec))) {
+                portalfile = binaryportalfile;
+            }
+
+            logging::print("loading portals from {}\n", portalfile);
+            LoadPortals(LoadPrtFile(portalfile, bsp.loadversion), &bsp);
+        }
 
         statefile = fs::path(vis_options.sourceMap).replace_extension("vis");
         statetmpfile = fs::path(vis_options.sourceMap).replace_extension("vi0");
+        incrementalfile = fs::path(vis_options.sourceMap).replace_extension("vic");
 
         if (bsp.loadversion->game->id != GAME_QUAKE_II) {
             uncompressed.resize(portalleafs * leafbytes_real);
@@ -784,10 +1054,13 @@ int vis_main(int argc, const char **argv)
         CalcPHS(&bsp);
     }
 
-    /* Convert data format back if necessary */
-    ConvertBSPFormat(&bspdata, loadversion);
+    // in-process, the bsp stays in the generic format for the next tool
+    if (!input) {
+        /* Convert data format back if necessary */
+        ConvertBSPFormat(&bspdata, loadversion);
 
-    WriteBSPFile(vis_options.sourceMap, &bspdata);
+        WriteBSPFile(vis_options.sourceMap, &bspdata);
+    }
 
     endtime = I_FloatTime();
     logging::print("{:.2} elapsed\n", (endtime - starttime));
@@ -801,6 +1074,11 @@ int vis_main(int argc, const char **argv)
     return 0;
 }
 
+int vis_main(int argc, const char **argv)
+{
+    return VisMain(argc, argv, nullptr);
+}
+
 int vis_main(const std::vector<std::string> &args)
 {
     std::vector<const char *> argPtrs;
@@ -810,3 +1088,13 @@ int vis_main(const std::vector<std::string> &args)
 
     return vis_main(argPtrs.size(), argPtrs.data());
 }
+
+int vis_main(const std::vector<std::string> &args, pipeline_data_t &data)
+{
+    std::vector<const char *> argPtrs;
+    for (const std::string &arg : args) {
+        argPtrs.push_back(arg.data());
+    }
+
+    return VisMain(argPtrs.size(), argPtrs.data(), &data);
+}